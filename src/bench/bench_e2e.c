@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../include/controller.h"
+#include "../include/client.h"
+
+// End-to-end loopback benchmark.
+//
+// Runs one controller and N clients in this process on 127.0.0.1, each
+// client on an in-memory TUN (no kernel device, no root). Client i sends
+// synthetic UDP/IPv4 packets to client (i+1) % N through the real data
+// path: TUN read -> forward_ip_packet_to_peer() -> UDP -> PKT_DATA ->
+// decrypt -> TUN write. Every packet carries its send time, so the
+// receiver measures one-way latency on the same clock.
+//
+// Scenarios pin the path with ZTNET_PATH: "direct" (peer to peer) and
+// "relay" (through the controller).
+
+#define BENCH_MAX_CLIENTS 16
+#define BENCH_MAX_SAMPLES (4 * 1024 * 1024)
+#define BENCH_MAGIC 0x5A54424EU      // "ZTBN"
+#define BENCH_SETUP_TIMEOUT_SEC 10
+#define BENCH_DRAIN_MS 300
+
+typedef struct {
+    int clients;
+    int seconds;
+    int size;                        // inner IP packet size
+    const char *paths;               // "direct", "relay" or "both"
+} bench_opts_t;
+
+typedef struct {
+    client_t *client;
+    uint32_t src_vip;                // network byte order
+    uint32_t dst_vip;
+    int fd;                          // harness end of the mem TUN
+    volatile bool *stop;
+    int size;
+    uint64_t sent;
+    // receiver side
+    uint64_t received;
+    uint64_t bytes;
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint32_t *lat_ns;                // latency samples (ns, saturated)
+    size_t samples;
+} bench_flow_t;
+
+static FILE *report;                 // real stdout; the daemons' chatter goes to /dev/null
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint16_t ip_checksum(const uint8_t *hdr, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2) sum += (uint32_t)((hdr[i] << 8) | hdr[i + 1]);
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+// IPv4/UDP packet; payload = magic(4) seq(8) send_ns(8) padding
+static void build_packet(uint8_t *pkt, int size, uint32_t src, uint32_t dst) {
+    memset(pkt, 0, (size_t)size);
+    pkt[0] = 0x45;
+    pkt[2] = (uint8_t)(size >> 8); pkt[3] = (uint8_t)size;
+    pkt[8] = 64;
+    pkt[9] = 17;
+    memcpy(pkt + 12, &src, 4);
+    memcpy(pkt + 16, &dst, 4);
+    uint16_t csum = ip_checksum(pkt, 20);
+    pkt[10] = (uint8_t)(csum >> 8); pkt[11] = (uint8_t)csum;
+    uint16_t udp_len = (uint16_t)(size - 20);
+    pkt[20] = 0x9C; pkt[21] = 0x40;  // 40000 -> 40001
+    pkt[22] = 0x9C; pkt[23] = 0x41;
+    pkt[24] = (uint8_t)(udp_len >> 8); pkt[25] = (uint8_t)udp_len;
+    uint32_t magic = BENCH_MAGIC;
+    memcpy(pkt + 28, &magic, 4);
+}
+
+static void* sender_main(void *arg) {
+    bench_flow_t *f = (bench_flow_t*)arg;
+    uint8_t pkt[TUN_MTU];
+    build_packet(pkt, f->size, f->src_vip, f->dst_vip);
+    struct pollfd pfd = { .fd = f->fd, .events = POLLOUT };
+    while (!*f->stop) {
+        // Wait for room: the client's TUN reads pace the sender
+        if (poll(&pfd, 1, 50) <= 0) continue;
+        uint64_t seq = f->sent;
+        uint64_t ts = now_ns();
+        memcpy(pkt + 32, &seq, 8);
+        memcpy(pkt + 40, &ts, 8);
+        if (send(f->fd, pkt, (size_t)f->size, MSG_DONTWAIT) == f->size) f->sent++;
+    }
+    return NULL;
+}
+
+static void* receiver_main(void *arg) {
+    bench_flow_t *f = (bench_flow_t*)arg;
+    uint8_t pkt[TUN_MTU];
+    struct pollfd pfd = { .fd = f->fd, .events = POLLIN };
+    while (!*f->stop) {
+        if (poll(&pfd, 1, 50) <= 0) continue;
+        ssize_t n = recv(f->fd, pkt, sizeof(pkt), MSG_DONTWAIT);
+        if (n < 48) continue;
+        uint32_t magic;
+        memcpy(&magic, pkt + 28, 4);
+        if (magic != BENCH_MAGIC) continue;
+        uint64_t ts, t = now_ns();
+        memcpy(&ts, pkt + 40, 8);
+        if (f->received == 0) f->first_ns = t;
+        f->last_ns = t;
+        f->received++;
+        f->bytes += (uint64_t)n;
+        if (f->samples < BENCH_MAX_SAMPLES) {
+            uint64_t lat = t - ts;
+            f->lat_ns[f->samples++] = lat > UINT32_MAX ? UINT32_MAX : (uint32_t)lat;
+        }
+    }
+    return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const uint32_t *sorted, size_t n, double p) {
+    if (n == 0) return 0.0;
+    size_t idx = (size_t)(p * (double)(n - 1));
+    return sorted[idx] / 1000.0;
+}
+
+// Wait until every client has joined and knows all other members
+static int wait_ready(client_t **clients, int n) {
+    uint64_t deadline = now_ns() + (uint64_t)BENCH_SETUP_TIMEOUT_SEC * 1000000000ULL;
+    while (now_ns() < deadline) {
+        int ready = 0;
+        for (int i = 0; i < n; i++) {
+            if (clients[i]->virtual_ip[0] && clients[i]->tun->is_up &&
+                clients[i]->peer_count == n - 1) ready++;
+        }
+        if (ready == n) return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+static int run_scenario(const bench_opts_t *opt, const char *path) {
+    setenv("ZTNET_TUN", "mem", 1);
+    setenv("ZTNET_PATH", path, 1);
+
+    controller_t *ctrl = controller_create("bench", 0, NULL);
+    if (!ctrl || controller_start(ctrl) != 0) {
+        fprintf(report, "bench: failed to start controller\n");
+        controller_destroy(ctrl);
+        return -1;
+    }
+    struct sockaddr_in caddr;
+    socklen_t clen = sizeof(caddr);
+    getsockname(ctrl->transport->socket_fd, (struct sockaddr*)&caddr, &clen);
+    uint16_t port = ntohs(caddr.sin_port);
+
+    client_t *clients[BENCH_MAX_CLIENTS] = {0};
+    bench_flow_t flows[BENCH_MAX_CLIENTS];
+    memset(flows, 0, sizeof(flows));
+    int rc = -1;
+    int created = 0;
+    for (; created < opt->clients; created++) {
+        clients[created] = client_create("127.0.0.1", port, ctrl->nets[0]->network->network_id);
+        if (!clients[created] || client_start(clients[created]) != 0 ||
+            client_connect(clients[created]) != 0) {
+            fprintf(report, "bench: failed to start client %d\n", created);
+            if (clients[created]) created++;
+            goto out;
+        }
+    }
+    if (wait_ready(clients, opt->clients) != 0) {
+        fprintf(report, "bench: clients did not join within %ds\n", BENCH_SETUP_TIMEOUT_SEC);
+        goto out;
+    }
+
+    volatile bool stop_send = false, stop_recv = false;
+    pthread_t senders[BENCH_MAX_CLIENTS], receivers[BENCH_MAX_CLIENTS];
+    for (int i = 0; i < opt->clients; i++) {
+        bench_flow_t *f = &flows[i];
+        client_t *dst = clients[(i + 1) % opt->clients];
+        f->client = clients[i];
+        f->src_vip = clients[i]->tun->ip_addr;
+        f->dst_vip = dst->tun->ip_addr;
+        f->fd = tun_mem_peer_fd(clients[i]->tun);
+        f->size = opt->size;
+        f->lat_ns = (uint32_t*)malloc(BENCH_MAX_SAMPLES * sizeof(uint32_t));
+        if (!f->lat_ns) {
+            fprintf(report, "bench: out of memory\n");
+            goto out;
+        }
+    }
+    // Flow i is received on client i+1's TUN: receivers read there
+    bench_flow_t rx[BENCH_MAX_CLIENTS];
+    for (int i = 0; i < opt->clients; i++) {
+        flows[i].stop = &stop_send;
+        rx[i] = flows[i];
+        rx[i].fd = tun_mem_peer_fd(clients[(i + 1) % opt->clients]->tun);
+        rx[i].stop = &stop_recv;
+        pthread_create(&receivers[i], NULL, receiver_main, &rx[i]);
+    }
+    for (int i = 0; i < opt->clients; i++) {
+        pthread_create(&senders[i], NULL, sender_main, &flows[i]);
+    }
+    sleep((unsigned)opt->seconds);
+    stop_send = true;
+    for (int i = 0; i < opt->clients; i++) {
+        pthread_join(senders[i], NULL);
+    }
+    usleep(BENCH_DRAIN_MS * 1000);
+    stop_recv = true;
+    for (int i = 0; i < opt->clients; i++) {
+        pthread_join(receivers[i], NULL);
+    }
+
+    // Aggregate
+    uint64_t sent = 0, received = 0, bytes = 0, first = UINT64_MAX, last = 0;
+    size_t total_samples = 0;
+    for (int i = 0; i < opt->clients; i++) {
+        sent += flows[i].sent;
+        received += rx[i].received;
+        bytes += rx[i].bytes;
+        total_samples += rx[i].samples;
+        if (rx[i].received) {
+            if (rx[i].first_ns < first) first = rx[i].first_ns;
+            if (rx[i].last_ns > last) last = rx[i].last_ns;
+        }
+    }
+    uint32_t *all = (uint32_t*)malloc((total_samples ? total_samples : 1) * sizeof(uint32_t));
+    size_t k = 0;
+    for (int i = 0; all && i < opt->clients; i++) {
+        memcpy(all + k, rx[i].lat_ns, rx[i].samples * sizeof(uint32_t));
+        k += rx[i].samples;
+    }
+    if (all) qsort(all, k, sizeof(uint32_t), cmp_u32);
+    double secs = received > 1 ? (double)(last - first) / 1e9 : 0.0;
+    double gbps = secs > 0 ? (double)bytes * 8.0 / secs / 1e9 : 0.0;
+    double mpps = secs > 0 ? (double)received / secs / 1e6 : 0.0;
+    fprintf(report, "%-7s clients=%d size=%d sent=%llu recv=%llu loss=%.2f%% "
+                    "%.3f Gbit/s %.4f Mpps  latency p50=%.1fus p99=%.1fus p999=%.1fus\n",
+            path, opt->clients, opt->size, (unsigned long long)sent, (unsigned long long)received,
+            sent ? 100.0 * (double)(sent - (received < sent ? received : sent)) / (double)sent : 0.0,
+            gbps, mpps, all ? percentile_us(all, k, 0.50) : 0.0,
+            all ? percentile_us(all, k, 0.99) : 0.0, all ? percentile_us(all, k, 0.999) : 0.0);
+    fflush(report);
+    free(all);
+    rc = 0;
+
+out:
+    for (int i = 0; i < created; i++) {
+        if (clients[i]) client_destroy(clients[i]);
+    }
+    for (int i = 0; i < opt->clients; i++) free(flows[i].lat_ns);
+    controller_destroy(ctrl);
+    return rc;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-c clients] [-s packet_size] [-t seconds] [-p direct|relay|both]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    bench_opts_t opt = { .clients = 2, .seconds = 3, .size = 1280, .paths = "both" };
+    int c;
+    while ((c = getopt(argc, argv, "c:s:t:p:h")) != -1) {
+        switch (c) {
+            case 'c': opt.clients = atoi(optarg); break;
+            case 's': opt.size = atoi(optarg); break;
+            case 't': opt.seconds = atoi(optarg); break;
+            case 'p': opt.paths = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (opt.clients < 2 || opt.clients > BENCH_MAX_CLIENTS || opt.size < 48 ||
+        opt.size > TUN_MTU || opt.seconds < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Keep the report on the real stdout; silence the per-packet logging
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    int devnull = open("/dev/null", O_WRONLY);
+    if (!report || devnull < 0) {
+        perror("Failed to set up output");
+        return 1;
+    }
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    fprintf(report, "bench-e2e: %d clients on 127.0.0.1, %d-byte packets, %ds per path\n",
+            opt.clients, opt.size, opt.seconds);
+    int rc = 0;
+    if (strcmp(opt.paths, "direct") == 0 || strcmp(opt.paths, "both") == 0) {
+        rc |= run_scenario(&opt, "direct");
+    }
+    if (strcmp(opt.paths, "relay") == 0 || strcmp(opt.paths, "both") == 0) {
+        rc |= run_scenario(&opt, "relay");
+    }
+    fclose(report);
+    return rc ? 1 : 0;
+}
\ No newline at end of file
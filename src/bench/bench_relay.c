@@ -0,0 +1,328 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "../include/controller.h"
+
+// Controller relay benchmark.
+//
+// Runs a controller in this process on 127.0.0.1 and drives its relay
+// path with bare UDP members (no TUN, no crypto): each pair has a sender
+// that blasts PKT_DATA at the controller addressed to its partner, and a
+// receiver that counts what the controller forwards. The throughput phase
+// reports relayed Mpps as seen by the receivers; a short ping phase before
+// it measures the one-way relay latency of an idle controller.
+
+#define BENCH_MAX_PAIRS 8
+#define BENCH_MAGIC 0x5A54524CU      // "ZTRL"
+#define BENCH_SEND_BATCH 32
+#define BENCH_SETUP_TIMEOUT_SEC 5
+#define BENCH_DRAIN_MS 300
+#define BENCH_SOCK_BUF (8 * 1024 * 1024)
+
+typedef struct {
+    int pairs;
+    int seconds;
+    int size;                        // PKT_DATA payload bytes
+    int pings;
+} bench_opts_t;
+
+typedef struct {
+    transport_t *tx;                 // sender member
+    transport_t *rx;                 // receiver member
+    uint64_t tx_id;
+    uint64_t rx_id;
+    struct sockaddr_in ctrl_addr;
+    int size;
+    volatile bool *stop_send;
+    volatile bool *stop_recv;
+    uint64_t sent;
+    uint64_t received;
+    uint64_t bytes;
+    uint64_t first_ns;
+    uint64_t last_ns;
+} bench_pair_t;
+
+static FILE *report;                 // real stdout; the controller's chatter goes to /dev/null
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void set_rcv_timeout(int fd, int ms) {
+    struct timeval tv = { .tv_sec = ms / 1000, .tv_usec = (ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+// JOIN without a password and wait for the controller's answer
+static int join_member(transport_t *t, struct sockaddr_in *ctrl_addr, uint64_t id,
+                       const uint8_t network_id[NETWORK_ID_SIZE]) {
+    if (transport_send(t, ctrl_addr, PKT_JOIN_REQUEST, id, 0, network_id, NETWORK_ID_SIZE) != 0) {
+        return -1;
+    }
+    uint64_t deadline = now_ns() + (uint64_t)BENCH_SETUP_TIMEOUT_SEC * 1000000000ULL;
+    packet_header_t header;
+    uint8_t data[MAX_PACKET_SIZE];
+    struct sockaddr_in from;
+    while (now_ns() < deadline) {
+        int n = transport_receive(t, &header, data, &from);
+        if (n >= JOIN_RESPONSE_V4_LEN && header.type == PKT_JOIN_RESPONSE) return 0;
+    }
+    return -1;
+}
+
+// Datagram: header + magic(4) send_ns(8) padding
+static int build_datagram(bench_pair_t *p, uint8_t *buf) {
+    memset(buf, 0, MAX_PACKET_SIZE);
+    transport_write_header(p->tx, buf, PKT_DATA, p->tx_id, p->rx_id, (uint16_t)p->size);
+    uint32_t magic = BENCH_MAGIC;
+    memcpy(buf + sizeof(packet_header_t), &magic, 4);
+    return (int)sizeof(packet_header_t) + p->size;
+}
+
+// Count a received datagram; returns its send time or 0 if it is not ours
+static uint64_t accept_datagram(const uint8_t *buf, ssize_t n) {
+    if (n < (ssize_t)sizeof(packet_header_t) + 12) return 0;
+    const packet_header_t *h = (const packet_header_t*)buf;
+    uint32_t magic;
+    memcpy(&magic, buf + sizeof(packet_header_t), 4);
+    if (h->type != PKT_DATA || magic != BENCH_MAGIC) return 0;
+    uint64_t ts;
+    memcpy(&ts, buf + sizeof(packet_header_t) + 4, 8);
+    return ts ? ts : 1;
+}
+
+static void* sender_main(void *arg) {
+    bench_pair_t *p = (bench_pair_t*)arg;
+    uint8_t buf[MAX_PACKET_SIZE];
+    int len = build_datagram(p, buf);
+    connect(p->tx->socket_fd, (struct sockaddr*)&p->ctrl_addr, sizeof(p->ctrl_addr));
+#ifdef __linux__
+    struct mmsghdr msgs[BENCH_SEND_BATCH];
+    struct iovec iov = { .iov_base = buf, .iov_len = (size_t)len };
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < BENCH_SEND_BATCH; i++) {
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (!*p->stop_send) {
+        int r = sendmmsg(p->tx->socket_fd, msgs, BENCH_SEND_BATCH, 0);
+        if (r > 0) p->sent += (uint64_t)r;
+    }
+#else
+    while (!*p->stop_send) {
+        if (send(p->tx->socket_fd, buf, (size_t)len, 0) == len) p->sent++;
+    }
+#endif
+    return NULL;
+}
+
+static void* receiver_main(void *arg) {
+    bench_pair_t *p = (bench_pair_t*)arg;
+    uint8_t bufs[BENCH_SEND_BATCH][MAX_PACKET_SIZE];
+#ifdef __linux__
+    struct mmsghdr msgs[BENCH_SEND_BATCH];
+    struct iovec iov[BENCH_SEND_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < BENCH_SEND_BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = MAX_PACKET_SIZE;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+    while (!*p->stop_recv) {
+#ifdef __linux__
+        int n = recvmmsg(p->rx->socket_fd, msgs, BENCH_SEND_BATCH, MSG_WAITFORONE, NULL);
+        if (n <= 0) continue;
+        uint64_t t = now_ns();
+        for (int i = 0; i < n; i++) {
+            if (!accept_datagram(bufs[i], (ssize_t)msgs[i].msg_len)) continue;
+            p->received++;
+            p->bytes += msgs[i].msg_len;
+        }
+#else
+        ssize_t len = recv(p->rx->socket_fd, bufs[0], MAX_PACKET_SIZE, 0);
+        if (len <= 0) continue;
+        uint64_t t = now_ns();
+        if (!accept_datagram(bufs[0], len)) continue;
+        p->received++;
+        p->bytes += (uint64_t)len;
+#endif
+        if (p->first_ns == 0) p->first_ns = t;
+        p->last_ns = t;
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// One packet at a time through the idle controller
+static void ping_phase(bench_pair_t *p, int count) {
+    uint64_t *lat = (uint64_t*)malloc((size_t)count * sizeof(uint64_t));
+    if (!lat) return;
+    uint8_t buf[MAX_PACKET_SIZE], in[MAX_PACKET_SIZE];
+    int len = build_datagram(p, buf);
+    int got = 0;
+    for (int i = 0; i < count; i++) {
+        uint64_t ts = now_ns();
+        memcpy(buf + sizeof(packet_header_t) + 4, &ts, 8);
+        if (sendto(p->tx->socket_fd, buf, (size_t)len, 0, (struct sockaddr*)&p->ctrl_addr,
+                   sizeof(p->ctrl_addr)) != len) continue;
+        for (;;) {
+            ssize_t n = recv(p->rx->socket_fd, in, sizeof(in), 0);
+            if (n < 0) break;                // lost: the receive timeout expired
+            uint64_t sent_ns = accept_datagram(in, n);
+            if (sent_ns == ts) {
+                lat[got++] = now_ns() - ts;
+                break;
+            }
+        }
+    }
+    qsort(lat, (size_t)got, sizeof(uint64_t), cmp_u64);
+    if (got > 0) {
+        fprintf(report, "latency pings=%d/%d one-way p50=%.1fus p99=%.1fus p999=%.1fus\n",
+                got, count, lat[got / 2] / 1000.0, lat[(size_t)(got - 1) * 99 / 100] / 1000.0,
+                lat[(size_t)(got - 1) * 999 / 1000] / 1000.0);
+    } else {
+        fprintf(report, "latency pings=0/%d: nothing came back through the relay\n", count);
+    }
+    fflush(report);
+    free(lat);
+}
+
+static int run(const bench_opts_t *opt) {
+    controller_t *ctrl = controller_create("bench", 0, NULL);
+    if (!ctrl || controller_start(ctrl) != 0) {
+        fprintf(report, "bench: failed to start controller\n");
+        controller_destroy(ctrl);
+        return -1;
+    }
+    struct sockaddr_in caddr;
+    memset(&caddr, 0, sizeof(caddr));
+    caddr.sin_family = AF_INET;
+    caddr.sin_port = htons(ctrl->transport->port);
+    caddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    bench_pair_t pairs[BENCH_MAX_PAIRS];
+    memset(pairs, 0, sizeof(pairs));
+    int rc = -1;
+    volatile bool stop_send = false, stop_recv = false;
+    for (int i = 0; i < opt->pairs; i++) {
+        bench_pair_t *p = &pairs[i];
+        p->tx_id = 1000 + 2 * (uint64_t)i;
+        p->rx_id = p->tx_id + 1;
+        p->ctrl_addr = caddr;
+        p->size = opt->size;
+        p->tx = transport_create(0);
+        p->rx = transport_create(0);
+        if (!p->tx || !p->rx) goto out;
+        int sock_buf = BENCH_SOCK_BUF;
+        setsockopt(p->rx->socket_fd, SOL_SOCKET, SO_RCVBUF, &sock_buf, sizeof(sock_buf));
+        set_rcv_timeout(p->tx->socket_fd, 100);
+        set_rcv_timeout(p->rx->socket_fd, 100);
+        if (join_member(p->tx, &caddr, p->tx_id, ctrl->nets[0]->network->network_id) != 0 ||
+            join_member(p->rx, &caddr, p->rx_id, ctrl->nets[0]->network->network_id) != 0) {
+            fprintf(report, "bench: member %d did not join within %ds\n", i, BENCH_SETUP_TIMEOUT_SEC);
+            goto out;
+        }
+    }
+
+    if (opt->pings > 0) ping_phase(&pairs[0], opt->pings);
+
+    pthread_t senders[BENCH_MAX_PAIRS], receivers[BENCH_MAX_PAIRS];
+    for (int i = 0; i < opt->pairs; i++) {
+        pairs[i].stop_send = &stop_send;
+        pairs[i].stop_recv = &stop_recv;
+        pthread_create(&receivers[i], NULL, receiver_main, &pairs[i]);
+    }
+    for (int i = 0; i < opt->pairs; i++) {
+        pthread_create(&senders[i], NULL, sender_main, &pairs[i]);
+    }
+    sleep((unsigned)opt->seconds);
+    stop_send = true;
+    for (int i = 0; i < opt->pairs; i++) pthread_join(senders[i], NULL);
+    usleep(BENCH_DRAIN_MS * 1000);
+    stop_recv = true;
+    for (int i = 0; i < opt->pairs; i++) pthread_join(receivers[i], NULL);
+
+    uint64_t sent = 0, received = 0, bytes = 0, first = UINT64_MAX, last = 0;
+    for (int i = 0; i < opt->pairs; i++) {
+        sent += pairs[i].sent;
+        received += pairs[i].received;
+        bytes += pairs[i].bytes;
+        if (pairs[i].received) {
+            if (pairs[i].first_ns < first) first = pairs[i].first_ns;
+            if (pairs[i].last_ns > last) last = pairs[i].last_ns;
+        }
+    }
+    double secs = received > 1 ? (double)(last - first) / 1e9 : 0.0;
+    fprintf(report, "relay   pairs=%d size=%d sent=%llu relayed=%llu loss=%.2f%% %.3f Mpps %.3f Gbit/s\n",
+            opt->pairs, opt->size, (unsigned long long)sent, (unsigned long long)received,
+            sent ? 100.0 * (double)(sent - (received < sent ? received : sent)) / (double)sent : 0.0,
+            secs > 0 ? (double)received / secs / 1e6 : 0.0,
+            secs > 0 ? (double)bytes * 8.0 / secs / 1e9 : 0.0);
+    fflush(report);
+    rc = 0;
+
+out:
+    for (int i = 0; i < opt->pairs; i++) {
+        if (pairs[i].tx) transport_destroy(pairs[i].tx);
+        if (pairs[i].rx) transport_destroy(pairs[i].rx);
+    }
+    controller_destroy(ctrl);
+    return rc;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-c pairs] [-s payload_size] [-t seconds] [-l pings]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    bench_opts_t opt = { .pairs = 2, .seconds = 3, .size = 1200, .pings = 1000 };
+    int c;
+    while ((c = getopt(argc, argv, "c:s:t:l:h")) != -1) {
+        switch (c) {
+            case 'c': opt.pairs = atoi(optarg); break;
+            case 's': opt.size = atoi(optarg); break;
+            case 't': opt.seconds = atoi(optarg); break;
+            case 'l': opt.pings = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (opt.pairs < 1 || opt.pairs > BENCH_MAX_PAIRS || opt.size < 12 ||
+        opt.size > MAX_PACKET_SIZE - (int)sizeof(packet_header_t) || opt.seconds < 1 || opt.pings < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Keep the report on the real stdout; silence the per-packet logging
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    int devnull = open("/dev/null", O_WRONLY);
+    if (!report || devnull < 0) {
+        perror("Failed to set up output");
+        return 1;
+    }
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    fprintf(report, "bench-relay: %d sender/receiver pairs on 127.0.0.1, %d-byte payloads, %ds\n",
+            opt.pairs, opt.size, opt.seconds);
+    int rc = run(&opt);
+    fclose(report);
+    return rc ? 1 : 0;
+}
\ No newline at end of file
@@ -2,28 +2,103 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "../include/core.h"
 #include "../include/transport.h"
+#include "../include/stats.h"
+
+#define TOP_INTERVAL_SEC 1
+#define LIST_DEFAULT_TIMEOUT_MS 1000
+#define LIST_DEFAULT_RETRIES 3
 
 static void usage() {
     fprintf(stderr, "Usage:\n");
-    fprintf(stderr, "  zerrytee list <controller_ip> [port]\n");
+    fprintf(stderr, "  zerrytee list <controller_ip> [port] [--active] [--prefix a.b.c.d/len]\n"
+                    "                [--timeout ms] [--retries n] [--window datagrams]\n");
+    fprintf(stderr, "  zerrytee top <client|controller> [pid]\n");
+    fprintf(stderr, "  zerrytee metrics <client|controller> [pid] [--listen port]\n");
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 3 || strcmp(argv[1], "list") != 0) {
-        usage();
-        return 1;
+typedef struct {
+    uint8_t data[MAX_PACKET_SIZE];
+    int len;                         // 0 = not received yet
+} list_part_t;
+
+static void print_list_part(const uint8_t *d, int n, int *total) {
+    int count = d[LIST_PAGE_HDR_LEN - 1];
+    if (n < LIST_PAGE_HDR_LEN + count * LIST_RECORD_LEN) return;
+    const uint8_t *netid = d + 14;
+    for (int i = 0; i < count; i++) {
+        const uint8_t *r = d + LIST_PAGE_HDR_LEN + i * LIST_RECORD_LEN;
+        uint64_t pid; uint32_t vip_net, ip_be; uint16_t port_be, idle;
+        memcpy(&pid, r, sizeof(uint64_t));
+        memcpy(&vip_net, r + 8, sizeof(uint32_t));
+        memcpy(&ip_be, r + 12, sizeof(uint32_t));
+        memcpy(&port_be, r + 16, sizeof(uint16_t));
+        memcpy(&idle, r + 19, sizeof(uint16_t));
+        char vip[16], addr[16], vip6[INET6_ADDRSTRLEN];
+        uint8_t ip6[IPV6_ADDR_SIZE];
+        network_overlay_ip6(netid, pid, ip6);
+        inet_ntop(AF_INET, &vip_net, vip, sizeof(vip));
+        inet_ntop(AF_INET, &ip_be, addr, sizeof(addr));
+        inet_ntop(AF_INET6, ip6, vip6, sizeof(vip6));
+        printf("- peer_id=%llu addr=%s:%d vIP=%s vIP6=%s idle=%us%s\n", (unsigned long long)pid,
+               addr, ntohs(port_be), vip, vip6, idle,
+               (r[18] & PEER_FLAG_RELAY) ? " relay" : "");
+        (*total)++;
     }
+}
 
+// Page through the controller's members: each request names a cursor and
+// gets back up to `window` datagrams; a page that times out or arrives
+// with parts missing is asked for again from the same cursor
+static int cmd_list(int argc, char *argv[]) {
     const char *controller_ip = argv[2];
-    uint16_t port = (argc >= 4) ? (uint16_t)atoi(argv[3]) : DEFAULT_PORT;
+    uint16_t port = DEFAULT_PORT;
+    int timeout_ms = LIST_DEFAULT_TIMEOUT_MS, retries = LIST_DEFAULT_RETRIES, window = LIST_MAX_WINDOW;
+    uint8_t req[LIST_REQUEST_PREFIX_LEN];
+    memset(req, 0, sizeof(req));
+    int req_len = LIST_REQUEST_LEN;
 
-    transport_t *t = transport_create(0);
-    if (!t) {
-        fprintf(stderr, "Failed to create transport\n");
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--active") == 0) {
+            req[13] |= LIST_FILTER_ACTIVE;
+        } else if (strcmp(argv[i], "--prefix") == 0 && i + 1 < argc) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%s", argv[++i]);
+            char *slash = strchr(buf, '/');
+            int len = slash ? atoi(slash + 1) : 32;
+            if (slash) *slash = '\0';
+            if (inet_pton(AF_INET, buf, req + 14) != 1 || len < 0 || len > 32) {
+                fprintf(stderr, "Invalid prefix '%s'\n", argv[i]);
+                return 1;
+            }
+            req[18] = (uint8_t)len;
+            req[13] |= LIST_FILTER_PREFIX;
+            req_len = LIST_REQUEST_PREFIX_LEN;
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            retries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            window = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            port = (uint16_t)atoi(argv[i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (timeout_ms <= 0 || retries < 0 || window < 1 || window > LIST_MAX_WINDOW) {
+        fprintf(stderr, "Invalid --timeout, --retries or --window\n");
         return 1;
     }
+    req[12] = (uint8_t)window;
 
     struct sockaddr_in ctrl;
     memset(&ctrl, 0, sizeof(ctrl));
@@ -31,41 +106,307 @@ int main(int argc, char *argv[]) {
     ctrl.sin_port = htons(port);
     if (inet_pton(AF_INET, controller_ip, &ctrl.sin_addr) <= 0) {
         fprintf(stderr, "Invalid controller IP\n");
-        transport_destroy(t);
         return 1;
     }
 
-    // Send LIST_REQUEST
-    if (transport_send(t, &ctrl, PKT_LIST_REQUEST, 0 /*cli id*/, 0, NULL, 0) != 0) {
-        fprintf(stderr, "Failed to send list request\n");
+    transport_t *t = transport_create(0);
+    if (!t) {
+        fprintf(stderr, "Failed to create transport\n");
+        return 1;
+    }
+    // A whole page lands before we read any of it
+    int rcvbuf = window * MAX_PACKET_SIZE * 2;
+    setsockopt(t->socket_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    list_part_t *parts = calloc((size_t)window, sizeof(list_part_t));
+    if (!parts) {
+        perror("Failed to allocate page buffer");
         transport_destroy(t);
         return 1;
     }
 
     printf("Connections (from %s:%d):\n", controller_ip, port);
 
-    while (1) {
-        packet_header_t header; uint8_t data[MAX_PACKET_SIZE]; struct sockaddr_in sender;
-        int n = transport_receive(t, &header, data, &sender);
-        if (n < 0) {
-            usleep(10000);
-            continue;
+    srand((unsigned)time(NULL) ^ (unsigned)getpid());
+    uint64_t cursor = 0;
+    int total = 0, pages = 0, rc = 0;
+    while (cursor != LIST_CURSOR_END) {
+        uint32_t tag = (uint32_t)rand();
+        memcpy(req, &tag, sizeof(tag));
+        memcpy(req + 4, &cursor, sizeof(cursor));
+
+        bool complete = false;
+        uint64_t next = LIST_CURSOR_END;
+        for (int attempt = 0; attempt <= retries && !complete; attempt++) {
+            uint8_t pkt[sizeof(packet_header_t) + LIST_REQUEST_PREFIX_LEN];
+            transport_write_header(t, pkt, PKT_LIST_REQUEST, 0 /*cli id*/, 0, (uint16_t)req_len);
+            memcpy(pkt + sizeof(packet_header_t), req, (size_t)req_len);
+            if (transport_send_raw(t, &ctrl, pkt, sizeof(packet_header_t) + (size_t)req_len, 0) != 0) {
+                fprintf(stderr, "Failed to send list request\n");
+                break;
+            }
+            for (int i = 0; i < window; i++) parts[i].len = 0;
+            int last = -1, have = 0;
+
+            struct pollfd pfd = { .fd = t->socket_fd, .events = POLLIN };
+            while (!complete && poll(&pfd, 1, timeout_ms) > 0) {
+                // Read straight off the socket: transport_receive logs every datagram
+                packet_header_t header; uint8_t buf[MAX_PACKET_SIZE];
+                ssize_t got = recv(t->socket_fd, buf, sizeof(buf), 0);
+                int n = got > 0 ? transport_decode(buf, (size_t)got, &header) : -1;
+                const uint8_t *data = buf + sizeof(packet_header_t);
+                if (n < LIST_PAGE_HDR_LEN || header.type != PKT_LIST_PAGE || memcmp(data, &tag, sizeof(tag)) != 0) {
+                    continue;
+                }
+                int part = data[4];
+                if (part >= window || parts[part].len) continue;
+                memcpy(parts[part].data, data, (size_t)n);
+                parts[part].len = n;
+                have++;
+                if (data[5] & LIST_PAGE_LAST) {
+                    last = part;
+                    memcpy(&next, data + 6, sizeof(next));
+                }
+                complete = last >= 0 && have == last + 1;
+            }
         }
-        if (header.type == PKT_PEER_INFO && n == (int)(sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint16_t))) {
-            uint64_t pid; uint32_t vip_net; uint32_t ip_be; uint16_t port_be;
-            memcpy(&pid, data, sizeof(uint64_t));
-            memcpy(&vip_net, data + 8, sizeof(uint32_t));
-            memcpy(&ip_be, data + 12, sizeof(uint32_t));
-            memcpy(&port_be, data + 16, sizeof(uint16_t));
-            char vip[16]; struct in_addr v; v.s_addr = vip_net; inet_ntop(AF_INET, &v, vip, sizeof(vip));
-            struct in_addr a; a.s_addr = ip_be;
-            printf("- peer_id=%llu addr=%s:%d vIP=%s\n", (unsigned long long)pid,
-                   inet_ntoa(a), ntohs(port_be), vip);
-        } else if (header.type == PKT_LIST_DONE) {
+        if (!complete) {
+            fprintf(stderr, "No complete answer from %s:%d after %d attempts\n",
+                    controller_ip, port, retries + 1);
+            rc = 1;
             break;
         }
+        for (int i = 0; i < window && parts[i].len; i++) {
+            print_list_part(parts[i].data, parts[i].len, &total);
+        }
+        pages++;
+        cursor = next;
     }
+    if (rc == 0) printf("%d members in %d pages\n", total, pages);
 
+    free(parts);
     transport_destroy(t);
+    return rc;
+}
+
+// Map the stats segment of a running client/controller (newest one when
+// no pid is given)
+static stats_t* open_stats(const char *role, const char *pid_arg) {
+    if (strcmp(role, "client") != 0 && strcmp(role, "controller") != 0) {
+        fprintf(stderr, "Unknown role '%s' (expect client or controller)\n", role);
+        return NULL;
+    }
+    int pid = pid_arg ? atoi(pid_arg) : stats_find_pid(role);
+    if (pid <= 0) {
+        fprintf(stderr, "No running %s found; pass its pid\n", role);
+        return NULL;
+    }
+    stats_t *st = stats_open(role, pid);
+    if (!st) {
+        fprintf(stderr, "Cannot open stats of %s %d: %s\n", role, pid,
+                errno == EPROTO ? "incompatible segment version" : strerror(errno));
+    }
+    return st;
+}
+
+static void format_rate(char *out, size_t len, double v) {
+    if (v >= 1e9) snprintf(out, len, "%.2fG", v / 1e9);
+    else if (v >= 1e6) snprintf(out, len, "%.2fM", v / 1e6);
+    else if (v >= 1e3) snprintf(out, len, "%.2fK", v / 1e3);
+    else snprintf(out, len, "%.0f", v);
+}
+
+typedef struct {
+    uint64_t global[STAT_COUNT];
+    uint64_t peer_id[STATS_PEER_SLOTS];
+    uint64_t peer[STATS_PEER_SLOTS][PSTAT_COUNT];
+} stats_snapshot_t;
+
+static void take_snapshot(const stats_t *st, stats_snapshot_t *snap) {
+    for (int i = 0; i < STAT_COUNT; i++) {
+        snap->global[i] = stats_read(st, (stat_id_t)i);
+    }
+    for (int s = 0; s < STATS_PEER_SLOTS; s++) {
+        for (int k = 0; k < PSTAT_COUNT; k++) {
+            snap->peer[s][k] = stats_peer_read(st, s, (peer_stat_id_t)k, &snap->peer_id[s]);
+        }
+    }
+}
+
+// Live view of counters and per-second rates, refreshed every second
+static int cmd_top(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    stats_t *st = open_stats(argv[2], argc >= 4 ? argv[3] : NULL);
+    if (!st) return 1;
+    const stats_header_t *h = &st->seg->hdr;
+
+    stats_snapshot_t *prev = calloc(1, sizeof(stats_snapshot_t));
+    stats_snapshot_t *cur = calloc(1, sizeof(stats_snapshot_t));
+    if (!prev || !cur) {
+        perror("Failed to allocate snapshots");
+        free(prev); free(cur);
+        stats_destroy(st);
+        return 1;
+    }
+    take_snapshot(st, prev);
+
+    while (1) {
+        sleep(TOP_INTERVAL_SEC);
+        take_snapshot(st, cur);
+        bool alive = !(kill((pid_t)h->pid, 0) != 0 && errno == ESRCH);
+        uint64_t up = (uint64_t)time(NULL) - h->start_unix;
+
+        printf("\033[H\033[2J");
+        printf("zerrytee top - %s pid %u, up %llu:%02llu:%02llu%s\n\n", h->role, h->pid,
+               (unsigned long long)(up / 3600), (unsigned long long)(up / 60 % 60),
+               (unsigned long long)(up % 60), alive ? "" : " (exited)");
+        printf("%-20s %16s %12s\n", "COUNTER", "TOTAL", "RATE/s");
+        for (int i = 0; i < STAT_COUNT; i++) {
+            char rate[32];
+            format_rate(rate, sizeof(rate), (double)(cur->global[i] - prev->global[i]) / TOP_INTERVAL_SEC);
+            printf("%-20s %16llu %12s\n", stats_name((stat_id_t)i),
+                   (unsigned long long)cur->global[i], rate);
+        }
+
+        printf("\n%-20s %10s %10s %10s %10s %10s %10s %8s\n", "PEER", "RX pps", "RX B/s",
+               "TX pps", "TX B/s", "RELAY pps", "RELAY B/s", "DECFAIL");
+        for (int s = 0; s < STATS_PEER_SLOTS; s++) {
+            if (cur->peer_id[s] == 0) continue;
+            bool same = prev->peer_id[s] == cur->peer_id[s];
+            char col[PSTAT_DECRYPT_FAIL][32];
+            for (int k = 0; k < PSTAT_DECRYPT_FAIL; k++) {
+                uint64_t base = same ? prev->peer[s][k] : 0;
+                format_rate(col[k], sizeof(col[k]), (double)(cur->peer[s][k] - base) / TOP_INTERVAL_SEC);
+            }
+            printf("%-20llu %10s %10s %10s %10s %10s %10s %8llu\n", (unsigned long long)cur->peer_id[s],
+                   col[PSTAT_RX_PACKETS], col[PSTAT_RX_BYTES], col[PSTAT_TX_PACKETS], col[PSTAT_TX_BYTES],
+                   col[PSTAT_RELAY_PACKETS], col[PSTAT_RELAY_BYTES],
+                   (unsigned long long)cur->peer[s][PSTAT_DECRYPT_FAIL]);
+        }
+        fflush(stdout);
+        if (!alive) break;
+
+        stats_snapshot_t *tmp = prev; prev = cur; cur = tmp;
+    }
+
+    free(prev); free(cur);
+    stats_destroy(st);
     return 0;
 }
+
+// Prometheus text exposition format (version 0.0.4)
+static void write_metrics(const stats_t *st, FILE *out) {
+    const stats_header_t *h = &st->seg->hdr;
+    char labels[64];
+    snprintf(labels, sizeof(labels), "role=\"%s\",pid=\"%u\"", h->role, h->pid);
+
+    fprintf(out, "# TYPE zerrytee_start_time_seconds gauge\n");
+    fprintf(out, "zerrytee_start_time_seconds{%s} %llu\n", labels, (unsigned long long)h->start_unix);
+    for (int i = 0; i < STAT_COUNT; i++) {
+        const char *name = stats_name((stat_id_t)i);
+        fprintf(out, "# TYPE zerrytee_%s_total counter\n", name);
+        fprintf(out, "zerrytee_%s_total{%s} %llu\n", name, labels,
+                (unsigned long long)stats_read(st, (stat_id_t)i));
+    }
+    for (int k = 0; k < PSTAT_COUNT; k++) {
+        const char *name = stats_peer_name((peer_stat_id_t)k);
+        fprintf(out, "# TYPE zerrytee_peer_%s_total counter\n", name);
+        for (int s = 0; s < STATS_PEER_SLOTS; s++) {
+            uint64_t peer_id = 0;
+            uint64_t v = stats_peer_read(st, s, (peer_stat_id_t)k, &peer_id);
+            if (peer_id == 0) continue;
+            fprintf(out, "zerrytee_peer_%s_total{%s,peer=\"%llu\"} %llu\n", name, labels,
+                    (unsigned long long)peer_id, (unsigned long long)v);
+        }
+    }
+}
+
+// Answer every HTTP request on the port with the current metrics
+static int serve_metrics(const stats_t *st, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket failed");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        perror("Failed to listen");
+        close(fd);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving metrics on :%d\n", port);
+
+    while (1) {
+        int c = accept(fd, NULL, NULL);
+        if (c < 0) {
+            if (errno == EINTR) continue;
+            perror("accept failed");
+            break;
+        }
+        char req[1024];
+        (void)read(c, req, sizeof(req));
+
+        char *body = NULL; size_t body_len = 0;
+        FILE *mem = open_memstream(&body, &body_len);
+        if (mem) {
+            write_metrics(st, mem);
+            fclose(mem);
+            char hdr[128];
+            int n = snprintf(hdr, sizeof(hdr),
+                             "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                             "Content-Length: %zu\r\n\r\n", body_len);
+            if (write(c, hdr, (size_t)n) == n) {
+                (void)write(c, body, body_len);
+            }
+            free(body);
+        }
+        close(c);
+    }
+    close(fd);
+    return 1;
+}
+
+static int cmd_metrics(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    const char *pid_arg = NULL;
+    int listen_port = 0;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            listen_port = atoi(argv[++i]);
+        } else {
+            pid_arg = argv[i];
+        }
+    }
+    stats_t *st = open_stats(argv[2], pid_arg);
+    if (!st) return 1;
+
+    int rc = 0;
+    if (listen_port > 0) {
+        rc = serve_metrics(st, (uint16_t)listen_port);
+    } else {
+        write_metrics(st, stdout);
+    }
+    stats_destroy(st);
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "list") == 0) return cmd_list(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "top") == 0) return cmd_top(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "metrics") == 0) return cmd_metrics(argc, argv);
+    usage();
+    return 1;
+}
\ No newline at end of file
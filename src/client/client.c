@@ -6,105 +6,835 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <errno.h>
 #include "../include/client.h"
 #include "../include/crypto.h"
+#include "../include/hc.h"
+#include "../include/pcomp.h"
+#include "../include/egress.h"
+#include "../include/path.h"
+#include "../include/clock.h"
 #include <openssl/rand.h>
 
 // --- Packet forwarding helpers ---
-static inline uint32_t extract_ipv4_dest(const uint8_t *packet, size_t len) {
-    // Minimal IPv4 validation: need at least 20 bytes, version 4
-    if (len < 20) return 0;
-    uint8_t version = (packet[0] >> 4) & 0x0F;
-    if (version != 4) return 0;
-    // Dest IP at bytes 16..19
-    uint32_t dest;
-    memcpy(&dest, packet + 16, sizeof(uint32_t));
-    return dest; // network byte order
-}
-
-static client_peer_t* find_peer_by_vip(client_t *client, uint32_t dest_ip_net) {
-    for (int i = 0; i < client->peer_count; i++) {
-        struct in_addr vip_addr;
-        if (inet_pton(AF_INET, client->peers[i].virtual_ip, &vip_addr) == 1) {
-            if (vip_addr.s_addr == dest_ip_net) {
-                return &client->peers[i];
-            }
+
+// Extract the destination address as a FIB key. Both families do one length
+// check and one fixed-size copy, so v4 and v6 cost the same on the fast path.
+static inline int extract_ip_dest(const uint8_t *packet, size_t len, uint8_t key[FIB_ADDR_SIZE]) {
+    if (len < 20) return -1;
+    switch (packet[0] >> 4) {
+        case 4: {
+            // Dest IP at bytes 16..19
+            uint32_t dest;
+            memcpy(&dest, packet + 16, sizeof(uint32_t));
+            fib_key_from_ipv4(dest, key);
+            return AF_INET; }
+        case 6:
+            // Fixed 40-byte header, dest IP at bytes 24..39
+            if (len < 40) return -1;
+            memcpy(key, packet + 24, FIB_ADDR_SIZE);
+            return AF_INET6;
+        default:
+            return -1;
+    }
+}
+
+static client_peer_t* find_peer_by_dest(client_t *client, const uint8_t key[FIB_ADDR_SIZE]) {
+    int idx = fib_lookup(&client->fib, key);
+    if (idx < 0 || idx >= client->peer_count) return NULL;
+    return &client->peers[idx];
+}
+
+static client_peer_t* find_peer_by_id(client_t *client, uint64_t peer_id) {
+    uint32_t idx;
+    if (!hmap_get(&client->peer_index, peer_id, &idx)) return NULL;
+    return &client->peers[idx];
+}
+
+static struct sockaddr_in* path_dest(client_t *client, client_peer_t *peer, path_kind_t kind) {
+    if (kind == PATH_DIRECT) return &peer->addr;
+    if (kind == PATH_PEER_RELAY) {
+        client_peer_t *relay = find_peer_by_id(client, peer->paths.relay_id);
+        if (relay) return &relay->addr;
+    }
+    return &client->fwd_controller_addr;
+}
+
+// Members offering to relay, kept apart so choosing a relay does not
+// scan the whole peer table; any change brings the next evaluation forward
+static void relay_list_update(client_t *client, uint64_t pid, bool offers) {
+    for (int i = 0; i < client->relay_count; i++) {
+        if (client->relay_ids[i] != pid) continue;
+        if (!offers) {
+            client->relay_ids[i] = client->relay_ids[--client->relay_count];
+            client->relay_eval_us = 0;
         }
+        return;
+    }
+    if (offers && client->relay_count < CLIENT_MAX_PEERS) {
+        client->relay_ids[client->relay_count++] = pid;
+        client->relay_eval_us = 0;
+    }
+}
+
+// Pick the member that relays for a peer: a volunteer we reach directly,
+// preferring the lowest RTT. A working relay is kept; one that never
+// answered probes for this peer is skipped for a while.
+static void choose_relay(client_t *client, client_peer_t *peer, uint64_t now_us) {
+    peer_paths_t *pp = &peer->paths;
+    if (path_relay_failing(pp)) {
+        pp->relay_failed_id = pp->relay_id;
+        pp->relay_failed_until_us = now_us + PATH_RELAY_BACKOFF_US;
+        path_set_relay(pp, 0);
+    }
+    client_peer_t *cur = pp->relay_id ? find_peer_by_id(client, pp->relay_id) : NULL;
+    if (cur && (cur->flags & PEER_FLAG_RELAY) && path_is_up(&cur->paths, PATH_DIRECT, now_us)) {
+        return;
+    }
+
+    client_peer_t *best = NULL;
+    for (int i = 0; i < client->relay_count; i++) {
+        client_peer_t *r = find_peer_by_id(client, client->relay_ids[i]);
+        if (!r || r == peer) continue;
+        if (!path_is_up(&r->paths, PATH_DIRECT, now_us)) continue;
+        if (r->id == pp->relay_failed_id && now_us < pp->relay_failed_until_us) continue;
+        if (!best || r->paths.path[PATH_DIRECT].srtt_us < best->paths.path[PATH_DIRECT].srtt_us) {
+            best = r;
+        }
+    }
+    uint64_t relay_id = best ? best->id : 0;
+    if (relay_id != pp->relay_id) {
+        if (relay_id) {
+            printf("Peer %llu: relaying through peer %llu\n",
+                   (unsigned long long)peer->id, (unsigned long long)relay_id);
+        }
+        path_set_relay(pp, relay_id);
+    }
+}
+
+// Forward a packet addressed to another member. Only peer-to-peer traffic
+// between known members is relayed, and only to members we reach directly;
+// the payload stays end-to-end encrypted.
+static void relay_packet(client_t *client, const packet_header_t *header,
+                         const uint8_t *data, int data_len) {
+    switch (header->type) {
+        case PKT_DATA: case PKT_HC_NACK: case PKT_PROBE: case PKT_PROBE_REPLY:
+            break;
+        default:
+            return;
+    }
+    if (!client->relay_enabled) return;
+    client_peer_t *dst = find_peer_by_id(client, header->dest_id);
+    client_peer_t *src = find_peer_by_id(client, header->sender_id);
+    if (!dst || !src) {
+        stats_inc(client->stats, STAT_DROP_UNKNOWN_PEER);
+        return;
+    }
+    if (!path_is_up(&dst->paths, PATH_DIRECT, monotonic_us())) return;
+    if (transport_send_tos(client->transport, &dst->addr, (packet_type_t)header->type,
+                           header->sender_id, header->dest_id, data, (uint16_t)data_len,
+                           client->transport->last_rx_tos) == 0) {
+        stats_inc(client->stats, STAT_RELAY_PACKETS);
+        stats_add(client->stats, STAT_RELAY_BYTES, (uint64_t)data_len);
+        stats_peer_add(client->stats, src->stats_slot, PSTAT_RELAY_PACKETS, 1);
+        stats_peer_add(client->stats, src->stats_slot, PSTAT_RELAY_BYTES, (uint64_t)data_len);
+    } else {
+        stats_inc(client->stats, STAT_DROP_SEND);
     }
-    return NULL;
+}
+
+// Tell the controller whether we volunteer as a relay
+static void announce_relay(client_t *client) {
+    uint8_t flag = client->relay_enabled ? PEER_FLAG_RELAY : 0;
+    transport_send(client->transport, &client->controller_addr, PKT_RELAY_ANNOUNCE,
+                   client->client_id, 0, &flag, 1);
+}
+
+// Current path to a peer, as chosen by path_select()
+static struct sockaddr_in* peer_dest(client_t *client, client_peer_t *peer) {
+    return path_dest(client, peer, peer->paths.active);
+}
+
+// Send a peer-to-peer packet over the peer's current path (direct or relay)
+static int send_to_peer(client_t *client, client_peer_t *peer, packet_type_t type,
+                        const uint8_t *data, uint16_t len) {
+    return transport_send(client->transport, peer_dest(client, peer), type,
+                          client->client_id, peer->id, data, len);
 }
 
 static void forward_ip_packet_to_peer(client_t *client, const uint8_t *buf, int len) {
-    uint32_t dest_ip_net = extract_ipv4_dest(buf, (size_t)len);
-    if (dest_ip_net == 0) {
+    uint8_t dest_key[FIB_ADDR_SIZE];
+    int family = extract_ip_dest(buf, (size_t)len, dest_key);
+    if (family < 0) {
         return;
     }
-    client_peer_t *peer = find_peer_by_vip(client, dest_ip_net);
+    client_peer_t *peer = find_peer_by_dest(client, dest_key);
     if (!peer) {
+        stats_inc(client->stats, STAT_DROP_NO_ROUTE);
+        return;
+    }
+    // Classify before doing any work; a full class queue tail-drops here
+    egress_class_t cls = egress_classify(buf, (size_t)len);
+    egress_pkt_t *slot = egress_reserve(&client->egress, cls);
+    if (!slot) {
+        stats_inc(client->stats, STAT_DROP_QUEUE_FULL);
+        return;
+    }
+
+    // Flow key for the payload compression policy (parsed before HC rewrites headers)
+    pc_key_t flow_key;
+    bool have_flow = client->pcomp.enabled && pc_flow_key(buf, (size_t)len, &flow_key) == 0;
+
+    // Compress inner IP/TCP/UDP headers against the per-flow context
+    uint8_t frame[TUN_MTU + HC_MAX_EXPANSION];
+    int frame_len = hc_compress(&peer->hc, buf, (size_t)len, frame, sizeof(frame));
+    if (frame_len < 0) {
+        stats_inc(client->stats, STAT_DROP_MALFORMED);
+        return;
+    }
+
+    // Optionally LZ-compress the frame when the flow's sampled ratio pays off
+    uint8_t packed[sizeof(frame) + PC_FRAME_HDR];
+    const uint8_t *plain = frame;
+    if (client->pcomp.enabled) {
+        frame_len = pc_compress(&client->pcomp, have_flow ? &flow_key : NULL,
+                                frame, (size_t)frame_len, packed, sizeof(packed));
+        if (frame_len < 0) {
+            return;
+        }
+        plain = packed;
+    }
+
+    size_t payload_len = AEAD_NONCE_SIZE + (size_t)frame_len + AEAD_TAG_SIZE;
+    if (sizeof(packet_header_t) + payload_len > MAX_PACKET_SIZE) {
+        fprintf(stderr, "Data too large: %zu bytes\n", payload_len);
         return;
     }
-    char dest_ip_str[INET_ADDRSTRLEN];
-    struct in_addr d; d.s_addr = dest_ip_net;
-    inet_ntop(AF_INET, &d, dest_ip_str, sizeof(dest_ip_str));
 
     // Derive session key from ids
     uint8_t key[AEAD_KEY_SIZE];
     derive_session_key(client->client_id, peer->id, key);
-    // Build payload: nonce(12) || ciphertext+tag
-    uint8_t nonce[AEAD_NONCE_SIZE];
-    RAND_bytes(nonce, AEAD_NONCE_SIZE);
-    uint8_t cipherbuf[AEAD_NONCE_SIZE + (size_t)len + AEAD_TAG_SIZE];
-    memcpy(cipherbuf, nonce, AEAD_NONCE_SIZE);
+    // Build the datagram in the queue slot: header || nonce(12) || ciphertext+tag
+    uint8_t *payload = slot->data + sizeof(packet_header_t);
+    RAND_bytes(payload, AEAD_NONCE_SIZE);
     size_t c_len = 0;
-    if (aead_encrypt_chacha20poly1305(key, nonce, buf, (size_t)len,
-                                       cipherbuf + AEAD_NONCE_SIZE, &c_len) != 0) {
+    if (aead_encrypt_chacha20poly1305(key, payload, plain, (size_t)frame_len,
+                                       payload + AEAD_NONCE_SIZE, &c_len) != 0) {
         fprintf(stderr, "encryption failed, dropping packet\n");
         return;
     }
-    size_t payload_len = AEAD_NONCE_SIZE + c_len;
+    transport_write_header(client->transport, slot->data, PKT_DATA,
+                           client->client_id, peer->id, (uint16_t)payload_len);
+    slot->len = (uint16_t)(sizeof(packet_header_t) + payload_len);
+    slot->dest = *peer_dest(client, peer);
+    // Outer UDP packet carries the inner DSCP and ECN bits
+    slot->tos = egress_inner_tos(buf, (size_t)len);
+    egress_commit(&client->egress, cls);
+    stats_inc(client->stats, STAT_TX_PACKETS);
+    stats_add(client->stats, STAT_TX_BYTES, slot->len);
+    stats_peer_add(client->stats, peer->stats_slot, PSTAT_TX_PACKETS, 1);
+    stats_peer_add(client->stats, peer->stats_slot, PSTAT_TX_BYTES, slot->len);
+    if (client->first_fwd_from_us) {
+        printf("First packet forwarded %.1f ms after start\n",
+               (monotonic_us() - client->first_fwd_from_us) / 1000.0);
+        client->first_fwd_from_us = 0;
+    }
+}
 
-    if (peer->reachable) {
-        printf("forward: vIP=%s -> %s:%d len=%d (direct)\n", dest_ip_str,
-               inet_ntoa(peer->addr.sin_addr), ntohs(peer->addr.sin_port), len);
-        transport_send(client->transport, &peer->addr, PKT_DATA,
-                       client->client_id, peer->id, cipherbuf, (uint16_t)payload_len);
-    } else {
-        // Relay via controller as fallback
-        printf("forward: vIP=%s -> controller relay len=%d\n", dest_ip_str, len);
-        transport_send(client->transport, &client->controller_addr, PKT_DATA,
-                       client->client_id, peer->id, cipherbuf, (uint16_t)payload_len);
+// Route the overlay networks through the TUN (queued into the setup batch)
+static void install_overlay_routes(tun_t *tun) {
+    // Only a kernel interface can carry routes
+    if (!tun || !tun_is_system(tun)) return;
+
+    uint32_t net4 = tun->ip_addr & tun->netmask;
+    if (tun_add_route(tun, AF_INET, &net4, __builtin_popcount(ntohl(tun->netmask))) != 0) {
+        fprintf(stderr, "Warning: failed to add overlay route via %s (may need sudo)\n", tun_get_name(tun));
     }
+#ifndef __linux__
+    // Linux installs the connected /64 together with the address
+    if (tun->ip6_prefix_len > 0) {
+        uint8_t prefix[IPV6_ADDR_SIZE] = {0};
+        memcpy(prefix, tun->ip6_addr, OVERLAY_V6_PREFIX_LEN / 8);
+        if (tun_add_route(tun, AF_INET6, prefix, OVERLAY_V6_PREFIX_LEN) != 0) {
+            fprintf(stderr, "Warning: failed to add IPv6 overlay route via %s (may need sudo)\n",
+                    tun_get_name(tun));
+        }
+    }
+#endif
 }
 
-static void install_overlay_route(tun_t *tun) {
-    if (!tun) return;
-    const char *ifname = tun_get_name(tun);
-    if (!ifname || !*ifname) return;
+// Assign the overlay addresses to the TUN and route the overlay through it.
+// Everything goes out as one batch (a single rtnetlink round trip on Linux).
+static void configure_overlay(client_t *client) {
+    if (!client->tun) return;
+    uint64_t t0 = monotonic_us();
+    tun_begin(client->tun);
+    tun_set_mtu(client->tun, CLIENT_OVERLAY_MTU);
+    struct in_addr mask; mask.s_addr = htonl(~0U << (32 - client->overlay_prefix_len));
+    char mask_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &mask, mask_str, sizeof(mask_str));
+    tun_configure(client->tun, client->virtual_ip, mask_str);
+    if (client->has_ip6) {
+        tun_configure6(client->tun, client->virtual_ip6, OVERLAY_V6_PREFIX_LEN);
+    }
+    tun_up(client->tun);
+    install_overlay_routes(client->tun);
+    if (tun_commit(client->tun) != 0) {
+        fprintf(stderr, "Warning: interface %s setup incomplete (may need sudo)\n", tun_get_name(client->tun));
+    }
+    uint64_t t1 = monotonic_us();
+    printf("TUN interface configured with IP: %s/%d\n", client->virtual_ip, client->overlay_prefix_len);
+    printf("Interface %s ready in %.2f ms (%.1f ms after start)\n", tun_get_name(client->tun),
+           (t1 - t0) / 1000.0, (t1 - client->created_us) / 1000.0);
+    client->overlay_configured = true;
+}
 
-#ifdef __APPLE__
-    // macOS: route add -net 10.0.0.0/24 via interface
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "route -n add -net 10.0.0.0/24 -interface %s", ifname);
-    int rc = system(cmd);
-    if (rc != 0) {
-        fprintf(stderr, "Warning: failed to add route via %s; you may need sudo: %s\n", ifname, cmd);
-    } else {
-        printf("Installed overlay route 10.0.0.0/24 via %s\n", ifname);
-    }
-#elif __linux__
-    // Linux: ip route add 10.0.0.0/24 dev <ifname>
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "ip route add 10.0.0.0/24 dev %s", ifname);
-    int rc = system(cmd);
-    if (rc != 0) {
-        fprintf(stderr, "Warning: failed to add route via %s; you may need sudo: %s\n", ifname, cmd);
+// Add a member to the peer table and index its overlay addresses
+static client_peer_t* add_peer(client_t *client, uint64_t pid, const struct sockaddr_in *paddr,
+                               uint32_t vip_net, const uint8_t *vip6, uint8_t flags) {
+    if (client->peer_count >= CLIENT_MAX_PEERS) {
+        // Once per filling up, not once per member we cannot take
+        if (!client->peers_full) {
+            fprintf(stderr, "Peer table full (%d peers); ignoring peer %llu and any further ones\n",
+                    CLIENT_MAX_PEERS, (unsigned long long)pid);
+            client->peers_full = true;
+        }
+        return NULL;
+    }
+    int idx = client->peer_count;
+    if (hmap_put(&client->peer_index, pid, (uint32_t)idx) != 0) return NULL;
+    client->peer_count++;
+    client_peer_t *cp = &client->peers[idx];
+    memset(cp, 0, sizeof(*cp));
+    cp->id = pid; cp->addr = *paddr;
+    cp->vip = vip_net;
+    cp->flags = flags;
+    cp->stats_slot = stats_peer_attach(client->stats, pid);
+    relay_list_update(client, pid, flags & PEER_FLAG_RELAY);
+    path_init(&cp->paths);
+    if (client->forced_path >= 0) {
+        path_force(&cp->paths, (path_kind_t)client->forced_path);
+    }
+    hc_init(&cp->hc);
+    struct in_addr vip; vip.s_addr = vip_net;
+    inet_ntop(AF_INET, &vip, cp->virtual_ip, sizeof(cp->virtual_ip));
+
+    // Index the peer's overlay addresses for O(1) forwarding
+    uint8_t key[FIB_ADDR_SIZE];
+    fib_key_from_ipv4(vip_net, key);
+    fib_insert(&client->fib, key, idx);
+    if (vip6) {
+        memcpy(cp->virtual_ip6, vip6, IPV6_ADDR_SIZE);
+        fib_insert(&client->fib, cp->virtual_ip6, idx);
+    }
+    return cp;
+}
+
+// --- Restart cache (ZTNET_STATE) ---
+
+// The cache belongs to one identity on one network behind one controller
+static bool state_matches(const cstate_t *st, const uint8_t network_id[NETWORK_ID_SIZE],
+                          const struct sockaddr_in *controller) {
+    return cstate_valid(st) &&
+           memcmp(st->f->network_id, network_id, NETWORK_ID_SIZE) == 0 &&
+           st->f->controller_ip == controller->sin_addr.s_addr &&
+           st->f->controller_port == controller->sin_port;
+}
+
+static void state_save_identity(client_t *client) {
+    cstate_t *st = client->state;
+    if (!st) return;
+    cstate_reset(st);
+    cstate_begin(st);
+    st->f->client_id = client->client_id;
+    st->f->keys = client->keys;
+    memcpy(st->f->network_id, client->target_network_id, NETWORK_ID_SIZE);
+    st->f->controller_ip = client->controller_addr.sin_addr.s_addr;
+    st->f->controller_port = client->controller_addr.sin_port;
+    st->f->local_port = client->transport->port;
+    cstate_end(st);
+}
+
+static void state_save_join(client_t *client, const client_peer_cmd_t *cmd) {
+    cstate_t *st = client->state;
+    if (!st) return;
+    cstate_begin(st);
+    st->f->vip = cmd->vip;
+    memcpy(st->f->vip6, cmd->vip6, IPV6_ADDR_SIZE);
+    st->f->has_ip6 = cmd->has_vip6;
+    st->f->prefix_len = cmd->prefix_len;
+    cstate_end(st);
+}
+
+static void state_save_peer(client_t *client, const client_peer_t *p) {
+    cstate_t *st = client->state;
+    if (!st) return;
+    static const uint8_t zero6[IPV6_ADDR_SIZE];
+    cstate_begin(st);
+    cstate_peer_t *sp = cstate_peer(st, p->id, true);
+    if (sp) {
+        sp->ip = p->addr.sin_addr.s_addr;
+        sp->port = p->addr.sin_port;
+        sp->flags = p->flags;
+        sp->path = (uint8_t)p->paths.active;
+        sp->vip = p->vip;
+        memcpy(sp->vip6, p->virtual_ip6, IPV6_ADDR_SIZE);
+        sp->has_vip6 = memcmp(p->virtual_ip6, zero6, IPV6_ADDR_SIZE) != 0;
+        sp->srtt_us = p->paths.path[p->paths.active].srtt_us;
+        sp->relay_id = p->paths.relay_id;
+    }
+    cstate_end(st);
+}
+
+static void state_forget_peer(client_t *client, uint64_t peer_id) {
+    cstate_t *st = client->state;
+    if (!st) return;
+    cstate_begin(st);
+    cstate_peer_t *sp = cstate_peer(st, peer_id, false);
+    if (sp) sp->id = 0;
+    cstate_end(st);
+}
+
+// Bring back the overlay addresses and every peer on its last path, so
+// traffic flows before the controller has answered; the JOIN that follows
+// reconciles addresses and endpoints in the background.
+static void state_restore(client_t *client) {
+    const cstate_file_t *f = client->state->f;
+    uint64_t now_us = monotonic_us();
+    if (f->vip) {
+        struct in_addr vip; vip.s_addr = f->vip;
+        inet_ntop(AF_INET, &vip, client->virtual_ip, sizeof(client->virtual_ip));
+        if (f->prefix_len) client->overlay_prefix_len = f->prefix_len;
+        if (f->has_ip6) {
+            memcpy(client->virtual_ip6, f->vip6, IPV6_ADDR_SIZE);
+            client->has_ip6 = true;
+        }
+        configure_overlay(client);
+    }
+    for (uint32_t i = 0; i < f->peer_count; i++) {
+        const cstate_peer_t *sp = &f->peer[i];
+        if (sp->id == 0) continue;
+        struct sockaddr_in paddr; memset(&paddr, 0, sizeof(paddr));
+        paddr.sin_family = AF_INET;
+        paddr.sin_addr.s_addr = sp->ip;
+        paddr.sin_port = sp->port;
+        client_peer_t *cp = add_peer(client, sp->id, &paddr, sp->vip,
+                                     sp->has_vip6 ? sp->vip6 : NULL, sp->flags);
+        if (!cp) break;
+        if (sp->path == PATH_PEER_RELAY) path_set_relay(&cp->paths, sp->relay_id);
+        if (sp->path < PATH_KINDS && (sp->path != PATH_PEER_RELAY || sp->relay_id != 0)) {
+            path_resume(&cp->paths, (path_kind_t)sp->path, sp->srtt_us, now_us);
+        }
+        // Reopen NAT mappings right away; probes confirm the path
+        transport_send(client->transport, &cp->addr, PKT_PEER_HELLO,
+                       client->client_id, cp->id, NULL, 0);
+    }
+    printf("Resumed from %s: vIP %s, %d peers\n", client->state->path,
+           client->virtual_ip[0] ? client->virtual_ip : "-", client->peer_count);
+}
+
+// Drop a member that left; the last peer moves into its slot and is
+// re-indexed under the new position
+static void remove_peer(client_t *client, uint64_t pid) {
+    client_peer_t *cp = find_peer_by_id(client, pid);
+    if (!cp) return;
+    static const uint8_t zero6[IPV6_ADDR_SIZE];
+    uint8_t key[FIB_ADDR_SIZE];
+    fib_key_from_ipv4(cp->vip, key);
+    fib_remove(&client->fib, key);
+    if (memcmp(cp->virtual_ip6, zero6, IPV6_ADDR_SIZE) != 0) fib_remove(&client->fib, cp->virtual_ip6);
+    stats_peer_detach(client->stats, cp->stats_slot);
+    relay_list_update(client, pid, false);
+    state_forget_peer(client, pid);
+    printf("Peer %llu left the network\n", (unsigned long long)pid);
+
+    int idx = (int)(cp - client->peers);
+    int last = --client->peer_count;
+    hmap_del(&client->peer_index, pid);
+    client->peers_full = false;
+    if (idx != last) {
+        *cp = client->peers[last];
+        hmap_put(&client->peer_index, cp->id, (uint32_t)idx);
+        fib_key_from_ipv4(cp->vip, key);
+        fib_insert(&client->fib, key, idx);
+        if (memcmp(cp->virtual_ip6, zero6, IPV6_ADDR_SIZE) != 0) fib_insert(&client->fib, cp->virtual_ip6, idx);
+    }
+}
+
+// A peer restored from the cache may have come back on other overlay
+// addresses: route the new ones to it and drop the old ones, unless they
+// already lead to another member
+static void readdress_peer(client_t *client, client_peer_t *cp, uint32_t vip_net, const uint8_t *vip6) {
+    static const uint8_t zero6[IPV6_ADDR_SIZE];
+    if (!vip6) vip6 = zero6;
+    if (cp->vip == vip_net && memcmp(cp->virtual_ip6, vip6, IPV6_ADDR_SIZE) == 0) return;
+    int idx = (int)(cp - client->peers);
+    uint8_t key[FIB_ADDR_SIZE];
+    fib_key_from_ipv4(cp->vip, key);
+    if (fib_lookup(&client->fib, key) == idx) fib_remove(&client->fib, key);
+    if (memcmp(cp->virtual_ip6, zero6, IPV6_ADDR_SIZE) != 0 &&
+        fib_lookup(&client->fib, cp->virtual_ip6) == idx) {
+        fib_remove(&client->fib, cp->virtual_ip6);
+    }
+    cp->vip = vip_net;
+    struct in_addr vip; vip.s_addr = vip_net;
+    inet_ntop(AF_INET, &vip, cp->virtual_ip, sizeof(cp->virtual_ip));
+    memcpy(cp->virtual_ip6, vip6, IPV6_ADDR_SIZE);
+    fib_key_from_ipv4(vip_net, key);
+    fib_insert(&client->fib, key, idx);
+    if (memcmp(vip6, zero6, IPV6_ADDR_SIZE) != 0) fib_insert(&client->fib, cp->virtual_ip6, idx);
+    printf("Peer %llu now has vIP %s\n", (unsigned long long)cp->id, cp->virtual_ip);
+}
+
+// --- Control plane ---
+//
+// The forwarding thread hands controller packets to the control thread
+// through ctl_ring and never waits on control work. Changes to the peer
+// table and the restart cache go back through cmd_ring and are applied by
+// the forwarding thread between batches, so each keeps a single writer.
+
+// Forwarding thread: queue a controller packet; dropped if the control
+// thread is this far behind
+static void queue_control(client_t *client, const packet_header_t *header,
+                          const uint8_t *data, int data_len, const struct sockaddr_in *sender) {
+    client_ctl_msg_t *m = (client_ctl_msg_t*)ring_reserve(client->ctl_ring);
+    if (!m) {
+        stats_inc(client->stats, STAT_DROP_QUEUE_FULL);
+        return;
+    }
+    m->header = *header;
+    m->sender = *sender;
+    m->len = (uint16_t)data_len;
+    memcpy(m->data, data, (size_t)data_len);
+    ring_commit(client->ctl_ring);
+    ring_notify_signal(&client->ctl_notify);
+}
+
+// Control thread: hand a peer update to the forwarding thread. The
+// control thread may wait here; the forwarding thread never does.
+static void publish_peer_update(client_t *client, const client_peer_cmd_t *cmd) {
+    while (ring_push(client->cmd_ring, cmd) != 0) {
+        if (!client->running) return;
+        usleep(1000);
+    }
+    ring_notify_signal(&client->cmd_notify);
+}
+
+static void set_connected(client_t *client, bool connected) {
+    __atomic_store_n(&client->connected, connected, __ATOMIC_RELEASE);
+}
+
+// Control thread: talk to another controller from now on; the forwarding
+// thread relays through its own copy of the address
+static void move_controller(client_t *client, const struct sockaddr_in *addr) {
+    client->controller_addr = *addr;
+    client_peer_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.kind = CLIENT_CMD_CONTROLLER;
+    cmd.addr = *addr;
+    publish_peer_update(client, &cmd);
+}
+
+// Forwarding thread: apply an update from the control thread
+static void apply_peer_update(client_t *client, const client_peer_cmd_t *cmd) {
+    if (cmd->kind == CLIENT_CMD_REMOVE) {
+        remove_peer(client, cmd->id);
+        return;
+    }
+    if (cmd->kind == CLIENT_CMD_JOINED) {
+        state_save_join(client, cmd);
+        return;
+    }
+    if (cmd->kind == CLIENT_CMD_CONTROLLER) {
+        client->fwd_controller_addr = cmd->addr;
+        return;
+    }
+    if (cmd->kind == CLIENT_CMD_PRUNE) {
+        // Backwards: remove_peer moves the last peer, already checked, into the gap
+        for (int i = client->peer_count - 1; i >= 0; i--) {
+            if (client->peers[i].member_version < cmd->version) remove_peer(client, client->peers[i].id);
+        }
+        return;
+    }
+    // Known peer: refresh its endpoint, overlay addresses and relay capability
+    client_peer_t *known = find_peer_by_id(client, cmd->id);
+    if (known) {
+        known->addr = cmd->addr;
+        if (cmd->version > known->member_version) known->member_version = cmd->version;
+        readdress_peer(client, known, cmd->vip, cmd->has_vip6 ? cmd->vip6 : NULL);
+        if (known->flags != cmd->flags) {
+            printf("Peer %llu %s relaying\n", (unsigned long long)cmd->id,
+                   (cmd->flags & PEER_FLAG_RELAY) ? "offers" : "stops");
+            known->flags = cmd->flags;
+            relay_list_update(client, cmd->id, cmd->flags & PEER_FLAG_RELAY);
+        }
+        state_save_peer(client, known);
+        return;
+    }
+    client_peer_t *cp = add_peer(client, cmd->id, &cmd->addr, cmd->vip,
+                                 cmd->has_vip6 ? cmd->vip6 : NULL, cmd->flags);
+    if (!cp) return;
+    cp->member_version = cmd->version;
+    printf("Discovered peer %llu at %s:%d (vIP %s)\n",
+           (unsigned long long)cp->id,
+           inet_ntoa(cp->addr.sin_addr), ntohs(cp->addr.sin_port), cp->virtual_ip);
+    state_save_peer(client, cp);
+
+    // Send direct hello to peer
+    transport_send(client->transport, &cp->addr, PKT_PEER_HELLO,
+                   client->client_id, cp->id, NULL, 0);
+}
+
+static void apply_peer_updates(client_t *client) {
+    client_peer_cmd_t *cmd;
+    while ((cmd = (client_peer_cmd_t*)ring_front(client->cmd_ring)) != NULL) {
+        apply_peer_update(client, cmd);
+        ring_release(client->cmd_ring);
+    }
+}
+
+// Control thread: one PEER_INFO record (id, vIP, endpoint, [vIP6 [flags]])
+// listed at membership version `version`, to the forwarding thread
+static void apply_peer_info(client_t *client, const uint8_t *data, int data_len, uint64_t version) {
+    uint64_t pid; uint32_t vip_net; uint32_t ip_be; uint16_t port_be;
+    memcpy(&pid, data, sizeof(uint64_t));
+    if (pid == client->client_id) return;
+    memcpy(&vip_net, data + 8, sizeof(uint32_t));
+    memcpy(&ip_be, data + 12, sizeof(uint32_t));
+    memcpy(&port_be, data + 16, sizeof(uint16_t));
+    bool has_vip6 = data_len >= PEER_INFO_V6_LEN;
+    uint8_t flags = data_len >= PEER_INFO_LEN ? data[PEER_INFO_V6_LEN] : 0;
+
+    // Build socket address
+    struct sockaddr_in paddr; memset(&paddr, 0, sizeof(paddr));
+    paddr.sin_family = AF_INET;
+    paddr.sin_addr.s_addr = ip_be;   // already BE
+    paddr.sin_port = port_be;         // already BE
+
+    // The forwarding thread owns the peer table
+    client_peer_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.kind = CLIENT_CMD_PEER;
+    cmd.id = pid;
+    cmd.addr = paddr;
+    cmd.vip = vip_net;
+    cmd.flags = flags;
+    cmd.version = version;
+    cmd.has_vip6 = has_vip6;
+    if (has_vip6) memcpy(cmd.vip6, data + PEER_INFO_V4_LEN, IPV6_ADDR_SIZE);
+    publish_peer_update(client, &cmd);
+}
+
+// KEEPALIVE to the controller, carrying the membership version we hold
+static void send_keepalive(client_t *client, uint64_t dest_id) {
+    uint8_t payload[KEEPALIVE_VERSION_LEN];
+    memcpy(payload, &client->member_version, sizeof(payload));
+    transport_send(client->transport, &client->controller_addr, PKT_KEEPALIVE,
+                   client->client_id, dest_id, payload, sizeof(payload));
+}
+
+// Control thread: apply a PKT_MEMBER_SYNC datagram. Records are applied as
+// they come (they carry full state, so repeats are harmless); the version
+// only advances over a delta that follows on from ours or a complete
+// snapshot. A gap is reported at once so the controller resends.
+static void handle_member_sync(client_t *client, const uint8_t *data, int data_len) {
+    if (data_len < MEMBER_SYNC_HDR_LEN) return;
+    uint64_t from, to;
+    uint16_t part, parts;
+    memcpy(&from, data, sizeof(uint64_t));
+    memcpy(&to, data + 8, sizeof(uint64_t));
+    uint8_t flags = data[16];
+    memcpy(&part, data + 17, sizeof(uint16_t));
+    memcpy(&parts, data + 19, sizeof(uint16_t));
+
+    for (int off = MEMBER_SYNC_HDR_LEN; off < data_len; ) {
+        uint8_t op = data[off++];
+        if (op == MEMBER_UPSERT && off + PEER_INFO_LEN <= data_len) {
+            apply_peer_info(client, data + off, PEER_INFO_LEN, to);
+            off += PEER_INFO_LEN;
+        } else if (op == MEMBER_REMOVE && off + 8 <= data_len) {
+            client_peer_cmd_t cmd;
+            memset(&cmd, 0, sizeof(cmd));
+            memcpy(&cmd.id, data + off, sizeof(uint64_t));
+            cmd.kind = CLIENT_CMD_REMOVE;
+            if (cmd.id != client->client_id) publish_peer_update(client, &cmd);
+            off += 8;
+        } else {
+            break;
+        }
+    }
+
+    if (flags & MEMBER_SYNC_SNAPSHOT) {
+        if (to != client->snap_version) {
+            client->snap_version = to;
+            memset(client->snap_seen, 0, sizeof(client->snap_seen));
+            client->snap_count = 0;
+        }
+        uint64_t *seen = &client->snap_seen[part / 64];
+        uint64_t bit = 1ULL << (part % 64);
+        if (part >= parts || (*seen & bit)) return;
+        *seen |= bit;
+        if (++client->snap_count < parts) return;
+        // Complete: members it does not list have left (possibly while we
+        // were away); those a newer delta brought in stay
+        client_peer_cmd_t cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.kind = CLIENT_CMD_PRUNE;
+        cmd.version = to;
+        publish_peer_update(client, &cmd);
+        if (to > client->member_version) client->member_version = to;
+    } else if (from <= client->member_version) {
+        if (to > client->member_version) client->member_version = to;
     } else {
-        printf("Installed overlay route 10.0.0.0/24 via %s\n", ifname);
+        send_keepalive(client, 0);
     }
-#else
-    (void)ifname;
-#endif
+}
+
+// Control thread: handle one packet from the controller
+static void handle_control_packet(client_t *client, const packet_header_t *header,
+                                  const uint8_t *data, int data_len) {
+    client->controller_heard = time(NULL);
+    switch (header->type) {
+        case PKT_HELLO_ACK:
+            printf("Received HELLO_ACK from controller\n");
+            break;
+        
+        case PKT_JOIN_RESPONSE:
+            if (data_len == JOIN_RESPONSE_V4_LEN || data_len >= JOIN_RESPONSE_LEN) {
+                printf("Received JOIN_RESPONSE - Successfully joined network!\n");
+                // A resumed client already runs on its cached addresses
+                char prev_vip[sizeof(client->virtual_ip)];
+                uint8_t prev_vip6[IPV6_ADDR_SIZE];
+                int prev_prefix_len = client->overlay_prefix_len;
+                memcpy(prev_vip, client->virtual_ip, sizeof(prev_vip));
+                memcpy(prev_vip6, client->virtual_ip6, sizeof(prev_vip6));
+                uint32_t vip_net;
+                memcpy(&vip_net, data, sizeof(uint32_t));
+                struct in_addr vip; vip.s_addr = vip_net;
+                inet_ntop(AF_INET, &vip, client->virtual_ip, sizeof(client->virtual_ip));
+                // Older controllers do not send the prefix: their overlay is the default /24
+                client->overlay_prefix_len = OVERLAY_DEFAULT_PREFIX_LEN;
+                if (data_len >= JOIN_RESPONSE_CIDR_LEN && data[JOIN_RESPONSE_LEN] >= 8 &&
+                    data[JOIN_RESPONSE_LEN] <= 30) {
+                    client->overlay_prefix_len = data[JOIN_RESPONSE_LEN];
+                }
+                printf("Assigned virtual IP: %s/%d\n", client->virtual_ip, client->overlay_prefix_len);
+                if (data_len >= JOIN_RESPONSE_LEN) {
+                    memcpy(client->virtual_ip6, data + JOIN_RESPONSE_V4_LEN, IPV6_ADDR_SIZE);
+                    client->has_ip6 = true;
+                    char vip6_str[INET6_ADDRSTRLEN];
+                    inet_ntop(AF_INET6, client->virtual_ip6, vip6_str, sizeof(vip6_str));
+                    printf("Assigned virtual IPv6: %s/%d\n", vip6_str, OVERLAY_V6_PREFIX_LEN);
+                }
+                // Configure TUN with assigned IP
+                if (client->overlay_configured && strcmp(prev_vip, client->virtual_ip) == 0 &&
+                    prev_prefix_len == client->overlay_prefix_len &&
+                    memcmp(prev_vip6, client->virtual_ip6, IPV6_ADDR_SIZE) == 0) {
+                    printf("Controller confirmed resumed addresses\n");
+                } else {
+                    configure_overlay(client);
+                }
+                // The forwarding thread is the restart cache's only writer
+                client_peer_cmd_t cmd;
+                memset(&cmd, 0, sizeof(cmd));
+                cmd.kind = CLIENT_CMD_JOINED;
+                cmd.vip = vip_net;
+                memcpy(cmd.vip6, client->virtual_ip6, IPV6_ADDR_SIZE);
+                cmd.has_vip6 = client->has_ip6;
+                cmd.prefix_len = (uint8_t)client->overlay_prefix_len;
+                publish_peer_update(client, &cmd);
+                set_connected(client, true);
+                client->redirects = 0;
+                if (client->relay_enabled) announce_relay(client);
+            } else {
+                fprintf(stderr, "JOIN denied by controller (network ID mismatch or policy).\n");
+                // Stop client loop gracefully
+                client->running = false;
+            }
+            break;
+        
+        case PKT_PEER_INFO:
+            if (data_len == PEER_INFO_V4_LEN || data_len >= PEER_INFO_V6_LEN) {
+                apply_peer_info(client, data, data_len, client->member_version);
+            }
+            break;
+
+        case PKT_MEMBER_SYNC:
+            handle_member_sync(client, data, data_len);
+            break;
+
+        case PKT_REDIRECT:
+            // A clustered controller sends us to the node serving our shard
+            if (data_len < REDIRECT_LEN || client->redirects >= CLIENT_MAX_REDIRECTS) break;
+            client->redirects++;
+            struct sockaddr_in to = client->controller_addr;
+            memcpy(&to.sin_addr.s_addr, data, sizeof(uint32_t));
+            memcpy(&to.sin_port, data + 4, sizeof(uint16_t));
+            move_controller(client, &to);
+            printf("Redirected to controller %s:%d\n", inet_ntoa(client->controller_addr.sin_addr),
+                   ntohs(client->controller_addr.sin_port));
+            set_connected(client, false);
+            client_connect(client);
+            break;
+
+        case PKT_KEEPALIVE:
+            // Send keepalive back
+            send_keepalive(client, header->sender_id);
+            break;
+        
+        default:
+            break;
+    }
+}
+
+// Control thread: controller packets, keepalives and relay announcements
+static void* client_control_run(void *arg) {
+    client_t *client = (client_t*)arg;
+    time_t last_keepalive = time(NULL);
+
+    affinity_pin(&client->affinity, AFF_TIMER, "client control");
+    while (client->running) {
+        struct pollfd pfd = { .fd = client->ctl_notify.rfd, .events = POLLIN };
+        if (poll(&pfd, 1, 1000) < 0 && errno != EINTR) {
+            perror("poll failed");
+            break;
+        }
+        ring_notify_drain(&client->ctl_notify);
+        client_ctl_msg_t *m;
+        while ((m = (client_ctl_msg_t*)ring_front(client->ctl_ring)) != NULL) {
+            handle_control_packet(client, &m->header, m->data, m->len);
+            ring_release(client->ctl_ring);
+        }
+
+        // A controller that went quiet (a failed cluster node, a restart
+        // without state): JOIN again through the seed
+        time_t now = time(NULL);
+        if (client_connected(client) && now - client->controller_heard > CLIENT_CONTROLLER_TIMEOUT) {
+            printf("Controller silent for %lds, rejoining via %s:%d\n", (long)(now - client->controller_heard),
+                   inet_ntoa(client->seed_addr.sin_addr), ntohs(client->seed_addr.sin_port));
+            move_controller(client, &client->seed_addr);
+            client->controller_heard = now;
+            client->redirects = 0;
+            set_connected(client, false);
+            client_connect(client);
+        }
+
+        // Send keepalives periodically
+        if (client_connected(client) && now - last_keepalive >= KEEPALIVE_INTERVAL) {
+            send_keepalive(client, 0);
+            if (client->relay_enabled) announce_relay(client);
+            last_keepalive = now;
+        }
+    }
+    return NULL;
+}
+
+static void client_free_queues(client_t *client) {
+    ring_destroy(client->ctl_ring);
+    ring_destroy(client->cmd_ring);
+    ring_notify_close(&client->ctl_notify);
+    ring_notify_close(&client->cmd_notify);
 }
 
 // Create client
@@ -116,9 +846,16 @@ client_t* client_create(const char *controller_ip, uint16_t controller_port, con
         perror("Failed to allocate client");
         return NULL;
     }
+    client->created_us = monotonic_us();
+    client->overlay_prefix_len = OVERLAY_DEFAULT_PREFIX_LEN;
+    client->first_fwd_from_us = client->created_us;
     
     // Generate client ID
-    client->client_id = (uint64_t)time(NULL) + (uint64_t)getpid();
+    // Random ID: time+pid collides when several clients share a process
+    if (RAND_bytes((uint8_t*)&client->client_id, sizeof(client->client_id)) != 1 ||
+        client->client_id == 0) {
+        client->client_id = (uint64_t)time(NULL) + (uint64_t)getpid();
+    }
     
     // Generate client keypair
     if (keypair_generate(&client->keys) != 0) {
@@ -132,9 +869,24 @@ client_t* client_create(const char *controller_ip, uint16_t controller_port, con
         memset(client->target_network_id, 0, NETWORK_ID_SIZE);
     }
     
+    // Set controller address
+    memset(&client->controller_addr, 0, sizeof(client->controller_addr));
+    client->controller_addr.sin_family = AF_INET;
+    client->controller_addr.sin_port = htons(controller_port);
+    if (inet_pton(AF_INET, controller_ip, &client->controller_addr.sin_addr) <= 0) {
+        fprintf(stderr, "Invalid controller IP address\n");
+        free(client);
+        return NULL;
+    }
+    client->seed_addr = client->controller_addr;
+    client->fwd_controller_addr = client->controller_addr;
+    client->controller_heard = time(NULL);
+    
     // Create TUN interface
     printf("Creating TUN interface...\n");
-    client->tun = tun_create(NULL);
+    // Kernel TUN by default; ZTNET_TUN=mem or pcap:in[,out] runs the data
+    // plane without /dev/net/tun or root
+    client->tun = tun_open(getenv("ZTNET_TUN"), NULL);
     if (!client->tun) {
         fprintf(stderr, "Failed to create TUN interface\n");
         fprintf(stderr, "Note: TUN interface requires root privileges\n");
@@ -142,9 +894,22 @@ client_t* client_create(const char *controller_ip, uint16_t controller_port, con
         return NULL;
     }
     
-    // Create transport on random port
-    client->transport = transport_create(0);
+    // Optional restart cache (ZTNET_STATE=<file>): resume the previous
+    // identity on the same UDP port, so peers' view of our endpoint holds
+    client->state = cstate_open(getenv("ZTNET_STATE"));
+    bool resume = state_matches(client->state, client->target_network_id, &client->controller_addr);
+    if (resume) {
+        client->client_id = client->state->f->client_id;
+        client->keys = client->state->f->keys;
+    }
+    
+    // Create transport on random port (or the one we had before a restart)
+    client->transport = resume ? transport_create(client->state->f->local_port) : NULL;
+    if (!client->transport) {
+        client->transport = transport_create(0);
+    }
     if (!client->transport) {
+        cstate_close(client->state);
         tun_destroy(client->tun);
         free(client);
         return NULL;
@@ -153,27 +918,88 @@ client_t* client_create(const char *controller_ip, uint16_t controller_port, con
     // Set socket to non-blocking
     int flags = fcntl(client->transport->socket_fd, F_GETFL, 0);
     fcntl(client->transport->socket_fd, F_SETFL, flags | O_NONBLOCK);
+
+    // Peers' batches can land while this thread is off the CPU; give the
+    // socket room to absorb them
+    int sock_buf = CLIENT_SOCK_BUF;
+    setsockopt(client->transport->socket_fd, SOL_SOCKET, SO_RCVBUF, &sock_buf, sizeof(sock_buf));
+    setsockopt(client->transport->socket_fd, SOL_SOCKET, SO_SNDBUF, &sock_buf, sizeof(sock_buf));
     
-    // Set controller address
-    memset(&client->controller_addr, 0, sizeof(client->controller_addr));
-    client->controller_addr.sin_family = AF_INET;
-    client->controller_addr.sin_port = htons(controller_port);
-    if (inet_pton(AF_INET, controller_ip, &client->controller_addr.sin_addr) <= 0) {
-        fprintf(stderr, "Invalid controller IP address\n");
+    // Thread placement follows ZTNET_AFFINITY, else the NIC that reaches
+    // the controller
+    affinity_load(&client->affinity, getenv("ZTNET_AFFINITY"), &client->controller_addr);
+
+    if (egress_init(&client->egress, &client->affinity) != 0) {
+        cstate_close(client->state);
+        transport_destroy(client->transport);
+        tun_destroy(client->tun);
+        free(client);
+        return NULL;
+    }
+    
+    // Queues between the forwarding and control threads
+    client->ctl_notify.rfd = client->ctl_notify.wfd = -1;
+    client->cmd_notify.rfd = client->cmd_notify.wfd = -1;
+    client->ctl_ring = ring_create(CLIENT_CTL_RING, sizeof(client_ctl_msg_t));
+    client->cmd_ring = ring_create(CLIENT_CMD_RING, sizeof(client_peer_cmd_t));
+    if (!client->ctl_ring || !client->cmd_ring ||
+        ring_notify_init(&client->ctl_notify) != 0 || ring_notify_init(&client->cmd_notify) != 0) {
+        perror("Failed to create control queues");
+        client_free_queues(client);
+        egress_free(&client->egress);
+        cstate_close(client->state);
         transport_destroy(client->transport);
         tun_destroy(client->tun);
         free(client);
         return NULL;
     }
     
-    client->connected = false;
+    set_connected(client, false);
     client->running = false;
     client->virtual_ip[0] = '\0';
+    client->has_ip6 = false;
     client->peer_count = 0;
+    fib_init(&client->fib);
+    if (hmap_init(&client->peer_index, CLIENT_MAX_PEERS * 2) != 0) {
+        client_free_queues(client);
+        egress_free(&client->egress);
+        cstate_close(client->state);
+        transport_destroy(client->transport);
+        tun_destroy(client->tun);
+        free(client);
+        return NULL;
+    }
+    
+    // Optional adaptive payload compression (ZTNET_COMPRESS=1)
+    const char *compress = getenv("ZTNET_COMPRESS");
+    pc_init(&client->pcomp, compress && strcmp(compress, "1") == 0);
+
+    // Optionally relay for other members (ZTNET_RELAY=1)
+    const char *relay = getenv("ZTNET_RELAY");
+    client->relay_enabled = relay && strcmp(relay, "1") == 0;
+
+    // Optionally pin every peer to one path kind (ZTNET_PATH=direct|relay|peer-relay)
+    const char *forced = getenv("ZTNET_PATH");
+    client->forced_path = path_kind_parse(forced);
+    if (forced && forced[0] && client->forced_path < 0 && strcmp(forced, "auto") != 0) {
+        fprintf(stderr, "Unknown ZTNET_PATH '%s', using automatic path selection\n", forced);
+    }
     
     printf("Client created with ID: %llu\n", (unsigned long long)client->client_id);
     printf("Controller: %s:%d\n", controller_ip, controller_port);
     printf("TUN interface: %s\n", tun_get_name(client->tun));
+    printf("Payload compression: %s\n", client->pcomp.enabled ? "adaptive" : "off");
+    printf("Relay for other peers: %s\n", client->relay_enabled ? "on" : "off");
+
+    // Live counters for `zerrytee top` / `zerrytee metrics`; optional
+    client->stats = stats_create("client");
+    client->egress.stats = client->stats;
+
+    if (resume) {
+        state_restore(client);
+    } else {
+        state_save_identity(client);
+    }
     
     return client;
 }
@@ -186,7 +1012,7 @@ void client_destroy(client_t *client) {
         client_stop(client);
     }
     
-    if (client->connected) {
+    if (client_connected(client)) {
         client_disconnect(client);
     }
     
@@ -198,15 +1024,47 @@ void client_destroy(client_t *client) {
         tun_destroy(client->tun);
     }
     
+    egress_free(&client->egress);
+    client_free_queues(client);
+    hmap_free(&client->peer_index);
+    stats_destroy(client->stats);
+    cstate_close(client->state);
+    
     printf("Client destroyed\n");
     free(client);
 }
 
+// Print per-flow payload compression counters
+void client_print_flow_stats(client_t *client) {
+    if (!client || !client->pcomp.enabled) return;
+    pc_print_flows(&client->pcomp, stdout);
+}
+
+// Print per-peer path state: why traffic takes the path it does
+void client_print_peers(client_t *client) {
+    if (!client) return;
+    uint64_t now_us = monotonic_us();
+    printf("\n=== Peers (%d) ===\n", client->peer_count);
+    if (client->relay_enabled) {
+        printf("  Relayed for others: %llu packets, %llu bytes\n",
+               (unsigned long long)stats_read(client->stats, STAT_RELAY_PACKETS),
+               (unsigned long long)stats_read(client->stats, STAT_RELAY_BYTES));
+    }
+    for (int i = 0; i < client->peer_count; i++) {
+        client_peer_t *p = &client->peers[i];
+        printf("  Peer %llu (vIP %s) at %s:%d%s\n", (unsigned long long)p->id, p->virtual_ip,
+               inet_ntoa(p->addr.sin_addr), ntohs(p->addr.sin_port),
+               (p->flags & PEER_FLAG_RELAY) ? " [relay]" : "");
+        path_print(&p->paths, stdout, now_us);
+    }
+    printf("\n");
+}
+
 // Connect to controller
 int client_connect(client_t *client) {
     if (!client) return -1;
     
-    if (client->connected) {
+    if (client_connected(client)) {
         printf("Already connected to controller\n");
         return 0;
     }
@@ -220,35 +1078,46 @@ int client_connect(client_t *client) {
     
     // Send JOIN_REQUEST with network ID (+ optional HMAC password)
     printf("Sending JOIN_REQUEST to controller...\n");
+    // Ask for the address we had before a restart (a hint the controller
+    // honours while it is free)
+    uint32_t vip_hint = 0;
+    if (client->virtual_ip[0]) inet_pton(AF_INET, client->virtual_ip, &vip_hint);
+    uint16_t hint_len = vip_hint ? JOIN_VIP_HINT_LEN : 0;
     const char *pwd = getenv("ZTNET_PASSWORD");
     if (pwd && pwd[0]) {
         uint8_t nonce8[8]; RAND_bytes(nonce8, sizeof(nonce8));
-        uint8_t msg[NETWORK_ID_SIZE + 8 + 8];
+        uint64_t now = (uint64_t)time(NULL);
+        uint8_t msg[JOIN_AUTH_MSG_LEN];
         memcpy(msg, client->target_network_id, NETWORK_ID_SIZE);
         memcpy(msg + NETWORK_ID_SIZE, &client->client_id, 8);
         memcpy(msg + NETWORK_ID_SIZE + 8, nonce8, 8);
+        memcpy(msg + NETWORK_ID_SIZE + 16, &now, 8);
         uint8_t mac[32];
         if (hmac_sha256((const uint8_t*)pwd, strlen(pwd), msg, sizeof(msg), mac) != 0) {
             fprintf(stderr, "Failed to compute HMAC for JOIN\n");
             return -1;
         }
-        uint8_t payload[NETWORK_ID_SIZE + 8 + 8 + 32];
+        uint8_t payload[JOIN_REQUEST_AUTH_LEN + JOIN_VIP_HINT_LEN];
         memcpy(payload, msg, sizeof(msg));
         memcpy(payload + sizeof(msg), mac, 32);
+        memcpy(payload + JOIN_REQUEST_AUTH_LEN, &vip_hint, JOIN_VIP_HINT_LEN);
         if (transport_send(client->transport, &client->controller_addr,
                           PKT_JOIN_REQUEST, client->client_id, 0,
-                          payload, sizeof(payload)) != 0) {
+                          payload, JOIN_REQUEST_AUTH_LEN + hint_len) != 0) {
             return -1;
         }
     } else {
+        uint8_t payload[NETWORK_ID_SIZE + JOIN_VIP_HINT_LEN];
+        memcpy(payload, client->target_network_id, NETWORK_ID_SIZE);
+        memcpy(payload + NETWORK_ID_SIZE, &vip_hint, JOIN_VIP_HINT_LEN);
         if (transport_send(client->transport, &client->controller_addr,
                           PKT_JOIN_REQUEST, client->client_id, 0,
-                          client->target_network_id, NETWORK_ID_SIZE) != 0) {
+                          payload, NETWORK_ID_SIZE + hint_len) != 0) {
             return -1;
         }
     }
     
-    client->connected = true;
+    set_connected(client, true);
     printf("Connected to controller\n");
     
     return 0;
@@ -256,14 +1125,14 @@ int client_connect(client_t *client) {
 
 // Disconnect from controller
 int client_disconnect(client_t *client) {
-    if (!client || !client->connected) return -1;
+    if (!client || !client_connected(client)) return -1;
     
     // Send BYE
     printf("Sending BYE to controller...\n");
     transport_send(client->transport, &client->controller_addr,
                   PKT_BYE, client->client_id, 0, NULL, 0);
     
-    client->connected = false;
+    set_connected(client, false);
     printf("Disconnected from controller\n");
     
     return 0;
@@ -285,6 +1154,12 @@ int client_start(client_t *client) {
         client->running = false;
         return -1;
     }
+    if (pthread_create(&client->ctl_thread, NULL, client_control_run, client) != 0) {
+        perror("Failed to create client control thread");
+        client->running = false;
+        pthread_join(client->thread, NULL);
+        return -1;
+    }
     
     printf("Client started\n");
     return 0;
@@ -296,29 +1171,152 @@ void client_stop(client_t *client) {
     
     printf("Stopping client...\n");
     client->running = false;
+    ring_notify_signal(&client->ctl_notify);
     
     pthread_join(client->thread, NULL);
+    pthread_join(client->ctl_thread, NULL);
     printf("Client stopped\n");
 }
 
+// Forwarding thread: one datagram from the UDP socket
+static void handle_datagram(client_t *client, const packet_header_t *header,
+                            const uint8_t *data, int data_len, const struct sockaddr_in *sender) {
+    stats_inc(client->stats, STAT_RX_PACKETS);
+    stats_add(client->stats, STAT_RX_BYTES, sizeof(packet_header_t) + (uint64_t)data_len);
+    if (header->dest_id != 0 && header->dest_id != client->client_id) {
+        // Transit traffic between two other members
+        relay_packet(client, header, data, data_len);
+        return;
+    }
+    switch (header->type) {
+        case PKT_HELLO_ACK:
+        case PKT_JOIN_RESPONSE:
+        case PKT_PEER_INFO:
+        case PKT_MEMBER_SYNC:
+        case PKT_KEEPALIVE:
+        case PKT_REDIRECT:
+            // Control work (TUN and route setup fork `ip`) runs on
+            // the control thread, never in the forwarding loop
+            queue_control(client, header, data, data_len, sender);
+            break;
+
+        case PKT_PEER_HELLO:
+            // Hole punched from the other side; direct probes measure the path
+            printf("Received direct PEER_HELLO from peer %llu\n", (unsigned long long)header->sender_id);
+            break;
+
+        case PKT_PROBE: {
+            // Echo over the path the probe measured: back to whoever
+            // delivered it (the peer, a relay peer or the controller)
+            if (data_len < PATH_PROBE_LEN) break;
+            transport_send(client->transport, (struct sockaddr_in*)sender, PKT_PROBE_REPLY,
+                           client->client_id, header->sender_id, data, (uint16_t)data_len);
+            break; }
+
+        case PKT_PROBE_REPLY: {
+            client_peer_t *src = find_peer_by_id(client, header->sender_id);
+            if (src) {
+                path_on_reply(&src->paths, data, (size_t)data_len, monotonic_us());
+            }
+            break; }
+            
+        case PKT_DATA: {
+            if (data_len > AEAD_NONCE_SIZE) {
+                const uint8_t *nonce = data;
+                const uint8_t *ct = data + AEAD_NONCE_SIZE;
+                size_t ct_len = (size_t)(data_len - AEAD_NONCE_SIZE);
+                uint8_t key[AEAD_KEY_SIZE];
+                derive_session_key(client->client_id, header->sender_id, key);
+                uint8_t plain[MAX_PACKET_SIZE]; size_t p_len = 0;
+                if (aead_decrypt_chacha20poly1305(key, nonce, ct, ct_len, plain, &p_len) == 0) {
+                    // Expand LZ-compressed payloads
+                    uint8_t unpacked[TUN_MTU + HC_MAX_EXPANSION];
+                    const uint8_t *frame = plain;
+                    int frame_len = (int)p_len;
+                    if (p_len > 0 && plain[0] == PC_FRAME) {
+                        frame_len = pc_decompress(plain, p_len, unpacked, sizeof(unpacked));
+                        frame = unpacked;
+                    }
+                    // Restore compressed inner headers
+                    client_peer_t *src = find_peer_by_id(client, header->sender_id);
+                    uint8_t pkt[TUN_MTU];
+                    uint8_t nack_cid = 0;
+                    int pkt_len = HC_ERR_MALFORMED;
+                    if (frame_len <= 0) {
+                        fprintf(stderr, "payload decompression failed\n");
+                        stats_inc(client->stats, STAT_DROP_MALFORMED);
+                    } else if (src) {
+                        pkt_len = hc_decompress(&src->hc, frame, (size_t)frame_len, pkt, sizeof(pkt), &nack_cid);
+                    } else if (!hc_is_frame(frame, (size_t)frame_len) && frame_len <= (int)sizeof(pkt)) {
+                        memcpy(pkt, frame, (size_t)frame_len);
+                        pkt_len = frame_len;
+                    }
+                    // Propagate congestion marks from the outer header
+                    if (pkt_len > 0 &&
+                        egress_ecn_decap(pkt, (size_t)pkt_len, client->transport->last_rx_tos) != 0) {
+                        stats_inc(client->stats, STAT_DROP_ECN);
+                        pkt_len = 0;
+                    }
+                    if (pkt_len == HC_ERR_RESYNC) {
+                        printf("recv: lost header context %u from %llu, requesting refresh\n",
+                               nack_cid, (unsigned long long)header->sender_id);
+                        stats_inc(client->stats, STAT_DROP_HC_RESYNC);
+                        send_to_peer(client, src, PKT_HC_NACK, &nack_cid, 1);
+                    } else if (pkt_len == HC_ERR_RESYNC_PENDING) {
+                        stats_inc(client->stats, STAT_DROP_HC_RESYNC);
+                    } else if (pkt_len < 0 && frame_len > 0) {
+                        stats_inc(client->stats, STAT_DROP_MALFORMED);
+                    } else if (client->tun && pkt_len > 0) {
+                        tun_write(client->tun, pkt, (size_t)pkt_len);
+                        stats_inc(client->stats, STAT_TUN_TX_PACKETS);
+                        if (src) {
+                            stats_peer_add(client->stats, src->stats_slot, PSTAT_RX_PACKETS, 1);
+                            stats_peer_add(client->stats, src->stats_slot, PSTAT_RX_BYTES, (uint64_t)data_len);
+                        }
+                    }
+                } else {
+                    fprintf(stderr, "decryption failed\n");
+                    stats_inc(client->stats, STAT_DECRYPT_FAIL);
+                    client_peer_t *src = find_peer_by_id(client, header->sender_id);
+                    if (src) stats_peer_add(client->stats, src->stats_slot, PSTAT_DECRYPT_FAIL, 1);
+                }
+            }
+            break; }
+
+        case PKT_HC_NACK: {
+            client_peer_t *src = find_peer_by_id(client, header->sender_id);
+            if (src && data_len >= 1) {
+                hc_handle_nack(&src->hc, data[0]);
+            }
+            break; }
+            
+        default:
+            printf("Unknown packet type: %d\n", header->type);
+            break;
+    }
+}
+
 // Client main loop
 void* client_run(void *arg) {
     client_t *client = (client_t*)arg;
     
-    time_t last_keepalive = time(NULL);
+    time_t last_state_save = time(NULL);
     uint8_t tun_buffer[1500];
     
     printf("Client thread started\n");
+    affinity_pin(&client->affinity, AFF_IO, "client");
     
     while (client->running) {
         time_t now = time(NULL);
         
         // Setup select for both TUN and UDP socket
-        fd_set read_fds;
+        fd_set read_fds, write_fds;
         struct timeval timeout;
         int max_fd = 0;
+        bool egress_blocked = egress_pending(&client->egress);
         
         FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
         
         // Add TUN file descriptor
         if (client->tun) {
@@ -327,169 +1325,102 @@ void* client_run(void *arg) {
             if (tun_fd > max_fd) max_fd = tun_fd;
         }
         
+        // Peer updates from the control thread
+        FD_SET(client->cmd_notify.rfd, &read_fds);
+        if (client->cmd_notify.rfd > max_fd) max_fd = client->cmd_notify.rfd;
+        
         // Add UDP socket
         if (client->transport) {
             FD_SET(client->transport->socket_fd, &read_fds);
+            // Wait for room in the socket while egress queues are backed up
+            if (egress_blocked) FD_SET(client->transport->socket_fd, &write_fds);
             if (client->transport->socket_fd > max_fd) max_fd = client->transport->socket_fd;
         }
         
         timeout.tv_sec = 0;
         timeout.tv_usec = 100000; // 100ms
         
-        int ready = select(max_fd + 1, &read_fds, NULL, NULL, &timeout);
+        int ready = select(max_fd + 1, &read_fds, &write_fds, NULL, &timeout);
         
         if (ready < 0 && errno != EINTR) {
             perror("select failed");
             break;
         }
         
-        // Read from TUN interface (packets from OS to forward to network)
+        if (ready < 0) {
+            FD_ZERO(&read_fds);
+            FD_ZERO(&write_fds);
+        }
+        
+        if (FD_ISSET(client->cmd_notify.rfd, &read_fds)) {
+            ring_notify_drain(&client->cmd_notify);
+        }
+        apply_peer_updates(client);
+        
+        // Read a batch from TUN (packets from OS to forward to network),
+        // classify into egress queues, then drain them in priority order
         if (client->tun && FD_ISSET(tun_get_fd(client->tun), &read_fds)) {
-            int n = tun_read(client->tun, tun_buffer, sizeof(tun_buffer));
-            if (n > 0) {
+            for (int i = 0; i < EGRESS_READ_BATCH; i++) {
+                int n = tun_read(client->tun, tun_buffer, sizeof(tun_buffer));
+                if (n <= 0) break;
+                stats_inc(client->stats, STAT_TUN_RX_PACKETS);
                 // Forward based on destination virtual IP (unicast)
                 forward_ip_packet_to_peer(client, tun_buffer, n);
             }
         }
+        if (egress_pending(&client->egress)) {
+            egress_flush(&client->egress, client->transport);
+        }
         
-        // Receive packets from network (UDP)
+        // Receive a batch from the network (UDP), bounded like the TUN side
+        // so neither direction starves the other, then send what it queued
         if (client->transport && FD_ISSET(client->transport->socket_fd, &read_fds)) {
-            packet_header_t header;
-            uint8_t data[MAX_PACKET_SIZE];
-            struct sockaddr_in sender;
-            
-            int data_len = transport_receive(client->transport, &header, data, &sender);
-            
-            if (data_len >= 0) {
-                // Handle packet based on type
-                switch (header.type) {
-                    case PKT_HELLO_ACK:
-                        printf("Received HELLO_ACK from controller\n");
-                        break;
-                        
-                    case PKT_JOIN_RESPONSE:
-                        if (data_len == 4) {
-                            printf("Received JOIN_RESPONSE - Successfully joined network!\n");
-                            uint32_t vip_net;
-                            memcpy(&vip_net, data, sizeof(uint32_t));
-                            struct in_addr vip; vip.s_addr = vip_net;
-                            inet_ntop(AF_INET, &vip, client->virtual_ip, sizeof(client->virtual_ip));
-                            printf("Assigned virtual IP: %s\n", client->virtual_ip);
-                            // Configure TUN with assigned IP
-                            if (client->tun) {
-                                tun_configure(client->tun, client->virtual_ip, OVERLAY_NETMASK);
-                                tun_up(client->tun);
-                                printf("TUN interface configured with IP: %s\n", client->virtual_ip);
-                                // Install overlay route automatically
-                                install_overlay_route(client->tun);
-                            }
-                            client->connected = true;
-                        } else {
-                            fprintf(stderr, "JOIN denied by controller (network ID mismatch or policy).\n");
-                            // Stop client loop gracefully
-                            client->running = false;
-                        }
-                        break;
-                        
-                    case PKT_PEER_INFO: {
-                        if (data_len == (int)(sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint16_t))) {
-                            uint64_t pid; uint32_t vip_net; uint32_t ip_be; uint16_t port_be;
-                            memcpy(&pid, data, sizeof(uint64_t));
-                            memcpy(&vip_net, data + 8, sizeof(uint32_t));
-                            memcpy(&ip_be, data + 12, sizeof(uint32_t));
-                            memcpy(&port_be, data + 16, sizeof(uint16_t));
-
-                            char vip_str[16];
-                            struct in_addr vip; vip.s_addr = vip_net;
-                            inet_ntop(AF_INET, &vip, vip_str, sizeof(vip_str));
-
-                            // Build socket address
-                            struct sockaddr_in paddr; memset(&paddr, 0, sizeof(paddr));
-                            paddr.sin_family = AF_INET;
-                            paddr.sin_addr.s_addr = ip_be;   // already BE
-                            paddr.sin_port = port_be;         // already BE
-
-                            // Add to local peer list if not exists
-                            bool exists = false;
-                            for (int i = 0; i < client->peer_count; i++) {
-                                if (client->peers[i].id == pid) { exists = true; break; }
-                            }
-                            if (!exists && client->peer_count < CLIENT_MAX_PEERS) {
-                                client_peer_t *cp = &client->peers[client->peer_count++];
-                                cp->id = pid; cp->addr = paddr; cp->reachable = false;
-                                strncpy(cp->virtual_ip, vip_str, sizeof(cp->virtual_ip) - 1);
-                                printf("Discovered peer %llu at %s:%d (vIP %s)\n",
-                                       (unsigned long long)pid,
-                                       inet_ntoa(paddr.sin_addr), ntohs(paddr.sin_port), vip_str);
-
-                                // Send direct hello to peer
-                                transport_send(client->transport, &cp->addr, PKT_PEER_HELLO,
-                                               client->client_id, cp->id, NULL, 0);
-                            }
-                        }
-                        break; }
-
-                    case PKT_PEER_HELLO:
-                        printf("Received direct PEER_HELLO from peer %llu\n", (unsigned long long)header.sender_id);
-                        // Mark peer as reachable
-                        for (int i = 0; i < client->peer_count; i++) {
-                            if (client->peers[i].id == header.sender_id) {
-                                client->peers[i].reachable = true;
-                                break;
-                            }
-                        }
-                        break;
-                        
-                    case PKT_KEEPALIVE:
-                        // Send keepalive back
-                        transport_send_keepalive(client->transport, 
-                                               &client->controller_addr,
-                                               client->client_id, header.sender_id);
-                        break;
-                        
-                    case PKT_DATA: {
-                        printf("recv: PKT_DATA from %llu len=%d, decrypting\n",
-                               (unsigned long long)header.sender_id, data_len);
-                        if (data_len > AEAD_NONCE_SIZE) {
-                            const uint8_t *nonce = data;
-                            const uint8_t *ct = data + AEAD_NONCE_SIZE;
-                            size_t ct_len = (size_t)(data_len - AEAD_NONCE_SIZE);
-                            uint8_t key[AEAD_KEY_SIZE];
-                            derive_session_key(client->client_id, header.sender_id, key);
-                            uint8_t plain[MAX_PACKET_SIZE]; size_t p_len = 0;
-                            if (aead_decrypt_chacha20poly1305(key, nonce, ct, ct_len, plain, &p_len) == 0) {
-                                if (client->tun && p_len > 0) {
-                                    tun_write(client->tun, plain, (int)p_len);
-                                    printf("recv: wrote %zu bytes to TUN\n", p_len);
-                                }
-                            } else {
-                                fprintf(stderr, "decryption failed\n");
-                            }
-                        }
-                        break; }
-                        
-                    default:
-                        printf("Unknown packet type: %d\n", header.type);
-                        break;
-                }
+            for (int i = 0; i < CLIENT_RX_BATCH; i++) {
+                packet_header_t header;
+                uint8_t data[MAX_PACKET_SIZE];
+                struct sockaddr_in sender;
+                int data_len = transport_receive(client->transport, &header, data, &sender);
+                if (data_len < 0) break;
+                handle_datagram(client, &header, data, data_len, &sender);
             }
         }
+        if (egress_pending(&client->egress)) {
+            egress_flush(&client->egress, client->transport);
+        }
         
-        // Send keepalives periodically
-        if (client->connected && now - last_keepalive >= KEEPALIVE_INTERVAL) {
-            transport_send_keepalive(client->transport, &client->controller_addr,
-                                    client->client_id, 0);
-            last_keepalive = now;
+        // Refresh the cached path measurements
+        if (client->state && now - last_state_save >= KEEPALIVE_INTERVAL) {
+            for (int i = 0; i < client->peer_count; i++) {
+                state_save_peer(client, &client->peers[i]);
+            }
+            cstate_flush(client->state);
+            last_state_save = now;
         }
 
-        // Probe peers for NAT hole punching until reachable
+        // Probe every candidate path of every peer (direct probes also keep
+        // NAT mappings open) and re-evaluate the active path. Relays are
+        // re-chosen at the probe cadence (RTTs change no faster) or when
+        // the set of relays changed.
+        uint64_t now_us = monotonic_us();
+        bool relay_due = now_us >= client->relay_eval_us;
+        if (relay_due) client->relay_eval_us = now_us + PATH_PROBE_INTERVAL_US;
         for (int i = 0; i < client->peer_count; i++) {
             client_peer_t *p = &client->peers[i];
-            if (p->reachable) continue;
-            if (p->last_probe == 0 || now - p->last_probe >= 1) { // every ~1s
-                transport_send(client->transport, &p->addr, PKT_PEER_HELLO,
-                               client->client_id, p->id, NULL, 0);
-                p->last_probe = now;
+            if (relay_due) choose_relay(client, p, now_us);
+            for (int k = 0; k < PATH_KINDS; k++) {
+                if (k == PATH_PEER_RELAY && p->paths.relay_id == 0) continue;
+                if (!path_probe_due(&p->paths, (path_kind_t)k, now_us)) continue;
+                uint8_t probe[PATH_PROBE_LEN];
+                path_make_probe(&p->paths, (path_kind_t)k, now_us, probe);
+                transport_send(client->transport, path_dest(client, p, (path_kind_t)k), PKT_PROBE,
+                               client->client_id, p->id, probe, sizeof(probe));
+            }
+            if (path_select(&p->paths, now_us)) {
+                const path_stats_t *ps = &p->paths.path[p->paths.active];
+                printf("Peer %llu: now using %s path (%s, srtt=%.2fms loss=%.0f%%)\n",
+                       (unsigned long long)p->id, path_kind_name(p->paths.active),
+                       path_reason_name(p->paths.reason), ps->srtt_us / 1000.0, ps->loss * 100.0);
+                state_save_peer(client, p);
             }
         }
     }
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include "../include/egress.h"
+
+// DSCP code points (RFC 4594)
+#define DSCP_CS1 8
+#define DSCP_AF11 10
+#define DSCP_AF13 14
+#define DSCP_CS5 40
+#define DSCP_EF 46
+
+// Queue slots are the packet pool of the I/O thread, so they are placed on
+// its NUMA node (aff may be NULL)
+int egress_init(egress_t *eg, const affinity_t *aff) {
+    if (!eg) return -1;
+    memset(eg, 0, sizeof(*eg));
+    const uint32_t caps[EGRESS_CLASSES] = { EGRESS_HIGH_LEN, EGRESS_NORMAL_LEN, EGRESS_BULK_LEN };
+    for (int c = 0; c < EGRESS_CLASSES; c++) {
+        eg->q[c].slots = (egress_pkt_t*)affinity_alloc(aff, AFF_IO, caps[c] * sizeof(egress_pkt_t));
+        if (!eg->q[c].slots) {
+            perror("Failed to allocate egress queue");
+            egress_free(eg);
+            return -1;
+        }
+        eg->q[c].cap = caps[c];
+    }
+    return 0;
+}
+
+void egress_free(egress_t *eg) {
+    if (!eg) return;
+    for (int c = 0; c < EGRESS_CLASSES; c++) {
+        affinity_free(eg->q[c].slots, eg->q[c].cap * sizeof(egress_pkt_t));
+        eg->q[c].slots = NULL;
+    }
+}
+
+// TOS byte of the inner packet (IPv4 TOS / IPv6 traffic class)
+uint8_t egress_inner_tos(const uint8_t *pkt, size_t len) {
+    if (!pkt || len < 2) return 0;
+    switch (pkt[0] >> 4) {
+        case 4: return pkt[1];
+        case 6: return (uint8_t)(((pkt[0] & 0x0F) << 4) | (pkt[1] >> 4));
+        default: return 0;
+    }
+}
+
+static bool is_interactive_port(uint16_t port) {
+    switch (port) {
+        case 53:    // DNS
+        case 123:   // NTP
+        case 3478:  // STUN/TURN
+        case 5060:  // SIP
+        case 5061:  // SIP-TLS
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Map an inner packet to a queue: DSCP first, then protocol and ports.
+// ICMP and SSH only count as interactive while small, so scp/rsync/sftp
+// and ping floods stay out of the high class.
+egress_class_t egress_classify(const uint8_t *pkt, size_t len) {
+    if (!pkt || len < 20) return EGRESS_NORMAL;
+
+    uint8_t dscp = egress_inner_tos(pkt, len) >> 2;
+    if (dscp == DSCP_EF || dscp >= DSCP_CS5) {
+        return EGRESS_HIGH;
+    }
+    if (dscp == DSCP_CS1 || (dscp >= DSCP_AF11 && dscp <= DSCP_AF13)) {
+        return EGRESS_BULK;
+    }
+
+    uint8_t proto;
+    size_t l4_off;
+    bool first_frag = true;
+    if ((pkt[0] >> 4) == 4) {
+        if ((pkt[0] & 0x0F) < 5) return EGRESS_NORMAL;
+        proto = pkt[9];
+        l4_off = (size_t)(pkt[0] & 0x0F) * 4;
+        first_frag = (((pkt[6] & 0x1F) << 8) | pkt[7]) == 0;
+    } else if ((pkt[0] >> 4) == 6 && len >= 40) {
+        proto = pkt[6];
+        l4_off = 40;
+    } else {
+        return EGRESS_NORMAL;
+    }
+    bool small = len <= EGRESS_SMALL_PKT;
+    if (proto == IPPROTO_ICMP || proto == IPPROTO_ICMPV6) return small ? EGRESS_HIGH : EGRESS_NORMAL;
+    // Later fragments carry payload where the ports would be
+    if (first_frag && (proto == IPPROTO_TCP || proto == IPPROTO_UDP) && len >= l4_off + 4) {
+        uint16_t sport = (uint16_t)((pkt[l4_off] << 8) | pkt[l4_off + 1]);
+        uint16_t dport = (uint16_t)((pkt[l4_off + 2] << 8) | pkt[l4_off + 3]);
+        if (is_interactive_port(sport) || is_interactive_port(dport)) return EGRESS_HIGH;
+        if (small && proto == IPPROTO_TCP && (sport == 22 || dport == 22)) return EGRESS_HIGH;
+    }
+    return EGRESS_NORMAL;
+}
+
+// Reserve the tail slot of a class queue to build a datagram in place.
+// Returns NULL (and counts a drop) when the class queue is full.
+egress_pkt_t* egress_reserve(egress_t *eg, egress_class_t cls) {
+    egress_queue_t *q = &eg->q[cls];
+    if (q->count >= q->cap) {
+        q->dropped++;
+        return NULL;
+    }
+    return &q->slots[(q->head + q->count) % q->cap];
+}
+
+void egress_commit(egress_t *eg, egress_class_t cls) {
+    egress_queue_t *q = &eg->q[cls];
+    q->count++;
+    q->enqueued++;
+}
+
+bool egress_pending(const egress_t *eg) {
+    for (int c = 0; c < EGRESS_CLASSES; c++) {
+        if (eg->q[c].count > 0) return true;
+    }
+    return false;
+}
+
+static egress_class_t next_class(egress_t *eg) {
+    bool high = eg->q[EGRESS_HIGH].count > 0;
+    bool normal = eg->q[EGRESS_NORMAL].count > 0;
+    bool bulk = eg->q[EGRESS_BULK].count > 0;
+    if (high && ((!normal && !bulk) || eg->high_credit < EGRESS_HIGH_WEIGHT)) {
+        eg->high_credit++;
+        return EGRESS_HIGH;
+    }
+    eg->high_credit = 0;
+    if (normal && (!bulk || eg->normal_credit < EGRESS_NORMAL_WEIGHT)) {
+        eg->normal_credit++;
+        return EGRESS_NORMAL;
+    }
+    eg->normal_credit = 0;
+    return bulk ? EGRESS_BULK : EGRESS_CLASSES;
+}
+
+// Drain queues in weighted priority order until empty or the socket is full.
+// Returns 1 if packets remain queued (wait for writability), 0 otherwise.
+int egress_flush(egress_t *eg, transport_t *trans) {
+    if (!eg || !trans) return 0;
+    for (;;) {
+        egress_class_t cls = next_class(eg);
+        if (cls == EGRESS_CLASSES) return 0;
+        egress_queue_t *q = &eg->q[cls];
+        egress_pkt_t *p = &q->slots[q->head];
+        if (transport_send_raw(trans, &p->dest, p->data, p->len, p->tos) != 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) return 1;
+            perror("Failed to send queued packet");
+            q->dropped++;
+            stats_inc(eg->stats, STAT_DROP_SEND);
+        } else {
+            q->sent++;
+        }
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+    }
+}
+
+// RFC 6040 decapsulation: copy an outer CE mark into an ECN-capable inner
+// packet (fixing the IPv4 checksum incrementally). Returns -1 when the
+// packet must be dropped (outer CE on a Not-ECT inner packet).
+int egress_ecn_decap(uint8_t *pkt, size_t len, uint8_t outer_tos) {
+    if (!pkt || len < 20 || (outer_tos & ECN_MASK) != ECN_CE) return 0;
+
+    uint8_t inner_ecn = egress_inner_tos(pkt, len) & ECN_MASK;
+    if (inner_ecn == ECN_CE) return 0;
+    if (inner_ecn == ECN_NOT_ECT) return -1;
+
+    if ((pkt[0] >> 4) == 4) {
+        uint16_t old_word = (uint16_t)((pkt[0] << 8) | pkt[1]);
+        pkt[1] |= ECN_CE;
+        uint16_t new_word = (uint16_t)((pkt[0] << 8) | pkt[1]);
+        // RFC 1624: HC' = ~(~HC + ~m + m')
+        uint32_t sum = (uint16_t)~((pkt[10] << 8) | pkt[11]);
+        sum += (uint16_t)~old_word;
+        sum += new_word;
+        while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+        uint16_t csum = (uint16_t)~sum;
+        pkt[10] = (uint8_t)(csum >> 8);
+        pkt[11] = (uint8_t)csum;
+    } else {
+        // IPv6: the ECN bits of the traffic class are bits 4-5 of byte 1
+        pkt[1] |= (uint8_t)(ECN_CE << 4);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/fib.h"
+
+#define FIB_MASK (FIB_SLOTS - 1)
+
+static inline uint32_t fib_hash(const uint8_t addr[FIB_ADDR_SIZE]) {
+    uint64_t a, b;
+    memcpy(&a, addr, sizeof(uint64_t));
+    memcpy(&b, addr + 8, sizeof(uint64_t));
+    uint64_t h = (a ^ (b * 0x9E3779B97F4A7C15ULL)) * 0xBF58476D1CE4E5B9ULL;
+    return (uint32_t)(h >> 32) & FIB_MASK;
+}
+
+void fib_init(fib_t *fib) {
+    if (!fib) return;
+    memset(fib, 0, sizeof(*fib));
+    for (int i = 0; i < FIB_SLOTS; i++) {
+        fib->entries[i].peer_idx = -1;
+    }
+}
+
+// Insert or replace a mapping (linear probing, load kept <= 1/2)
+int fib_insert(fib_t *fib, const uint8_t addr[FIB_ADDR_SIZE], int peer_idx) {
+    if (!fib || !addr || peer_idx < 0) return -1;
+
+    uint32_t i = fib_hash(addr);
+    for (;;) {
+        fib_entry_t *e = &fib->entries[i];
+        if (e->peer_idx < 0) {
+            if (fib->count >= FIB_SLOTS / 2) {
+                fprintf(stderr, "Forwarding table full\n");
+                return -1;
+            }
+            memcpy(e->addr, addr, FIB_ADDR_SIZE);
+            e->peer_idx = peer_idx;
+            fib->count++;
+            return 0;
+        }
+        if (memcmp(e->addr, addr, FIB_ADDR_SIZE) == 0) {
+            e->peer_idx = peer_idx;
+            return 0;
+        }
+        i = (i + 1) & FIB_MASK;
+    }
+}
+
+// Remove a mapping, back-shifting the probe chain so lookups need no tombstones
+int fib_remove(fib_t *fib, const uint8_t addr[FIB_ADDR_SIZE]) {
+    if (!fib || !addr) return -1;
+
+    uint32_t i = fib_hash(addr);
+    while (fib->entries[i].peer_idx >= 0) {
+        if (memcmp(fib->entries[i].addr, addr, FIB_ADDR_SIZE) == 0) {
+            uint32_t hole = i;
+            uint32_t j = (i + 1) & FIB_MASK;
+            while (fib->entries[j].peer_idx >= 0) {
+                uint32_t home = fib_hash(fib->entries[j].addr);
+                // Move j into the hole unless its home lies cyclically in (hole, j]
+                if (((j - home) & FIB_MASK) >= ((j - hole) & FIB_MASK)) {
+                    fib->entries[hole] = fib->entries[j];
+                    hole = j;
+                }
+                j = (j + 1) & FIB_MASK;
+            }
+            fib->entries[hole].peer_idx = -1;
+            fib->count--;
+            return 0;
+        }
+        i = (i + 1) & FIB_MASK;
+    }
+    return -1;
+}
+
+int fib_lookup(const fib_t *fib, const uint8_t addr[FIB_ADDR_SIZE]) {
+    uint32_t i = fib_hash(addr);
+    for (;;) {
+        const fib_entry_t *e = &fib->entries[i];
+        if (e->peer_idx < 0) return -1;
+        if (memcmp(e->addr, addr, FIB_ADDR_SIZE) == 0) return e->peer_idx;
+        i = (i + 1) & FIB_MASK;
+    }
+}
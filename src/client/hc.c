@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include "../include/hc.h"
+#include "../include/clock.h"
+
+#define IPV4_HDR_LEN 20
+#define UDP_HDR_LEN 8
+#define TCP_HDR_LEN 20
+#define HC_FRAME_HDR 3           // type, cid, gen
+#define HC_UDP_FIELDS 4          // ip id, udp csum
+#define HC_TCP_FIELDS 18         // ip id, seq, ack, off+flags, win, csum, urg
+
+static uint16_t ipv4_checksum(const uint8_t *hdr) {
+    uint32_t sum = 0;
+    for (int i = 0; i < IPV4_HDR_LEN; i += 2) {
+        sum += (uint32_t)((hdr[i] << 8) | hdr[i + 1]);
+    }
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return htons((uint16_t)~sum);
+}
+
+static bool flow_equal(const hc_flow_t *a, const hc_flow_t *b) {
+    return a->src == b->src && a->dst == b->dst && a->sport == b->sport &&
+           a->dport == b->dport && a->proto == b->proto && a->tos == b->tos &&
+           a->ttl == b->ttl && a->frag == b->frag;
+}
+
+static uint8_t flow_cid(const hc_flow_t *f) {
+    uint32_t h = f->src * 0x9E3779B1u;
+    h ^= f->dst * 0x85EBCA77u;
+    h ^= ((uint32_t)f->sport << 16 | f->dport) * 0xC2B2AE3Du;
+    h ^= f->proto;
+    h ^= h >> 15;
+    return (uint8_t)(h % HC_MAX_CONTEXTS);
+}
+
+// Parse an IPv4 TCP/UDP packet into its static flow fields. Returns the L4
+// header length, or 0 when the packet is not a candidate for compression.
+static size_t parse_flow(const uint8_t *pkt, size_t len, hc_flow_t *f) {
+    if (len < IPV4_HDR_LEN || pkt[0] != 0x45) return 0;
+    uint16_t tot_len = (uint16_t)((pkt[2] << 8) | pkt[3]);
+    uint16_t frag;
+    memcpy(&frag, pkt + 6, sizeof(frag));
+    // Only unfragmented packets (DF allowed) whose length matches the buffer
+    if (tot_len != len || (ntohs(frag) & 0xBFFF) != 0) return 0;
+
+    memset(f, 0, sizeof(*f));
+    f->tos = pkt[1];
+    f->frag = frag;
+    f->ttl = pkt[8];
+    f->proto = pkt[9];
+    memcpy(&f->src, pkt + 12, sizeof(uint32_t));
+    memcpy(&f->dst, pkt + 16, sizeof(uint32_t));
+
+    const uint8_t *l4 = pkt + IPV4_HDR_LEN;
+    size_t l4_len = len - IPV4_HDR_LEN;
+    size_t hdr_len;
+    if (f->proto == IPPROTO_UDP) {
+        if (l4_len < UDP_HDR_LEN) return 0;
+        if (((l4[4] << 8) | l4[5]) != (int)l4_len) return 0;
+        hdr_len = UDP_HDR_LEN;
+    } else if (f->proto == IPPROTO_TCP) {
+        if (l4_len < TCP_HDR_LEN) return 0;
+        hdr_len = (size_t)(l4[12] >> 4) * 4;
+        if (hdr_len < TCP_HDR_LEN || hdr_len > l4_len) return 0;
+    } else {
+        return 0;
+    }
+    memcpy(&f->sport, l4, sizeof(uint16_t));
+    memcpy(&f->dport, l4 + 2, sizeof(uint16_t));
+    return hdr_len;
+}
+
+void hc_init(hc_state_t *hc) {
+    if (!hc) return;
+    memset(hc, 0, sizeof(*hc));
+}
+
+bool hc_is_frame(const uint8_t *buf, size_t len) {
+    return len >= HC_FRAME_HDR && buf[0] >= HC_IR && buf[0] <= HC_CO_TCP;
+}
+
+static int emit_raw(const uint8_t *pkt, size_t len, uint8_t *out, size_t out_cap) {
+    if (len > out_cap) return -1;
+    memcpy(out, pkt, len);
+    return (int)len;
+}
+
+// Compress one packet into out. Packets that cannot be compressed (IPv6,
+// options, fragments, other protocols) are copied through unchanged.
+int hc_compress(hc_state_t *hc, const uint8_t *pkt, size_t len, uint8_t *out, size_t out_cap) {
+    if (!hc || !pkt || !out) return -1;
+
+    hc_flow_t flow;
+    size_t l4_hdr = parse_flow(pkt, len, &flow);
+    if (l4_hdr == 0) return emit_raw(pkt, len, out, out_cap);
+
+    uint8_t cid = flow_cid(&flow);
+    hc_comp_ctx_t *ctx = &hc->comp[cid];
+    if (!ctx->valid || !flow_equal(&ctx->flow, &flow)) {
+        // New flow (or cid collision, or TOS/TTL change): start a new generation
+        ctx->flow = flow;
+        ctx->gen = (uint8_t)(ctx->gen + 1);
+        ctx->ir_remaining = HC_IR_COUNT;
+        ctx->valid = true;
+    } else if (++ctx->since_refresh >= HC_REFRESH_PACKETS) {
+        ctx->ir_remaining = 1;
+    }
+
+    if (ctx->ir_remaining > 0) {
+        if (len + HC_FRAME_HDR > out_cap) return emit_raw(pkt, len, out, out_cap);
+        out[0] = HC_IR;
+        out[1] = cid;
+        out[2] = ctx->gen;
+        memcpy(out + HC_FRAME_HDR, pkt, len);
+        ctx->ir_remaining--;
+        ctx->since_refresh = 0;
+        return (int)(len + HC_FRAME_HDR);
+    }
+
+    const uint8_t *l4 = pkt + IPV4_HDR_LEN;
+    const uint8_t *payload = l4 + l4_hdr;
+    size_t payload_len = len - IPV4_HDR_LEN - l4_hdr;
+    size_t n = HC_FRAME_HDR;
+    out[1] = cid;
+    out[2] = ctx->gen;
+    memcpy(out + n, pkt + 4, 2); n += 2;                 // IP ID
+    if (flow.proto == IPPROTO_UDP) {
+        out[0] = HC_CO_UDP;
+        memcpy(out + n, l4 + 6, 2); n += 2;              // UDP checksum
+    } else {
+        out[0] = HC_CO_TCP;
+        memcpy(out + n, l4 + 4, 16); n += 16;            // seq..urg
+        memcpy(out + n, l4 + TCP_HDR_LEN, l4_hdr - TCP_HDR_LEN);
+        n += l4_hdr - TCP_HDR_LEN;                       // options
+    }
+    if (n + payload_len > out_cap) return emit_raw(pkt, len, out, out_cap);
+    memcpy(out + n, payload, payload_len);
+    n += payload_len;
+    hc->bytes_saved += len - n;
+    return (int)n;
+}
+
+static void write_ipv4_header(const hc_flow_t *f, const uint8_t ip_id[2], size_t tot_len, uint8_t *out) {
+    out[0] = 0x45;
+    out[1] = f->tos;
+    out[2] = (uint8_t)(tot_len >> 8);
+    out[3] = (uint8_t)tot_len;
+    memcpy(out + 4, ip_id, 2);
+    memcpy(out + 6, &f->frag, 2);
+    out[8] = f->ttl;
+    out[9] = f->proto;
+    out[10] = out[11] = 0;
+    memcpy(out + 12, &f->src, 4);
+    memcpy(out + 16, &f->dst, 4);
+    uint16_t csum = ipv4_checksum(out);
+    memcpy(out + 10, &csum, 2);
+}
+
+// Reverse hc_compress(). Raw IP packets are copied through. Returns the
+// packet length, HC_ERR_MALFORMED, or HC_ERR_RESYNC with *nack_cid set when
+// the sender should be asked to refresh that context (HC_ERR_RESYNC_PENDING
+// while the last request is still within HC_NACK_INTERVAL_MS).
+int hc_decompress(hc_state_t *hc, const uint8_t *in, size_t len,
+                  uint8_t *out, size_t out_cap, uint8_t *nack_cid) {
+    if (!hc || !in || !out || len == 0) return HC_ERR_MALFORMED;
+    if (!hc_is_frame(in, len)) return emit_raw(in, len, out, out_cap);
+
+    uint8_t type = in[0];
+    uint8_t cid = in[1];
+    uint8_t gen = in[2];
+    if (cid >= HC_MAX_CONTEXTS) return HC_ERR_MALFORMED;
+    hc_decomp_ctx_t *ctx = &hc->decomp[cid];
+
+    if (type == HC_IR) {
+        hc_flow_t flow;
+        const uint8_t *pkt = in + HC_FRAME_HDR;
+        size_t pkt_len = len - HC_FRAME_HDR;
+        if (parse_flow(pkt, pkt_len, &flow) == 0) return HC_ERR_MALFORMED;
+        ctx->flow = flow;
+        ctx->gen = gen;
+        ctx->valid = true;
+        return emit_raw(pkt, pkt_len, out, out_cap);
+    }
+
+    if (!ctx->valid || ctx->gen != gen) {
+        // Lost IR: drop and ask for a refresh (rate limited per context)
+        uint64_t now = monotonic_us() / 1000;
+        if (now - ctx->last_nack_ms < HC_NACK_INTERVAL_MS) return HC_ERR_RESYNC_PENDING;
+        ctx->last_nack_ms = now;
+        hc->resyncs++;
+        if (nack_cid) *nack_cid = cid;
+        return HC_ERR_RESYNC;
+    }
+
+    const hc_flow_t *f = &ctx->flow;
+    const uint8_t *p = in + HC_FRAME_HDR;
+    size_t remaining = len - HC_FRAME_HDR;
+    uint8_t *l4 = out + IPV4_HDR_LEN;
+
+    if (type == HC_CO_UDP) {
+        if (f->proto != IPPROTO_UDP || remaining < HC_UDP_FIELDS) return HC_ERR_MALFORMED;
+        size_t payload_len = remaining - HC_UDP_FIELDS;
+        size_t tot_len = IPV4_HDR_LEN + UDP_HDR_LEN + payload_len;
+        if (tot_len > out_cap) return HC_ERR_MALFORMED;
+        write_ipv4_header(f, p, tot_len, out);
+        memcpy(l4, &f->sport, 2);
+        memcpy(l4 + 2, &f->dport, 2);
+        l4[4] = (uint8_t)((UDP_HDR_LEN + payload_len) >> 8);
+        l4[5] = (uint8_t)(UDP_HDR_LEN + payload_len);
+        memcpy(l4 + 6, p + 2, 2);
+        memcpy(l4 + UDP_HDR_LEN, p + HC_UDP_FIELDS, payload_len);
+        return (int)tot_len;
+    }
+
+    if (type == HC_CO_TCP) {
+        if (f->proto != IPPROTO_TCP || remaining < HC_TCP_FIELDS) return HC_ERR_MALFORMED;
+        const uint8_t *tcp = p + 2;                      // seq..urg
+        size_t hdr_len = (size_t)(tcp[8] >> 4) * 4;
+        if (hdr_len < TCP_HDR_LEN || remaining < HC_TCP_FIELDS + hdr_len - TCP_HDR_LEN) {
+            return HC_ERR_MALFORMED;
+        }
+        size_t opt_len = hdr_len - TCP_HDR_LEN;
+        size_t payload_len = remaining - HC_TCP_FIELDS - opt_len;
+        size_t tot_len = IPV4_HDR_LEN + hdr_len + payload_len;
+        if (tot_len > out_cap) return HC_ERR_MALFORMED;
+        write_ipv4_header(f, p, tot_len, out);
+        memcpy(l4, &f->sport, 2);
+        memcpy(l4 + 2, &f->dport, 2);
+        memcpy(l4 + 4, tcp, 16);
+        memcpy(l4 + TCP_HDR_LEN, p + HC_TCP_FIELDS, opt_len + payload_len);
+        return (int)tot_len;
+    }
+
+    return HC_ERR_MALFORMED;
+}
+
+// Peer reported a lost context: resend IRs for it on the next packets
+void hc_handle_nack(hc_state_t *hc, uint8_t cid) {
+    if (!hc || cid >= HC_MAX_CONTEXTS) return;
+    hc_comp_ctx_t *ctx = &hc->comp[cid];
+    if (ctx->valid) {
+        ctx->ir_remaining = HC_IR_COUNT;
+    }
+}
@@ -24,7 +24,7 @@ static int hex2bin(const char *hex, uint8_t *out, size_t outlen) {
 void signal_handler(int sig) {
     printf("\nReceived signal %d, shutting down...\n", sig);
     if (g_client) {
-        if (g_client->connected) {
+        if (client_connected(g_client)) {
             client_disconnect(g_client);
         }
         if (g_client->running) {
@@ -117,8 +117,13 @@ int main(int argc, char *argv[]) {
     printf("Virtual IP: %s\n", g_client->virtual_ip);
     printf("Press Ctrl+C to disconnect.\n\n");
     
+    int ticks = 0;
     while (1) {
         sleep(1);
+        if (++ticks % 30 == 0) {
+            client_print_peers(g_client);
+            client_print_flow_stats(g_client);
+        }
     }
     
     return 0;
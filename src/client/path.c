@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <string.h>
+#include "../include/path.h"
+
+void path_init(peer_paths_t *pp) {
+    if (!pp) return;
+    memset(pp, 0, sizeof(*pp));
+    for (int k = 0; k < PATH_KINDS; k++) {
+        pp->path[k].next_seq = 1;
+    }
+    pp->active = PATH_RELAY;
+    pp->reason = PATH_REASON_NONE;
+}
+
+bool path_probe_due(const peer_paths_t *pp, path_kind_t kind, uint64_t now_us) {
+    const path_stats_t *ps = &pp->path[kind];
+    return ps->last_probe_us == 0 || now_us - ps->last_probe_us >= PATH_PROBE_INTERVAL_US;
+}
+
+// Build the next probe for a path. A previous probe still unanswered is
+// accounted as lost.
+size_t path_make_probe(peer_paths_t *pp, path_kind_t kind, uint64_t now_us, uint8_t out[PATH_PROBE_LEN]) {
+    path_stats_t *ps = &pp->path[kind];
+    if (ps->outstanding_seq != 0) {
+        ps->loss += (1.0f - ps->loss) / 8.0f;
+    }
+    uint32_t seq = ps->next_seq++;
+    if (ps->next_seq == 0) ps->next_seq = 1;
+    ps->outstanding_seq = seq;
+    ps->last_probe_us = now_us;
+    ps->probes_sent++;
+
+    out[0] = (uint8_t)kind;
+    memcpy(out + 1, &seq, sizeof(seq));
+    memcpy(out + 5, &now_us, sizeof(now_us));
+    return PATH_PROBE_LEN;
+}
+
+// Feed an echoed probe. Returns the path kind it measured, or -1 if stale.
+int path_on_reply(peer_paths_t *pp, const uint8_t *payload, size_t len, uint64_t now_us) {
+    if (!pp || !payload || len < PATH_PROBE_LEN) return -1;
+    uint8_t kind = payload[0];
+    if (kind >= PATH_KINDS) return -1;
+    uint32_t seq;
+    uint64_t sent_us;
+    memcpy(&seq, payload + 1, sizeof(seq));
+    memcpy(&sent_us, payload + 5, sizeof(sent_us));
+
+    path_stats_t *ps = &pp->path[kind];
+    // Late replies were already counted as lost
+    if (seq != ps->outstanding_seq || sent_us > now_us) return -1;
+    ps->outstanding_seq = 0;
+    ps->last_reply_us = now_us;
+    ps->replies++;
+    ps->loss -= ps->loss / 8.0f;
+
+    uint32_t rtt = (uint32_t)(now_us - sent_us);
+    if (ps->srtt_us == 0) {
+        ps->srtt_us = rtt;
+        ps->rttvar_us = rtt / 2;
+    } else {
+        uint32_t err = rtt > ps->srtt_us ? rtt - ps->srtt_us : ps->srtt_us - rtt;
+        ps->rttvar_us = (3 * ps->rttvar_us + err) / 4;
+        ps->srtt_us = (7 * ps->srtt_us + rtt) / 8;
+    }
+    return kind;
+}
+
+bool path_is_up(const peer_paths_t *pp, path_kind_t kind, uint64_t now_us) {
+    const path_stats_t *ps = &pp->path[kind];
+    return ps->last_reply_us != 0 && now_us - ps->last_reply_us <= PATH_DEAD_US;
+}
+
+static uint64_t path_score(const path_stats_t *ps) {
+    // Floor RTT at 1us so loss still differentiates sub-microsecond paths
+    uint64_t rtt = ps->srtt_us ? ps->srtt_us : 1;
+    return (uint64_t)((double)rtt * (1.0 + PATH_LOSS_PENALTY * ps->loss));
+}
+
+// Re-evaluate the active path. Returns true when it changed.
+bool path_select(peer_paths_t *pp, uint64_t now_us) {
+    if (pp->forced) return false;
+    // Until a path is chosen the first to answer wins; one batch of
+    // datagrams can bring replies on several paths at once
+    bool first = pp->reason == PATH_REASON_NONE;
+    path_kind_t best = PATH_KINDS;
+    for (int k = 0; k < PATH_KINDS; k++) {
+        if (!path_is_up(pp, (path_kind_t)k, now_us)) continue;
+        if (best == PATH_KINDS ||
+            (first ? pp->path[k].last_reply_us < pp->path[best].last_reply_us
+                   : path_score(&pp->path[k]) < path_score(&pp->path[best]))) {
+            best = (path_kind_t)k;
+        }
+    }
+    if (best == PATH_KINDS) {
+        pp->better_streak = 0;
+        // Everything is silent: fall back to the controller relay
+        if (pp->active != PATH_RELAY && pp->reason != PATH_REASON_NONE) {
+            pp->active = PATH_RELAY;
+            pp->reason = PATH_REASON_FAILOVER;
+            pp->switches++;
+            return true;
+        }
+        return false;
+    }
+    if (best == pp->active) {
+        pp->better_streak = 0;
+        if (pp->reason == PATH_REASON_NONE ||
+            (pp->reason == PATH_REASON_RESUMED && pp->path[best].replies > 0)) {
+            pp->reason = PATH_REASON_INITIAL;
+        }
+        return false;
+    }
+
+    path_reason_t reason;
+    if (first || !path_is_up(pp, pp->active, now_us)) {
+        reason = first ? PATH_REASON_INITIAL : PATH_REASON_FAILOVER;
+    } else {
+        uint64_t cur = path_score(&pp->path[pp->active]);
+        uint64_t cand = path_score(&pp->path[best]);
+        bool clearly_better = cand * 100 <= cur * (100 - PATH_SWITCH_MARGIN_PCT) &&
+                              cur - cand >= PATH_SWITCH_MIN_US;
+        if (!clearly_better) {
+            pp->better_streak = 0;
+            return false;
+        }
+        if (++pp->better_streak < PATH_SWITCH_STREAK) return false;
+        reason = PATH_REASON_BETTER;
+    }
+
+    pp->active = best;
+    pp->reason = reason;
+    pp->better_streak = 0;
+    pp->switches++;
+    return true;
+}
+
+// Pin the active path (benchmarks, debugging); probes keep measuring all paths
+void path_force(peer_paths_t *pp, path_kind_t kind) {
+    if (!pp || kind >= PATH_KINDS) return;
+    pp->active = kind;
+    pp->reason = PATH_REASON_FORCED;
+    pp->forced = true;
+}
+
+// Start on the path that was active before a restart. It counts as up
+// for one dead interval, so traffic flows at once; if probes get no
+// answer by then, selection fails over as usual.
+void path_resume(peer_paths_t *pp, path_kind_t kind, uint32_t srtt_us, uint64_t now_us) {
+    if (!pp || kind >= PATH_KINDS || pp->forced) return;
+    path_stats_t *ps = &pp->path[kind];
+    ps->srtt_us = srtt_us;
+    ps->rttvar_us = srtt_us / 2;
+    ps->last_reply_us = now_us;
+    pp->active = kind;
+    pp->reason = PATH_REASON_RESUMED;
+}
+
+// Path kind by name ("direct", "relay", "peer-relay"); -1 if unknown
+int path_kind_parse(const char *name) {
+    if (!name) return -1;
+    for (int k = 0; k < PATH_KINDS; k++) {
+        if (strcmp(name, path_kind_name((path_kind_t)k)) == 0) return k;
+    }
+    return -1;
+}
+
+// Switch the peer-relay path to another relay; its measurements restart
+void path_set_relay(peer_paths_t *pp, uint64_t relay_id) {
+    if (!pp || pp->relay_id == relay_id) return;
+    pp->relay_id = relay_id;
+    memset(&pp->path[PATH_PEER_RELAY], 0, sizeof(path_stats_t));
+    pp->path[PATH_PEER_RELAY].next_seq = 1;
+}
+
+// The current relay keeps swallowing probes: it cannot reach the peer
+bool path_relay_failing(const peer_paths_t *pp) {
+    const path_stats_t *ps = &pp->path[PATH_PEER_RELAY];
+    return pp->relay_id != 0 && ps->replies == 0 && ps->probes_sent >= PATH_RELAY_TRIES;
+}
+
+const char* path_kind_name(path_kind_t kind) {
+    switch (kind) {
+        case PATH_DIRECT: return "direct";
+        case PATH_RELAY: return "relay";
+        case PATH_PEER_RELAY: return "peer-relay";
+        default: return "?";
+    }
+}
+
+const char* path_reason_name(path_reason_t reason) {
+    switch (reason) {
+        case PATH_REASON_NONE: return "no path answered yet";
+        case PATH_REASON_INITIAL: return "first path up";
+        case PATH_REASON_FAILOVER: return "previous path dead";
+        case PATH_REASON_BETTER: return "lower rtt/loss";
+        case PATH_REASON_FORCED: return "forced";
+        case PATH_REASON_RESUMED: return "resumed";
+        default: return "?";
+    }
+}
+
+void path_print(const peer_paths_t *pp, FILE *fp, uint64_t now_us) {
+    if (!pp || !fp) return;
+    fprintf(fp, "    active: %s (%s, %llu switches)\n", path_kind_name(pp->active),
+            path_reason_name(pp->reason), (unsigned long long)pp->switches);
+    for (int k = 0; k < PATH_KINDS; k++) {
+        const path_stats_t *ps = &pp->path[k];
+        if (k == PATH_PEER_RELAY && pp->relay_id == 0) continue;
+        if (k == PATH_PEER_RELAY) {
+            fprintf(fp, "    via relay peer %llu:\n", (unsigned long long)pp->relay_id);
+        }
+        fprintf(fp, "    %-10s %s srtt=%.2fms rttvar=%.2fms loss=%.1f%% probes=%llu replies=%llu\n",
+                path_kind_name((path_kind_t)k),
+                path_is_up(pp, (path_kind_t)k, now_us) ? "up  " : "down",
+                ps->srtt_us / 1000.0, ps->rttvar_us / 1000.0, ps->loss * 100.0,
+                (unsigned long long)ps->probes_sent, (unsigned long long)ps->replies);
+    }
+}
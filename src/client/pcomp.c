@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "../include/pcomp.h"
+#include "../include/lz.h"
+
+void pc_init(pc_table_t *pc, bool enabled) {
+    if (!pc) return;
+    memset(pc, 0, sizeof(*pc));
+    pc->enabled = enabled;
+}
+
+// Extract the flow 5-tuple of an IPv4/IPv6 packet (ports 0 for non TCP/UDP)
+int pc_flow_key(const uint8_t *pkt, size_t len, pc_key_t *key) {
+    if (!pkt || !key || len < 20) return -1;
+    memset(key, 0, sizeof(*key));
+    size_t l4_off;
+    switch (pkt[0] >> 4) {
+        case 4:
+            key->src[10] = key->src[11] = 0xFF;
+            key->dst[10] = key->dst[11] = 0xFF;
+            memcpy(key->src + 12, pkt + 12, 4);
+            memcpy(key->dst + 12, pkt + 16, 4);
+            key->proto = pkt[9];
+            l4_off = (size_t)(pkt[0] & 0x0F) * 4;
+            break;
+        case 6:
+            if (len < 40) return -1;
+            memcpy(key->src, pkt + 8, 16);
+            memcpy(key->dst, pkt + 24, 16);
+            key->proto = pkt[6];
+            l4_off = 40;
+            break;
+        default:
+            return -1;
+    }
+    if ((key->proto == IPPROTO_TCP || key->proto == IPPROTO_UDP) && len >= l4_off + 4) {
+        memcpy(&key->sport, pkt + l4_off, 2);
+        memcpy(&key->dport, pkt + l4_off + 2, 2);
+    }
+    return 0;
+}
+
+static uint32_t key_slot(const pc_key_t *k) {
+    uint32_t h = 2166136261u;
+    const uint8_t *p = (const uint8_t*)k;
+    for (size_t i = 0; i < offsetof(pc_key_t, proto) + 1; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h % PC_FLOWS;
+}
+
+static bool key_equal(const pc_key_t *a, const pc_key_t *b) {
+    return memcmp(a->src, b->src, sizeof(a->src)) == 0 &&
+           memcmp(a->dst, b->dst, sizeof(a->dst)) == 0 &&
+           a->sport == b->sport && a->dport == b->dport && a->proto == b->proto;
+}
+
+static void end_sample(pc_flow_t *f) {
+    bool good = (uint64_t)f->sample_out * 100 <= (uint64_t)f->sample_in * PC_ON_RATIO_PCT;
+    f->mode = good ? PC_ON : PC_OFF;
+    f->sample_packets = 0;
+    f->sample_in = f->sample_out = 0;
+    f->skipped = 0;
+}
+
+static int pass_through(pc_flow_t *f, const uint8_t *frame, size_t len, uint8_t *out, size_t out_cap) {
+    if (len > out_cap) return -1;
+    memcpy(out, frame, len);
+    if (f) f->bytes_out += len;
+    return (int)len;
+}
+
+// Compress one frame of a flow when its policy says so. Returns the length
+// written to out (the frame is copied unchanged when not compressed).
+int pc_compress(pc_table_t *pc, const pc_key_t *key,
+                const uint8_t *frame, size_t len, uint8_t *out, size_t out_cap) {
+    if (!pc || !frame || !out) return -1;
+    if (!pc->enabled || !key) return pass_through(NULL, frame, len, out, out_cap);
+
+    pc_flow_t *f = &pc->flows[key_slot(key)];
+    if (!f->valid || !key_equal(&f->key, key)) {
+        memset(f, 0, sizeof(*f));
+        f->valid = true;
+        f->key = *key;
+        f->mode = PC_PROBING;
+    }
+    f->packets++;
+    f->bytes_in += len;
+
+    if (f->mode == PC_OFF) {
+        if (++f->skipped < PC_RESAMPLE_PACKETS) return pass_through(f, frame, len, out, out_cap);
+        f->mode = PC_PROBING;
+        f->sample_packets = 0;
+        f->sample_in = f->sample_out = 0;
+    }
+    if (len < PC_MIN_LEN || out_cap <= PC_FRAME_HDR) return pass_through(f, frame, len, out, out_cap);
+
+    // Only keep the compressed form if it is strictly smaller
+    int c_len = lz_compress(frame, len, out + PC_FRAME_HDR, len - 1 < out_cap - PC_FRAME_HDR ?
+                                                             len - 1 : out_cap - PC_FRAME_HDR);
+    size_t wire_len = c_len > 0 ? (size_t)c_len + PC_FRAME_HDR : len;
+    f->sample_packets++;
+    f->sample_in += (uint32_t)len;
+    f->sample_out += (uint32_t)(wire_len < len ? wire_len : len);
+    if (f->sample_packets >= PC_SAMPLE_PACKETS) end_sample(f);
+
+    if (c_len <= 0 || wire_len >= len) return pass_through(f, frame, len, out, out_cap);
+    out[0] = PC_FRAME;
+    out[1] = (uint8_t)(len >> 8);
+    out[2] = (uint8_t)len;
+    f->packets_compressed++;
+    f->bytes_out += wire_len;
+    return (int)wire_len;
+}
+
+// Expand a PC_FRAME; anything else is copied through unchanged
+int pc_decompress(const uint8_t *in, size_t len, uint8_t *out, size_t out_cap) {
+    if (!in || !out || len == 0) return -1;
+    if (in[0] != PC_FRAME) {
+        if (len > out_cap) return -1;
+        memcpy(out, in, len);
+        return (int)len;
+    }
+    if (len < PC_FRAME_HDR) return -1;
+    size_t orig_len = ((size_t)in[1] << 8) | in[2];
+    if (orig_len == 0 || orig_len > out_cap) return -1;
+    return lz_decompress(in + PC_FRAME_HDR, len - PC_FRAME_HDR, out, orig_len);
+}
+
+void pc_print_flows(const pc_table_t *pc, FILE *fp) {
+    if (!pc || !fp) return;
+    static const char *mode_names[] = { "probing", "on", "off" };
+    uint64_t total_saved = 0;
+    fprintf(fp, "Payload compression flows:\n");
+    for (int i = 0; i < PC_FLOWS; i++) {
+        const pc_flow_t *f = &pc->flows[i];
+        if (!f->valid) continue;
+        bool v4 = f->key.src[10] == 0xFF && f->key.src[11] == 0xFF;
+        char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+        inet_ntop(v4 ? AF_INET : AF_INET6, v4 ? f->key.src + 12 : f->key.src, src, sizeof(src));
+        inet_ntop(v4 ? AF_INET : AF_INET6, v4 ? f->key.dst + 12 : f->key.dst, dst, sizeof(dst));
+        uint64_t saved = f->bytes_in > f->bytes_out ? f->bytes_in - f->bytes_out : 0;
+        total_saved += saved;
+        fprintf(fp, "  %s:%u -> %s:%u proto %u [%s] pkts=%llu compressed=%llu in=%llu out=%llu saved=%llu\n",
+                src, ntohs(f->key.sport), dst, ntohs(f->key.dport), f->key.proto,
+                mode_names[f->mode],
+                (unsigned long long)f->packets, (unsigned long long)f->packets_compressed,
+                (unsigned long long)f->bytes_in, (unsigned long long)f->bytes_out,
+                (unsigned long long)saved);
+    }
+    fprintf(fp, "  total saved: %llu bytes\n", (unsigned long long)total_saved);
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/state.h"
+
+// Map the state file, creating it if needed. An existing file of another
+// size or format is mapped but reports !cstate_valid().
+cstate_t* cstate_open(const char *path) {
+    if (!path || !path[0]) return NULL;
+    cstate_t *st = (cstate_t*)calloc(1, sizeof(cstate_t));
+    if (!st) {
+        perror("Failed to allocate state");
+        return NULL;
+    }
+    snprintf(st->path, sizeof(st->path), "%s", path);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open state file %s: %s\n", path, strerror(errno));
+        free(st);
+        return NULL;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 ||
+        ((size_t)sb.st_size != sizeof(cstate_file_t) && ftruncate(fd, sizeof(cstate_file_t)) != 0)) {
+        perror("Failed to size state file");
+        close(fd);
+        free(st);
+        return NULL;
+    }
+    st->f = (cstate_file_t*)mmap(NULL, sizeof(cstate_file_t), PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, fd, 0);
+    close(fd);
+    if (st->f == MAP_FAILED) {
+        perror("mmap failed");
+        free(st);
+        return NULL;
+    }
+    return st;
+}
+
+void cstate_close(cstate_t *st) {
+    if (!st) return;
+    if (st->f) {
+        msync(st->f, sizeof(cstate_file_t), MS_SYNC);
+        munmap(st->f, sizeof(cstate_file_t));
+    }
+    free(st);
+}
+
+// A complete state written by this version, not torn by a crash
+bool cstate_valid(const cstate_t *st) {
+    if (!st || !st->f) return false;
+    const cstate_file_t *f = st->f;
+    return f->magic == CSTATE_MAGIC && f->version == CSTATE_VERSION &&
+           f->size == sizeof(cstate_file_t) && (f->seq & 1) == 0 &&
+           f->client_id != 0 && f->peer_count <= CSTATE_MAX_PEERS;
+}
+
+// Start over with an empty state
+void cstate_reset(cstate_t *st) {
+    if (!st || !st->f) return;
+    memset(st->f, 0, sizeof(cstate_file_t));
+    st->f->magic = CSTATE_MAGIC;
+    st->f->version = CSTATE_VERSION;
+    st->f->size = sizeof(cstate_file_t);
+}
+
+void cstate_begin(cstate_t *st) {
+    if (!st) return;
+    __atomic_store_n(&st->f->seq, st->f->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void cstate_end(cstate_t *st) {
+    if (!st) return;
+    st->f->saved_unix = (uint64_t)time(NULL);
+    __atomic_store_n(&st->f->seq, st->f->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Record of a peer; with create, a free slot is claimed for a new peer.
+// Returns NULL when the peer is unknown (or the table is full).
+cstate_peer_t* cstate_peer(cstate_t *st, uint64_t peer_id, bool create) {
+    if (!st || peer_id == 0) return NULL;
+    cstate_file_t *f = st->f;
+    cstate_peer_t *free_slot = NULL;
+    for (uint32_t i = 0; i < f->peer_count; i++) {
+        if (f->peer[i].id == peer_id) return &f->peer[i];
+        if (!free_slot && f->peer[i].id == 0) free_slot = &f->peer[i];
+    }
+    if (!create) return NULL;
+    if (!free_slot && f->peer_count < CSTATE_MAX_PEERS) free_slot = &f->peer[f->peer_count++];
+    if (free_slot) {
+        memset(free_slot, 0, sizeof(*free_slot));
+        free_slot->id = peer_id;
+    }
+    return free_slot;
+}
+
+// Ask the kernel to write dirty pages back (only matters for power loss;
+// a crashed process leaves its stores in the page cache)
+void cstate_flush(cstate_t *st) {
+    if (!st || !st->f) return;
+    msync(st->f, sizeof(cstate_file_t), MS_ASYNC);
+}
\ No newline at end of file
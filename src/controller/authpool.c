@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include "../include/authpool.h"
+#include "../include/crypto.h"
+
+// Everything about a JOIN that needs no controller state; runs on a
+// worker, or on the event loop when there is no pool
+void auth_verify(const auth_job_t *job, int join_window, time_t now, auth_result_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->peer_id = job->peer_id;
+    out->addr = job->addr;
+    out->net = job->net;
+    out->verdict = AUTH_OK;
+
+    if (job->password[0]) {
+        // Expect payload: netid(16) + client_id(8) + nonce(8) + time(8) + hmac(32)
+        if (job->len != JOIN_REQUEST_AUTH_LEN && job->len != JOIN_REQUEST_AUTH_LEN + JOIN_VIP_HINT_LEN) {
+            out->verdict = AUTH_BAD_FORMAT;
+            return;
+        }
+        uint64_t client_id = 0, sent_at = 0;
+        memcpy(&client_id, job->data + NETWORK_ID_SIZE, 8);
+        memcpy(&out->nonce, job->data + NETWORK_ID_SIZE + 8, 8);
+        memcpy(&sent_at, job->data + NETWORK_ID_SIZE + 16, 8);
+        // Identity binding
+        if (client_id != job->peer_id) {
+            out->verdict = AUTH_BAD_IDENTITY;
+            return;
+        }
+        // Freshness: the replay window is bounded in time
+        out->skew = (int64_t)sent_at - (int64_t)now;
+        if (out->skew > join_window || out->skew < -join_window) {
+            out->verdict = AUTH_STALE;
+            return;
+        }
+        // Constant-time compare: timing must not reveal a MAC prefix
+        uint8_t calc[32];
+        if (hmac_sha256((const uint8_t*)job->password, strlen(job->password),
+                        job->data, JOIN_AUTH_MSG_LEN, calc) != 0 ||
+            CRYPTO_memcmp(calc, job->data + JOIN_AUTH_MSG_LEN, 32) != 0) {
+            out->verdict = AUTH_BAD_MAC;
+            return;
+        }
+        out->authenticated = true;
+    }
+    // Optional trailing hint: the vIP held before a restart
+    if (job->len == NETWORK_ID_SIZE + JOIN_VIP_HINT_LEN ||
+        job->len == JOIN_REQUEST_AUTH_LEN + JOIN_VIP_HINT_LEN) {
+        memcpy(&out->vip_hint, job->data + job->len - JOIN_VIP_HINT_LEN, JOIN_VIP_HINT_LEN);
+    }
+    // A failure here only means the loop generates the keys itself
+    if (job->need_keys) out->has_keys = keypair_generate(&out->keys) == 0;
+}
+
+int auth_pool_default_workers(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 1) return 0;
+    return cpus - 1 > AUTH_MAX_WORKERS ? AUTH_MAX_WORKERS : (int)(cpus - 1);
+}
+
+static void* auth_worker_run(void *arg) {
+    auth_worker_t *w = (auth_worker_t*)arg;
+    auth_pool_t *pool = w->pool;
+    char name[16];
+    snprintf(name, sizeof(name), "ctrl auth %d", w->index);
+    affinity_pin(pool->affinity, AFF_CRYPTO, name);
+
+    struct pollfd pfd = { .fd = w->wake.rfd, .events = POLLIN };
+    while (!pool->stopping) {
+        ring_notify_drain(&w->wake);
+        int done = 0;
+        auth_job_t *job;
+        while ((job = (auth_job_t*)ring_front(w->jobs)) != NULL) {
+            // Never full: the loop keeps at most AUTH_RING_SLOTS JOINs in
+            // flight per worker, queued or answered
+            auth_result_t *r = (auth_result_t*)ring_reserve(w->results);
+            auth_verify(job, pool->join_window, time(NULL), r);
+            ring_commit(w->results);
+            ring_release(w->jobs);
+            done++;
+        }
+        if (done > 0) ring_notify_signal(&pool->done);
+        else poll(&pfd, 1, -1);
+    }
+    return NULL;
+}
+
+auth_pool_t* auth_pool_create(int workers, int join_window, const affinity_t *aff) {
+    if (workers <= 0) return NULL;
+    if (workers > AUTH_MAX_WORKERS) workers = AUTH_MAX_WORKERS;
+
+    auth_pool_t *pool = (auth_pool_t*)calloc(1, sizeof(auth_pool_t));
+    if (!pool) {
+        perror("Failed to allocate JOIN auth pool");
+        return NULL;
+    }
+    pool->join_window = join_window;
+    pool->affinity = aff;
+    pool->done.rfd = pool->done.wfd = -1;
+    if (ring_notify_init(&pool->done) != 0) {
+        perror("Failed to create JOIN auth notifier");
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < workers; i++) {
+        auth_worker_t *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->wake.rfd = w->wake.wfd = -1;
+        w->jobs = ring_create(AUTH_RING_SLOTS, sizeof(auth_job_t));
+        w->results = ring_create(AUTH_RING_SLOTS, sizeof(auth_result_t));
+        if (!w->jobs || !w->results || ring_notify_init(&w->wake) != 0 ||
+            pthread_create(&w->thread, NULL, auth_worker_run, w) != 0) {
+            perror("Failed to start JOIN auth worker");
+            ring_destroy(w->jobs);
+            ring_destroy(w->results);
+            ring_notify_close(&w->wake);
+            auth_pool_destroy(pool);
+            return NULL;
+        }
+        pool->count++;
+    }
+    printf("JOIN authentication on %d worker thread%s\n", pool->count, pool->count == 1 ? "" : "s");
+    return pool;
+}
+
+void auth_pool_destroy(auth_pool_t *pool) {
+    if (!pool) return;
+    pool->stopping = true;
+    for (int i = 0; i < pool->count; i++) {
+        ring_notify_signal(&pool->workers[i].wake);
+    }
+    for (int i = 0; i < pool->count; i++) {
+        auth_worker_t *w = &pool->workers[i];
+        pthread_join(w->thread, NULL);
+        ring_destroy(w->jobs);
+        ring_destroy(w->results);
+        ring_notify_close(&w->wake);
+    }
+    ring_notify_close(&pool->done);
+    free(pool);
+}
+
+// Loop side: queue a JOIN; -1 when its worker already has a full ring
+// (the client retries)
+int auth_pool_submit(auth_pool_t *pool, const auth_job_t *job) {
+    auth_worker_t *w = &pool->workers[(job->peer_id * 0x9E3779B97F4A7C15ULL >> 32) % (uint64_t)pool->count];
+    if (w->in_flight >= AUTH_RING_SLOTS || ring_push(w->jobs, job) != 0) return -1;
+    w->in_flight++;
+    ring_notify_signal(&w->wake);
+    return 0;
+}
+
+// Loop side: hand every posted verdict to cb; returns how many
+int auth_pool_collect(auth_pool_t *pool, auth_result_cb cb, void *ctx) {
+    ring_notify_drain(&pool->done);
+    int n = 0;
+    for (int i = 0; i < pool->count; i++) {
+        auth_worker_t *w = &pool->workers[i];
+        const auth_result_t *r;
+        while ((r = (const auth_result_t*)ring_front(w->results)) != NULL) {
+            cb(ctx, r);
+            ring_release(w->results);
+            w->in_flight--;
+            n++;
+        }
+    }
+    return n;
+}
\ No newline at end of file
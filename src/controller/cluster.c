@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <openssl/crypto.h>
+#include "../include/cluster.h"
+#include "../include/crypto.h"
+
+// splitmix64 finalizer: ring points and peer IDs spread evenly
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int vnode_cmp(const void *a, const void *b) {
+    uint64_t x = ((const cluster_vnode_t*)a)->point, y = ((const cluster_vnode_t*)b)->point;
+    return x < y ? -1 : x > y;
+}
+
+// Points depend on the node's address only, so every node builds the
+// same ring from the same set of live nodes
+static void ring_build(cluster_t *c) {
+    c->ring_len = 0;
+    for (uint32_t n = 0; n < c->node_count; n++) {
+        if (!c->nodes[n].alive) continue;
+        uint64_t base = ((uint64_t)ntohl(c->nodes[n].addr.sin_addr.s_addr) << 16) |
+                        ntohs(c->nodes[n].addr.sin_port);
+        for (uint32_t v = 0; v < CLUSTER_VNODES; v++) {
+            c->ring[c->ring_len].point = mix64(base * CLUSTER_VNODES + v);
+            c->ring[c->ring_len].node = n;
+            c->ring_len++;
+        }
+    }
+    qsort(c->ring, c->ring_len, sizeof(cluster_vnode_t), vnode_cmp);
+}
+
+// spec: "ip:port,ip:port,..."; node_id: index into it, or NULL to pick
+// the entry with our port; key: the shared ZTNET_CLUSTER_KEY
+int cluster_init(cluster_t *c, const char *spec, const char *node_id, const char *key,
+                 uint16_t port, uint64_t now_us) {
+    if (!c || !spec) return -1;
+    memset(c, 0, sizeof(*c));
+    if (!key || key[0] == '\0' || strlen(key) > sizeof(c->key)) {
+        fprintf(stderr, "ZTNET_CLUSTER needs ZTNET_CLUSTER_KEY (1 to %d bytes)\n", CLUSTER_KEY_MAX);
+        return -1;
+    }
+    c->key_len = strlen(key);
+    memcpy(c->key, key, c->key_len);
+    snprintf(c->spec, sizeof(c->spec), "%s", spec);
+    char buf[sizeof(c->spec)];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    char *save = NULL;
+    for (char *item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        while (*item == ' ') item++;
+        char *colon = strrchr(item, ':');
+        long p = colon ? strtol(colon + 1, NULL, 10) : 0;
+        if (colon) *colon = '\0';
+        cluster_node_t *n = &c->nodes[c->node_count];
+        n->addr.sin_family = AF_INET;
+        n->addr.sin_port = htons((uint16_t)p);
+        if (c->node_count == CLUSTER_MAX_NODES || p <= 0 || p > 65535 ||
+            inet_pton(AF_INET, item, &n->addr.sin_addr) != 1) {
+            fprintf(stderr, "Invalid ZTNET_CLUSTER entry '%s' (expect ip:port, at most %d)\n",
+                    item, CLUSTER_MAX_NODES);
+            return -1;
+        }
+        // Every node starts out alive so all of them agree on placement
+        // from the first JOIN; silent ones drop out after CLUSTER_DEAD_MS
+        n->alive = true;
+        n->last_heard_us = now_us;
+        c->node_count++;
+    }
+    if (c->node_count == 0) {
+        fprintf(stderr, "ZTNET_CLUSTER lists no controllers\n");
+        return -1;
+    }
+
+    c->self = CLUSTER_NO_NODE;
+    if (node_id) {
+        char *end = NULL;
+        long id = strtol(node_id, &end, 10);
+        if (*end == '\0' && id >= 0 && id < (long)c->node_count) c->self = (uint32_t)id;
+    } else {
+        for (uint32_t n = 0; n < c->node_count; n++) {
+            if (ntohs(c->nodes[n].addr.sin_port) != port) continue;
+            if (c->self != CLUSTER_NO_NODE) {
+                fprintf(stderr, "Port %u appears twice in ZTNET_CLUSTER; set ZTNET_NODE_ID\n", port);
+                return -1;
+            }
+            c->self = n;
+        }
+    }
+    if (c->self == CLUSTER_NO_NODE) {
+        fprintf(stderr, "This controller is not in ZTNET_CLUSTER; set ZTNET_NODE_ID\n");
+        return -1;
+    }
+    ring_build(c);
+    return 0;
+}
+
+// Node a peer ID belongs to: first ring point at or after its hash
+uint32_t cluster_owner(const cluster_t *c, uint64_t peer_id) {
+    if (c->ring_len == 0) return c->self;
+    uint64_t h = mix64(peer_id);
+    uint32_t lo = 0, hi = c->ring_len;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (c->ring[mid].point < h) lo = mid + 1;
+        else hi = mid;
+    }
+    return c->ring[lo == c->ring_len ? 0 : lo].node;
+}
+
+// Index of the node sending from addr, CLUSTER_NO_NODE for anyone else
+uint32_t cluster_node_of(const cluster_t *c, const struct sockaddr_in *addr) {
+    for (uint32_t n = 0; n < c->node_count; n++) {
+        if (n != c->self && c->nodes[n].addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            c->nodes[n].addr.sin_port == addr->sin_port) return n;
+    }
+    return CLUSTER_NO_NODE;
+}
+
+// Append the MAC of buf[0..len) under the cluster key; buf needs
+// CLUSTER_MAC_LEN bytes of room after len. Returns the sealed length.
+size_t cluster_seal(const cluster_t *c, uint8_t *buf, size_t len) {
+    if (hmac_sha256(c->key, c->key_len, buf, len, buf + len) != 0) return 0;
+    return len + CLUSTER_MAC_LEN;
+}
+
+// Whether buf ends in a valid MAC of what precedes it
+bool cluster_verify(const cluster_t *c, const uint8_t *buf, size_t len) {
+    uint8_t mac[CLUSTER_MAC_LEN];
+    if (len < CLUSTER_MAC_LEN) return false;
+    len -= CLUSTER_MAC_LEN;
+    return hmac_sha256(c->key, c->key_len, buf, len, mac) == 0 &&
+           CRYPTO_memcmp(mac, buf + len, CLUSTER_MAC_LEN) == 0;
+}
+
+// A heartbeat or replication datagram from node; true if it (re)joined
+// the ring with it
+bool cluster_heard(cluster_t *c, uint32_t node, uint64_t now_us) {
+    cluster_node_t *n = &c->nodes[node];
+    n->last_heard_us = now_us;
+    if (n->alive) return false;
+    n->alive = true;
+    ring_build(c);
+    return true;
+}
+
+// Take nodes that went silent out of the ring; returns how many
+int cluster_expire(cluster_t *c, uint64_t now_us) {
+    int dead = 0;
+    for (uint32_t n = 0; n < c->node_count; n++) {
+        cluster_node_t *node = &c->nodes[n];
+        if (n == c->self || !node->alive ||
+            now_us - node->last_heard_us < CLUSTER_DEAD_MS * 1000ULL) continue;
+        node->alive = false;
+        node->synced = false;
+        dead++;
+    }
+    if (dead > 0) ring_build(c);
+    return dead;
+}
+
+// Network IDs are derived from the cluster spec and the name, so every
+// node hosts a network under the same ID without coordination
+int cluster_network_id(const cluster_t *c, const char *name, uint8_t out[NETWORK_ID_SIZE]) {
+    uint8_t mac[32];
+    if (hmac_sha256((const uint8_t*)c->spec, strlen(c->spec),
+                    (const uint8_t*)name, strlen(name), mac) != 0) return -1;
+    memcpy(out, mac, NETWORK_ID_SIZE);
+    return 0;
+}
\ No newline at end of file
@@ -6,75 +6,969 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <fcntl.h>
+#include <errno.h>
 #include "../include/controller.h"
 #include "../include/crypto.h"
+#include "../include/clock.h"
 
-static uint32_t base_overlay_host(void) {
-    struct in_addr base; inet_aton(OVERLAY_BASE_IP, &base);
-    return ntohl(base.s_addr);
+// Forward declarations of the event handlers registered in controller_create
+static void on_socket_readable(void *arg);
+static void on_wheel_timer(void *arg, uint64_t now_us);
+static void on_sweep_timer(void *arg, uint64_t now_us);
+static void on_sync_timer(void *arg, uint64_t now_us);
+static void on_cluster_timer(void *arg, uint64_t now_us);
+static void on_auth_done(void *arg);
+
+// --- Hosted networks ---
+
+static uint64_t netid_key(const uint8_t id[NETWORK_ID_SIZE]) {
+    uint64_t a, b;
+    memcpy(&a, id, sizeof(a));
+    memcpy(&b, id + 8, sizeof(b));
+    return a ^ (b * 0x9E3779B97F4A7C15ULL);
+}
+
+static uint64_t name_key(const char *name) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const char *c = name; *c; c++) {
+        h = (h ^ (uint8_t)*c) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static ctrl_net_t* find_network(controller_t *ctrl, const uint8_t id[NETWORK_ID_SIZE]) {
+    uint32_t idx;
+    if (!hmap_get(&ctrl->net_by_id, netid_key(id), &idx)) return NULL;
+    ctrl_net_t *net = ctrl->nets[idx];
+    return memcmp(net->network->network_id, id, NETWORK_ID_SIZE) == 0 ? net : NULL;
+}
+
+// The member with this ID in whichever network it belongs to
+static peer_t* find_member(controller_t *ctrl, uint64_t peer_id, ctrl_net_t **net_out) {
+    uint32_t idx;
+    *net_out = NULL;
+    if (!hmap_get(&ctrl->member_net, peer_id, &idx)) return NULL;
+    *net_out = ctrl->nets[idx];
+    return network_find_peer(ctrl->nets[idx]->network, peer_id);
+}
+
+// A member another node of the cluster serves
+static bool is_remote(const controller_t *ctrl, uint64_t peer_id) {
+    return ctrl->cluster && hmap_get(&ctrl->remote, peer_id, NULL);
+}
+
+// Queue a network for the next commit and sync flush
+static void mark_dirty(controller_t *ctrl, ctrl_net_t *net) {
+    if (net->dirty) return;
+    if (ctrl->dirty_count == ctrl->dirty_cap) {
+        uint32_t cap = ctrl->dirty_cap ? ctrl->dirty_cap * 2 : 64;
+        uint32_t *d = (uint32_t*)realloc(ctrl->dirty, cap * sizeof(uint32_t));
+        if (!d) {
+            perror("Failed to grow dirty network list");
+            return;
+        }
+        ctrl->dirty = d;
+        ctrl->dirty_cap = cap;
+    }
+    ctrl->dirty[ctrl->dirty_count++] = net->index;
+    net->dirty = true;
+}
+
+static void net_free(ctrl_net_t *net) {
+    if (!net) return;
+    if (net->network) network_destroy(net->network);
+    store_close(&net->store);
+    ipam_free(&net->ipam);
+    member_log_free(&net->members);
+    free(net->repl);
+    free(net);
+}
+
+// --- Membership sync ---
+
+typedef struct {
+    controller_t *ctrl;
+    peer_t *to;
+} sync_target_t;
+
+static void sync_send(void *arg, const uint8_t *buf, uint16_t len) {
+    sync_target_t *t = (sync_target_t*)arg;
+    transport_send(t->ctrl->transport, &t->to->addr, PKT_MEMBER_SYNC,
+                   t->ctrl->controller_id, t->to->id, buf, len);
+}
+
+// Keep the delta shared by most members to send it to each of them
+static void sync_collect(void *arg, const uint8_t *buf, uint16_t len) {
+    controller_t *ctrl = (controller_t*)arg;
+    size_t need = ctrl->sync_frames_len + sizeof(uint16_t) + len;
+    if (need > ctrl->sync_frames_cap) {
+        size_t cap = ctrl->sync_frames_cap ? ctrl->sync_frames_cap : 4096;
+        while (cap < need) cap *= 2;
+        uint8_t *f = (uint8_t*)realloc(ctrl->sync_frames, cap);
+        if (!f) {
+            perror("Failed to grow membership sync buffer");
+            return;
+        }
+        ctrl->sync_frames = f;
+        ctrl->sync_frames_cap = cap;
+    }
+    memcpy(ctrl->sync_frames + ctrl->sync_frames_len, &len, sizeof(uint16_t));
+    memcpy(ctrl->sync_frames + ctrl->sync_frames_len + sizeof(uint16_t), buf, len);
+    ctrl->sync_frames_len = need;
+}
+
+// Bring every member up to the latest membership version: the delta
+// since the previous flush (encoded once) for members that had it, an
+// older delta or a snapshot for the rest. Changes between flushes are
+// coalesced, so a burst of joins costs each member a few datagrams.
+static void member_sync_flush(controller_t *ctrl, ctrl_net_t *net) {
+    uint64_t v = net->members.version;
+    if (v == net->synced_version && !net->sync_pending) return;
+    net->sync_pending = false;
+
+    ctrl->sync_frames_len = 0;
+    bool shared = v != net->synced_version && net->synced_version != 0 &&
+                  member_sync_delta(&net->members, net->network, net->synced_version,
+                                    sync_collect, ctrl) == 0;
+    for (int i = 0; i < net->network->peer_count; i++) {
+        peer_t *p = &net->network->peers[i];
+        if (p->sync_version == v || is_remote(ctrl, p->id)) continue;
+        sync_target_t t = { ctrl, p };
+        if (shared && p->sync_version == net->synced_version) {
+            for (size_t off = 0; off < ctrl->sync_frames_len; ) {
+                uint16_t len;
+                memcpy(&len, ctrl->sync_frames + off, sizeof(uint16_t));
+                sync_send(&t, ctrl->sync_frames + off + sizeof(uint16_t), len);
+                off += sizeof(uint16_t) + len;
+            }
+        } else if (p->sync_version == 0 ||
+                   member_sync_delta(&net->members, net->network, p->sync_version,
+                                     sync_send, &t) != 0) {
+            member_sync_snapshot(&net->members, net->network, p->id, sync_send, &t);
+        }
+        p->sync_version = v;
+    }
+    net->synced_version = v;
+}
+
+// Queue one of our members' changes for the other nodes of the cluster
+static void repl_add(ctrl_net_t *net, uint8_t op, const peer_t *p) {
+    size_t need = net->repl_len + 1 + PEER_INFO_LEN;
+    if (need > net->repl_cap) {
+        size_t cap = net->repl_cap ? net->repl_cap * 2 : 1024;
+        while (cap < need) cap *= 2;
+        uint8_t *r = (uint8_t*)realloc(net->repl, cap);
+        if (!r) {
+            perror("Failed to grow cluster replication buffer");
+            return;
+        }
+        net->repl = r;
+        net->repl_cap = cap;
+    }
+    net->repl[net->repl_len++] = op;
+    if (op == MEMBER_UPSERT) {
+        member_pack_info(p, net->repl + net->repl_len);
+        net->repl_len += PEER_INFO_LEN;
+    } else {
+        memcpy(net->repl + net->repl_len, &p->id, sizeof(uint64_t));
+        net->repl_len += sizeof(uint64_t);
+    }
+}
+
+// Membership change of one of our members: versioned for sync, queued for
+// the WAL and, in a cluster, for the other nodes
+static void member_changed(controller_t *ctrl, ctrl_net_t *net, uint8_t op, peer_t *p) {
+    uint64_t v = member_log_append(&net->members, op, p);
+    if (net->persist) store_append(&net->store, v, op, p, time(NULL));
+    if (ctrl->cluster) repl_add(net, op, p);
+    mark_dirty(ctrl, net);
+}
+
+// Group commit: one WAL write + fdatasync per network changed since the
+// last one, then the JOIN replies that were waiting on them
+static void controller_commit(controller_t *ctrl) {
+    for (uint32_t i = 0; i < ctrl->dirty_count; i++) {
+        ctrl_net_t *net = ctrl->nets[ctrl->dirty[i]];
+        if (net->persist) store_commit(&net->store);
+    }
+    for (size_t i = 0; i < ctrl->reply_count; i++) {
+        join_reply_t *r = &ctrl->replies[i];
+        transport_send(ctrl->transport, &r->addr, PKT_JOIN_RESPONSE,
+                       ctrl->controller_id, r->peer_id, r->resp, sizeof(r->resp));
+    }
+    ctrl->reply_count = 0;
 }
 
-static int vip_in_use(controller_t *ctrl, uint32_t vip_net) {
-    for (int i = 0; i < ctrl->network->peer_count; i++) {
-        if (ctrl->network->peers[i].virtual_ip == vip_net) return 1;
+static void send_join_reply(controller_t *ctrl, const ctrl_net_t *net, struct sockaddr_in *addr,
+                            uint64_t peer_id, const uint8_t resp[JOIN_RESPONSE_CIDR_LEN]) {
+    if (net->persist && ctrl->reply_count == ctrl->reply_cap) {
+        size_t cap = ctrl->reply_cap ? ctrl->reply_cap * 2 : 64;
+        join_reply_t *r = (join_reply_t*)realloc(ctrl->replies, cap * sizeof(join_reply_t));
+        if (r) {
+            ctrl->replies = r;
+            ctrl->reply_cap = cap;
+        }
+    }
+    if (!net->persist || ctrl->reply_count == ctrl->reply_cap) {
+        transport_send(ctrl->transport, addr, PKT_JOIN_RESPONSE,
+                       ctrl->controller_id, peer_id, resp, JOIN_RESPONSE_CIDR_LEN);
+        return;
+    }
+    join_reply_t *r = &ctrl->replies[ctrl->reply_count++];
+    r->addr = *addr;
+    r->peer_id = peer_id;
+    memcpy(r->resp, resp, JOIN_RESPONSE_CIDR_LEN);
+}
+
+// Write a snapshot of a network's whole state; its WAL starts over
+static int controller_save(controller_t *ctrl, ctrl_net_t *net) {
+    store_header_t h;
+    memset(&h, 0, sizeof(h));
+    h.controller_id = ctrl->controller_id;
+    memcpy(h.network_id, net->network->network_id, NETWORK_ID_SIZE);
+    h.network_keys = net->network->network_keys;
+    snprintf(h.name, sizeof(h.name), "%s", net->network->name);
+    h.overlay_network = net->ipam.network;
+    h.prefix_len = (uint32_t)net->ipam.prefix_len;
+    h.member_version = net->members.version;
+    return store_snapshot(&net->store, &h, net->network, &net->ipam,
+                          ctrl->cluster ? &ctrl->remote : NULL);
+}
+
+// --- Per-member deadlines ---
+//
+// Each member has one timer in the wheel, keyed by peer ID and due at the
+// earlier of its next keepalive and its expiry. Keepalive phases are
+// spread over the interval by peer ID, so a few go out per tick instead
+// of all at once. Packets only refresh last_seen; the expiry is re-checked
+// when the timer fires, so traffic never touches the wheel.
+
+static void peer_timer_arm(controller_t *ctrl, peer_t *p, uint64_t now_us) {
+    int64_t left = (int64_t)(p->last_seen + PEER_TIMEOUT - time(NULL)) + 1;
+    uint64_t expiry_us = now_us + (left > 0 ? (uint64_t)left * 1000000ULL : 0);
+    twheel_arm(&ctrl->wheel, p->timer,
+               p->next_keepalive_us < expiry_us ? p->next_keepalive_us : expiry_us);
+}
+
+static void peer_timer_start(controller_t *ctrl, peer_t *p) {
+    uint64_t now_us = monotonic_us();
+    p->timer = twheel_add(&ctrl->wheel, p->id);
+    if (p->timer == TWHEEL_NONE) return;
+    p->next_keepalive_us = now_us + 1 + (p->id * 0x9E3779B97F4A7C15ULL) % (KEEPALIVE_INTERVAL * 1000000ULL);
+    peer_timer_arm(ctrl, p, now_us);
+}
+
+// Drop a member (BYE or timeout): its timer, counters and vIP lease go,
+// the registry entry goes in O(1) and the others hear on the next sync
+static void evict_peer(controller_t *ctrl, ctrl_net_t *net, peer_t *p) {
+    uint64_t id = p->id;
+    twheel_del(&ctrl->wheel, p->timer);
+    stats_peer_detach(ctrl->stats, p->stats_slot);
+    ipam_release(&net->ipam, id, time(NULL));
+    member_changed(ctrl, net, MEMBER_REMOVE, p);
+    hmap_del(&ctrl->member_net, id);
+    network_remove_peer(net->network, id);
+}
+
+// Keepalives that come due in one tick leave as one sendmmsg
+static void flush_keepalives(controller_t *ctrl) {
+    int queued = ctrl->relay->fwd_count;
+    if (queued == 0) return;
+    int sent = relay_batch_flush(ctrl->relay, ctrl->transport);
+    stats_add(ctrl->stats, STAT_TX_PACKETS, (uint64_t)sent);
+    stats_add(ctrl->stats, STAT_TX_BYTES, (uint64_t)sent * sizeof(packet_header_t));
+    if (sent < queued) stats_add(ctrl->stats, STAT_DROP_SEND, (uint64_t)(queued - sent));
+}
+
+static void queue_keepalive(controller_t *ctrl, const peer_t *p) {
+    uint8_t *buf = relay_batch_add(ctrl->relay, &p->addr, sizeof(packet_header_t));
+    if (!buf) {
+        flush_keepalives(ctrl);
+        buf = relay_batch_add(ctrl->relay, &p->addr, sizeof(packet_header_t));
+        if (!buf) return;
+    }
+    transport_write_header(ctrl->transport, buf, PKT_KEEPALIVE, ctrl->controller_id, p->id, 0);
+}
+
+static void on_peer_timer(void *arg, uint64_t key, uint32_t id) {
+    controller_t *ctrl = (controller_t*)arg;
+    ctrl_net_t *net;
+    peer_t *p = find_member(ctrl, key, &net);
+    if (!p || p->timer != id) {
+        twheel_del(&ctrl->wheel, id);
+        return;
+    }
+    if (!peer_is_alive(p, PEER_TIMEOUT)) {
+        printf("Peer %llu timed out, evicting\n", (unsigned long long)p->id);
+        evict_peer(ctrl, net, p);
+        return;
+    }
+    uint64_t now_us = monotonic_us();
+    if (now_us >= p->next_keepalive_us) {
+        queue_keepalive(ctrl, p);
+        p->next_keepalive_us += KEEPALIVE_INTERVAL * 1000000ULL;
+        if (p->next_keepalive_us <= now_us) p->next_keepalive_us = now_us + KEEPALIVE_INTERVAL * 1000000ULL;
+    }
+    peer_timer_arm(ctrl, p, now_us);
+}
+
+// --- Persistence ---
+
+typedef struct {
+    controller_t *ctrl;
+    ctrl_net_t *net;
+} restore_ctx_t;
+
+// One record from the state directory. Members come back on their vIPs
+// and endpoints as if just seen, so they carry on without re-joining and
+// their keepalives resume on the wheel; removals leave the vIP held.
+static void restore_record(void *arg, uint8_t op, const store_member_t *m) {
+    controller_t *ctrl = ((restore_ctx_t*)arg)->ctrl;
+    ctrl_net_t *net = ((restore_ctx_t*)arg)->net;
+    time_t now = time(NULL);
+    peer_t *p = network_find_peer(net->network, m->id);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = m->ip;
+    addr.sin_port = m->port;
+
+    if (op == MEMBER_REMOVE) {
+        if (p) {
+            twheel_del(&ctrl->wheel, p->timer);
+            stats_peer_detach(ctrl->stats, p->stats_slot);
+            hmap_del(&ctrl->member_net, m->id);
+            network_remove_peer(net->network, m->id);
+        } else {
+            ipam_adopt(&net->ipam, m->id, m->vip, now);
+        }
+        ipam_release(&net->ipam, m->id, (time_t)m->released);
+        return;
+    }
+    if (p) {
+        network_set_endpoint(net->network, p, &addr);
+        p->flags = m->flags;
+        return;
+    }
+    uint32_t other;
+    if (hmap_get(&ctrl->member_net, m->id, &other)) {
+        fprintf(stderr, "Restored peer %llu is already a member of '%s'\n",
+                (unsigned long long)m->id, ctrl->nets[other]->network->name);
+        return;
+    }
+
+    peer_t np;
+    memset(&np, 0, sizeof(np));
+    np.id = m->id;
+    np.addr = addr;
+    np.last_seen = now;
+    np.is_active = true;
+    np.flags = m->flags;
+    np.virtual_ip = ipam_adopt(&net->ipam, m->id, m->vip, now);
+    if (np.virtual_ip == 0) np.virtual_ip = ipam_assign(&net->ipam, m->id, m->vip, now);
+    if (np.virtual_ip != m->vip) {
+        fprintf(stderr, "Restored peer %llu could not keep its vIP\n", (unsigned long long)m->id);
+        if (np.virtual_ip == 0) return;
+    }
+    network_overlay_ip6(net->network->network_id, m->id, np.virtual_ip6);
+    np.stats_slot = stats_peer_attach(ctrl->stats, m->id);
+    if (network_load_peer(net->network, &np) != 0 ||
+        hmap_put(&ctrl->member_net, m->id, net->index) != 0) {
+        network_remove_peer(net->network, m->id);
+        stats_peer_detach(ctrl->stats, np.stats_slot);
+        ipam_release(&net->ipam, m->id, now);
+        return;
+    }
+    peer_timer_start(ctrl, network_find_peer(net->network, m->id));
+}
+
+// Load a network's snapshot and WAL tail. Members are taken to hold the
+// restored membership version, so only those that report an older one in
+// their next keepalive are sent anything.
+static int controller_restore(controller_t *ctrl, ctrl_net_t *net) {
+    bool fresh = store_header(&net->store) == NULL;
+    uint64_t start_us = monotonic_us();
+    restore_ctx_t rc = { ctrl, net };
+    uint64_t version = store_replay(&net->store, restore_record, &rc);
+    member_log_restore(&net->members, version);
+    net->synced_version = version;
+    for (int i = 0; i < net->network->peer_count; i++) {
+        net->network->peers[i].sync_version = version;
+    }
+    if (net->network->peer_count > 0) {
+        printf("Restored %d members of '%s' at membership version %llu in %.1f ms\n",
+               net->network->peer_count, net->network->name, (unsigned long long)version,
+               (double)(monotonic_us() - start_us) / 1000.0);
+    }
+    // The identity goes to disk before anyone can join
+    if (fresh || store_wants_compaction(&net->store, net->network->peer_count)) {
+        return controller_save(ctrl, net);
     }
     return 0;
 }
 
-// search 10.0.0.2 .. 10.0.0.254 for first free
-static uint32_t allocate_virtual_ip(controller_t *ctrl) {
-    uint32_t base = base_overlay_host();
-    for (int host = 2; host <= 254; host++) {
-        uint32_t candidate = htonl(base + (uint32_t)host);
-        if (!vip_in_use(ctrl, candidate)) return candidate;
+// --- Cluster ---
+
+// buf already sealed with cluster_seal
+static void cluster_send(controller_t *ctrl, uint32_t node, const uint8_t *buf, size_t len) {
+    const cluster_node_t *n = &ctrl->cluster->nodes[node];
+    transport_send(ctrl->transport, (struct sockaddr_in*)&n->addr, PKT_CLUSTER,
+                   ctrl->controller_id, 0, buf, (uint16_t)len);
+}
+
+// Member records of one network to a node, or to every live node but us
+// when node is CLUSTER_NO_NODE, as many per datagram as fit
+static void cluster_send_records(controller_t *ctrl, const ctrl_net_t *net, uint32_t node,
+                                 const uint8_t *recs, size_t len) {
+    cluster_t *c = ctrl->cluster;
+    uint8_t buf[MEMBER_SYNC_MAX];
+    buf[0] = CLUSTER_MEMBERS;
+    buf[1] = (uint8_t)c->self;
+    memcpy(buf + 2, net->network->network_id, NETWORK_ID_SIZE);
+    for (size_t off = 0; off < len; ) {
+        size_t n = CLUSTER_MEMBERS_HDR_LEN;
+        while (off < len) {
+            size_t rec = 1 + (recs[off] == MEMBER_UPSERT ? PEER_INFO_LEN : sizeof(uint64_t));
+            if (n + rec > sizeof(buf) - CLUSTER_MAC_LEN) break;
+            memcpy(buf + n, recs + off, rec);
+            n += rec;
+            off += rec;
+        }
+        n = cluster_seal(c, buf, n);
+        if (n == 0) return;
+        for (uint32_t i = 0; i < c->node_count; i++) {
+            if (i == c->self || !c->nodes[i].alive || (node != CLUSTER_NO_NODE && i != node)) continue;
+            cluster_send(ctrl, i, buf, n);
+        }
+    }
+}
+
+// Every member we serve, to one node (it just came up) or to all of them
+// (the periodic refresh that keeps replicas from going stale)
+static void cluster_push_all(controller_t *ctrl, uint32_t node) {
+    for (uint32_t i = 0; i < ctrl->net_count; i++) {
+        ctrl_net_t *net = ctrl->nets[i];
+        network_t *network = net->network;
+        uint8_t recs[64 * (1 + PEER_INFO_LEN)];
+        size_t len = 0;
+        for (int k = 0; k < network->peer_count; k++) {
+            const peer_t *p = &network->peers[k];
+            if (is_remote(ctrl, p->id)) continue;
+            recs[len++] = MEMBER_UPSERT;
+            member_pack_info(p, recs + len);
+            len += PEER_INFO_LEN;
+            if (len == sizeof(recs)) {
+                cluster_send_records(ctrl, net, node, recs, len);
+                len = 0;
+            }
+        }
+        if (len > 0) cluster_send_records(ctrl, net, node, recs, len);
+    }
+}
+
+// A member of net that node serves changed (or was refreshed)
+static void cluster_upsert(controller_t *ctrl, ctrl_net_t *net, uint32_t node, const uint8_t *rec) {
+    cluster_t *c = ctrl->cluster;
+    uint64_t id;
+    uint32_t vip;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    memcpy(&id, rec, sizeof(uint64_t));
+    memcpy(&vip, rec + 8, sizeof(uint32_t));
+    memcpy(&addr.sin_addr.s_addr, rec + 12, sizeof(uint32_t));
+    memcpy(&addr.sin_port, rec + 16, sizeof(uint16_t));
+    uint8_t flags = rec[PEER_INFO_V6_LEN];
+    time_t now = time(NULL);
+
+    ctrl_net_t *owner_net;
+    peer_t *p = find_member(ctrl, id, &owner_net);
+    if (owner_net && owner_net != net) return;
+    if (p && !is_remote(ctrl, id)) {
+        // Both of us serve it (a node came back after a failover): the
+        // ring owner keeps it and the other one lets go
+        if (cluster_owner(c, id) == c->self) {
+            repl_add(net, MEMBER_UPSERT, p);
+            mark_dirty(ctrl, net);
+            return;
+        }
+        printf("Peer %llu is served by cluster node %u now\n", (unsigned long long)id, node);
+        twheel_del(&ctrl->wheel, p->timer);
+        p->timer = TWHEEL_NONE;
+        stats_peer_detach(ctrl->stats, p->stats_slot);
+        p->stats_slot = -1;
+        hmap_put(&ctrl->remote, id, node);
+        if (vip != p->virtual_ip && ipam_adopt(&net->ipam, id, vip, now)) p->virtual_ip = vip;
+        network_set_endpoint(net->network, p, &addr);
+        p->flags = flags;
+        p->last_seen = now;
+        // Not ours to restore any more
+        uint64_t v = member_log_append(&net->members, MEMBER_UPSERT, p);
+        if (net->persist) store_append(&net->store, v, MEMBER_REMOVE, p, now);
+        mark_dirty(ctrl, net);
+        return;
+    }
+    if (p) {
+        hmap_put(&ctrl->remote, id, node);
+        p->last_seen = now;
+        bool changed = p->flags != flags || p->addr.sin_addr.s_addr != addr.sin_addr.s_addr ||
+                       p->addr.sin_port != addr.sin_port;
+        if (vip != p->virtual_ip && ipam_adopt(&net->ipam, id, vip, now)) {
+            p->virtual_ip = vip;
+            changed = true;
+        }
+        if (!changed) return;
+        network_set_endpoint(net->network, p, &addr);
+        p->flags = flags;
+        member_log_append(&net->members, MEMBER_UPSERT, p);
+        mark_dirty(ctrl, net);
+        return;
+    }
+
+    peer_t np;
+    memset(&np, 0, sizeof(np));
+    np.id = id;
+    np.addr = addr;
+    np.last_seen = now;
+    np.is_active = true;
+    np.flags = flags;
+    np.timer = TWHEEL_NONE;
+    np.stats_slot = -1;
+    np.virtual_ip = ipam_adopt(&net->ipam, id, vip, now);
+    if (np.virtual_ip == 0) {
+        fprintf(stderr, "Peer %llu from cluster node %u: vIP already in use here\n",
+                (unsigned long long)id, node);
+        return;
+    }
+    network_overlay_ip6(net->network->network_id, id, np.virtual_ip6);
+    if (network_load_peer(net->network, &np) != 0 ||
+        hmap_put(&ctrl->member_net, id, net->index) != 0 ||
+        hmap_put(&ctrl->remote, id, node) != 0) {
+        hmap_del(&ctrl->member_net, id);
+        network_remove_peer(net->network, id);
+        ipam_release(&net->ipam, id, now);
+        return;
+    }
+    member_log_append(&net->members, MEMBER_UPSERT, network_find_peer(net->network, id));
+    mark_dirty(ctrl, net);
+}
+
+// Forget a member placed elsewhere
+static void drop_remote(controller_t *ctrl, ctrl_net_t *net, peer_t *p) {
+    uint64_t id = p->id;
+    member_log_append(&net->members, MEMBER_REMOVE, p);
+    mark_dirty(ctrl, net);
+    ipam_release(&net->ipam, id, time(NULL));
+    hmap_del(&ctrl->remote, id);
+    hmap_del(&ctrl->member_net, id);
+    network_remove_peer(net->network, id);
+}
+
+// PKT_CLUSTER from another node
+static void cluster_receive(controller_t *ctrl, uint32_t node, const uint8_t *data, int data_len) {
+    cluster_t *c = ctrl->cluster;
+    if (cluster_heard(c, node, monotonic_us())) {
+        printf("Cluster node %u is back\n", node);
+    }
+    if (!c->nodes[node].synced) {
+        c->nodes[node].synced = true;
+        cluster_push_all(ctrl, node);
+    }
+    if (data_len < CLUSTER_MEMBERS_HDR_LEN || data[0] != CLUSTER_MEMBERS) return;
+    ctrl_net_t *net = find_network(ctrl, data + 2);
+    if (!net) return;
+    for (int off = CLUSTER_MEMBERS_HDR_LEN; off < data_len; ) {
+        uint8_t op = data[off++];
+        if (op == MEMBER_UPSERT && off + PEER_INFO_LEN <= data_len) {
+            cluster_upsert(ctrl, net, node, data + off);
+            off += PEER_INFO_LEN;
+        } else if (op == MEMBER_REMOVE && off + 8 <= data_len) {
+            uint64_t id;
+            uint32_t holder;
+            memcpy(&id, data + off, sizeof(uint64_t));
+            off += 8;
+            // Only the node serving the member may remove it
+            ctrl_net_t *owner_net;
+            peer_t *p = find_member(ctrl, id, &owner_net);
+            if (p && owner_net == net && hmap_get(&ctrl->remote, id, &holder) && holder == node) {
+                drop_remote(ctrl, net, p);
+            }
+        } else {
+            break;
+        }
+    }
+}
+
+// Nodes went silent: serve the members the ring now gives us. Their
+// clients rejoin through their seed controller, which sends them here,
+// and keep their addresses.
+static void cluster_failover(controller_t *ctrl) {
+    cluster_t *c = ctrl->cluster;
+    int adopted = 0;
+    for (uint32_t i = 0; i < ctrl->net_count; i++) {
+        ctrl_net_t *net = ctrl->nets[i];
+        for (int k = 0; k < net->network->peer_count; k++) {
+            peer_t *p = &net->network->peers[k];
+            uint32_t holder;
+            if (!hmap_get(&ctrl->remote, p->id, &holder) || c->nodes[holder].alive ||
+                cluster_owner(c, p->id) != c->self) continue;
+            hmap_del(&ctrl->remote, p->id);
+            p->stats_slot = stats_peer_attach(ctrl->stats, p->id);
+            peer_update_last_seen(p);
+            peer_timer_start(ctrl, p);
+            member_changed(ctrl, net, MEMBER_UPSERT, p);
+            adopted++;
+        }
+    }
+    if (adopted > 0) printf("Took over %d members from failed cluster nodes\n", adopted);
+}
+
+// Heartbeats out, silent nodes out of the ring, periodic full refresh
+static void on_cluster_timer(void *arg, uint64_t now_us) {
+    controller_t *ctrl = (controller_t*)arg;
+    cluster_t *c = ctrl->cluster;
+    uint8_t hb[2 + CLUSTER_MAC_LEN] = { CLUSTER_HEARTBEAT, (uint8_t)c->self };
+    if (cluster_seal(c, hb, 2) == 0) return;
+    // Dead nodes too, so they learn we are here when they come back
+    for (uint32_t n = 0; n < c->node_count; n++) {
+        if (n != c->self) cluster_send(ctrl, n, hb, sizeof(hb));
+    }
+    if (cluster_expire(c, now_us) > 0) {
+        printf("Cluster node down; %u live points on the ring\n", c->ring_len);
+        cluster_failover(ctrl);
+    }
+    time_t now = time(NULL);
+    if (now - ctrl->last_resync >= CLUSTER_RESYNC_INTERVAL) {
+        ctrl->last_resync = now;
+        cluster_push_all(ctrl, CLUSTER_NO_NODE);
+    }
+}
+
+// Host another network. Its state lives in ZTNET_STATE_DIR itself for the
+// first network and in ZTNET_STATE_DIR/networks/<name> for the others.
+// Returns the network's index, -1 on error.
+// Undo the registration of the network just added (its restore failed):
+// members brought back so far leave their timers, counters and index entries
+static void net_discard(controller_t *ctrl, ctrl_net_t *net) {
+    for (int i = 0; i < net->network->peer_count; i++) {
+        peer_t *p = &net->network->peers[i];
+        twheel_del(&ctrl->wheel, p->timer);
+        stats_peer_detach(ctrl->stats, p->stats_slot);
+        hmap_del(&ctrl->member_net, p->id);
     }
-    return 0; // none available
+    hmap_del(&ctrl->net_by_id, netid_key(net->network->network_id));
+    hmap_del(&ctrl->net_by_name, name_key(net->network->name));
+    ctrl->nets[--ctrl->net_count] = NULL;
+    net_free(net);
+}
+
+int controller_add_network(controller_t *ctrl, const char *name, const char *password,
+                           const char *cidr, const char *reserve) {
+    if (!ctrl || !name || !name[0]) return -1;
+    if (strlen(name) >= MAX_NETWORK_NAME || strchr(name, '/') || name[0] == '.') {
+        fprintf(stderr, "Invalid network name '%s'\n", name);
+        return -1;
+    }
+    uint32_t idx;
+    if (hmap_get(&ctrl->net_by_name, name_key(name), &idx) &&
+        strcmp(ctrl->nets[idx]->network->name, name) == 0) {
+        fprintf(stderr, "Network '%s' is already hosted\n", name);
+        return -1;
+    }
+    if (ctrl->net_count == CONTROLLER_MAX_NETWORKS) {
+        fprintf(stderr, "Controller is full (max %d networks)\n", CONTROLLER_MAX_NETWORKS);
+        return -1;
+    }
+    if (ctrl->net_count == ctrl->net_cap) {
+        uint32_t cap = ctrl->net_cap ? ctrl->net_cap * 2 : 16;
+        ctrl_net_t **n = (ctrl_net_t**)realloc(ctrl->nets, cap * sizeof(ctrl_net_t*));
+        if (!n) {
+            perror("Failed to grow network table");
+            return -1;
+        }
+        ctrl->nets = n;
+        ctrl->net_cap = cap;
+    }
+
+    ctrl_net_t *net = (ctrl_net_t*)calloc(1, sizeof(ctrl_net_t));
+    if (!net) {
+        perror("Failed to allocate network");
+        return -1;
+    }
+    net->index = ctrl->net_count;
+    if (password) snprintf(net->password, sizeof(net->password), "%s", password);
+
+    // Overlay address pool: cidr, ZTNET_IPAM_LEASE (seconds a departed
+    // member's address is held for it), reservations
+    const char *lease = getenv("ZTNET_IPAM_LEASE");
+    if (ipam_init(&net->ipam, cidr ? cidr : OVERLAY_DEFAULT_CIDR,
+                  lease ? atoi(lease) : IPAM_DEFAULT_LEASE) != 0 ||
+        ipam_load_reservations(&net->ipam, reserve) != 0) {
+        net_free(net);
+        return -1;
+    }
+    // Cluster nodes allocate from disjoint strides of the same pool
+    if (ctrl->cluster &&
+        ipam_partition(&net->ipam, ctrl->cluster->node_count, ctrl->cluster->self) != 0) {
+        net_free(net);
+        return -1;
+    }
+    member_log_init(&net->members);
+
+    const store_header_t *saved = NULL;
+    if (ctrl->state_dir[0]) {
+        char dir[sizeof(net->store.dir)];
+        if (net->index == 0) snprintf(dir, sizeof(dir), "%s", ctrl->state_dir);
+        else snprintf(dir, sizeof(dir), "%s/networks/%s", ctrl->state_dir, name);
+        if (store_open(&net->store, dir) != 0) {
+            net_free(net);
+            return -1;
+        }
+        net->persist = true;
+        saved = store_header(&net->store);
+        if (saved && (saved->overlay_network != net->ipam.network ||
+                      saved->prefix_len != (uint32_t)net->ipam.prefix_len)) {
+            char cidr_str[32];
+            ipam_cidr_str(&net->ipam, cidr_str, sizeof(cidr_str));
+            fprintf(stderr, "State in %s is for another overlay than %s\n", dir, cidr_str);
+            net_free(net);
+            return -1;
+        }
+    }
+
+    // In a cluster the ID follows from the name, the same on every node
+    uint8_t cluster_id[NETWORK_ID_SIZE];
+    if (ctrl->cluster) {
+        if (cluster_network_id(ctrl->cluster, name, cluster_id) != 0 ||
+            (saved && memcmp(saved->network_id, cluster_id, NETWORK_ID_SIZE) != 0)) {
+            fprintf(stderr, "State of '%s' is not from this cluster\n", name);
+            net_free(net);
+            return -1;
+        }
+    }
+    net->network = saved ? network_create_with_id(name, true, saved->network_id, &saved->network_keys)
+                 : ctrl->cluster ? network_create_with_id(name, true, cluster_id, NULL)
+                 : network_create(name, true);
+    if (!net->network) {
+        net_free(net);
+        return -1;
+    }
+    if (find_network(ctrl, net->network->network_id)) {
+        fprintf(stderr, "Network ID of '%s' is already in use\n", name);
+        net_free(net);
+        return -1;
+    }
+    if (hmap_put(&ctrl->net_by_id, netid_key(net->network->network_id), net->index) != 0 ||
+        hmap_put(&ctrl->net_by_name, name_key(name), net->index) != 0) {
+        hmap_del(&ctrl->net_by_id, netid_key(net->network->network_id));
+        net_free(net);
+        return -1;
+    }
+    ctrl->nets[ctrl->net_count++] = net;
+    if (saved && net->index == 0) ctrl->controller_id = saved->controller_id;
+
+    if (net->persist && controller_restore(ctrl, net) != 0) {
+        net_discard(ctrl, net);
+        return -1;
+    }
+    return (int)net->index;
+}
+
+// Host the networks listed in a file, one per line:
+//   <name> [password=<pw>] [cidr=<a.b.c.d/len>] [reserve=<spec>]
+// reserve takes the ZTNET_IPAM_RESERVE syntax; '#' starts a comment.
+// Without cidr= the network uses ZTNET_OVERLAY_CIDR or the default.
+int controller_load_networks(controller_t *ctrl, const char *path) {
+    if (!ctrl || !path) return -1;
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open networks file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char line[1024];
+    int lineno = 0, added = 0, rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *save = NULL;
+        char *name = strtok_r(line, " \t\r\n", &save);
+        if (!name) continue;
+        const char *password = NULL, *cidr = getenv("ZTNET_OVERLAY_CIDR"), *reserve = NULL;
+        for (char *opt = strtok_r(NULL, " \t\r\n", &save); opt; opt = strtok_r(NULL, " \t\r\n", &save)) {
+            if (strncmp(opt, "password=", 9) == 0) password = opt + 9;
+            else if (strncmp(opt, "cidr=", 5) == 0) cidr = opt + 5;
+            else if (strncmp(opt, "reserve=", 8) == 0) reserve = opt + 8;
+            else {
+                fprintf(stderr, "%s:%d: unknown option '%s'\n", path, lineno, opt);
+                rc = -1;
+                break;
+            }
+        }
+        if (rc == 0 && controller_add_network(ctrl, name, password, cidr, reserve) < 0) {
+            fprintf(stderr, "%s:%d: network '%s' not added\n", path, lineno, name);
+            rc = -1;
+        }
+        if (rc == 0) added++;
+    }
+    fclose(f);
+    printf("Hosting %u networks (%d from %s)\n", ctrl->net_count, added, path);
+    return rc;
 }
 
 // Create controller
 controller_t* controller_create(const char *network_name, uint16_t port, const char *password) {
     if (!network_name) return NULL;
-    
+
     controller_t *ctrl = (controller_t*)calloc(1, sizeof(controller_t));
     if (!ctrl) {
         perror("Failed to allocate controller");
         return NULL;
     }
-    
-    // Generate controller ID
+
+    // Generate controller ID (kept across restarts with ZTNET_STATE_DIR)
     ctrl->controller_id = (uint64_t)time(NULL);
 
-    if (password) {
-        strncpy(ctrl->network_password, password, sizeof(ctrl->network_password)-1);
-        ctrl->network_password[sizeof(ctrl->network_password)-1] = '\0';
-    } else {
-        ctrl->network_password[0] = '\0';
+    // JOIN replay protection: ZTNET_JOIN_WINDOW seconds of allowed clock
+    // difference, ZTNET_REPLAY_CACHE JOINs remembered
+    const char *window = getenv("ZTNET_JOIN_WINDOW");
+    const char *cache = getenv("ZTNET_REPLAY_CACHE");
+    ctrl->join_window = window && atoi(window) > 0 ? atoi(window) : JOIN_DEFAULT_WINDOW;
+    long cache_size = cache ? atol(cache) : REPLAY_DEFAULT_CAPACITY;
+    if (cache_size < 1 || cache_size > (1L << 24)) cache_size = REPLAY_DEFAULT_CAPACITY;
+    if (replay_init(&ctrl->replay, (uint32_t)cache_size, ctrl->join_window) != 0) {
+        free(ctrl);
+        return NULL;
     }
-    ctrl->nonce_cache_count = 0;
-    
-    // Create network
-    ctrl->network = network_create(network_name, true);
-    if (!ctrl->network) {
+
+    // Persistent state: ZTNET_STATE_DIR keeps network IDs, keys, members
+    // and leases across restarts
+    const char *state_dir = getenv("ZTNET_STATE_DIR");
+    if (state_dir) snprintf(ctrl->state_dir, sizeof(ctrl->state_dir), "%s", state_dir);
+
+    // Indexes over the hosted networks and their members
+    if (hmap_init(&ctrl->net_by_id, 16) != 0 || hmap_init(&ctrl->net_by_name, 16) != 0 ||
+        hmap_init(&ctrl->member_net, 256) != 0) {
+        hmap_free(&ctrl->net_by_id);
+        hmap_free(&ctrl->net_by_name);
+        replay_free(&ctrl->replay);
         free(ctrl);
         return NULL;
     }
-    
+
     // Create transport
     ctrl->transport = transport_create(port);
     if (!ctrl->transport) {
-        network_destroy(ctrl->network);
+        hmap_free(&ctrl->net_by_id);
+        hmap_free(&ctrl->net_by_name);
+        hmap_free(&ctrl->member_net);
+        replay_free(&ctrl->replay);
         free(ctrl);
         return NULL;
     }
-    
+
     // Set socket to non-blocking
     int flags = fcntl(ctrl->transport->socket_fd, F_GETFL, 0);
     fcntl(ctrl->transport->socket_fd, F_SETFL, flags | O_NONBLOCK);
-    
+
+    // Relayed traffic arrives in bursts; give the socket room to absorb them
+    int sock_buf = CONTROLLER_SOCK_BUF;
+    setsockopt(ctrl->transport->socket_fd, SOL_SOCKET, SO_RCVBUF, &sock_buf, sizeof(sock_buf));
+    setsockopt(ctrl->transport->socket_fd, SOL_SOCKET, SO_SNDBUF, &sock_buf, sizeof(sock_buf));
+
+    // Thread placement follows ZTNET_AFFINITY, else the default-route NIC
+    affinity_load(&ctrl->affinity, getenv("ZTNET_AFFINITY"), NULL);
+
+    // Batched relay I/O; ZTNET_RELAY_GSO=0 turns off UDP GSO trains
+    const char *gso = getenv("ZTNET_RELAY_GSO");
+    ctrl->relay = relay_batch_create(&ctrl->affinity, !(gso && strcmp(gso, "0") == 0));
+    if (!ctrl->relay) {
+        transport_destroy(ctrl->transport);
+        hmap_free(&ctrl->net_by_id);
+        hmap_free(&ctrl->net_by_name);
+        hmap_free(&ctrl->member_net);
+        replay_free(&ctrl->replay);
+        free(ctrl);
+        return NULL;
+    }
+
+    twheel_init(&ctrl->wheel, CONTROLLER_TICK_MS * 1000ULL, monotonic_us());
+
+    // Event loop: the socket, the timer wheel, lease sweeps and sync flushes
+    if (evloop_init(&ctrl->loop) != 0 ||
+        evloop_add_fd(&ctrl->loop, ctrl->transport->socket_fd, on_socket_readable, ctrl) != 0 ||
+        evloop_add_timer(&ctrl->loop, CONTROLLER_TICK_MS * 1000ULL, CONTROLLER_TICK_MS * 1000ULL,
+                         on_wheel_timer, ctrl) != 0 ||
+        evloop_add_timer(&ctrl->loop, LEASE_SWEEP_INTERVAL * 1000000ULL, LEASE_SWEEP_INTERVAL * 1000000ULL,
+                         on_sweep_timer, ctrl) != 0 ||
+        evloop_add_timer(&ctrl->loop, MEMBER_SYNC_INTERVAL_MS * 1000ULL, MEMBER_SYNC_INTERVAL_MS * 1000ULL,
+                         on_sync_timer, ctrl) != 0) {
+        fprintf(stderr, "Failed to set up controller event loop\n");
+        evloop_close(&ctrl->loop);
+        twheel_free(&ctrl->wheel);
+        relay_batch_destroy(ctrl->relay);
+        transport_destroy(ctrl->transport);
+        hmap_free(&ctrl->net_by_id);
+        hmap_free(&ctrl->net_by_name);
+        hmap_free(&ctrl->member_net);
+        replay_free(&ctrl->replay);
+        free(ctrl);
+        return NULL;
+    }
+
     ctrl->running = false;
-    
+
+    // Live counters for `zerrytee top` / `zerrytee metrics`; optional
+    ctrl->stats = stats_create("controller");
+
+    // JOIN verification and member keys on worker threads; ZTNET_AUTH_WORKERS
+    // sizes the pool, 0 keeps it on the event loop
+    const char *auth_workers = getenv("ZTNET_AUTH_WORKERS");
+    int workers = auth_workers ? atoi(auth_workers) : auth_pool_default_workers();
+    if (workers > 0) {
+        ctrl->auth = auth_pool_create(workers, ctrl->join_window, &ctrl->affinity);
+        if (!ctrl->auth || evloop_add_fd(&ctrl->loop, ctrl->auth->done.rfd, on_auth_done, ctrl) != 0) {
+            fprintf(stderr, "Failed to set up JOIN auth workers\n");
+            controller_destroy(ctrl);
+            return NULL;
+        }
+    }
+
+    // Cluster: ZTNET_CLUSTER lists the controllers, ZTNET_NODE_ID picks ours,
+    // ZTNET_CLUSTER_KEY authenticates them to each other
+    const char *cluster = getenv("ZTNET_CLUSTER");
+    if (cluster) {
+        ctrl->cluster = (cluster_t*)calloc(1, sizeof(cluster_t));
+        if (!ctrl->cluster ||
+            cluster_init(ctrl->cluster, cluster, getenv("ZTNET_NODE_ID"), getenv("ZTNET_CLUSTER_KEY"),
+                         port, monotonic_us()) != 0 ||
+            hmap_init(&ctrl->remote, 256) != 0 ||
+            evloop_add_timer(&ctrl->loop, CLUSTER_HEARTBEAT_MS * 1000ULL, CLUSTER_HEARTBEAT_MS * 1000ULL,
+                             on_cluster_timer, ctrl) != 0) {
+            fprintf(stderr, "Failed to set up cluster\n");
+            controller_destroy(ctrl);
+            return NULL;
+        }
+        ctrl->last_resync = time(NULL);
+    }
+
+    // The network named on the command line; ZTNET_OVERLAY_CIDR and
+    // ZTNET_IPAM_RESERVE configure its address pool
+    if (controller_add_network(ctrl, network_name, password, getenv("ZTNET_OVERLAY_CIDR"),
+                               getenv("ZTNET_IPAM_RESERVE")) < 0) {
+        controller_destroy(ctrl);
+        return NULL;
+    }
+    ctrl_net_t *net = ctrl->nets[0];
+
     printf("Controller created with ID: %llu\n", (unsigned long long)ctrl->controller_id);
-    if (ctrl->network_password[0]) {
+    if (ctrl->cluster) {
+        printf("Cluster node %u of %u\n", ctrl->cluster->self, ctrl->cluster->node_count);
+    }
+    char cidr_str[32];
+    ipam_cidr_str(&net->ipam, cidr_str, sizeof(cidr_str));
+    printf("Overlay network: %s (%u addresses free)\n", cidr_str, net->ipam.free_count);
+    if (net->password[0]) {
         printf("Network password: set\n");
     } else {
         printf("Network password: not set\n");
@@ -85,19 +979,38 @@ controller_t* controller_create(const char *network_name, uint16_t port, const c
 // Destroy controller
 void controller_destroy(controller_t *ctrl) {
     if (!ctrl) return;
-    
+
     if (ctrl->running) {
         controller_stop(ctrl);
     }
-    
+    auth_pool_destroy(ctrl->auth);
+
     if (ctrl->transport) {
         transport_destroy(ctrl->transport);
     }
-    
-    if (ctrl->network) {
-        network_destroy(ctrl->network);
+
+    evloop_close(&ctrl->loop);
+    twheel_free(&ctrl->wheel);
+    relay_batch_destroy(ctrl->relay);
+
+    // A clean shutdown leaves snapshots and empty WALs
+    for (uint32_t i = 0; i < ctrl->net_count; i++) {
+        if (ctrl->nets[i]->persist) controller_save(ctrl, ctrl->nets[i]);
+        net_free(ctrl->nets[i]);
     }
-    
+    free(ctrl->nets);
+    free(ctrl->dirty);
+    free(ctrl->replies);
+    hmap_free(&ctrl->net_by_id);
+    hmap_free(&ctrl->net_by_name);
+    hmap_free(&ctrl->member_net);
+    hmap_free(&ctrl->remote);
+    free(ctrl->cluster);
+    replay_free(&ctrl->replay);
+    free(ctrl->sync_frames);
+
+    stats_destroy(ctrl->stats);
+
     printf("Controller destroyed\n");
     free(ctrl);
 }
@@ -105,20 +1018,21 @@ void controller_destroy(controller_t *ctrl) {
 // Start controller thread
 int controller_start(controller_t *ctrl) {
     if (!ctrl) return -1;
-    
+
     if (ctrl->running) {
         fprintf(stderr, "Controller already running\n");
         return -1;
     }
-    
+
     ctrl->running = true;
-    
+    ctrl->loop.stopped = false;
+
     if (pthread_create(&ctrl->thread, NULL, controller_run, ctrl) != 0) {
         perror("Failed to create controller thread");
         ctrl->running = false;
         return -1;
     }
-    
+
     printf("Controller started\n");
     return 0;
 }
@@ -126,263 +1040,565 @@ int controller_start(controller_t *ctrl) {
 // Stop controller
 void controller_stop(controller_t *ctrl) {
     if (!ctrl || !ctrl->running) return;
-    
+
     printf("Stopping controller...\n");
     ctrl->running = false;
-    
+    evloop_stop(&ctrl->loop);
+
     pthread_join(ctrl->thread, NULL);
     printf("Controller stopped\n");
 }
 
-// Approve a peer to join the network
-int controller_approve_peer(controller_t *ctrl, uint64_t peer_id, 
-                            struct sockaddr_in addr) {
-    if (!ctrl) return -1;
-    
-    peer_t *new_peer = peer_create(peer_id, addr);
-    if (!new_peer) return -1;
-
-    // Assign a unique virtual IP address from the overlay subnet
-    uint32_t assigned_ip = allocate_virtual_ip(ctrl);
-    if (assigned_ip == 0) {
-        fprintf(stderr, "No available virtual IPs in %s/24\n", OVERLAY_BASE_IP);
+// Approve a peer to join a network
+// requested_vip is the address the client had before (0 = none); it is
+// kept when still free so restarted clients come back on the same vIP.
+int controller_approve_peer(controller_t *ctrl, ctrl_net_t *net, uint64_t peer_id,
+                            struct sockaddr_in addr, uint32_t requested_vip, const keypair_t *keys) {
+    if (!ctrl || !net) return -1;
+
+    // A member restarting without BYE rejoins with its addresses unchanged
+    peer_t *member = network_find_peer(net->network, peer_id);
+    if (member && is_remote(ctrl, peer_id)) {
+        // Served by another node of the cluster until now
+        hmap_del(&ctrl->remote, peer_id);
+        member->stats_slot = stats_peer_attach(ctrl->stats, peer_id);
+        peer_timer_start(ctrl, member);
+    }
+    if (member) {
+        network_set_endpoint(net->network, member, &addr);
+        peer_update_last_seen(member);
+        printf("Peer %llu rejoined from %s:%d\n", (unsigned long long)peer_id,
+               inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+    } else {
+        peer_t *new_peer = keys ? peer_create_with_keys(peer_id, addr, keys) : peer_create(peer_id, addr);
+        if (!new_peer) return -1;
+
+        // Assign a unique virtual IP address from the overlay subnet
+        uint32_t assigned_ip = ipam_assign(&net->ipam, peer_id, requested_vip, time(NULL));
+        if (assigned_ip == 0) {
+            char cidr_str[32];
+            ipam_cidr_str(&net->ipam, cidr_str, sizeof(cidr_str));
+            fprintf(stderr, "No available virtual IPs in %s\n", cidr_str);
+            peer_destroy(new_peer);
+            return -1;
+        }
+        new_peer->virtual_ip = assigned_ip;
+        network_overlay_ip6(net->network->network_id, peer_id, new_peer->virtual_ip6);
+        new_peer->stats_slot = stats_peer_attach(ctrl->stats, peer_id);
+
+        int result = network_add_peer(net->network, new_peer);
+        if (result == 0 && hmap_put(&ctrl->member_net, peer_id, net->index) != 0) {
+            network_remove_peer(net->network, peer_id);
+            result = -1;
+        }
+        if (result != 0) {
+            stats_peer_detach(ctrl->stats, new_peer->stats_slot);
+            ipam_release(&net->ipam, peer_id, time(NULL));
+            peer_destroy(new_peer);
+            return result;
+        }
         peer_destroy(new_peer);
-        return -1;
+        member = network_find_peer(net->network, peer_id);
+        peer_timer_start(ctrl, member);
     }
-    new_peer->virtual_ip = assigned_ip;
-    
-    int result = network_add_peer(ctrl->network, new_peer);
-    
-    if (result == 0) {
-        // Send JOIN_RESPONSE with assigned virtual IP as 4-byte payload
-        transport_send(ctrl->transport, &addr, PKT_JOIN_RESPONSE,
-                       ctrl->controller_id, peer_id, (const uint8_t*)&assigned_ip, sizeof(assigned_ip));
-
-        // 1) Send existing peers to the new client
-        for (int i = 0; i < ctrl->network->peer_count - 1; i++) {
-            peer_t *p = &ctrl->network->peers[i];
-            uint8_t payload[sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint16_t)] = {0};
-            uint32_t ip_be = p->addr.sin_addr.s_addr; // already BE
-            uint16_t port_be = p->addr.sin_port;      // already BE
-            memcpy(payload, &p->id, sizeof(uint64_t));
-            memcpy(payload + 8, &p->virtual_ip, sizeof(uint32_t));
-            memcpy(payload + 12, &ip_be, sizeof(uint32_t));
-            memcpy(payload + 16, &port_be, sizeof(uint16_t));
-            transport_send(ctrl->transport, &addr, PKT_PEER_INFO, ctrl->controller_id, peer_id, payload, sizeof(payload));
-        }
-
-        // 2) Broadcast the new peer to all existing clients
-        for (int i = 0; i < ctrl->network->peer_count - 1; i++) {
-            peer_t *p = &ctrl->network->peers[i];
-            uint8_t payload[sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint16_t)] = {0};
-            uint32_t ip_be = addr.sin_addr.s_addr;
-            uint16_t port_be = addr.sin_port;
-            memcpy(payload, &new_peer->id, sizeof(uint64_t));
-            memcpy(payload + 8, &new_peer->virtual_ip, sizeof(uint32_t));
-            memcpy(payload + 12, &ip_be, sizeof(uint32_t));
-            memcpy(payload + 16, &port_be, sizeof(uint16_t));
-            transport_send(ctrl->transport, &p->addr, PKT_PEER_INFO, ctrl->controller_id, p->id, payload, sizeof(payload));
-        }
-    }
-    
-    peer_destroy(new_peer);
-    return result;
-}
-
-// List all peers
+
+    stats_inc(ctrl->stats, STAT_JOIN_OK);
+    // Send JOIN_RESPONSE with assigned virtual IPv4 + IPv6 addresses and
+    // the overlay prefix length
+    uint8_t resp[JOIN_RESPONSE_CIDR_LEN];
+    memcpy(resp, &member->virtual_ip, sizeof(uint32_t));
+    memcpy(resp + 4, member->virtual_ip6, IPV6_ADDR_SIZE);
+    resp[JOIN_RESPONSE_LEN] = (uint8_t)net->ipam.prefix_len;
+
+    // The member gets a snapshot and everyone else this change on the
+    // next sync flush
+    member->sync_version = 0;
+    member_changed(ctrl, net, MEMBER_UPSERT, member);
+    send_join_reply(ctrl, net, &addr, peer_id, resp);
+    return 0;
+}
+
+// List the members of every network that has any
 void controller_list_peers(controller_t *ctrl) {
-    if (!ctrl || !ctrl->network) return;
-    
-    printf("\n=== Network: %s ===\n", ctrl->network->name);
-    printf("Total peers: %d\n", ctrl->network->peer_count);
-    
-    for (int i = 0; i < ctrl->network->peer_count; i++) {
-        peer_t *p = &ctrl->network->peers[i];
-        char ip_str[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &(p->addr.sin_addr), ip_str, INET_ADDRSTRLEN);
-
-        char vip_str[INET_ADDRSTRLEN] = {0};
-        if (p->virtual_ip != 0) {
-            struct in_addr vip; vip.s_addr = p->virtual_ip;
-            inet_ntop(AF_INET, &vip, vip_str, INET_ADDRSTRLEN);
-        }
-        
-        time_t now = time(NULL);
-        int elapsed = (int)(now - p->last_seen);
-        
-        printf("  Peer %llu: %s:%d (vIP: %s) (last seen: %ds ago, %s)\n",
-               (unsigned long long)p->id, ip_str, ntohs(p->addr.sin_port),
-               vip_str[0] ? vip_str : "-",
-               elapsed,
-               p->is_active ? "active" : "inactive");
+    if (!ctrl) return;
+
+    int idle = 0;
+    for (uint32_t n = 0; n < ctrl->net_count; n++) {
+        network_t *network = ctrl->nets[n]->network;
+        if (network->peer_count == 0 && ctrl->net_count > 1) {
+            idle++;
+            continue;
+        }
+        printf("\n=== Network: %s ===\n", network->name);
+        printf("Total peers: %d\n", network->peer_count);
+
+        for (int i = 0; i < network->peer_count; i++) {
+            peer_t *p = &network->peers[i];
+            char ip_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &(p->addr.sin_addr), ip_str, INET_ADDRSTRLEN);
+
+            char vip_str[INET_ADDRSTRLEN] = {0};
+            if (p->virtual_ip != 0) {
+                struct in_addr vip; vip.s_addr = p->virtual_ip;
+                inet_ntop(AF_INET, &vip, vip_str, INET_ADDRSTRLEN);
+            }
+            char vip6_str[INET6_ADDRSTRLEN];
+            inet_ntop(AF_INET6, p->virtual_ip6, vip6_str, sizeof(vip6_str));
+
+            time_t now = time(NULL);
+            int elapsed = (int)(now - p->last_seen);
+
+            char where[32] = "";
+            uint32_t node;
+            if (ctrl->cluster && hmap_get(&ctrl->remote, p->id, &node)) {
+                snprintf(where, sizeof(where), ", on node %u", node);
+            }
+
+            printf("  Peer %llu: %s:%d (vIP: %s, %s) (last seen: %ds ago, %s%s%s)\n",
+                   (unsigned long long)p->id, ip_str, ntohs(p->addr.sin_port),
+                   vip_str[0] ? vip_str : "-", vip6_str,
+                   elapsed,
+                   p->is_active ? "active" : "inactive",
+                   (p->flags & PEER_FLAG_RELAY) ? ", relay" : "", where);
+        }
     }
+    if (idle > 0) printf("\n(%d networks without members)\n", idle);
     printf("\n");
 }
 
-static int is_replay_and_record(controller_t *ctrl, uint64_t client_id, uint64_t nonce_val) {
-    // Check existing
-    for (int i = 0; i < ctrl->nonce_cache_count; i++) {
-        if (ctrl->nonce_cache[i].client_id == client_id && ctrl->nonce_cache[i].nonce == nonce_val) {
-            return 1; // replay
-        }
-    }
-    // Insert/overwrite (ring buffer behavior)
-    if (ctrl->nonce_cache_count < JOIN_REPLAY_CACHE) {
-        ctrl->nonce_cache[ctrl->nonce_cache_count].client_id = client_id;
-        ctrl->nonce_cache[ctrl->nonce_cache_count].nonce = nonce_val;
-        ctrl->nonce_cache_count++;
+static void list_send(controller_t *ctrl, struct sockaddr_in *to, uint64_t cli_id,
+                      uint8_t *buf, size_t count) {
+    uint8_t *page = buf + sizeof(packet_header_t);
+    page[LIST_PAGE_HDR_LEN - 1] = (uint8_t)count;
+    size_t len = LIST_PAGE_HDR_LEN + count * LIST_RECORD_LEN;
+    transport_write_header(ctrl->transport, buf, PKT_LIST_PAGE, ctrl->controller_id, cli_id, (uint16_t)len);
+    if (transport_send_raw(ctrl->transport, to, buf, sizeof(packet_header_t) + len, 0) == 0) {
+        stats_inc(ctrl->stats, STAT_TX_PACKETS);
     } else {
-        // Simple overwrite oldest
-        for (int i = 1; i < JOIN_REPLAY_CACHE; i++) ctrl->nonce_cache[i-1] = ctrl->nonce_cache[i];
-        ctrl->nonce_cache[JOIN_REPLAY_CACHE-1].client_id = client_id;
-        ctrl->nonce_cache[JOIN_REPLAY_CACHE-1].nonce = nonce_val;
+        stats_inc(ctrl->stats, STAT_DROP_SEND);
     }
-    return 0;
 }
 
-// Controller main loop
-void* controller_run(void *arg) {
-    controller_t *ctrl = (controller_t*)arg;
-    
-    time_t last_keepalive = time(NULL);
-    time_t last_check = time(NULL);
-    
-    printf("Controller thread started\n");
-    
-    while (ctrl->running) {
-        time_t now = time(NULL);
-        
-        // Receive packets
-        packet_header_t header;
-        uint8_t data[MAX_PACKET_SIZE];
-        struct sockaddr_in sender;
-        
-        int data_len = transport_receive(ctrl->transport, &header, data, &sender);
-        
-        if (data_len >= 0) {
-            // Update sender's observed address if known
-            peer_t *sender_peer = network_find_peer(ctrl->network, header.sender_id);
-            if (sender_peer) {
-                sender_peer->addr = sender; // update public endpoint
+// One page of a member listing (PKT_LIST_REQUEST): up to `window`
+// datagrams of compact records, with at most LIST_SCAN_BUDGET members
+// looked at, so listing a large network is a series of short pauses in
+// the event loop rather than one long one
+static void send_list_page(controller_t *ctrl, struct sockaddr_in *to, uint64_t cli_id,
+                           const uint8_t *req, int req_len) {
+    if (req_len < LIST_REQUEST_LEN) {
+        // Old-style request: end the listing rather than flood the asker
+        transport_send(ctrl->transport, to, PKT_LIST_DONE, ctrl->controller_id, cli_id, NULL, 0);
+        return;
+    }
+    uint64_t cursor;
+    memcpy(&cursor, req + 4, sizeof(cursor));
+    int window = req[12] ? req[12] : 1;
+    if (window > LIST_MAX_WINDOW) window = LIST_MAX_WINDOW;
+    uint8_t filter = req[13];
+    uint32_t prefix = 0, mask = 0;
+    if ((filter & LIST_FILTER_PREFIX) && req_len >= LIST_REQUEST_PREFIX_LEN && req[18] <= 32) {
+        memcpy(&prefix, req + 14, sizeof(prefix));
+        mask = req[18] ? htonl(~0U << (32 - req[18])) : 0;
+        prefix &= mask;
+    }
+    time_t now = time(NULL);
+
+    uint8_t buf[MAX_PACKET_SIZE];
+    uint8_t *page = buf + sizeof(packet_header_t);
+    const size_t cap = (MEMBER_SYNC_MAX - LIST_PAGE_HDR_LEN) / LIST_RECORD_LEN;
+    memset(page, 0, LIST_PAGE_HDR_LEN);
+    memcpy(page, req, 4);
+    size_t count = 0;
+    int sent = 0, scanned = 0;
+    bool stop = false;
+    uint32_t ni = cursor == LIST_CURSOR_END ? ctrl->net_count : (uint32_t)(cursor >> 32);
+    uint32_t mi = (uint32_t)cursor, open_net = UINT32_MAX;
+
+    while (!stop && ni < ctrl->net_count) {
+        network_t *network = ctrl->nets[ni]->network;
+        // Handle slots, not peers[]: removals reorder the dense array
+        // between pages, while a member keeps its slot
+        for (; mi < network->slot_count; mi++) {
+            if (scanned++ == LIST_SCAN_BUDGET) {
+                stop = true;
+                break;
             }
-            // Handle packet based on type
-            switch (header.type) {
-                case PKT_HELLO:
-                    printf("Received HELLO from peer %llu\n", (unsigned long long)header.sender_id);
-                    transport_send(ctrl->transport, &sender, PKT_HELLO_ACK,
-                                 ctrl->controller_id, header.sender_id, NULL, 0);
-                    break;
-                
-                case PKT_JOIN_REQUEST:
-                    printf("Received JOIN_REQUEST from peer %llu\n", (unsigned long long)header.sender_id);
-                    if (data_len >= NETWORK_ID_SIZE && memcmp(data, ctrl->network->network_id, NETWORK_ID_SIZE) == 0) {
-                        int ok = 1;
-                        if (ctrl->network_password[0]) {
-                            // Expect payload: netid(16) + client_id(8) + nonce(8) + hmac(32)
-                            if (data_len != NETWORK_ID_SIZE + 8 + 8 + 32) ok = 0;
-                            else {
-                                uint64_t client_id_payload = 0, nonce_val = 0;
-                                memcpy(&client_id_payload, data + NETWORK_ID_SIZE, 8);
-                                memcpy(&nonce_val, data + NETWORK_ID_SIZE + 8, 8);
-                                const uint8_t *mac = data + NETWORK_ID_SIZE + 16;
-                                // Identity binding
-                                if (client_id_payload != header.sender_id) ok = 0;
-                                // Replay protection
-                                if (ok && is_replay_and_record(ctrl, client_id_payload, nonce_val)) ok = 0;
-                                // HMAC check
-                                if (ok) {
-                                    uint8_t msg[NETWORK_ID_SIZE + 8 + 8];
-                                    memcpy(msg, data, sizeof(msg));
-                                    uint8_t calc[32];
-                                    if (hmac_sha256((const uint8_t*)ctrl->network_password,
-                                                    strlen(ctrl->network_password),
-                                                    msg, sizeof(msg), calc) != 0) ok = 0;
-                                    else if (memcmp(calc, mac, 32) != 0) ok = 0;
-                                }
-                            }
-                        }
-                        if (ok) controller_approve_peer(ctrl, header.sender_id, sender);
-                        else {
-                            printf("JOIN denied: auth failed for peer %llu\n", (unsigned long long)header.sender_id);
-                            transport_send(ctrl->transport, &sender, PKT_JOIN_RESPONSE,
-                                           ctrl->controller_id, header.sender_id, NULL, 0);
-                        }
-                    } else {
-                        printf("JOIN denied: network ID mismatch from peer %llu\n", (unsigned long long)header.sender_id);
-                        transport_send(ctrl->transport, &sender, PKT_JOIN_RESPONSE,
-                                       ctrl->controller_id, header.sender_id, NULL, 0);
-                    }
-                    break;
-                
-                case PKT_KEEPALIVE: {
-                    peer_t *peer = network_find_peer(ctrl->network, header.sender_id);
-                    if (peer) {
-                        peer_update_last_seen(peer);
-                    }
-                    break; }
-                
-                case PKT_BYE:
-                    printf("Received BYE from peer %llu\n", (unsigned long long)header.sender_id);
-                    network_remove_peer(ctrl->network, header.sender_id);
-                    break;
-                
-                case PKT_LIST_REQUEST: {
-                    for (int i = 0; i < ctrl->network->peer_count; i++) {
-                        peer_t *p = &ctrl->network->peers[i];
-                        uint8_t payload[sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint16_t)] = {0};
-                        uint32_t ip_be = p->addr.sin_addr.s_addr;
-                        uint16_t port_be = p->addr.sin_port;
-                        memcpy(payload, &p->id, sizeof(uint64_t));
-                        memcpy(payload + 8, &p->virtual_ip, sizeof(uint32_t));
-                        memcpy(payload + 12, &ip_be, sizeof(uint32_t));
-                        memcpy(payload + 16, &port_be, sizeof(uint16_t));
-                        transport_send(ctrl->transport, &sender, PKT_PEER_INFO,
-                                       ctrl->controller_id, header.sender_id,
-                                       payload, sizeof(payload));
-                    }
-                    transport_send(ctrl->transport, &sender, PKT_LIST_DONE,
-                                   ctrl->controller_id, header.sender_id, NULL, 0);
-                    break; }
-                
-                case PKT_DATA: {
-                    // Relay DATA to destination peer if direct failed
-                    peer_t *dst = network_find_peer(ctrl->network, header.dest_id);
-                    if (dst) {
-                        transport_send(ctrl->transport, &dst->addr, PKT_DATA,
-                                       header.sender_id, dst->id, data, (uint16_t)data_len);
-                    }
-                    break; }
-                
-                default:
-                    printf("Unknown packet type: %d\n", header.type);
+            const peer_t *p = network_slot_peer(network, mi);
+            if (!p) continue;
+            if ((filter & LIST_FILTER_ACTIVE) && !(p->is_active && now - p->last_seen <= PEER_TIMEOUT)) continue;
+            if ((filter & LIST_FILTER_PREFIX) && (p->virtual_ip & mask) != prefix) continue;
+            // A datagram holds one network's members
+            if (count == cap || (count > 0 && open_net != ni)) {
+                if (sent + 1 == window) {
+                    stop = true;
                     break;
+                }
+                list_send(ctrl, to, cli_id, buf, count);
+                page[4] = (uint8_t)++sent;
+                count = 0;
+            }
+            if (count == 0) {
+                open_net = ni;
+                memcpy(page + 14, network->network_id, NETWORK_ID_SIZE);
             }
+            uint8_t *r = page + LIST_PAGE_HDR_LEN + count * LIST_RECORD_LEN;
+            uint16_t idle = now - p->last_seen > 65535 ? 65535 : (uint16_t)(now - p->last_seen);
+            memcpy(r, &p->id, sizeof(uint64_t));
+            memcpy(r + 8, &p->virtual_ip, sizeof(uint32_t));
+            memcpy(r + 12, &p->addr.sin_addr.s_addr, sizeof(uint32_t));
+            memcpy(r + 16, &p->addr.sin_port, sizeof(uint16_t));
+            r[18] = p->flags;
+            memcpy(r + 19, &idle, sizeof(uint16_t));
+            count++;
         }
-        
-        // Send keepalives periodically
-        if (now - last_keepalive >= KEEPALIVE_INTERVAL) {
-            for (int i = 0; i < ctrl->network->peer_count; i++) {
-                peer_t *p = &ctrl->network->peers[i];
-                transport_send_keepalive(ctrl->transport, &p->addr,
-                                        ctrl->controller_id, p->id);
+        if (!stop) {
+            ni++;
+            mi = 0;
+        }
+    }
+    cursor = ni < ctrl->net_count ? ((uint64_t)ni << 32) | mi : LIST_CURSOR_END;
+    page[5] = LIST_PAGE_LAST;
+    memcpy(page + 6, &cursor, sizeof(cursor));
+    list_send(ctrl, to, cli_id, buf, count);
+}
+
+static void deny_join(controller_t *ctrl, struct sockaddr_in *sender, uint64_t peer_id) {
+    stats_inc(ctrl->stats, STAT_JOIN_DENIED);
+    transport_send(ctrl->transport, sender, PKT_JOIN_RESPONSE,
+                   ctrl->controller_id, peer_id, NULL, 0);
+}
+
+// Finish a JOIN once its HMAC and keys are done (on a worker or inline):
+// replay check, then admission. The network may have gained the peer
+// through another JOIN in the meantime.
+static void join_verdict(controller_t *ctrl, const auth_result_t *r) {
+    ctrl_net_t *net = ctrl->nets[r->net], *current;
+    struct sockaddr_in addr = r->addr;
+    bool ok = r->verdict == AUTH_OK;
+    if (r->verdict == AUTH_STALE) {
+        printf("JOIN from peer %llu outside the %d s window (clock off by %lld s)\n",
+               (unsigned long long)r->peer_id, ctrl->join_window, (long long)r->skew);
+    }
+    // Replay protection, once the JOIN is known to be genuine
+    if (ok && r->authenticated) {
+        int seen = replay_check(&ctrl->replay, r->peer_id, r->nonce, time(NULL));
+        if (seen < 0) fprintf(stderr, "JOIN replay cache full; refusing JOINs\n");
+        if (seen != 0) ok = false;
+    }
+    if (!ok) {
+        printf("JOIN denied: auth failed for peer %llu\n", (unsigned long long)r->peer_id);
+        deny_join(ctrl, &addr, r->peer_id);
+        return;
+    }
+    if (find_member(ctrl, r->peer_id, &current) && current != net) {
+        printf("JOIN denied: peer %llu is a member of '%s'\n",
+               (unsigned long long)r->peer_id, current->network->name);
+        deny_join(ctrl, &addr, r->peer_id);
+        return;
+    }
+    controller_approve_peer(ctrl, net, r->peer_id, addr, r->vip_hint, r->has_keys ? &r->keys : NULL);
+}
+
+static void on_auth_result(void *arg, const auth_result_t *r) {
+    join_verdict((controller_t*)arg, r);
+}
+
+// Verdicts posted by the JOIN auth workers
+static void on_auth_done(void *arg) {
+    controller_t *ctrl = (controller_t*)arg;
+    auth_pool_collect(ctrl->auth, on_auth_result, ctrl);
+    if (ctrl->reply_count > 0) controller_commit(ctrl);
+}
+
+// Handle one datagram from the controller socket
+static void handle_packet(controller_t *ctrl, packet_header_t header, const uint8_t *data,
+                          int data_len, struct sockaddr_in sender) {
+    if (header.type == PKT_CLUSTER) {
+        // The source address only names the node; the MAC proves it, and
+        // the node index inside must agree with it
+        uint32_t node = ctrl->cluster ? cluster_node_of(ctrl->cluster, &sender) : CLUSTER_NO_NODE;
+        if (node == CLUSTER_NO_NODE) return;
+        if (!cluster_verify(ctrl->cluster, data, (size_t)data_len) ||
+            data_len < 2 + CLUSTER_MAC_LEN || data[1] != node) {
+            fprintf(stderr, "Dropped unauthenticated cluster packet from %s:%u\n",
+                    inet_ntoa(sender.sin_addr), ntohs(sender.sin_port));
+            return;
+        }
+        cluster_receive(ctrl, node, data, data_len - CLUSTER_MAC_LEN);
+        return;
+    }
+    // Update sender's observed address if known; members another node of
+    // the cluster serves are only looked at when they JOIN
+    ctrl_net_t *net;
+    peer_t *sender_peer = find_member(ctrl, header.sender_id, &net);
+    if (sender_peer && is_remote(ctrl, sender_peer->id)) sender_peer = NULL;
+    if (sender_peer) {
+        // A member that roamed (new NAT mapping, new network) keeps
+        // its vIP; the others learn the new endpoint with the next sync
+        bool moved = sender_peer->addr.sin_addr.s_addr != sender.sin_addr.s_addr ||
+                     sender_peer->addr.sin_port != sender.sin_port;
+        network_set_endpoint(net->network, sender_peer, &sender); // update public endpoint
+        if (moved && header.type != PKT_JOIN_REQUEST) {
+            printf("Peer %llu moved to %s:%d\n", (unsigned long long)sender_peer->id,
+                   inet_ntoa(sender.sin_addr), ntohs(sender.sin_port));
+            member_changed(ctrl, net, MEMBER_UPSERT, sender_peer);
+        }
+        stats_peer_add(ctrl->stats, sender_peer->stats_slot, PSTAT_RX_PACKETS, 1);
+        stats_peer_add(ctrl->stats, sender_peer->stats_slot, PSTAT_RX_BYTES, (uint64_t)data_len);
+    }
+    // Handle packet based on type
+    switch (header.type) {
+        case PKT_HELLO:
+            printf("Received HELLO from peer %llu\n", (unsigned long long)header.sender_id);
+            transport_send(ctrl->transport, &sender, PKT_HELLO_ACK,
+                         ctrl->controller_id, header.sender_id, NULL, 0);
+            break;
+
+        case PKT_JOIN_REQUEST: {
+            printf("Received JOIN_REQUEST from peer %llu\n", (unsigned long long)header.sender_id);
+            // The network is named by its ID; a peer ID belongs to one network
+            ctrl_net_t *target = data_len >= NETWORK_ID_SIZE ? find_network(ctrl, data) : NULL;
+            if (!target) {
+                printf("JOIN denied: unknown network ID from peer %llu\n", (unsigned long long)header.sender_id);
+                deny_join(ctrl, &sender, header.sender_id);
+                break;
             }
-            last_keepalive = now;
-        }
-        
-        // Check peer timeouts
-        if (now - last_check >= 10) {
-            for (int i = 0; i < ctrl->network->peer_count; i++) {
-                peer_t *p = &ctrl->network->peers[i];
-                if (!peer_is_alive(p, PEER_TIMEOUT)) {
-                    printf("Peer %llu timed out\n", (unsigned long long)p->id);
+            if (net && net != target) {
+                printf("JOIN denied: peer %llu is a member of '%s'\n",
+                       (unsigned long long)header.sender_id, net->network->name);
+                deny_join(ctrl, &sender, header.sender_id);
+                break;
+            }
+            // Another node's shard: send the client there
+            uint32_t owner = ctrl->cluster ? cluster_owner(ctrl->cluster, header.sender_id) : 0;
+            if (ctrl->cluster && owner != ctrl->cluster->self && !sender_peer) {
+                const struct sockaddr_in *to = &ctrl->cluster->nodes[owner].addr;
+                uint8_t redirect[REDIRECT_LEN];
+                memcpy(redirect, &to->sin_addr.s_addr, sizeof(uint32_t));
+                memcpy(redirect + 4, &to->sin_port, sizeof(uint16_t));
+                printf("JOIN from peer %llu redirected to cluster node %u\n",
+                       (unsigned long long)header.sender_id, owner);
+                transport_send(ctrl->transport, &sender, PKT_REDIRECT,
+                               ctrl->controller_id, header.sender_id, redirect, sizeof(redirect));
+                break;
+            }
+            auth_job_t job;
+            job.peer_id = header.sender_id;
+            job.addr = sender;
+            job.net = target->index;
+            job.password = target->password;
+            job.need_keys = !sender_peer;
+            job.len = (uint8_t)(data_len < AUTH_PAYLOAD_MAX ? data_len : AUTH_PAYLOAD_MAX);
+            memcpy(job.data, data, job.len);
+            if (job.len != data_len) job.len = 0;   // oversized: never a valid length
+            if (ctrl->auth) {
+                if (auth_pool_submit(ctrl->auth, &job) != 0) {
+                    printf("JOIN from peer %llu dropped: auth workers busy\n",
+                           (unsigned long long)header.sender_id);
                 }
+            } else {
+                auth_result_t r;
+                auth_verify(&job, ctrl->join_window, time(NULL), &r);
+                join_verdict(ctrl, &r);
             }
-            last_check = now;
+            break; }
+
+        case PKT_KEEPALIVE:
+            if (sender_peer) {
+                peer_update_last_seen(sender_peer);
+                // Clients report the membership version they hold; one that
+                // lost a sync datagram gets the missing part again
+                uint64_t version;
+                if (data_len >= KEEPALIVE_VERSION_LEN) {
+                    memcpy(&version, data, sizeof(version));
+                    if (version < sender_peer->sync_version) {
+                        sender_peer->sync_version = version;
+                        net->sync_pending = true;
+                        mark_dirty(ctrl, net);
+                    }
+                }
+            }
+            break;
+
+        case PKT_RELAY_ANNOUNCE: {
+            // Member volunteers (or withdraws) as a relay: advertise the
+            // change to everyone else so they can route through it
+            peer_t *peer = sender_peer;
+            if (!peer || data_len < 1) break;
+            uint8_t flags = (data[0] & PEER_FLAG_RELAY) ? (peer->flags | PEER_FLAG_RELAY)
+                                                        : (peer->flags & ~PEER_FLAG_RELAY);
+            if (flags == peer->flags) break;
+            peer->flags = flags;
+            printf("Peer %llu %s relaying\n", (unsigned long long)peer->id,
+                   (flags & PEER_FLAG_RELAY) ? "offers" : "stops");
+            member_changed(ctrl, net, MEMBER_UPSERT, peer);
+            break; }
+
+        case PKT_BYE:
+            printf("Received BYE from peer %llu\n", (unsigned long long)header.sender_id);
+            if (sender_peer) evict_peer(ctrl, net, sender_peer);
+            break;
+
+        case PKT_LIST_REQUEST:
+            send_list_page(ctrl, &sender, header.sender_id, data, data_len);
+            break;
+
+        case PKT_DATA:
+        case PKT_HC_NACK:
+        case PKT_PROBE:
+        case PKT_PROBE_REPLY: {
+            // Relay peer-to-peer packets to destination peer if direct
+            // failed; only between members of the same network
+            peer_t *dst = sender_peer ? network_find_peer(net->network, header.dest_id) : NULL;
+            if (!dst) {
+                stats_inc(ctrl->stats, STAT_DROP_UNKNOWN_PEER);
+                break;
+            }
+            // Keep the sender's outer DSCP/ECN on the relayed hop
+            if (transport_send_tos(ctrl->transport, &dst->addr, (packet_type_t)header.type,
+                                   header.sender_id, dst->id, data, (uint16_t)data_len,
+                                   ctrl->transport->last_rx_tos) != 0) {
+                stats_inc(ctrl->stats, STAT_DROP_SEND);
+                break;
+            }
+            stats_inc(ctrl->stats, STAT_RELAY_PACKETS);
+            stats_add(ctrl->stats, STAT_RELAY_BYTES, (uint64_t)data_len);
+            stats_peer_add(ctrl->stats, sender_peer->stats_slot, PSTAT_RELAY_PACKETS, 1);
+            stats_peer_add(ctrl->stats, sender_peer->stats_slot, PSTAT_RELAY_BYTES, (uint64_t)data_len);
+            stats_peer_add(ctrl->stats, dst->stats_slot, PSTAT_TX_PACKETS, 1);
+            stats_peer_add(ctrl->stats, dst->stats_slot, PSTAT_TX_BYTES, (uint64_t)data_len);
+            break; }
+
+        default:
+            printf("Unknown packet type: %d\n", header.type);
+            break;
+    }
+}
+
+// Relay fast path for peer-to-peer traffic: look the members up in the
+// hash indexes and queue the datagram to go out unchanged. Returns false
+// for anything handle_packet() has to see (control packets, roaming).
+static bool relay_fast(controller_t *ctrl, int idx, uint64_t *relay_bytes) {
+    relay_msg_t *m = &ctrl->relay->msg[idx];
+    if (m->len < sizeof(packet_header_t)) return false;
+    const packet_header_t *h = (const packet_header_t*)m->data;
+    if (h->type != PKT_DATA && h->type != PKT_HC_NACK &&
+        h->type != PKT_PROBE && h->type != PKT_PROBE_REPLY) return false;
+
+    // The sender must be the member registered at this endpoint in its
+    // network; roaming and unknown senders take the slow path
+    uint32_t n;
+    if (!hmap_get(&ctrl->member_net, h->sender_id, &n)) return false;
+    network_t *network = ctrl->nets[n]->network;
+    peer_t *src = network_find_endpoint(network, &m->from);
+    if (!src || src->id != h->sender_id) return false;
+    uint64_t data_len = m->len - sizeof(packet_header_t);
+    stats_peer_add(ctrl->stats, src->stats_slot, PSTAT_RX_PACKETS, 1);
+    stats_peer_add(ctrl->stats, src->stats_slot, PSTAT_RX_BYTES, data_len);
+    peer_t *dst = network_find_peer(network, h->dest_id);
+    if (!dst) {
+        stats_inc(ctrl->stats, STAT_DROP_UNKNOWN_PEER);
+        return true;
+    }
+    // Header and payload stay as the sender built them; only the UDP
+    // destination changes (the outer DSCP/ECN is carried over)
+    relay_batch_forward(ctrl->relay, idx, &dst->addr);
+    *relay_bytes += data_len;
+    stats_peer_add(ctrl->stats, src->stats_slot, PSTAT_RELAY_PACKETS, 1);
+    stats_peer_add(ctrl->stats, src->stats_slot, PSTAT_RELAY_BYTES, data_len);
+    stats_peer_add(ctrl->stats, dst->stats_slot, PSTAT_TX_PACKETS, 1);
+    stats_peer_add(ctrl->stats, dst->stats_slot, PSTAT_TX_BYTES, data_len);
+    return true;
+}
+
+// Socket readable: drain what is queued in batches, up to a budget so
+// timers still run on time under flood (the fd stays readable and we
+// come straight back)
+static void on_socket_readable(void *arg) {
+    controller_t *ctrl = (controller_t*)arg;
+    relay_batch_t *b = ctrl->relay;
+    for (int budget = CONTROLLER_RX_BUDGET; budget > 0; budget -= RELAY_BATCH) {
+        int n = relay_batch_recv(b, ctrl->transport);
+        if (n <= 0) break;
+        uint64_t rx_bytes = 0, relay_bytes = 0;
+        for (int i = 0; i < n; i++) {
+            rx_bytes += b->msg[i].len;
+            if (relay_fast(ctrl, i, &relay_bytes)) continue;
+            packet_header_t header;
+            int data_len = transport_decode(b->msg[i].data, b->msg[i].len, &header);
+            if (data_len < 0) continue;
+            ctrl->transport->last_rx_tos = b->msg[i].tos;
+            handle_packet(ctrl, header, b->msg[i].data + sizeof(packet_header_t), data_len,
+                          b->msg[i].from);
+        }
+        int queued = b->fwd_count;
+        int sent = relay_batch_flush(b, ctrl->transport);
+        stats_add(ctrl->stats, STAT_RX_PACKETS, (uint64_t)n);
+        stats_add(ctrl->stats, STAT_RX_BYTES, rx_bytes);
+        stats_add(ctrl->stats, STAT_RELAY_PACKETS, (uint64_t)sent);
+        stats_add(ctrl->stats, STAT_RELAY_BYTES, relay_bytes);
+        if (sent < queued) stats_add(ctrl->stats, STAT_DROP_SEND, (uint64_t)(queued - sent));
+        if (ctrl->reply_count > 0) controller_commit(ctrl);
+        if (n < RELAY_BATCH) break;
+    }
+}
+
+// Turn the timer wheel: keepalives and expiries that came due
+static void on_wheel_timer(void *arg, uint64_t now_us) {
+    controller_t *ctrl = (controller_t*)arg;
+    twheel_advance(&ctrl->wheel, now_us, on_peer_timer, ctrl);
+    flush_keepalives(ctrl);
+}
+
+// Return expired vIP leases to the pool; fold long WALs into snapshots;
+// drop members of other nodes that have not been refreshed for a while
+static void on_sweep_timer(void *arg, uint64_t now_us) {
+    controller_t *ctrl = (controller_t*)arg;
+    (void)now_us;
+    time_t now = time(NULL);
+    for (uint32_t i = 0; i < ctrl->net_count; i++) {
+        ctrl_net_t *net = ctrl->nets[i];
+        ipam_expire(&net->ipam, now);
+        for (int k = ctrl->cluster ? net->network->peer_count - 1 : -1; k >= 0; k--) {
+            peer_t *p = &net->network->peers[k];
+            if (now - p->last_seen > 3 * CLUSTER_RESYNC_INTERVAL && is_remote(ctrl, p->id)) {
+                drop_remote(ctrl, net, p);
+            }
+        }
+        if (net->persist && store_wants_compaction(&net->store, net->network->peer_count)) {
+            controller_commit(ctrl);
+            controller_save(ctrl, net);
+        }
+    }
+}
+
+// Commit and push coalesced membership changes of the networks that had any
+static void on_sync_timer(void *arg, uint64_t now_us) {
+    controller_t *ctrl = (controller_t*)arg;
+    (void)now_us;
+    if (ctrl->dirty_count == 0) return;
+    controller_commit(ctrl);
+    for (uint32_t i = 0; i < ctrl->dirty_count; i++) {
+        ctrl_net_t *net = ctrl->nets[ctrl->dirty[i]];
+        net->dirty = false;
+        member_sync_flush(ctrl, net);
+        if (net->repl_len > 0) {
+            cluster_send_records(ctrl, net, CLUSTER_NO_NODE, net->repl, net->repl_len);
+            net->repl_len = 0;
         }
-        
-        usleep(100000);
     }
-    
+    ctrl->dirty_count = 0;
+}
+
+// Controller main loop: sleeps until a datagram arrives or a timer is due
+void* controller_run(void *arg) {
+    controller_t *ctrl = (controller_t*)arg;
+
+    printf("Controller thread started\n");
+    affinity_pin(&ctrl->affinity, AFF_IO, "controller");
+
+    evloop_run(&ctrl->loop);
+
     printf("Controller thread exiting\n");
     return NULL;
 }
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "../include/ipam.h"
+
+#define IPAM_NO_LEASE UINT32_MAX
+
+// --- Hierarchical bitmap ---
+
+static bool bit_test(const ipam_t *ip, uint32_t host) {
+    return (ip->level[0][host >> 6] >> (host & 63)) & 1;
+}
+
+// Mark taken; a word that fills up sets its bit one level higher
+static void take(ipam_t *ip, uint32_t host) {
+    ip->free_count--;
+    for (int k = 0; k < ip->levels; k++) {
+        uint32_t w = host >> 6;
+        ip->level[k][w] |= 1ULL << (host & 63);
+        if (ip->level[k][w] != ~0ULL) break;
+        host = w;
+    }
+}
+
+// Mark free; a word that was full clears its bit one level higher
+static void give(ipam_t *ip, uint32_t host) {
+    ip->free_count++;
+    for (int k = 0; k < ip->levels; k++) {
+        uint32_t w = host >> 6;
+        bool was_full = ip->level[k][w] == ~0ULL;
+        ip->level[k][w] &= ~(1ULL << (host & 63));
+        if (!was_full) break;
+        host = w;
+    }
+}
+
+// Lowest free address: one word per level, top down
+static bool find_free(const ipam_t *ip, uint32_t *host) {
+    uint32_t idx = 0;
+    for (int k = ip->levels - 1; k >= 0; k--) {
+        uint64_t w = ip->level[k][idx];
+        if (w == ~0ULL) return false;
+        idx = idx * 64 + (uint32_t)__builtin_ctzll(~w);
+    }
+    *host = idx;
+    return true;
+}
+
+// Addresses outside our part of a partitioned pool are marked taken in
+// the bitmap for good; the ones adopted for members placed elsewhere are
+// tracked in a side set
+static bool foreign(const ipam_t *ip, uint32_t host) {
+    return ip->parts > 1 && host % ip->parts != ip->part;
+}
+
+static bool host_taken(const ipam_t *ip, uint32_t host) {
+    return foreign(ip, host) ? hmap_get(&ip->foreign, host, NULL) : bit_test(ip, host);
+}
+
+static int host_take(ipam_t *ip, uint32_t host) {
+    if (foreign(ip, host)) return hmap_put(&ip->foreign, host, 1);
+    take(ip, host);
+    return 0;
+}
+
+static void host_give(ipam_t *ip, uint32_t host) {
+    if (foreign(ip, host)) hmap_del(&ip->foreign, host);
+    else give(ip, host);
+}
+
+// --- Leases ---
+
+static uint32_t lease_new(ipam_t *ip, uint64_t peer_id, uint32_t host, ipam_lease_state_t state) {
+    uint32_t idx = ip->free_lease;
+    if (idx != IPAM_NO_LEASE) {
+        ip->free_lease = ip->leases[idx].host;   // free leases chain through host
+    } else {
+        if (ip->lease_count == ip->lease_cap) {
+            uint32_t cap = ip->lease_cap ? ip->lease_cap * 2 : 64;
+            ipam_lease_t *l = (ipam_lease_t*)realloc(ip->leases, cap * sizeof(ipam_lease_t));
+            if (!l) {
+                perror("Failed to grow lease table");
+                return IPAM_NO_LEASE;
+            }
+            ip->leases = l;
+            ip->lease_cap = cap;
+        }
+        idx = ip->lease_count++;
+        ip->leases[idx].gen = 0;
+    }
+    if (hmap_put(&ip->by_peer, peer_id, idx) != 0) {
+        ip->leases[idx].state = IPAM_LEASE_FREE;
+        ip->leases[idx].host = ip->free_lease;
+        ip->free_lease = idx;
+        return IPAM_NO_LEASE;
+    }
+    ipam_lease_t *l = &ip->leases[idx];
+    l->peer_id = peer_id;
+    l->host = host;
+    l->state = (uint8_t)state;
+    l->active = state == IPAM_LEASE_ACTIVE;
+    l->released = 0;
+    return idx;
+}
+
+// Return a lease's address to the pool
+static void lease_drop(ipam_t *ip, uint32_t idx) {
+    ipam_lease_t *l = &ip->leases[idx];
+    hmap_del(&ip->by_peer, l->peer_id);
+    host_give(ip, l->host);
+    l->state = IPAM_LEASE_FREE;
+    l->host = ip->free_lease;
+    ip->free_lease = idx;
+}
+
+static int held_push(ipam_t *ip, uint32_t idx) {
+    if (ip->held_count == ip->held_cap) {
+        uint32_t cap = ip->held_cap ? ip->held_cap * 2 : 64;
+        ipam_held_t *h = (ipam_held_t*)malloc(cap * sizeof(ipam_held_t));
+        if (!h) {
+            perror("Failed to grow held lease queue");
+            return -1;
+        }
+        for (uint32_t i = 0; i < ip->held_count; i++) {
+            h[i] = ip->held[(ip->held_head + i) % ip->held_cap];
+        }
+        free(ip->held);
+        ip->held = h;
+        ip->held_head = 0;
+        ip->held_cap = cap;
+    }
+    ipam_held_t *e = &ip->held[(ip->held_head + ip->held_count) % ip->held_cap];
+    e->lease = idx;
+    e->gen = ip->leases[idx].gen;
+    ip->held_count++;
+    return 0;
+}
+
+// Oldest queue entry that still refers to a held lease (stale ones, for
+// members that came back, are discarded on the way)
+static ipam_lease_t* held_front(ipam_t *ip, uint32_t *idx) {
+    while (ip->held_count > 0) {
+        const ipam_held_t *e = &ip->held[ip->held_head];
+        ipam_lease_t *l = &ip->leases[e->lease];
+        if (l->state == IPAM_LEASE_HELD && l->gen == e->gen) {
+            *idx = e->lease;
+            return l;
+        }
+        ip->held_head = (ip->held_head + 1) % ip->held_cap;
+        ip->held_count--;
+    }
+    return NULL;
+}
+
+static void held_pop(ipam_t *ip) {
+    ip->held_head = (ip->held_head + 1) % ip->held_cap;
+    ip->held_count--;
+}
+
+// --- Pool ---
+
+// cidr is "a.b.c.d/len"; host bits of the address are ignored
+int ipam_init(ipam_t *ip, const char *cidr, int lease_sec) {
+    if (!ip || !cidr) return -1;
+    memset(ip, 0, sizeof(*ip));
+    char addr[INET_ADDRSTRLEN];
+    const char *slash = strchr(cidr, '/');
+    struct in_addr a;
+    char *end = NULL;
+    long plen = slash ? strtol(slash + 1, &end, 10) : -1;
+    if (!slash || (size_t)(slash - cidr) >= sizeof(addr) || *end != '\0' ||
+        plen < IPAM_MIN_PREFIX || plen > IPAM_MAX_PREFIX) {
+        fprintf(stderr, "Invalid overlay CIDR '%s' (expect a.b.c.d/%d..%d)\n", cidr,
+                IPAM_MIN_PREFIX, IPAM_MAX_PREFIX);
+        return -1;
+    }
+    memcpy(addr, cidr, (size_t)(slash - cidr));
+    addr[slash - cidr] = '\0';
+    if (inet_pton(AF_INET, addr, &a) != 1) {
+        fprintf(stderr, "Invalid overlay CIDR '%s' (expect a.b.c.d/%d..%d)\n", cidr,
+                IPAM_MIN_PREFIX, IPAM_MAX_PREFIX);
+        return -1;
+    }
+    ip->prefix_len = (int)plen;
+    ip->network = ntohl(a.s_addr) & ntohl(ipam_netmask(ip));
+    ip->size = 1U << (32 - ip->prefix_len);
+    ip->lease_sec = lease_sec < 0 ? 0 : lease_sec;
+    ip->free_lease = IPAM_NO_LEASE;
+
+    uint32_t words = (ip->size + 63) / 64;
+    for (ip->levels = 0; ; ip->levels++) {
+        ip->words[ip->levels] = words;
+        ip->level[ip->levels] = (uint64_t*)calloc(words, sizeof(uint64_t));
+        if (!ip->level[ip->levels]) {
+            perror("Failed to allocate address bitmap");
+            ipam_free(ip);
+            return -1;
+        }
+        if (words == 1) {
+            ip->levels++;
+            break;
+        }
+        words = (words + 63) / 64;
+    }
+    // Bits past the end of each level count as taken, so a partial last
+    // word can fill up
+    for (int k = 0; k < ip->levels; k++) {
+        uint32_t used = k == 0 ? ip->size : ip->words[k - 1];
+        for (uint32_t b = used; b < ip->words[k] * 64; b++) {
+            ip->level[k][b >> 6] |= 1ULL << (b & 63);
+        }
+    }
+    if (hmap_init(&ip->by_peer, 16) != 0) {
+        ipam_free(ip);
+        return -1;
+    }
+    // Network and broadcast addresses, and .1 which stays with the gateway
+    ip->free_count = ip->size;
+    take(ip, 0);
+    take(ip, ip->size - 1);
+    take(ip, 1);
+    return 0;
+}
+
+void ipam_free(ipam_t *ip) {
+    if (!ip) return;
+    for (int k = 0; k < IPAM_LEVELS; k++) {
+        free(ip->level[k]);
+        ip->level[k] = NULL;
+    }
+    free(ip->leases);
+    free(ip->held);
+    ip->leases = NULL;
+    ip->held = NULL;
+    hmap_free(&ip->by_peer);
+    hmap_free(&ip->foreign);
+}
+
+// Host offset of a network-order address, or -1 outside the pool
+static int64_t host_of(const ipam_t *ip, uint32_t addr_net) {
+    uint32_t a = ntohl(addr_net);
+    if ((a & ntohl(ipam_netmask(ip))) != ip->network) return -1;
+    return a - ip->network;
+}
+
+// Comma-separated reservations (ZTNET_IPAM_RESERVE):
+//   a.b.c.d            never handed out
+//   a.b.c.d-e.f.g.h    range never handed out
+//   <peer id>=a.b.c.d  always this address for that peer
+int ipam_load_reservations(ipam_t *ip, const char *spec) {
+    if (!ip || !spec) return 0;
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    char *save = NULL;
+    for (char *item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        while (*item == ' ') item++;
+        char *eq = strchr(item, '=');
+        char *dash = strchr(item, '-');
+        struct in_addr lo, hi;
+        if (eq) {
+            *eq = '\0';
+            char *end = NULL;
+            uint64_t peer_id = strtoull(item, &end, 10);
+            int64_t host = inet_pton(AF_INET, eq + 1, &lo) == 1 ? host_of(ip, lo.s_addr) : -1;
+            if (*end != '\0' || peer_id == 0 || host < 0) {
+                fprintf(stderr, "Invalid IPAM reservation '%s=%s'\n", item, eq + 1);
+                return -1;
+            }
+            if (bit_test(ip, (uint32_t)host) || hmap_get(&ip->by_peer, peer_id, NULL)) {
+                fprintf(stderr, "IPAM reservation %s=%s conflicts with an earlier one\n", item, eq + 1);
+                return -1;
+            }
+            take(ip, (uint32_t)host);
+            if (lease_new(ip, peer_id, (uint32_t)host, IPAM_LEASE_STATIC) == IPAM_NO_LEASE) {
+                give(ip, (uint32_t)host);
+                return -1;
+            }
+            continue;
+        }
+        if (dash) *dash = '\0';
+        int64_t first = inet_pton(AF_INET, item, &lo) == 1 ? host_of(ip, lo.s_addr) : -1;
+        int64_t last = first;
+        if (dash) last = inet_pton(AF_INET, dash + 1, &hi) == 1 ? host_of(ip, hi.s_addr) : -1;
+        if (first < 0 || last < first) {
+            fprintf(stderr, "Invalid IPAM reservation '%s' (outside the overlay?)\n", item);
+            return -1;
+        }
+        for (int64_t h = first; h <= last; h++) {
+            if (!bit_test(ip, (uint32_t)h)) take(ip, (uint32_t)h);
+        }
+    }
+    return 0;
+}
+
+// Hand out only every parts-th address, starting at part, so the
+// controllers of a cluster allocate from the same pool without clashing.
+// Call after the reservations are loaded.
+int ipam_partition(ipam_t *ip, uint32_t parts, uint32_t part) {
+    if (!ip || parts <= 1) return 0;
+    if (part >= parts || hmap_init(&ip->foreign, 16) != 0) return -1;
+    for (uint32_t h = 0; h < ip->size; h++) {
+        if (h % parts != part && !bit_test(ip, h)) take(ip, h);
+    }
+    ip->parts = parts;
+    ip->part = part;
+    return 0;
+}
+
+// Drop held leases whose time is up
+void ipam_expire(ipam_t *ip, time_t now) {
+    if (!ip) return;
+    uint32_t idx;
+    ipam_lease_t *l;
+    while ((l = held_front(ip, &idx)) != NULL && now - l->released >= ip->lease_sec) {
+        held_pop(ip);
+        lease_drop(ip, idx);
+    }
+}
+
+// Address for a joining peer (network byte order), 0 if the pool is
+// exhausted. A peer with a lease gets its address back; otherwise the
+// hint (its address before a restart) when free, else the lowest free one.
+uint32_t ipam_assign(ipam_t *ip, uint64_t peer_id, uint32_t hint, time_t now) {
+    if (!ip) return 0;
+    ipam_expire(ip, now);
+
+    uint32_t idx;
+    if (hmap_get(&ip->by_peer, peer_id, &idx)) {
+        ipam_lease_t *l = &ip->leases[idx];
+        if (l->state == IPAM_LEASE_HELD) l->state = IPAM_LEASE_ACTIVE;
+        l->active = 1;
+        return htonl(ip->network + l->host);
+    }
+
+    uint32_t host;
+    int64_t h = hint ? host_of(ip, hint) : -1;
+    if (h >= 0 && !bit_test(ip, (uint32_t)h)) {
+        host = (uint32_t)h;
+    } else if (!find_free(ip, &host)) {
+        // Full: the oldest held lease gives way before its time
+        ipam_lease_t *l = held_front(ip, &idx);
+        if (!l) return 0;
+        held_pop(ip);
+        lease_drop(ip, idx);
+        if (!find_free(ip, &host)) return 0;
+    }
+    take(ip, host);
+    if (lease_new(ip, peer_id, host, IPAM_LEASE_ACTIVE) == IPAM_NO_LEASE) {
+        give(ip, host);
+        return 0;
+    }
+    return htonl(ip->network + host);
+}
+
+// The peer holds exactly this address (network byte order): a member
+// placed by another controller of the cluster, or one being restored. A
+// lease held for a departed peer gives way; returns 0 if an active lease
+// of another peer has the address.
+uint32_t ipam_adopt(ipam_t *ip, uint64_t peer_id, uint32_t addr, time_t now) {
+    if (!ip) return 0;
+    int64_t h = host_of(ip, addr);
+    if (h < 0) return 0;
+    ipam_expire(ip, now);
+
+    uint32_t idx;
+    if (hmap_get(&ip->by_peer, peer_id, &idx)) {
+        ipam_lease_t *l = &ip->leases[idx];
+        if (l->host == (uint32_t)h) {
+            if (l->state == IPAM_LEASE_HELD) l->state = IPAM_LEASE_ACTIVE;
+            l->active = 1;
+            return addr;
+        }
+        if (l->state == IPAM_LEASE_STATIC) return 0;
+        lease_drop(ip, idx);
+    }
+    if (host_taken(ip, (uint32_t)h)) {
+        // Rare (clocks of the hold period differ between controllers): a
+        // scan for the held lease is fine here
+        uint32_t i;
+        for (i = 0; i < ip->lease_count; i++) {
+            if (ip->leases[i].state == IPAM_LEASE_HELD && ip->leases[i].host == (uint32_t)h) break;
+        }
+        if (i == ip->lease_count) return 0;
+        lease_drop(ip, i);
+        if (host_taken(ip, (uint32_t)h)) return 0;
+    }
+    if (host_take(ip, (uint32_t)h) != 0) return 0;
+    if (lease_new(ip, peer_id, (uint32_t)h, IPAM_LEASE_ACTIVE) == IPAM_NO_LEASE) {
+        host_give(ip, (uint32_t)h);
+        return 0;
+    }
+    return addr;
+}
+
+// The peer left: hold its address for it (static reservations stay put)
+void ipam_release(ipam_t *ip, uint64_t peer_id, time_t now) {
+    uint32_t idx;
+    if (!ip || !hmap_get(&ip->by_peer, peer_id, &idx)) return;
+    ipam_lease_t *l = &ip->leases[idx];
+    l->active = 0;
+    if (l->state != IPAM_LEASE_ACTIVE) return;
+    l->state = IPAM_LEASE_HELD;
+    l->gen++;
+    l->released = now;
+    if (ip->lease_sec == 0 || held_push(ip, idx) != 0) lease_drop(ip, idx);
+}
+
+uint32_t ipam_netmask(const ipam_t *ip) {
+    return htonl(~0U << (32 - ip->prefix_len));
+}
+
+void ipam_cidr_str(const ipam_t *ip, char *out, size_t len) {
+    struct in_addr a; a.s_addr = htonl(ip->network);
+    char buf[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &a, buf, sizeof(buf));
+    snprintf(out, len, "%s/%d", buf, ip->prefix_len);
+}
\ No newline at end of file
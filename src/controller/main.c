@@ -50,6 +50,15 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // More networks on the same socket: ZTNET_NETWORKS names a file with
+    // one network per line
+    const char *networks = getenv("ZTNET_NETWORKS");
+    if (networks && controller_load_networks(g_controller, networks) != 0) {
+        fprintf(stderr, "Failed to load networks from %s\n", networks);
+        controller_destroy(g_controller);
+        return 1;
+    }
+
     printf("Starting controller...\n");
     if (controller_start(g_controller) != 0) {
         fprintf(stderr, "Failed to start controller\n");
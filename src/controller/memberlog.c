@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/memberlog.h"
+
+void member_log_init(member_log_t *log) {
+    if (!log) return;
+    memset(log, 0, sizeof(*log));
+}
+
+void member_log_free(member_log_t *log) {
+    if (!log) return;
+    free(log->e);
+    log->e = NULL;
+}
+
+// Continue from a persisted version with an empty ring: members already
+// at that version need nothing, anyone older gets a snapshot
+void member_log_restore(member_log_t *log, uint64_t version) {
+    if (!log) return;
+    log->version = version;
+    log->base = version;
+}
+
+// Record a change to peer; returns its version. For upserts the peer
+// remembers the version so older entries about it can be skipped.
+uint64_t member_log_append(member_log_t *log, uint8_t op, peer_t *peer) {
+    if (!log || !peer) return 0;
+    if (!log->e) {
+        // Without a ring every member falls back to snapshots
+        log->e = (member_log_entry_t*)calloc(MEMBER_LOG_SIZE, sizeof(member_log_entry_t));
+        if (!log->e) perror("Failed to allocate membership log");
+        log->base = log->version;
+    }
+    uint64_t v = ++log->version;
+    if (log->e) {
+        member_log_entry_t *e = &log->e[v % MEMBER_LOG_SIZE];
+        e->version = v;
+        e->peer_id = peer->id;
+        e->op = op;
+    }
+    peer->log_version = v;
+    return v;
+}
+
+// Whether every entry after `since` is still in the ring
+bool member_log_covers(const member_log_t *log, uint64_t since) {
+    return log && log->e && since >= log->base && since <= log->version &&
+           log->version - since <= MEMBER_LOG_SIZE;
+}
+
+// Serialize a PEER_INFO record: id, vIP, public endpoint, vIP6, flags
+void member_pack_info(const peer_t *p, uint8_t out[PEER_INFO_LEN]) {
+    uint32_t ip_be = p->addr.sin_addr.s_addr; // already BE
+    uint16_t port_be = p->addr.sin_port;      // already BE
+    memcpy(out, &p->id, sizeof(uint64_t));
+    memcpy(out + 8, &p->virtual_ip, sizeof(uint32_t));
+    memcpy(out + 12, &ip_be, sizeof(uint32_t));
+    memcpy(out + 16, &port_be, sizeof(uint16_t));
+    memcpy(out + PEER_INFO_V4_LEN, p->virtual_ip6, IPV6_ADDR_SIZE);
+    out[PEER_INFO_V6_LEN] = p->flags;
+}
+
+typedef struct {
+    uint8_t buf[MEMBER_SYNC_MAX];
+    uint16_t len;
+    uint64_t from;
+    uint8_t flags;
+    uint16_t part, parts;
+    member_sync_emit_fn emit;
+    void *ctx;
+} sync_writer_t;
+
+static void writer_init(sync_writer_t *w, uint64_t from, uint8_t flags, uint16_t parts,
+                        member_sync_emit_fn emit, void *ctx) {
+    w->len = MEMBER_SYNC_HDR_LEN;
+    w->from = from;
+    w->flags = flags;
+    w->part = 0;
+    w->parts = parts;
+    w->emit = emit;
+    w->ctx = ctx;
+}
+
+// Emit the records so far as covering (from, to]
+static void writer_flush(sync_writer_t *w, uint64_t to) {
+    memcpy(w->buf, &w->from, sizeof(uint64_t));
+    memcpy(w->buf + 8, &to, sizeof(uint64_t));
+    w->buf[16] = w->flags;
+    memcpy(w->buf + 17, &w->part, sizeof(uint16_t));
+    memcpy(w->buf + 19, &w->parts, sizeof(uint16_t));
+    w->emit(w->ctx, w->buf, w->len);
+    if (!(w->flags & MEMBER_SYNC_SNAPSHOT)) w->from = to;
+    w->part++;
+    w->len = MEMBER_SYNC_HDR_LEN;
+}
+
+// Everything after `since`, split into datagrams whose version ranges
+// follow on from each other. -1 if the ring no longer reaches back that far.
+int member_sync_delta(const member_log_t *log, network_t *net, uint64_t since,
+                      member_sync_emit_fn emit, void *ctx) {
+    if (!log || !net || !emit || !member_log_covers(log, since)) return -1;
+    sync_writer_t w;
+    writer_init(&w, since, 0, 0, emit, ctx);
+    for (uint64_t v = since + 1; v <= log->version; v++) {
+        const member_log_entry_t *e = &log->e[v % MEMBER_LOG_SIZE];
+        const peer_t *p = NULL;
+        uint16_t need = 1 + 8;
+        if (e->op == MEMBER_UPSERT) {
+            // Gone since, or described again by a later entry
+            p = network_find_peer(net, e->peer_id);
+            if (!p || p->log_version != v) continue;
+            need = 1 + PEER_INFO_LEN;
+        }
+        if (w.len + need > MEMBER_SYNC_MAX) writer_flush(&w, v - 1);
+        w.buf[w.len++] = e->op;
+        if (p) {
+            member_pack_info(p, w.buf + w.len);
+            w.len += PEER_INFO_LEN;
+        } else {
+            memcpy(w.buf + w.len, &e->peer_id, sizeof(uint64_t));
+            w.len += 8;
+        }
+    }
+    if (w.len > MEMBER_SYNC_HDR_LEN || w.from < log->version) writer_flush(&w, log->version);
+    return 0;
+}
+
+// The whole current membership (minus skip_id, the recipient) as of the
+// latest version, in numbered parts
+int member_sync_snapshot(const member_log_t *log, const network_t *net, uint64_t skip_id,
+                         member_sync_emit_fn emit, void *ctx) {
+    if (!log || !net || !emit) return -1;
+    const int per_part = (MEMBER_SYNC_MAX - MEMBER_SYNC_HDR_LEN) / (1 + PEER_INFO_LEN);
+    int records = 0;
+    for (int i = 0; i < net->peer_count; i++) {
+        if (net->peers[i].id != skip_id) records++;
+    }
+    int parts = records > 0 ? (records + per_part - 1) / per_part : 1;
+    if (parts > UINT16_MAX) {
+        fprintf(stderr, "Membership snapshot too large (%d records)\n", records);
+        return -1;
+    }
+    sync_writer_t w;
+    writer_init(&w, 0, MEMBER_SYNC_SNAPSHOT, (uint16_t)parts, emit, ctx);
+    for (int i = 0; i < net->peer_count; i++) {
+        const peer_t *p = &net->peers[i];
+        if (p->id == skip_id) continue;
+        if (w.len + 1 + PEER_INFO_LEN > MEMBER_SYNC_MAX) writer_flush(&w, log->version);
+        w.buf[w.len++] = MEMBER_UPSERT;
+        member_pack_info(p, w.buf + w.len);
+        w.len += PEER_INFO_LEN;
+    }
+    writer_flush(&w, log->version);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,287 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include "../include/relay.h"
+
+#if defined(__linux__) && !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103
+#endif
+
+typedef union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+} rx_ctl_t;
+
+#ifdef __linux__
+typedef union {
+    char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+} tx_ctl_t;
+
+typedef struct {
+    struct mmsghdr rx[RELAY_BATCH];
+    struct iovec rx_iov[RELAY_BATCH];
+    rx_ctl_t rx_ctl[RELAY_BATCH];
+    struct mmsghdr tx[RELAY_BATCH];
+    struct iovec tx_iov[RELAY_BATCH];
+    tx_ctl_t tx_ctl[RELAY_BATCH];
+    int tx_head[RELAY_BATCH];        // msg[] index of each tx entry's first datagram
+    int tx_segs[RELAY_BATCH];        // datagrams in each tx entry (>1 = GSO train)
+    int tx_bytes[RELAY_BATCH];
+} relay_io_t;
+#else
+typedef struct {
+    rx_ctl_t rx_ctl;
+} relay_io_t;
+#endif
+
+relay_batch_t* relay_batch_create(const affinity_t *aff, bool gso) {
+    relay_batch_t *b = (relay_batch_t*)calloc(1, sizeof(relay_batch_t));
+    if (!b) {
+        perror("Failed to allocate relay batch");
+        return NULL;
+    }
+    b->io = calloc(1, sizeof(relay_io_t));
+    b->pool = (uint8_t*)affinity_alloc(aff, AFF_IO, (size_t)RELAY_BATCH * MAX_PACKET_SIZE);
+    if (!b->io || !b->pool) {
+        fprintf(stderr, "Failed to allocate relay buffers\n");
+        relay_batch_destroy(b);
+        return NULL;
+    }
+    for (int i = 0; i < RELAY_BATCH; i++) {
+        b->msg[i].data = b->pool + (size_t)i * MAX_PACKET_SIZE;
+    }
+#ifdef __linux__
+    b->gso = gso;
+#else
+    (void)gso;
+#endif
+    return b;
+}
+
+void relay_batch_destroy(relay_batch_t *b) {
+    if (!b) return;
+    if (b->pool) affinity_free(b->pool, (size_t)RELAY_BATCH * MAX_PACKET_SIZE);
+    free(b->io);
+    free(b);
+}
+
+// Outer TOS from the ancillary data (Linux delivers a byte, BSDs an int)
+static uint8_t rx_tos(struct msghdr *mh) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(mh); cmsg; cmsg = CMSG_NXTHDR(mh, cmsg)) {
+        if (cmsg->cmsg_level != IPPROTO_IP) continue;
+        if (cmsg->cmsg_type != IP_TOS
+#ifdef IP_RECVTOS
+            && cmsg->cmsg_type != IP_RECVTOS
+#endif
+            ) continue;
+        if (cmsg->cmsg_len >= CMSG_LEN(sizeof(int))) {
+            int tos_val;
+            memcpy(&tos_val, CMSG_DATA(cmsg), sizeof(tos_val));
+            return (uint8_t)tos_val;
+        }
+        return *(uint8_t*)CMSG_DATA(cmsg);
+    }
+    return 0;
+}
+
+// Receive what is queued on the socket, up to RELAY_BATCH datagrams.
+// Returns the count (0 when nothing is pending), -1 on error.
+int relay_batch_recv(relay_batch_t *b, transport_t *trans) {
+    if (!b || !trans) return -1;
+    relay_io_t *io = (relay_io_t*)b->io;
+    b->count = 0;
+    b->fwd_count = 0;
+#ifdef __linux__
+    for (int i = 0; i < RELAY_BATCH; i++) {
+        io->rx_iov[i].iov_base = b->msg[i].data;
+        io->rx_iov[i].iov_len = MAX_PACKET_SIZE;
+        struct msghdr *mh = &io->rx[i].msg_hdr;
+        mh->msg_name = &b->msg[i].from;
+        mh->msg_namelen = sizeof(b->msg[i].from);
+        mh->msg_iov = &io->rx_iov[i];
+        mh->msg_iovlen = 1;
+        mh->msg_control = io->rx_ctl[i].buf;
+        mh->msg_controllen = sizeof(io->rx_ctl[i].buf);
+        mh->msg_flags = 0;
+    }
+    int n = recvmmsg(trans->socket_fd, io->rx, RELAY_BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0;
+        perror("recvmmsg failed");
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        b->msg[i].len = (uint16_t)io->rx[i].msg_len;
+        b->msg[i].tos = rx_tos(&io->rx[i].msg_hdr);
+    }
+    b->count = n;
+#else
+    while (b->count < RELAY_BATCH) {
+        relay_msg_t *m = &b->msg[b->count];
+        struct iovec iov = { .iov_base = m->data, .iov_len = MAX_PACKET_SIZE };
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_name = &m->from;
+        mh.msg_namelen = sizeof(m->from);
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = io->rx_ctl.buf;
+        mh.msg_controllen = sizeof(io->rx_ctl.buf);
+        ssize_t n = recvmsg(trans->socket_fd, &mh, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) break;
+            perror("recvmsg failed");
+            return b->count > 0 ? b->count : -1;
+        }
+        m->len = (uint16_t)n;
+        m->tos = rx_tos(&mh);
+        b->count++;
+    }
+#endif
+    return b->count;
+}
+
+// Queue msg[idx] to go out unchanged to `to` on the next flush
+void relay_batch_forward(relay_batch_t *b, int idx, const struct sockaddr_in *to) {
+    if (!b || !to || idx < 0 || idx >= b->count || b->fwd_count >= RELAY_BATCH) return;
+    b->msg[idx].to = *to;
+    b->fwd[b->fwd_count++] = (uint16_t)idx;
+}
+
+// Queue a datagram built in place (header included) to go out on the next
+// flush; returns the buffer to fill, NULL when the batch is full
+uint8_t* relay_batch_add(relay_batch_t *b, const struct sockaddr_in *to, uint16_t len) {
+    if (!b || !to || len > MAX_PACKET_SIZE || b->count >= RELAY_BATCH) return NULL;
+    relay_msg_t *m = &b->msg[b->count];
+    m->len = len;
+    m->tos = 0;
+    m->to = *to;
+    b->fwd[b->fwd_count++] = (uint16_t)b->count++;
+    return m->data;
+}
+
+#ifdef __linux__
+static bool same_dest(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+// Attach the TOS and, for trains, the GSO segment size
+static void set_tx_control(relay_io_t *io, int e, uint8_t tos, uint16_t seg_len) {
+    struct msghdr *mh = &io->tx[e].msg_hdr;
+    size_t len = 0;
+    if (tos != 0) len += CMSG_SPACE(sizeof(int));
+    if (io->tx_segs[e] > 1) len += CMSG_SPACE(sizeof(uint16_t));
+    if (len == 0) {
+        mh->msg_control = NULL;
+        mh->msg_controllen = 0;
+        return;
+    }
+    memset(&io->tx_ctl[e], 0, sizeof(io->tx_ctl[e]));
+    mh->msg_control = io->tx_ctl[e].buf;
+    mh->msg_controllen = len;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(mh);
+    if (tos != 0) {
+        int tos_val = tos;
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type = IP_TOS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &tos_val, sizeof(tos_val));
+        cmsg = CMSG_NXTHDR(mh, cmsg);
+    }
+    if (io->tx_segs[e] > 1) {
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(cmsg), &seg_len, sizeof(seg_len));
+    }
+}
+#endif
+
+// Send everything queued by relay_batch_forward(). Returns the number of
+// datagrams handed to the kernel; the rest were dropped (socket full).
+int relay_batch_flush(relay_batch_t *b, transport_t *trans) {
+    if (!b || !trans) return -1;
+    int delivered = 0;
+#ifdef __linux__
+    relay_io_t *io = (relay_io_t*)b->io;
+    int entries = 0;
+    for (int k = 0; k < b->fwd_count; k++) {
+        relay_msg_t *m = &b->msg[b->fwd[k]];
+        io->tx_iov[k].iov_base = m->data;
+        io->tx_iov[k].iov_len = m->len;
+        if (entries > 0 && b->gso) {
+            // Extend the previous entry into a train: same member, same
+            // TOS and the same size as its segments
+            int e = entries - 1;
+            struct msghdr *mh = &io->tx[e].msg_hdr;
+            const relay_msg_t *head = &b->msg[io->tx_head[e]];
+            if (same_dest(&head->to, &m->to) && head->tos == m->tos && head->len == m->len &&
+                io->tx_segs[e] < RELAY_GSO_SEGS && io->tx_bytes[e] + m->len <= RELAY_GSO_BYTES) {
+                mh->msg_iovlen++;
+                io->tx_segs[e]++;
+                io->tx_bytes[e] += m->len;
+                continue;
+            }
+        }
+        struct msghdr *mh = &io->tx[entries].msg_hdr;
+        memset(mh, 0, sizeof(*mh));
+        mh->msg_name = &m->to;
+        mh->msg_namelen = sizeof(m->to);
+        mh->msg_iov = &io->tx_iov[k];
+        mh->msg_iovlen = 1;
+        io->tx_head[entries] = b->fwd[k];
+        io->tx_segs[entries] = 1;
+        io->tx_bytes[entries] = m->len;
+        entries++;
+    }
+    for (int e = 0; e < entries; e++) {
+        const relay_msg_t *head = &b->msg[io->tx_head[e]];
+        set_tx_control(io, e, head->tos, head->len);
+    }
+
+    int done = 0;
+    while (done < entries) {
+        int r = sendmmsg(trans->socket_fd, io->tx + done, (unsigned)(entries - done), 0);
+        if (r > 0) {
+            for (int e = done; e < done + r; e++) delivered += io->tx_segs[e];
+            done += r;
+            continue;
+        }
+        if (r < 0 && errno == EINTR) continue;
+        struct msghdr *mh = &io->tx[done].msg_hdr;
+        if (io->tx_segs[done] > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT ||
+                                      errno == EOPNOTSUPP)) {
+            // No UDP GSO here: send this train packet by packet, and stop
+            // building trains
+            fprintf(stderr, "Relay: UDP GSO unavailable (%s), sending datagrams individually\n",
+                    strerror(errno));
+            b->gso = false;
+            const relay_msg_t *head = &b->msg[io->tx_head[done]];
+            for (size_t s = 0; s < mh->msg_iovlen; s++) {
+                if (transport_send_raw(trans, &head->to, (const uint8_t*)mh->msg_iov[s].iov_base,
+                                       mh->msg_iov[s].iov_len, head->tos) == 0) {
+                    delivered++;
+                }
+            }
+        }
+        // Otherwise (socket buffer full, unreachable member) drop the entry
+        done++;
+    }
+#else
+    for (int k = 0; k < b->fwd_count; k++) {
+        const relay_msg_t *m = &b->msg[b->fwd[k]];
+        if (transport_send_raw(trans, &m->to, m->data, m->len, m->tos) == 0) delivered++;
+    }
+#endif
+    b->fwd_count = 0;
+    b->count = 0;
+    return delivered;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/replay.h"
+
+int replay_init(replay_t *r, uint32_t capacity, int window_sec) {
+    if (!r || capacity == 0) return -1;
+    memset(r, 0, sizeof(*r));
+    r->ring = (replay_entry_t*)calloc(capacity, sizeof(replay_entry_t));
+    if (!r->ring || hmap_init(&r->set, capacity * 2) != 0) {
+        perror("Failed to allocate JOIN replay cache");
+        free(r->ring);
+        r->ring = NULL;
+        return -1;
+    }
+    r->cap = capacity;
+    r->retain_sec = 2 * (window_sec > 0 ? window_sec : JOIN_DEFAULT_WINDOW);
+    return 0;
+}
+
+void replay_free(replay_t *r) {
+    if (!r) return;
+    hmap_free(&r->set);
+    free(r->ring);
+    r->ring = NULL;
+}
+
+// One 64-bit key per (client ID, nonce); splitmix64 finalizer
+static uint64_t replay_key(uint64_t client_id, uint64_t nonce) {
+    uint64_t z = client_id ^ (nonce * 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// 0 = first sighting (now recorded), 1 = replay, -1 = cache full
+int replay_check(replay_t *r, uint64_t client_id, uint64_t nonce, time_t now) {
+    if (!r || !r->ring) return -1;
+    // Forget what no timestamp check would let through any more
+    while (r->count > 0 && now - r->ring[r->head].seen >= r->retain_sec) {
+        hmap_del(&r->set, r->ring[r->head].key);
+        r->head = (r->head + 1) % r->cap;
+        r->count--;
+    }
+    uint64_t key = replay_key(client_id, nonce);
+    if (hmap_get(&r->set, key, NULL)) return 1;
+    if (r->count == r->cap || hmap_put(&r->set, key, 0) != 0) return -1;
+    replay_entry_t *e = &r->ring[(r->head + r->count) % r->cap];
+    e->key = key;
+    e->seen = now;
+    r->count++;
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/store.h"
+#include "../include/transport.h"
+
+#define STORE_WRITE_CHUNK 4096       // snapshot records per write()
+
+static void store_path(const store_t *st, const char *file, char *out, size_t len) {
+    snprintf(out, len, "%s/%s", st->dir, file);
+}
+
+static uint64_t rec_check(const store_wal_rec_t *r) {
+    store_wal_rec_t tmp = *r;
+    tmp.check = 0;
+    const uint8_t *b = (const uint8_t*)&tmp;
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < sizeof(tmp); i++) {
+        h = (h ^ b[i]) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t*)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// mkdir -p
+static int make_dirs(const char *dir) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (char *p = path + 1; ; p++) {
+        if (*p != '/' && *p != '\0') continue;
+        char c = *p;
+        *p = '\0';
+        if (mkdir(path, 0700) != 0 && errno != EEXIST) return -1;
+        if (c == '\0') return 0;
+        *p = c;
+    }
+}
+
+// Create the state directory if needed and map its snapshot. A missing
+// snapshot is a fresh start; one that is present but unreadable is an
+// error rather than a silently new network.
+int store_open(store_t *st, const char *dir) {
+    if (!st || !dir || !dir[0]) return -1;
+    memset(st, 0, sizeof(*st));
+    snprintf(st->dir, sizeof(st->dir), "%s", dir);
+    if (make_dirs(dir) != 0) {
+        fprintf(stderr, "Failed to create state directory %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    char path[256];
+    store_path(st, "snapshot", path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        struct stat sb;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &sb) == 0 && (size_t)sb.st_size >= sizeof(store_header_t)) {
+            map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        const store_header_t *h = (const store_header_t*)map;
+        if (map == MAP_FAILED || h->magic != STORE_MAGIC || h->version != STORE_VERSION ||
+            h->size != sizeof(store_header_t) || h->record_size != sizeof(store_member_t) ||
+            (size_t)sb.st_size != sizeof(store_header_t) + h->count * sizeof(store_member_t)) {
+            fprintf(stderr, "Snapshot %s is damaged or from another version\n", path);
+            if (map != MAP_FAILED) munmap(map, (size_t)sb.st_size);
+            return -1;
+        }
+        madvise(map, (size_t)sb.st_size, MADV_SEQUENTIAL);
+        st->snap = h;
+        st->snap_len = (size_t)sb.st_size;
+    } else if (errno != ENOENT) {
+        fprintf(stderr, "Failed to open snapshot %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+void store_close(store_t *st) {
+    if (!st) return;
+    if (st->snap) munmap((void*)st->snap, st->snap_len);
+    st->snap = NULL;
+    free(st->pending);
+    st->pending = NULL;
+    st->pending_count = st->pending_cap = 0;
+}
+
+// Identity from the snapshot; NULL on a fresh start or after store_replay()
+const store_header_t* store_header(const store_t *st) {
+    return st ? st->snap : NULL;
+}
+
+// Hand every snapshot record, then every WAL change after it, to fn.
+// Held leases come as removals. The WAL is cut back to its last good
+// record and the snapshot unmapped. Returns the membership version reached.
+uint64_t store_replay(store_t *st, store_load_fn fn, void *ctx) {
+    if (!st || !st->dir[0]) return 0;
+    uint64_t version = 0;
+    if (st->snap) {
+        const store_member_t *m = (const store_member_t*)(st->snap + 1);
+        for (uint64_t i = 0; i < st->snap->count; i++) {
+            fn(ctx, m[i].kind == STORE_HELD ? MEMBER_REMOVE : MEMBER_UPSERT, &m[i]);
+        }
+        version = st->snap->member_version;
+    }
+
+    char path[256];
+    store_path(st, "wal", path, sizeof(path));
+    int fd = open(path, O_RDWR);
+    struct stat sb;
+    off_t good = 0;
+    if (fd >= 0 && st->snap && fstat(fd, &sb) == 0 && sb.st_size > 0) {
+        void *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)sb.st_size, MADV_SEQUENTIAL);
+            const store_wal_rec_t *r = (const store_wal_rec_t*)map;
+            size_t n = (size_t)sb.st_size / sizeof(store_wal_rec_t);
+            for (size_t i = 0; i < n; i++) {
+                if (r[i].check != rec_check(&r[i])) break;          // torn write
+                if (r[i].version <= st->snap->member_version) {
+                    good = (off_t)((i + 1) * sizeof(store_wal_rec_t)); // already in the snapshot
+                    continue;
+                }
+                if (r[i].version != version + 1) break;              // gap
+                fn(ctx, r[i].op, &r[i].m);
+                version = r[i].version;
+                st->wal_records++;
+                good = (off_t)((i + 1) * sizeof(store_wal_rec_t));
+            }
+            munmap(map, (size_t)sb.st_size);
+        }
+    }
+    if (fd >= 0 && fstat(fd, &sb) == 0 && sb.st_size != good) {
+        if (!st->snap) fprintf(stderr, "WAL without a snapshot in %s; discarding it\n", st->dir);
+        if (ftruncate(fd, good) != 0) perror("Failed to truncate WAL");
+        else if (st->snap) printf("WAL: dropped %lld bytes of incomplete records\n",
+                                  (long long)(sb.st_size - good));
+    }
+    if (fd >= 0) close(fd);
+    st->wal_bytes = (uint64_t)good;
+    if (st->snap) munmap((void*)st->snap, st->snap_len);
+    st->snap = NULL;
+    return version;
+}
+
+// Queue one change for the next group commit
+int store_append(store_t *st, uint64_t version, uint8_t op, const peer_t *peer, time_t now) {
+    if (!st || !peer) return -1;
+    if (st->pending_count == st->pending_cap) {
+        size_t cap = st->pending_cap ? st->pending_cap * 2 : 256;
+        store_wal_rec_t *p = (store_wal_rec_t*)realloc(st->pending, cap * sizeof(store_wal_rec_t));
+        if (!p) {
+            perror("Failed to grow WAL buffer");
+            return -1;
+        }
+        st->pending = p;
+        st->pending_cap = cap;
+    }
+    store_wal_rec_t *r = &st->pending[st->pending_count++];
+    memset(r, 0, sizeof(*r));
+    r->version = version;
+    r->op = op;
+    r->m.id = peer->id;
+    r->m.vip = peer->virtual_ip;
+    r->m.ip = peer->addr.sin_addr.s_addr;
+    r->m.port = peer->addr.sin_port;
+    r->m.flags = peer->flags;
+    r->m.kind = op == MEMBER_REMOVE ? STORE_HELD : STORE_MEMBER;
+    if (op == MEMBER_REMOVE) r->m.released = (uint64_t)now;
+    r->check = rec_check(r);
+    return 0;
+}
+
+bool store_pending(const store_t *st) {
+    return st && st->pending_count > 0;
+}
+
+// Make everything queued durable: one write, one fdatasync. On failure
+// the group stays queued for the next attempt.
+int store_commit(store_t *st) {
+    if (!st || !st->dir[0] || st->pending_count == 0) return 0;
+    char path[256];
+    store_path(st, "wal", path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open WAL %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    size_t len = st->pending_count * sizeof(store_wal_rec_t);
+    if (write_all(fd, st->pending, len) != 0 || fdatasync(fd) != 0) {
+        perror("WAL write failed");
+        if (ftruncate(fd, (off_t)st->wal_bytes) != 0) perror("Failed to truncate WAL");
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    st->wal_bytes += len;
+    st->wal_records += st->pending_count;
+    st->pending_count = 0;
+    return 0;
+}
+
+// Write the whole state as of hdr->member_version and start a new WAL;
+// members whose IDs are in skip (may be NULL) are left out
+int store_snapshot(store_t *st, const store_header_t *hdr, const network_t *net, const ipam_t *ip,
+                   const hmap_t *skip) {
+    if (!st || !hdr || !net || !ip || !st->dir[0]) return -1;
+    if (store_commit(st) != 0) return -1;
+
+    char path[256], tmp_path[256];
+    store_path(st, "snapshot", path, sizeof(path));
+    store_path(st, "snapshot.tmp", tmp_path, sizeof(tmp_path));
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create %s: %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+
+    // Held leases are counted up front so the header can go first
+    uint64_t held = 0;
+    for (uint32_t i = 0; i < ip->held_count; i++) {
+        const ipam_held_t *e = &ip->held[(ip->held_head + i) % ip->held_cap];
+        const ipam_lease_t *l = &ip->leases[e->lease];
+        if (l->state == IPAM_LEASE_HELD && l->gen == e->gen) held++;
+    }
+    store_header_t h = *hdr;
+    h.magic = STORE_MAGIC;
+    h.version = STORE_VERSION;
+    h.size = sizeof(store_header_t);
+    h.record_size = sizeof(store_member_t);
+    uint64_t members = 0;
+    for (int i = 0; i < net->peer_count; i++) {
+        if (!skip || !hmap_get(skip, net->peers[i].id, NULL)) members++;
+    }
+    h.count = members + held;
+
+    store_member_t *buf = (store_member_t*)calloc(STORE_WRITE_CHUNK, sizeof(store_member_t));
+    int rc = buf && write_all(fd, &h, sizeof(h)) == 0 ? 0 : -1;
+    size_t n = 0;
+    // Held leases first, oldest first, so restoring them keeps expiry order
+    for (uint32_t i = 0; rc == 0 && i < ip->held_count; i++) {
+        const ipam_held_t *e = &ip->held[(ip->held_head + i) % ip->held_cap];
+        const ipam_lease_t *l = &ip->leases[e->lease];
+        if (l->state != IPAM_LEASE_HELD || l->gen != e->gen) continue;
+        store_member_t *m = &buf[n++];
+        memset(m, 0, sizeof(*m));
+        m->id = l->peer_id;
+        m->vip = htonl(ip->network + l->host);
+        m->released = (uint64_t)l->released;
+        m->kind = STORE_HELD;
+        if (n == STORE_WRITE_CHUNK) {
+            rc = write_all(fd, buf, n * sizeof(store_member_t));
+            n = 0;
+        }
+    }
+    for (int i = 0; rc == 0 && i < net->peer_count; i++) {
+        const peer_t *p = &net->peers[i];
+        if (skip && hmap_get(skip, p->id, NULL)) continue;
+        store_member_t *m = &buf[n++];
+        memset(m, 0, sizeof(*m));
+        m->id = p->id;
+        m->vip = p->virtual_ip;
+        m->ip = p->addr.sin_addr.s_addr;
+        m->port = p->addr.sin_port;
+        m->flags = p->flags;
+        m->kind = STORE_MEMBER;
+        if (n == STORE_WRITE_CHUNK) {
+            rc = write_all(fd, buf, n * sizeof(store_member_t));
+            n = 0;
+        }
+    }
+    if (rc == 0 && n > 0) rc = write_all(fd, buf, n * sizeof(store_member_t));
+    free(buf);
+    if (rc == 0) rc = fdatasync(fd);
+    close(fd);
+    if (rc == 0 && rename(tmp_path, path) != 0) rc = -1;
+    if (rc != 0) {
+        fprintf(stderr, "Failed to write snapshot %s: %s\n", path, strerror(errno));
+        unlink(tmp_path);
+        return -1;
+    }
+    // The rename has to reach the disk before the old WAL is dropped
+    int dfd = open(st->dir, O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    store_path(st, "wal", path, sizeof(path));
+    if (truncate(path, 0) != 0 && errno != ENOENT) perror("Failed to truncate WAL");
+    st->wal_records = 0;
+    st->wal_bytes = 0;
+    return 0;
+}
+
+// The WAL replays more changes than a snapshot holds records
+bool store_wants_compaction(const store_t *st, int members) {
+    return st && st->dir[0] && st->wal_records >= STORE_COMPACT_MIN &&
+           st->wal_records > (uint64_t)members;
+}
\ No newline at end of file
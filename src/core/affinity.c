@@ -0,0 +1,274 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include "../include/affinity.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#define MPOL_PREFERRED 1
+#endif
+
+static const char *role_names[AFF_ROLES] = { "io", "crypto", "timer" };
+
+const char* affinity_role_name(affinity_role_t role) {
+    return role < AFF_ROLES ? role_names[role] : "?";
+}
+
+static void cpu_list_add(cpu_list_t *cl, int cpu) {
+    if (cpu < 0 || cpu >= AFF_MAX_CPUS) return;
+    uint64_t bit = 1ULL << (cpu % 64);
+    if (!(cl->mask[cpu / 64] & bit)) {
+        cl->mask[cpu / 64] |= bit;
+        cl->count++;
+    }
+}
+
+static bool cpu_list_has(const cpu_list_t *cl, int cpu) {
+    return cpu >= 0 && cpu < AFF_MAX_CPUS && (cl->mask[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+// Parse a kernel-style CPU list ("0-3,8,10-11"). Stops at the first
+// character that cannot be part of a list. Returns -1 on a malformed list.
+int cpu_list_parse(const char *s, cpu_list_t *out) {
+    if (!s || !out) return -1;
+    memset(out, 0, sizeof(*out));
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10);
+        if (end == s || lo < 0) return -1;
+        long hi = lo;
+        s = end;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo) return -1;
+            s = end;
+        }
+        for (long c = lo; c <= hi; c++) cpu_list_add(out, (int)c);
+        if (*s != ',') break;
+        s++;
+        // "crypto=4,6,timer=1": a name after the comma ends this list
+        if (*s < '0' || *s > '9') {
+            s--;
+            break;
+        }
+    }
+    return 0;
+}
+
+void cpu_list_format(const cpu_list_t *cl, char *out, size_t len) {
+    size_t n = 0;
+    out[0] = '\0';
+    for (int c = 0; c < AFF_MAX_CPUS && n < len; c++) {
+        if (!cpu_list_has(cl, c)) continue;
+        int hi = c;
+        while (hi + 1 < AFF_MAX_CPUS && cpu_list_has(cl, hi + 1)) hi++;
+        int w = hi > c ? snprintf(out + n, len - n, "%s%d-%d", n ? "," : "", c, hi)
+                       : snprintf(out + n, len - n, "%s%d", n ? "," : "", c);
+        if (w < 0) break;
+        n += (size_t)w;
+        c = hi;
+    }
+}
+
+static int read_sysfs(const char *path, char *buf, size_t len) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    char *ok = fgets(buf, (int)len, fp);
+    fclose(fp);
+    if (!ok) return -1;
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+// NUMA node of a CPU, AFF_NO_NODE if unknown
+static int cpu_node(int cpu) {
+    char path[96];
+    for (int node = 0; node < 64; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) return node;
+    }
+    return AFF_NO_NODE;
+}
+
+// Node shared by every CPU of the list, AFF_NO_NODE if they span nodes
+static int cpu_list_node(const cpu_list_t *cl) {
+    int node = AFF_NO_NODE;
+    for (int c = 0; c < AFF_MAX_CPUS; c++) {
+        if (!cpu_list_has(cl, c)) continue;
+        int n = cpu_node(c);
+        if (n == AFF_NO_NODE || (node != AFF_NO_NODE && n != node)) return AFF_NO_NODE;
+        node = n;
+    }
+    return node;
+}
+
+// Interface that carries traffic to remote (or the default route when
+// remote is NULL)
+static int egress_interface(const struct sockaddr_in *remote, char *ifname, size_t len) {
+    if (remote && remote->sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+        // A connected UDP socket reveals the source address the kernel picks
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) return -1;
+        struct sockaddr_in local;
+        socklen_t slen = sizeof(local);
+        int rc = connect(fd, (const struct sockaddr*)remote, sizeof(*remote));
+        if (rc == 0) rc = getsockname(fd, (struct sockaddr*)&local, &slen);
+        close(fd);
+        if (rc != 0) return -1;
+
+        struct ifaddrs *ifs = NULL;
+        if (getifaddrs(&ifs) != 0) return -1;
+        int found = -1;
+        for (struct ifaddrs *i = ifs; i; i = i->ifa_next) {
+            if (!i->ifa_addr || i->ifa_addr->sa_family != AF_INET) continue;
+            if (((struct sockaddr_in*)i->ifa_addr)->sin_addr.s_addr == local.sin_addr.s_addr) {
+                snprintf(ifname, len, "%s", i->ifa_name);
+                found = 0;
+                break;
+            }
+        }
+        freeifaddrs(ifs);
+        return found;
+    }
+
+    // Default route from the kernel routing table
+    FILE *fp = fopen("/proc/net/route", "r");
+    if (!fp) return -1;
+    char line[256], name[IF_NAMESIZE + 1];
+    unsigned long dest;
+    int found = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%16s %lx", name, &dest) == 2 && dest == 0) {
+            snprintf(ifname, len, "%s", name);
+            found = 0;
+            break;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+// CPUs local to the NIC carrying our traffic
+static void detect_nic_locality(affinity_t *aff, const struct sockaddr_in *remote) {
+    aff->nic[0] = '\0';
+    aff->nic_node = AFF_NO_NODE;
+    if (egress_interface(remote, aff->nic, sizeof(aff->nic)) != 0) return;
+
+    char path[128], buf[256];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", aff->nic);
+    if (read_sysfs(path, buf, sizeof(buf)) == 0) aff->nic_node = atoi(buf);
+    if (aff->nic_node < 0) {
+        aff->nic_node = AFF_NO_NODE;
+        return;
+    }
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/local_cpulist", aff->nic);
+    cpu_list_t local;
+    if (read_sysfs(path, buf, sizeof(buf)) != 0 || cpu_list_parse(buf, &local) != 0) return;
+    // Roles without an explicit list follow the NIC
+    for (int r = 0; r < AFF_ROLES; r++) {
+        if (aff->cpus[r].count == 0) aff->cpus[r] = local;
+    }
+}
+
+// Resolve the CPU lists of every role from spec (ZTNET_AFFINITY) and the
+// NIC that carries traffic to remote. Returns -1 on a malformed spec.
+int affinity_load(affinity_t *aff, const char *spec, const struct sockaddr_in *remote) {
+    if (!aff) return -1;
+    memset(aff, 0, sizeof(*aff));
+    aff->nic_node = AFF_NO_NODE;
+    for (int r = 0; r < AFF_ROLES; r++) aff->node[r] = AFF_NO_NODE;
+    if (spec && strcmp(spec, "off") == 0) return 0;
+
+    int rc = 0;
+    const char *s = spec;
+    while (s && *s) {
+        int role = -1;
+        for (int r = 0; r < AFF_ROLES; r++) {
+            size_t n = strlen(role_names[r]);
+            if (strncmp(s, role_names[r], n) == 0 && s[n] == '=') {
+                role = r;
+                s += n + 1;
+                break;
+            }
+        }
+        if (role < 0 || cpu_list_parse(s, &aff->cpus[role]) != 0) {
+            fprintf(stderr, "Invalid ZTNET_AFFINITY near '%s' (expect io=,crypto=,timer= CPU lists)\n", s);
+            memset(&aff->cpus[role < 0 ? 0 : role], 0, sizeof(cpu_list_t));
+            rc = -1;
+            break;
+        }
+        // Skip to the next "role="
+        while (*s && !(*s == ',' && (s[1] < '0' || s[1] > '9'))) s++;
+        if (*s == ',') s++;
+    }
+
+#ifdef __linux__
+    detect_nic_locality(aff, remote);
+#else
+    (void)remote;
+#endif
+    for (int r = 0; r < AFF_ROLES; r++) {
+        if (aff->cpus[r].count > 0) aff->node[r] = cpu_list_node(&aff->cpus[r]);
+    }
+    return rc;
+}
+
+// Pin the calling thread to the CPUs of its role
+int affinity_pin(const affinity_t *aff, affinity_role_t role, const char *thread_name) {
+    if (!aff || role >= AFF_ROLES || aff->cpus[role].count == 0) return 0;
+    char list[256];
+    cpu_list_format(&aff->cpus[role], list, sizeof(list));
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < AFF_MAX_CPUS && c < CPU_SETSIZE; c++) {
+        if (cpu_list_has(&aff->cpus[role], c)) CPU_SET(c, &set);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        fprintf(stderr, "Failed to pin %s thread to CPUs %s: %s\n", thread_name, list, strerror(err));
+        return -1;
+    }
+    printf("Pinned %s thread (%s) to CPUs %s (node %d%s%s)\n", thread_name, role_names[role], list,
+           aff->node[role], aff->nic[0] ? ", NIC " : "", aff->nic);
+    return 0;
+#else
+    (void)thread_name;
+    return 0;
+#endif
+}
+
+// Allocate zeroed memory for a role's pools/tables on its NUMA node.
+// Falls back to a normal anonymous mapping when the node is unknown.
+void* affinity_alloc(const affinity_t *aff, affinity_role_t role, size_t len) {
+    if (len == 0) return NULL;
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+#ifdef __linux__
+    if (aff && role < AFF_ROLES && aff->node[role] >= 0 && aff->node[role] < 64) {
+        // Bind before first touch so pages land on the node whoever faults them
+        unsigned long nodemask = 1UL << aff->node[role];
+        if (syscall(SYS_mbind, p, len, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0) != 0 &&
+            errno != ENOSYS) {
+            perror("mbind failed");
+        }
+    }
+#else
+    (void)aff; (void)role;
+#endif
+    return p;
+}
+
+void affinity_free(void *ptr, size_t len) {
+    if (ptr && len) munmap(ptr, len);
+}
\ No newline at end of file
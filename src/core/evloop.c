@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include "../include/evloop.h"
+#include "../include/clock.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+int evloop_init(evloop_t *ev) {
+    if (!ev) return -1;
+    memset(ev, 0, sizeof(*ev));
+    ev->epfd = -1;
+    if (ring_notify_init(&ev->wake) != 0) {
+        perror("Failed to create event loop wakeup");
+        return -1;
+    }
+#ifdef __linux__
+    ev->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (ev->epfd < 0) {
+        perror("epoll_create1 failed");
+        ring_notify_close(&ev->wake);
+        return -1;
+    }
+    struct epoll_event e = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, ev->wake.rfd, &e) != 0) {
+        perror("epoll_ctl failed");
+        close(ev->epfd);
+        ring_notify_close(&ev->wake);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+void evloop_close(evloop_t *ev) {
+    if (!ev) return;
+    if (ev->epfd >= 0) close(ev->epfd);
+    ev->epfd = -1;
+    ring_notify_close(&ev->wake);
+}
+
+int evloop_add_fd(evloop_t *ev, int fd, ev_fd_cb cb, void *ctx) {
+    if (!ev || fd < 0 || !cb || ev->fd_count >= EV_MAX_FDS) return -1;
+    ev_fd_t *slot = &ev->fds[ev->fd_count];
+    slot->fd = fd;
+    slot->cb = cb;
+    slot->ctx = ctx;
+#ifdef __linux__
+    struct epoll_event e = { .events = EPOLLIN, .data.ptr = slot };
+    if (epoll_ctl(ev->epfd, EPOLL_CTL_ADD, fd, &e) != 0) {
+        perror("epoll_ctl failed");
+        return -1;
+    }
+#endif
+    ev->fd_count++;
+    return 0;
+}
+
+static void heap_swap(ev_timer_t *a, ev_timer_t *b) {
+    ev_timer_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static void heap_up(evloop_t *ev, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (ev->heap[parent].due_us <= ev->heap[i].due_us) break;
+        heap_swap(&ev->heap[parent], &ev->heap[i]);
+        i = parent;
+    }
+}
+
+static void heap_down(evloop_t *ev, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < ev->timer_count && ev->heap[l].due_us < ev->heap[min].due_us) min = l;
+        if (r < ev->timer_count && ev->heap[r].due_us < ev->heap[min].due_us) min = r;
+        if (min == i) break;
+        heap_swap(&ev->heap[min], &ev->heap[i]);
+        i = min;
+    }
+}
+
+// Run cb after delay_us, then every period_us (0 = once)
+int evloop_add_timer(evloop_t *ev, uint64_t delay_us, uint64_t period_us, ev_timer_cb cb, void *ctx) {
+    if (!ev || !cb || ev->timer_count >= EV_MAX_TIMERS) return -1;
+    int i = ev->timer_count++;
+    ev->heap[i].due_us = monotonic_us() + delay_us;
+    ev->heap[i].period_us = period_us;
+    ev->heap[i].cb = cb;
+    ev->heap[i].ctx = ctx;
+    heap_up(ev, i);
+    return 0;
+}
+
+// Fire every due timer; returns the wait until the next one in ms (-1 = none)
+static int run_timers(evloop_t *ev) {
+    uint64_t now = monotonic_us();
+    while (ev->timer_count > 0 && ev->heap[0].due_us <= now) {
+        ev_timer_t t = ev->heap[0];
+        if (t.period_us > 0) {
+            // Keep the cadence; skip missed periods instead of bursting
+            do {
+                ev->heap[0].due_us += t.period_us;
+            } while (ev->heap[0].due_us <= now);
+        } else {
+            ev->heap[0] = ev->heap[--ev->timer_count];
+        }
+        heap_down(ev, 0);
+        t.cb(t.ctx, now);
+        now = monotonic_us();
+    }
+    if (ev->timer_count == 0) return -1;
+    // Round up so we never wake just before the deadline
+    return (int)((ev->heap[0].due_us - now + 999) / 1000);
+}
+
+// Dispatch events until evloop_stop()
+int evloop_run(evloop_t *ev) {
+    if (!ev) return -1;
+    while (!ev->stopped) {
+        int timeout_ms = run_timers(ev);
+        if (ev->stopped) break;
+#ifdef __linux__
+        struct epoll_event events[EV_MAX_FDS + 1];
+        int n = epoll_wait(ev->epfd, events, EV_MAX_FDS + 1, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            return -1;
+        }
+        for (int i = 0; i < n && !ev->stopped; i++) {
+            ev_fd_t *slot = (ev_fd_t*)events[i].data.ptr;
+            if (!slot) {
+                ring_notify_drain(&ev->wake);
+                continue;
+            }
+            slot->cb(slot->ctx);
+        }
+#else
+        struct pollfd pfds[EV_MAX_FDS + 1];
+        pfds[0].fd = ev->wake.rfd;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < ev->fd_count; i++) {
+            pfds[i + 1].fd = ev->fds[i].fd;
+            pfds[i + 1].events = POLLIN;
+        }
+        int n = poll(pfds, (nfds_t)ev->fd_count + 1, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("poll failed");
+            return -1;
+        }
+        if (pfds[0].revents & POLLIN) ring_notify_drain(&ev->wake);
+        for (int i = 0; i < ev->fd_count && !ev->stopped; i++) {
+            if (pfds[i + 1].revents & (POLLIN | POLLERR)) ev->fds[i].cb(ev->fds[i].ctx);
+        }
+#endif
+    }
+    return 0;
+}
+
+// Safe from any thread, also before evloop_run(): the loop returns after
+// the current dispatch
+void evloop_stop(evloop_t *ev) {
+    if (!ev) return;
+    ev->stopped = true;
+    ring_notify_signal(&ev->wake);
+}
\ No newline at end of file
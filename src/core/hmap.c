@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/hmap.h"
+
+// Fibonacci hashing; the high bits are the well-mixed ones
+static uint32_t hmap_bucket(const hmap_t *m, uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & m->mask;
+}
+
+// capacity is rounded up to a power of two
+int hmap_init(hmap_t *m, uint32_t capacity) {
+    if (!m) return -1;
+    uint32_t cap = 16;
+    while (cap < capacity) cap <<= 1;
+    m->e = (hmap_entry_t*)calloc(cap, sizeof(hmap_entry_t));
+    if (!m->e) {
+        perror("Failed to allocate hash map");
+        return -1;
+    }
+    m->mask = cap - 1;
+    m->count = 0;
+    return 0;
+}
+
+void hmap_free(hmap_t *m) {
+    if (!m) return;
+    free(m->e);
+    m->e = NULL;
+    m->mask = 0;
+    m->count = 0;
+}
+
+static int hmap_grow(hmap_t *m) {
+    hmap_t bigger;
+    if (hmap_init(&bigger, (m->mask + 1) * 2) != 0) return -1;
+    for (uint32_t i = 0; i <= m->mask; i++) {
+        if (!m->e[i].used) continue;
+        uint32_t b = hmap_bucket(&bigger, m->e[i].key);
+        while (bigger.e[b].used) b = (b + 1) & bigger.mask;
+        bigger.e[b] = m->e[i];
+        bigger.count++;
+    }
+    free(m->e);
+    *m = bigger;
+    return 0;
+}
+
+// Insert or replace
+int hmap_put(hmap_t *m, uint64_t key, uint32_t val) {
+    if (!m || !m->e) return -1;
+    if ((m->count + 1) * 2 > m->mask + 1 && hmap_grow(m) != 0) return -1;
+    uint32_t b = hmap_bucket(m, key);
+    while (m->e[b].used) {
+        if (m->e[b].key == key) {
+            m->e[b].val = val;
+            return 0;
+        }
+        b = (b + 1) & m->mask;
+    }
+    m->e[b].key = key;
+    m->e[b].val = val;
+    m->e[b].used = 1;
+    m->count++;
+    return 0;
+}
+
+bool hmap_get(const hmap_t *m, uint64_t key, uint32_t *val) {
+    if (!m || !m->e) return false;
+    for (uint32_t b = hmap_bucket(m, key); m->e[b].used; b = (b + 1) & m->mask) {
+        if (m->e[b].key == key) {
+            if (val) *val = m->e[b].val;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool hmap_del(hmap_t *m, uint64_t key) {
+    if (!m || !m->e) return false;
+    uint32_t b = hmap_bucket(m, key);
+    while (m->e[b].used && m->e[b].key != key) b = (b + 1) & m->mask;
+    if (!m->e[b].used) return false;
+    // Backward shift: pull later entries of the cluster into the hole
+    // unless that would move them before their home bucket
+    uint32_t hole = b;
+    for (uint32_t j = (hole + 1) & m->mask; m->e[j].used; j = (j + 1) & m->mask) {
+        uint32_t home = hmap_bucket(m, m->e[j].key);
+        if (((j - home) & m->mask) >= ((j - hole) & m->mask)) {
+            m->e[hole] = m->e[j];
+            hole = j;
+        }
+    }
+    m->e[hole].used = 0;
+    m->count--;
+    return true;
+}
\ No newline at end of file
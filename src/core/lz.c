@@ -0,0 +1,127 @@
+#include <string.h>
+#include "../include/lz.h"
+
+#define LZ_HASH_LOG 12
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5       // block must end with >= 5 literals
+#define LZ_MFLIMIT 12            // no match may start in the last 12 bytes
+#define LZ_MAX_OFFSET 65535
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+// Write a length continuation (255, 255, ..., rest) after the token nibble
+static int put_length(uint8_t *dst, size_t *op, size_t dst_cap, size_t len) {
+    while (len >= 255) {
+        if (*op >= dst_cap) return -1;
+        dst[(*op)++] = 255;
+        len -= 255;
+    }
+    if (*op >= dst_cap) return -1;
+    dst[(*op)++] = (uint8_t)len;
+    return 0;
+}
+
+static int emit_sequence(uint8_t *dst, size_t *op, size_t dst_cap,
+                         const uint8_t *lit, size_t lit_len,
+                         size_t offset, size_t match_len) {
+    if (*op >= dst_cap) return -1;
+    size_t token_pos = (*op)++;
+    uint8_t token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15 && put_length(dst, op, dst_cap, lit_len - 15) != 0) return -1;
+    if (*op + lit_len > dst_cap) return -1;
+    memcpy(dst + *op, lit, lit_len);
+    *op += lit_len;
+
+    if (match_len > 0) {
+        size_t ml = match_len - LZ_MIN_MATCH;
+        token |= (uint8_t)(ml >= 15 ? 15 : ml);
+        if (*op + 2 > dst_cap) return -1;
+        dst[(*op)++] = (uint8_t)offset;
+        dst[(*op)++] = (uint8_t)(offset >> 8);
+        if (ml >= 15 && put_length(dst, op, dst_cap, ml - 15) != 0) return -1;
+    }
+    dst[token_pos] = token;
+    return 0;
+}
+
+// Compress src into dst. Returns the compressed size, or -1 if it does not fit.
+int lz_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_cap) {
+    if (!src || !dst || src_len > LZ_MAX_OFFSET) return -1;
+
+    uint16_t table[1 << LZ_HASH_LOG];
+    memset(table, 0, sizeof(table));
+
+    size_t ip = 0, anchor = 0, op = 0;
+    if (src_len > LZ_MFLIMIT) {
+        size_t limit = src_len - LZ_MFLIMIT;
+        size_t match_end = src_len - LZ_LAST_LITERALS;
+        while (ip < limit) {
+            uint32_t seq = read32(src + ip);
+            uint32_t h = lz_hash(seq);
+            size_t ref = table[h];
+            table[h] = (uint16_t)ip;
+            if (ref >= ip || read32(src + ref) != seq) {
+                ip++;
+                continue;
+            }
+            size_t len = LZ_MIN_MATCH;
+            while (ip + len < match_end && src[ref + len] == src[ip + len]) len++;
+            if (emit_sequence(dst, &op, dst_cap, src + anchor, ip - anchor, ip - ref, len) != 0) {
+                return -1;
+            }
+            ip += len;
+            anchor = ip;
+        }
+    }
+    if (emit_sequence(dst, &op, dst_cap, src + anchor, src_len - anchor, 0, 0) != 0) return -1;
+    return (int)op;
+}
+
+static int get_length(const uint8_t *src, size_t *ip, size_t src_len, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= src_len) return -1;
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+// Decompress exactly dst_len bytes. Returns dst_len, or -1 on malformed input.
+int lz_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len) {
+    if (!src || !dst) return -1;
+
+    size_t ip = 0, op = 0;
+    while (ip < src_len) {
+        uint8_t token = src[ip++];
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && get_length(src, &ip, src_len, &lit_len) != 0) return -1;
+        if (ip + lit_len > src_len || op + lit_len > dst_len) return -1;
+        memcpy(dst + op, src + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == src_len) break;    // last sequence has no match
+
+        if (ip + 2 > src_len) return -1;
+        size_t offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return -1;
+        size_t match_len = (token & 0x0F);
+        if (match_len == 15 && get_length(src, &ip, src_len, &match_len) != 0) return -1;
+        match_len += LZ_MIN_MATCH;
+        if (op + match_len > dst_len) return -1;
+        // Byte copy: the match may overlap the bytes being produced
+        const uint8_t *m = dst + op - offset;
+        for (size_t i = 0; i < match_len; i++) dst[op + i] = m[i];
+        op += match_len;
+    }
+    return op == dst_len ? (int)op : -1;
+}
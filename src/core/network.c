@@ -4,8 +4,53 @@
 #include <time.h>
 #include "../include/core.h"
 
+#define NETWORK_INITIAL_PEERS 64
+
+static uint64_t endpoint_key(const struct sockaddr_in *addr) {
+    return ((uint64_t)addr->sin_addr.s_addr << 16) | addr->sin_port;
+}
+
+static uint32_t handle_slot(peer_handle_t h) {
+    return (uint32_t)h;
+}
+
+static peer_handle_t make_handle(uint32_t slot, uint32_t gen) {
+    return ((uint64_t)gen << 32) | slot;
+}
+
+static int registry_init(network_t *net) {
+    net->peer_cap = NETWORK_INITIAL_PEERS;
+    net->slot_cap = NETWORK_INITIAL_PEERS;
+    net->peers = (peer_t*)calloc((size_t)net->peer_cap, sizeof(peer_t));
+    net->slots = (peer_slot_t*)calloc(net->slot_cap, sizeof(peer_slot_t));
+    net->free_slot = UINT32_MAX;
+    if (!net->peers || !net->slots ||
+        hmap_init(&net->by_id, NETWORK_INITIAL_PEERS * 2) != 0 ||
+        hmap_init(&net->by_endpoint, NETWORK_INITIAL_PEERS * 2) != 0) {
+        perror("Failed to allocate peer registry");
+        return -1;
+    }
+    return 0;
+}
+
+static void registry_free(network_t *net) {
+    free(net->peers);
+    free(net->slots);
+    hmap_free(&net->by_id);
+    hmap_free(&net->by_endpoint);
+}
+
 // Create a new network
 network_t* network_create(const char *name, bool is_controller) {
+    return network_create_with_id(name, is_controller, NULL, NULL);
+}
+
+// Create a network with a known identity (a controller restoring its
+// state, or a network hosted by a cluster); network_id and keys NULL
+// generate new ones
+network_t* network_create_with_id(const char *name, bool is_controller,
+                                  const uint8_t network_id[NETWORK_ID_SIZE],
+                                  const keypair_t *keys) {
     if (!name) return NULL;
     
     network_t *net = (network_t*)calloc(1, sizeof(network_t));
@@ -18,31 +63,40 @@ network_t* network_create(const char *name, bool is_controller) {
     strncpy(net->name, name, MAX_NETWORK_NAME - 1);
     net->name[MAX_NETWORK_NAME - 1] = '\0';
     
-    // Generate network ID (simplified - 16 raw bytes based on time and name)
-    time_t now = time(NULL);
-    uint64_t t = (uint64_t)now;
-    uint64_t h = 0;
-    size_t nlen = strlen(name);
-    for (size_t i = 0; i < nlen; i++) {
-        h = (h * 131) ^ (uint8_t)name[i];
-    }
-    for (int i = 0; i < NETWORK_ID_SIZE; i++) {
-        uint8_t tb = (uint8_t)((t >> ((i % 8) * 8)) & 0xFF);
-        uint8_t hb = (uint8_t)((h >> (((i + 3) % 8) * 8)) & 0xFF);
-        net->network_id[i] = tb ^ hb;
+    if (network_id) {
+        memcpy(net->network_id, network_id, NETWORK_ID_SIZE);
+    } else {
+        // Generate network ID (simplified - 16 raw bytes based on time and name)
+        time_t now = time(NULL);
+        uint64_t t = (uint64_t)now;
+        uint64_t h = 0;
+        size_t nlen = strlen(name);
+        for (size_t i = 0; i < nlen; i++) {
+            h = (h * 131) ^ (uint8_t)name[i];
+        }
+        for (int i = 0; i < NETWORK_ID_SIZE; i++) {
+            uint8_t tb = (uint8_t)((t >> ((i % 8) * 8)) & 0xFF);
+            uint8_t hb = (uint8_t)((h >> (((i + 3) % 8) * 8)) & 0xFF);
+            net->network_id[i] = tb ^ hb;
+        }
     }
     
     // Generate network keypair
-    if (keypair_generate(&net->network_keys) != 0) {
+    if (keys) {
+        net->network_keys = *keys;
+    } else if (keypair_generate(&net->network_keys) != 0) {
         free(net);
         return NULL;
     }
     
+    // The registry is allocated with the first member, so an idle
+    // network costs little more than this struct
     net->peer_count = 0;
+    net->free_slot = UINT32_MAX;
     net->is_controller = is_controller;
     
-    printf("Network '%s' created (controller: %s)\n", 
-           net->name, is_controller ? "yes" : "no");
+    printf("Network '%s' %s (controller: %s)\n", 
+           net->name, keys ? "restored" : "created", is_controller ? "yes" : "no");
     printf("Network ID: ");
     for (int i = 0; i < NETWORK_ID_SIZE; i++) {
         printf("%02x", net->network_id[i]);
@@ -57,11 +111,33 @@ void network_destroy(network_t *net) {
     if (!net) return;
     
     printf("Destroying network '%s'\n", net->name);
+    registry_free(net);
     free(net);
 }
 
-// Add a peer to the network
-int network_add_peer(network_t *net, peer_t *peer) {
+// Room for one more member (amortized O(1): arrays double)
+static int registry_reserve(network_t *net) {
+    if (!net->peers) return registry_init(net);
+    if (net->peer_count == net->peer_cap) {
+        int cap = net->peer_cap * 2;
+        peer_t *p = (peer_t*)realloc(net->peers, (size_t)cap * sizeof(peer_t));
+        if (!p) return -1;
+        net->peers = p;
+        net->peer_cap = cap;
+    }
+    if (net->free_slot == UINT32_MAX && net->slot_count == net->slot_cap) {
+        uint32_t cap = net->slot_cap * 2;
+        peer_slot_t *s = (peer_slot_t*)realloc(net->slots, cap * sizeof(peer_slot_t));
+        if (!s) return -1;
+        memset(s + net->slot_cap, 0, (cap - net->slot_cap) * sizeof(peer_slot_t));
+        net->slots = s;
+        net->slot_cap = cap;
+    }
+    return 0;
+}
+
+// Add a peer to the network (copied into the registry) without logging it
+int network_load_peer(network_t *net, peer_t *peer) {
     if (!net || !peer) return -1;
     
     if (net->peer_count >= MAX_PEERS) {
@@ -70,53 +146,154 @@ int network_add_peer(network_t *net, peer_t *peer) {
     }
     
     // Check if peer already exists
-    for (int i = 0; i < net->peer_count; i++) {
-        if (net->peers[i].id == peer->id) {
-            fprintf(stderr, "Peer %llu already exists\n", (unsigned long long)peer->id);
-            return -1;
-        }
+    if (network_find_peer(net, peer->id)) {
+        fprintf(stderr, "Peer %llu already exists\n", (unsigned long long)peer->id);
+        return -1;
+    }
+    
+    if (registry_reserve(net) != 0) {
+        perror("Failed to grow peer registry");
+        return -1;
+    }
+    uint32_t slot;
+    if (net->free_slot != UINT32_MAX) {
+        slot = net->free_slot;
+        net->free_slot = net->slots[slot].dense;
+    } else {
+        slot = net->slot_count++;
+        net->slots[slot].gen = 1;
+    }
+    int idx = net->peer_count;
+    if (hmap_put(&net->by_id, peer->id, slot) != 0) {
+        net->slots[slot].dense = net->free_slot;
+        net->free_slot = slot;
+        return -1;
     }
+    hmap_put(&net->by_endpoint, endpoint_key(&peer->addr), slot);
+    net->slots[slot].dense = (uint32_t)idx;
     
     // Add peer
-    memcpy(&net->peers[net->peer_count], peer, sizeof(peer_t));
+    memcpy(&net->peers[idx], peer, sizeof(peer_t));
+    net->peers[idx].handle = make_handle(slot, net->slots[slot].gen);
+    peer->handle = net->peers[idx].handle;
     net->peer_count++;
-    
-    printf("Peer %llu added to network '%s' (total: %d)\n", 
-           (unsigned long long)peer->id, net->name, net->peer_count);
-    
     return 0;
 }
 
-// Remove a peer from the network
+// Add a peer to the network (copied into the registry)
+int network_add_peer(network_t *net, peer_t *peer) {
+    int rc = network_load_peer(net, peer);
+    if (rc == 0) {
+        printf("Peer %llu added to network '%s' (total: %d)\n", 
+               (unsigned long long)peer->id, net->name, net->peer_count);
+    }
+    return rc;
+}
+
+// Remove a peer from the network (the last member moves into its place)
 int network_remove_peer(network_t *net, uint64_t peer_id) {
     if (!net) return -1;
     
-    for (int i = 0; i < net->peer_count; i++) {
-        if (net->peers[i].id == peer_id) {
-            // Shift remaining peers
-            for (int j = i; j < net->peer_count - 1; j++) {
-                memcpy(&net->peers[j], &net->peers[j + 1], sizeof(peer_t));
-            }
-            net->peer_count--;
-            
-            printf("Peer %llu removed from network '%s'\n", (unsigned long long)peer_id, net->name);
-            return 0;
-        }
+    uint32_t slot;
+    if (!hmap_get(&net->by_id, peer_id, &slot)) {
+        fprintf(stderr, "Peer %llu not found\n", (unsigned long long)peer_id);
+        return -1;
+    }
+    uint32_t idx = net->slots[slot].dense;
+    peer_t *p = &net->peers[idx];
+    hmap_del(&net->by_id, peer_id);
+    uint32_t ep_slot;
+    if (hmap_get(&net->by_endpoint, endpoint_key(&p->addr), &ep_slot) && ep_slot == slot) {
+        hmap_del(&net->by_endpoint, endpoint_key(&p->addr));
     }
     
-    fprintf(stderr, "Peer %llu not found\n", (unsigned long long)peer_id);
-    return -1;
+    uint32_t last = (uint32_t)net->peer_count - 1;
+    if (idx != last) {
+        net->peers[idx] = net->peers[last];
+        net->slots[handle_slot(net->peers[idx].handle)].dense = idx;
+    }
+    net->peer_count--;
+    
+    net->slots[slot].gen++;
+    net->slots[slot].dense = net->free_slot;
+    net->free_slot = slot;
+    
+    printf("Peer %llu removed from network '%s'\n", (unsigned long long)peer_id, net->name);
+    return 0;
 }
 
 // Find a peer by ID
 peer_t* network_find_peer(network_t *net, uint64_t peer_id) {
     if (!net) return NULL;
     
-    for (int i = 0; i < net->peer_count; i++) {
-        if (net->peers[i].id == peer_id) {
-            return &net->peers[i];
-        }
-    }
+    uint32_t slot;
+    if (!hmap_get(&net->by_id, peer_id, &slot)) return NULL;
+    return &net->peers[net->slots[slot].dense];
+}
+
+// Find the member last seen at this public endpoint
+peer_t* network_find_endpoint(network_t *net, const struct sockaddr_in *addr) {
+    if (!net || !addr) return NULL;
     
-    return NULL;
+    uint32_t slot;
+    if (!hmap_get(&net->by_endpoint, endpoint_key(addr), &slot)) return NULL;
+    return &net->peers[net->slots[slot].dense];
+}
+
+// Resolve a handle; NULL once the member has been removed
+peer_t* network_get_peer(network_t *net, peer_handle_t handle) {
+    if (!net || handle == PEER_HANDLE_NONE) return NULL;
+    
+    uint32_t slot = handle_slot(handle);
+    if (slot >= net->slot_count || net->slots[slot].gen != (uint32_t)(handle >> 32)) return NULL;
+    return &net->peers[net->slots[slot].dense];
+}
+
+// Member holding a handle slot, NULL while the slot is free. A member
+// keeps its slot for as long as it stays, so walking slots in order is a
+// listing order that joins and leaves elsewhere do not disturb.
+peer_t* network_slot_peer(network_t *net, uint32_t slot) {
+    if (!net || slot >= net->slot_count) return NULL;
+    uint32_t idx = net->slots[slot].dense;
+    if (idx >= (uint32_t)net->peer_count || handle_slot(net->peers[idx].handle) != slot) return NULL;
+    return &net->peers[idx];
+}
+
+// Record a member's new public endpoint (keeps the endpoint index in step)
+void network_set_endpoint(network_t *net, peer_t *peer, const struct sockaddr_in *addr) {
+    if (!net || !peer || !addr) return;
+    
+    uint32_t slot = handle_slot(peer->handle);
+    uint64_t old_key = endpoint_key(&peer->addr);
+    uint64_t new_key = endpoint_key(addr);
+    peer->addr = *addr;
+    if (old_key == new_key) return;
+    uint32_t ep_slot;
+    if (hmap_get(&net->by_endpoint, old_key, &ep_slot) && ep_slot == slot) {
+        hmap_del(&net->by_endpoint, old_key);
+    }
+    hmap_put(&net->by_endpoint, new_key, slot);
+}
+
+// Derive the network's IPv6 overlay /64: fd00::/8 ULA space plus 56 bits
+// hashed (FNV-1a) from the network ID, so every member computes the same prefix.
+void network_overlay_prefix6(const uint8_t network_id[NETWORK_ID_SIZE], uint8_t out[IPV6_ADDR_SIZE]) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < NETWORK_ID_SIZE; i++) {
+        h = (h ^ network_id[i]) * 0x100000001B3ULL;
+    }
+    memset(out, 0, IPV6_ADDR_SIZE);
+    out[0] = 0xFD;
+    for (int i = 0; i < 7; i++) {
+        out[1 + i] = (uint8_t)(h >> (i * 8));
+    }
+}
+
+// Member address = network /64 prefix + 64-bit member suffix (the peer ID)
+void network_overlay_ip6(const uint8_t network_id[NETWORK_ID_SIZE], uint64_t member_id,
+                         uint8_t out[IPV6_ADDR_SIZE]) {
+    network_overlay_prefix6(network_id, out);
+    for (int i = 0; i < 8; i++) {
+        out[8 + i] = (uint8_t)(member_id >> ((7 - i) * 8));
+    }
 }
\ No newline at end of file
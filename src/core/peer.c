@@ -7,6 +7,13 @@
 
 // Create a new peer
 peer_t* peer_create(uint64_t id, struct sockaddr_in addr) {
+    keypair_t keys;
+    if (keypair_generate(&keys) != 0) return NULL;
+    return peer_create_with_keys(id, addr, &keys);
+}
+
+// Create a peer whose keypair was generated elsewhere (e.g. on a worker)
+peer_t* peer_create_with_keys(uint64_t id, struct sockaddr_in addr, const keypair_t *keys) {
     peer_t *peer = (peer_t*)calloc(1, sizeof(peer_t));
     if (!peer) {
         perror("Failed to allocate peer");
@@ -17,12 +24,8 @@ peer_t* peer_create(uint64_t id, struct sockaddr_in addr) {
     memcpy(&peer->addr, &addr, sizeof(struct sockaddr_in));
     peer->last_seen = time(NULL);
     peer->is_active = true;
-    
-    // Generate keypair for this peer
-    if (keypair_generate(&peer->keys) != 0) {
-        free(peer);
-        return NULL;
-    }
+    peer->stats_slot = -1;
+    peer->keys = *keys;
     
     char ip_str[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &(addr.sin_addr), ip_str, INET_ADDRSTRLEN);
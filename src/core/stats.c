@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/stats.h"
+
+static const char *stat_names[STAT_COUNT] = {
+    [STAT_RX_PACKETS] = "rx_packets",
+    [STAT_RX_BYTES] = "rx_bytes",
+    [STAT_TX_PACKETS] = "tx_packets",
+    [STAT_TX_BYTES] = "tx_bytes",
+    [STAT_TUN_RX_PACKETS] = "tun_rx_packets",
+    [STAT_TUN_TX_PACKETS] = "tun_tx_packets",
+    [STAT_RELAY_PACKETS] = "relay_packets",
+    [STAT_RELAY_BYTES] = "relay_bytes",
+    [STAT_DECRYPT_FAIL] = "decrypt_failures",
+    [STAT_JOIN_OK] = "joins_accepted",
+    [STAT_JOIN_DENIED] = "joins_denied",
+    [STAT_DROP_NO_ROUTE] = "drop_no_route",
+    [STAT_DROP_QUEUE_FULL] = "drop_queue_full",
+    [STAT_DROP_SEND] = "drop_send_error",
+    [STAT_DROP_MALFORMED] = "drop_malformed",
+    [STAT_DROP_HC_RESYNC] = "drop_hc_resync",
+    [STAT_DROP_ECN] = "drop_ecn",
+    [STAT_DROP_UNKNOWN_PEER] = "drop_unknown_peer",
+};
+
+static const char *peer_stat_names[PSTAT_COUNT] = {
+    [PSTAT_RX_PACKETS] = "rx_packets",
+    [PSTAT_RX_BYTES] = "rx_bytes",
+    [PSTAT_TX_PACKETS] = "tx_packets",
+    [PSTAT_TX_BYTES] = "tx_bytes",
+    [PSTAT_RELAY_PACKETS] = "relay_packets",
+    [PSTAT_RELAY_BYTES] = "relay_bytes",
+    [PSTAT_DECRYPT_FAIL] = "decrypt_failures",
+};
+
+// Threads take private shards in order of first use; once they run out,
+// the remaining threads share the last one with atomic adds.
+__thread int stats_tls_shard = -1;
+static unsigned next_shard = 0;
+
+int stats_shard_claim(void) {
+    unsigned s = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED);
+    stats_tls_shard = s < STATS_SHARED_SHARD ? (int)s : STATS_SHARED_SHARD;
+    return stats_tls_shard;
+}
+
+static void segment_name(char *out, size_t len, const char *role, int pid) {
+    snprintf(out, len, "/zerrytee-%s-%d", role, pid);
+}
+
+// Create and map a fresh segment
+static stats_t* stats_map_new(const char *role) {
+    stats_t *st = (stats_t*)calloc(1, sizeof(stats_t));
+    if (!st) {
+        perror("Failed to allocate stats");
+        return NULL;
+    }
+    segment_name(st->name, sizeof(st->name), role, (int)getpid());
+
+    int fd = shm_open(st->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("shm_open failed");
+        free(st);
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(stats_segment_t)) != 0) {
+        perror("ftruncate failed");
+        close(fd);
+        shm_unlink(st->name);
+        free(st);
+        return NULL;
+    }
+    st->seg = (stats_segment_t*)mmap(NULL, sizeof(stats_segment_t), PROT_READ | PROT_WRITE,
+                                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (st->seg == MAP_FAILED) {
+        perror("mmap failed");
+        shm_unlink(st->name);
+        free(st);
+        return NULL;
+    }
+    st->owner = true;
+    st->refs = 1;
+
+    stats_header_t *h = &st->seg->hdr;
+    h->version = STATS_VERSION;
+    h->size = sizeof(stats_segment_t);
+    h->pid = (uint32_t)getpid();
+    strncpy(h->role, role, sizeof(h->role) - 1);
+    h->start_unix = (uint64_t)time(NULL);
+    h->shard_count = STATS_SHARDS;
+    h->counter_count = STAT_COUNT;
+    h->peer_slots = STATS_PEER_SLOTS;
+    h->peer_counter_count = PSTAT_COUNT;
+    // Readers check the magic last: the header is complete once it is set
+    __atomic_store_n(&h->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+
+    printf("Stats segment: /dev/shm%s\n", st->name);
+    return st;
+}
+
+// Segments created by this process, shared by every instance of a role
+// (several clients in one process, as in the benchmarks)
+static stats_t *created[4];
+static pthread_mutex_t created_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Create and map this process's segment for a role, or take another
+// reference to it
+stats_t* stats_create(const char *role) {
+    if (!role) return NULL;
+    pthread_mutex_lock(&created_lock);
+    for (size_t i = 0; i < sizeof(created) / sizeof(created[0]); i++) {
+        if (created[i] && strcmp(created[i]->seg->hdr.role, role) == 0) {
+            created[i]->refs++;
+            pthread_mutex_unlock(&created_lock);
+            return created[i];
+        }
+    }
+    stats_t *st = stats_map_new(role);
+    if (st) {
+        for (size_t i = 0; i < sizeof(created) / sizeof(created[0]); i++) {
+            if (!created[i]) { created[i] = st; break; }
+        }
+    }
+    pthread_mutex_unlock(&created_lock);
+    return st;
+}
+
+void stats_destroy(stats_t *st) {
+    if (!st) return;
+    if (st->owner) {
+        pthread_mutex_lock(&created_lock);
+        bool last = --st->refs == 0;
+        for (size_t i = 0; last && i < sizeof(created) / sizeof(created[0]); i++) {
+            if (created[i] == st) created[i] = NULL;
+        }
+        pthread_mutex_unlock(&created_lock);
+        if (!last) return;
+    }
+    if (st->seg) {
+        munmap(st->seg, sizeof(stats_segment_t));
+    }
+    if (st->owner) {
+        shm_unlink(st->name);
+    }
+    free(st);
+}
+
+// Claim a per-peer slot. Returns -1 when all slots are taken (the peer is
+// then only counted globally).
+int stats_peer_attach(stats_t *st, uint64_t peer_id) {
+    if (!st || peer_id == 0) return -1;
+    // Members beyond the table go without counters; don't walk it for them
+    if (__atomic_load_n(&st->peers_used, __ATOMIC_RELAXED) >= STATS_PEER_SLOTS) return -1;
+    for (int i = 0; i < STATS_PEER_SLOTS; i++) {
+        uint64_t expected = 0;
+        if (__atomic_load_n(&st->seg->peer[i].id, __ATOMIC_RELAXED) != 0) continue;
+        if (__atomic_compare_exchange_n(&st->seg->peer[i].id, &expected, peer_id, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            __atomic_add_fetch(&st->peers_used, 1, __ATOMIC_RELAXED);
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Counters are cleared before the slot is released so the next owner
+// starts from zero
+void stats_peer_detach(stats_t *st, int slot) {
+    if (!st || slot < 0 || slot >= STATS_PEER_SLOTS) return;
+    stats_peer_t *p = &st->seg->peer[slot];
+    for (int k = 0; k < PSTAT_COUNT; k++) {
+        __atomic_store_n(&p->c[k], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&p->id, 0, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&st->peers_used, 1, __ATOMIC_RELAXED);
+}
+
+// Map another process's segment read-only
+stats_t* stats_open(const char *role, int pid) {
+    if (!role || pid <= 0) return NULL;
+    stats_t *st = (stats_t*)calloc(1, sizeof(stats_t));
+    if (!st) return NULL;
+    segment_name(st->name, sizeof(st->name), role, pid);
+
+    int fd = shm_open(st->name, O_RDONLY, 0);
+    if (fd < 0) {
+        free(st);
+        return NULL;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(stats_segment_t)) {
+        close(fd);
+        free(st);
+        errno = EPROTO;
+        return NULL;
+    }
+    st->seg = (stats_segment_t*)mmap(NULL, sizeof(stats_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (st->seg == MAP_FAILED) {
+        free(st);
+        return NULL;
+    }
+    const stats_header_t *h = &st->seg->hdr;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC ||
+        h->version != STATS_VERSION || h->size != sizeof(stats_segment_t) ||
+        h->shard_count != STATS_SHARDS || h->counter_count != STAT_COUNT ||
+        h->peer_slots != STATS_PEER_SLOTS || h->peer_counter_count != PSTAT_COUNT) {
+        munmap(st->seg, sizeof(stats_segment_t));
+        free(st);
+        errno = EPROTO;
+        return NULL;
+    }
+    return st;
+}
+
+// Find the running process of a role that created the newest segment.
+// Segments left behind by dead processes are ignored.
+int stats_find_pid(const char *role) {
+    DIR *dir = opendir("/dev/shm");
+    if (!dir) return -1;
+    char prefix[STATS_NAME_MAX];
+    snprintf(prefix, sizeof(prefix), "zerrytee-%s-", role);
+    size_t plen = strlen(prefix);
+
+    int best = -1;
+    time_t best_mtime = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, prefix, plen) != 0) continue;
+        char *end = NULL;
+        long pid = strtol(de->d_name + plen, &end, 10);
+        if (*end != '\0' || pid <= 0) continue;
+        if (kill((pid_t)pid, 0) != 0 && errno == ESRCH) continue;
+        char path[300];
+        snprintf(path, sizeof(path), "/dev/shm/%s", de->d_name);
+        struct stat sb;
+        if (stat(path, &sb) != 0) continue;
+        if (best < 0 || sb.st_mtime >= best_mtime) {
+            best = (int)pid;
+            best_mtime = sb.st_mtime;
+        }
+    }
+    closedir(dir);
+    return best;
+}
+
+uint64_t stats_read(const stats_t *st, stat_id_t id) {
+    if (!st || id >= STAT_COUNT) return 0;
+    uint64_t sum = 0;
+    for (int s = 0; s < STATS_SHARDS; s++) {
+        sum += __atomic_load_n(&st->seg->shard[s].c[id], __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+// Read one counter of a peer slot; *peer_id is 0 for a free slot
+uint64_t stats_peer_read(const stats_t *st, int slot, peer_stat_id_t id, uint64_t *peer_id) {
+    if (!st || slot < 0 || slot >= STATS_PEER_SLOTS || id >= PSTAT_COUNT) return 0;
+    const stats_peer_t *p = &st->seg->peer[slot];
+    if (peer_id) *peer_id = __atomic_load_n(&p->id, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&p->c[id], __ATOMIC_RELAXED);
+}
+
+const char* stats_name(stat_id_t id) {
+    return id < STAT_COUNT ? stat_names[id] : "?";
+}
+
+const char* stats_peer_name(peer_stat_id_t id) {
+    return id < PSTAT_COUNT ? peer_stat_names[id] : "?";
+}
\ No newline at end of file
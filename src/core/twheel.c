@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/twheel.h"
+
+#define TWHEEL_MASK (TWHEEL_SLOTS - 1)
+
+int twheel_init(twheel_t *tw, uint64_t tick_us, uint64_t now_us) {
+    if (!tw || tick_us == 0) return -1;
+    memset(tw, 0, sizeof(*tw));
+    for (int i = 0; i <= TWHEEL_FIRING; i++) tw->head[i] = TWHEEL_NONE;
+    tw->free_head = TWHEEL_NONE;
+    tw->tick_us = tick_us;
+    tw->origin_us = now_us;
+    return 0;
+}
+
+void twheel_free(twheel_t *tw) {
+    if (!tw) return;
+    free(tw->nodes);
+    tw->nodes = NULL;
+    tw->count = tw->cap = 0;
+}
+
+static void unlink_node(twheel_t *tw, uint32_t id) {
+    tw_node_t *n = &tw->nodes[id];
+    if (n->slot == TWHEEL_NONE) return;
+    if (n->prev != TWHEEL_NONE) tw->nodes[n->prev].next = n->next;
+    else tw->head[n->slot] = n->next;
+    if (n->next != TWHEEL_NONE) tw->nodes[n->next].prev = n->prev;
+    n->slot = TWHEEL_NONE;
+    tw->armed--;
+}
+
+// Queue a node by how far its tick is from the next one to be processed
+static void link_node(twheel_t *tw, uint32_t id) {
+    tw_node_t *n = &tw->nodes[id];
+    uint64_t cur = tw->tick + 1;
+    if (n->expires < cur) n->expires = cur;
+    uint64_t delta = n->expires - cur;
+    int level = 0;
+    while (level < TWHEEL_LEVELS - 1 && delta >= (1ULL << (TWHEEL_BITS * (level + 1)))) level++;
+    if (delta >= (1ULL << (TWHEEL_BITS * TWHEEL_LEVELS))) {
+        n->expires = cur + (1ULL << (TWHEEL_BITS * TWHEEL_LEVELS)) - 1;
+    }
+    uint32_t slot = (uint32_t)level * TWHEEL_SLOTS +
+                    (uint32_t)((n->expires >> (TWHEEL_BITS * level)) & TWHEEL_MASK);
+    n->slot = slot;
+    n->prev = TWHEEL_NONE;
+    n->next = tw->head[slot];
+    if (n->next != TWHEEL_NONE) tw->nodes[n->next].prev = id;
+    tw->head[slot] = id;
+    tw->armed++;
+}
+
+// New idle timer for key; TWHEEL_NONE if out of memory
+uint32_t twheel_add(twheel_t *tw, uint64_t key) {
+    if (!tw) return TWHEEL_NONE;
+    uint32_t id = tw->free_head;
+    if (id != TWHEEL_NONE) {
+        tw->free_head = tw->nodes[id].next;
+    } else {
+        if (tw->count == tw->cap) {
+            uint32_t cap = tw->cap ? tw->cap * 2 : 256;
+            tw_node_t *n = (tw_node_t*)realloc(tw->nodes, cap * sizeof(tw_node_t));
+            if (!n) {
+                perror("Failed to grow timer wheel");
+                return TWHEEL_NONE;
+            }
+            tw->nodes = n;
+            tw->cap = cap;
+        }
+        id = tw->count++;
+    }
+    tw_node_t *n = &tw->nodes[id];
+    n->key = key;
+    n->expires = 0;
+    n->next = n->prev = TWHEEL_NONE;
+    n->slot = TWHEEL_NONE;
+    return id;
+}
+
+void twheel_del(twheel_t *tw, uint32_t id) {
+    if (!tw || id >= tw->count) return;
+    unlink_node(tw, id);
+    tw->nodes[id].next = tw->free_head;
+    tw->free_head = id;
+}
+
+// (Re)arm to fire at the first tick at or after due_us
+void twheel_arm(twheel_t *tw, uint32_t id, uint64_t due_us) {
+    if (!tw || id >= tw->count) return;
+    unlink_node(tw, id);
+    uint64_t rel = due_us > tw->origin_us ? due_us - tw->origin_us : 0;
+    tw->nodes[id].expires = (rel + tw->tick_us - 1) / tw->tick_us;
+    link_node(tw, id);
+}
+
+// Move every timer of one upper-level slot down to where it now belongs
+static void cascade(twheel_t *tw, int level, uint64_t tick) {
+    uint32_t slot = (uint32_t)level * TWHEEL_SLOTS +
+                    (uint32_t)((tick >> (TWHEEL_BITS * level)) & TWHEEL_MASK);
+    uint32_t id = tw->head[slot];
+    tw->head[slot] = TWHEEL_NONE;
+    while (id != TWHEEL_NONE) {
+        uint32_t next = tw->nodes[id].next;
+        tw->nodes[id].slot = TWHEEL_NONE;
+        tw->armed--;
+        link_node(tw, id);
+        id = next;
+    }
+}
+
+// Process every tick up to now_us, calling fire for each timer that comes
+// due. fire may arm, re-arm or delete any timer. Returns the number fired.
+int twheel_advance(twheel_t *tw, uint64_t now_us, twheel_fire_fn fire, void *ctx) {
+    if (!tw || !fire || now_us < tw->origin_us) return 0;
+    uint64_t target = (now_us - tw->origin_us) / tw->tick_us;
+    int fired = 0;
+    while (tw->tick < target) {
+        if (tw->armed == 0) {
+            // Nothing to cascade or fire; jump ahead
+            tw->tick = target;
+            break;
+        }
+        uint64_t t = tw->tick + 1;
+        // Entering a new block of a level pulls its slot down from the
+        // level above (lower levels first, as in a clock's carry)
+        for (int level = 1; level < TWHEEL_LEVELS; level++) {
+            if ((t & ((1ULL << (TWHEEL_BITS * level)) - 1)) != 0) break;
+            tw->tick = t - 1;
+            cascade(tw, level, t);
+        }
+        tw->tick = t;
+        // Detach the due slot first: a timer re-armed 64 ticks out from a
+        // callback lands in this same slot and must wait for the next turn
+        uint32_t slot = (uint32_t)(t & TWHEEL_MASK);
+        tw->head[TWHEEL_FIRING] = tw->head[slot];
+        tw->head[slot] = TWHEEL_NONE;
+        for (uint32_t id = tw->head[TWHEEL_FIRING]; id != TWHEEL_NONE; id = tw->nodes[id].next) {
+            tw->nodes[id].slot = TWHEEL_FIRING;
+        }
+        uint32_t id;
+        while ((id = tw->head[TWHEEL_FIRING]) != TWHEEL_NONE) {
+            unlink_node(tw, id);
+            fire(ctx, tw->nodes[id].key, id);
+            fired++;
+        }
+    }
+    return fired;
+}
\ No newline at end of file
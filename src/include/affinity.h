@@ -0,0 +1,49 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+// CPU affinity and NUMA placement for worker threads.
+//
+// ZTNET_AFFINITY assigns CPU lists to thread roles, e.g.
+//   ZTNET_AFFINITY="io=2-3,crypto=4,6,timer=1"
+// ("off" disables pinning). A role without a list follows the NIC that
+// carries our traffic: the CPUs of its NUMA node (sysfs local_cpulist).
+// Memory for a role's packet pools and tables is bound to the NUMA node
+// of its CPUs, independent of which thread allocates it.
+// Pinning is Linux-only; elsewhere everything is a no-op.
+
+#define AFF_MAX_CPUS 1024
+#define AFF_NO_NODE -1
+
+typedef enum {
+    AFF_IO = 0,                      // socket/TUN event loops
+    AFF_CRYPTO,                      // AEAD / handshake workers
+    AFF_TIMER,                       // timers, keepalives, housekeeping
+    AFF_ROLES
+} affinity_role_t;
+
+typedef struct {
+    uint64_t mask[AFF_MAX_CPUS / 64];
+    int count;
+} cpu_list_t;
+
+typedef struct {
+    cpu_list_t cpus[AFF_ROLES];      // empty = not pinned
+    int node[AFF_ROLES];             // NUMA node of the CPUs, AFF_NO_NODE if mixed/unknown
+    char nic[32];                    // interface used for locality ("" if unknown)
+    int nic_node;
+} affinity_t;
+
+int affinity_load(affinity_t *aff, const char *spec, const struct sockaddr_in *remote);
+int affinity_pin(const affinity_t *aff, affinity_role_t role, const char *thread_name);
+void* affinity_alloc(const affinity_t *aff, affinity_role_t role, size_t len);
+void affinity_free(void *ptr, size_t len);
+int cpu_list_parse(const char *s, cpu_list_t *out);
+void cpu_list_format(const cpu_list_t *cl, char *out, size_t len);
+const char* affinity_role_name(affinity_role_t role);
+
+#endif // AFFINITY_H
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef AUTHPOOL_H
+#define AUTHPOOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include "core.h"
+#include "transport.h"
+#include "affinity.h"
+#include "ring.h"
+
+// JOIN admission work off the controller's event loop.
+//
+// The loop hands each JOIN to a worker through that worker's SPSC ring
+// (the worker is picked by peer ID, so one peer's retries stay in order).
+// The worker checks the identity binding, timestamp window and HMAC of a
+// password-protected JOIN, generates the keypair of a peer that is not a
+// member yet, and posts the verdict on its result ring; one notifier
+// shared by all workers wakes the loop. The replay cache and everything
+// that touches membership stay on the loop thread, which owns them.
+//
+// ZTNET_AUTH_WORKERS sets the pool size, 0 = verify inline on the loop.
+// The default is one worker per CPU beyond the loop's own. Workers are
+// pinned to the crypto CPUs of ZTNET_AFFINITY.
+
+#define AUTH_MAX_WORKERS 16
+#define AUTH_RING_SLOTS 1024             // JOINs in flight per worker
+#define AUTH_PAYLOAD_MAX (JOIN_REQUEST_AUTH_LEN + JOIN_VIP_HINT_LEN)
+
+typedef enum {
+    AUTH_OK = 0,
+    AUTH_BAD_FORMAT,                 // wrong length for a protected network
+    AUTH_BAD_IDENTITY,               // signed client ID is not the sender
+    AUTH_STALE,                      // timestamp outside the JOIN window
+    AUTH_BAD_MAC
+} auth_verdict_t;
+
+typedef struct {
+    uint64_t peer_id;
+    struct sockaddr_in addr;
+    uint32_t net;                    // index in controller_t.nets
+    const char *password;            // "" = open network
+    bool need_keys;                  // not a member yet: generate its keypair
+    uint8_t len;
+    uint8_t data[AUTH_PAYLOAD_MAX];  // JOIN payload, netid first
+} auth_job_t;
+
+typedef struct {
+    uint64_t peer_id;
+    struct sockaddr_in addr;
+    uint32_t net;
+    uint8_t verdict;                 // auth_verdict_t
+    bool has_keys;
+    bool authenticated;              // passed the HMAC: replay-check nonce
+    int64_t skew;                    // JOIN timestamp minus our clock, seconds
+    uint64_t nonce;
+    uint32_t vip_hint;               // 0 = none
+    keypair_t keys;
+} auth_result_t;
+
+typedef struct auth_pool auth_pool_t;
+
+typedef struct {
+    auth_pool_t *pool;
+    pthread_t thread;
+    int index;
+    ring_t *jobs;                    // loop -> worker
+    ring_t *results;                 // worker -> loop
+    ring_notify_t wake;              // jobs queued
+    uint32_t in_flight;              // loop side: submitted, not yet collected
+} auth_worker_t;
+
+struct auth_pool {
+    auth_worker_t workers[AUTH_MAX_WORKERS];
+    int count;
+    int join_window;
+    const affinity_t *affinity;
+    ring_notify_t done;              // results posted (poll rfd from the loop)
+    volatile bool stopping;
+};
+
+typedef void (*auth_result_cb)(void *ctx, const auth_result_t *r);
+
+void auth_verify(const auth_job_t *job, int join_window, time_t now, auth_result_t *out);
+int auth_pool_default_workers(void);
+auth_pool_t* auth_pool_create(int workers, int join_window, const affinity_t *aff);
+void auth_pool_destroy(auth_pool_t *pool);
+int auth_pool_submit(auth_pool_t *pool, const auth_job_t *job);
+int auth_pool_collect(auth_pool_t *pool, auth_result_cb cb, void *ctx);
+
+#endif // AUTHPOOL_H
\ No newline at end of file
@@ -5,35 +5,131 @@
 #include <pthread.h>
 #include "core.h"
 #include "transport.h"
+#include "crypto.h"
 #include "tun.h"
+#include "fib.h"
+#include "hc.h"
+#include "pcomp.h"
+#include "egress.h"
+#include "path.h"
+#include "stats.h"
+#include "affinity.h"
+#include "state.h"
+#include "ring.h"
+#include "hmap.h"
 
 #define KEEPALIVE_INTERVAL 30
+#define CLIENT_CONTROLLER_TIMEOUT (3 * KEEPALIVE_INTERVAL) // silence before rejoining via the seed
+#define CLIENT_MAX_REDIRECTS 4           // PKT_REDIRECTs followed per JOIN
 #define CLIENT_MAX_PEERS 256
+#define CLIENT_CTL_RING 256              // controller packets queued for the control thread
+#define CLIENT_CMD_RING 256              // peer updates queued for the forwarding thread
+#define CLIENT_RX_BATCH 32               // datagrams read per wakeup (EGRESS_READ_BATCH for the TUN)
+#define CLIENT_SOCK_BUF (1024 * 1024)    // UDP socket send/receive buffer
+#define CLIENT_SNAP_PARTS 65536          // PKT_MEMBER_SYNC part numbers are 16-bit
+
+// Largest inner packet that still fits one encrypted datagram, so the
+// kernel fragments or answers PMTU instead of us dropping oversize frames
+#define CLIENT_OVERLAY_MTU (MAX_PACKET_SIZE - (int)sizeof(packet_header_t) - AEAD_NONCE_SIZE - \
+                            AEAD_TAG_SIZE - HC_MAX_EXPANSION - PC_FRAME_HDR)
 
 typedef struct {
     uint64_t id;
     struct sockaddr_in addr;
     char virtual_ip[16];
-    bool reachable;
-    time_t last_probe; // last time we sent a probe to this peer
+    uint32_t vip;                    // virtual IPv4 (network byte order)
+    uint8_t virtual_ip6[IPV6_ADDR_SIZE];
+    uint8_t flags;                   // PEER_FLAG_* as advertised by the controller
+    peer_paths_t paths; // per-path RTT/loss and the active path
+    hc_state_t hc;     // inner header compression contexts
+    int stats_slot;    // per-peer counters in the stats segment (-1 = none)
+    uint64_t member_version; // newest membership version that listed it (0 = cached only)
 } client_peer_t;
 
+// Controller packet handed from the forwarding thread to the control thread
+typedef struct {
+    packet_header_t header;
+    struct sockaddr_in sender;
+    uint16_t len;
+    uint8_t data[MAX_PACKET_SIZE];
+} client_ctl_msg_t;
+
+// What a command on cmd_ring asks the forwarding thread to do
+typedef enum {
+    CLIENT_CMD_PEER,                 // add or refresh a peer
+    CLIENT_CMD_REMOVE,               // member left: drop it
+    CLIENT_CMD_JOINED,               // JOIN accepted: record our addresses in the restart cache
+    CLIENT_CMD_CONTROLLER,           // controller moved (redirect, rejoin via the seed)
+    CLIENT_CMD_PRUNE                 // snapshot complete: drop peers it did not list
+} client_cmd_kind_t;
+
+// Update handed from the control thread to the forwarding thread, which is
+// the only writer of the peer table, the FIB and the restart cache
+typedef struct {
+    uint8_t kind;                    // client_cmd_kind_t
+    uint64_t id;
+    struct sockaddr_in addr;         // CONTROLLER: its new endpoint
+    uint32_t vip;                    // network byte order (JOINED: ours)
+    uint8_t vip6[IPV6_ADDR_SIZE];
+    bool has_vip6;
+    uint8_t flags;
+    uint8_t prefix_len;              // JOINED: overlay IPv4 prefix
+    uint64_t version;                // PEER: membership version listing it; PRUNE: the snapshot's
+} client_peer_cmd_t;
+
 // Client structure
 typedef struct {
     uint64_t client_id;
     transport_t *transport;
     tun_t *tun;                      // TUN interface
-    struct sockaddr_in controller_addr;
-    bool connected;
-    pthread_t thread;
+    struct sockaddr_in controller_addr; // control thread's copy
+    struct sockaddr_in fwd_controller_addr; // forwarding thread's copy (relay path), via cmd_ring
+    struct sockaddr_in seed_addr;    // controller given at startup; JOINs start there
+    int redirects;                   // followed since the last JOIN_RESPONSE
+    time_t controller_heard;         // last packet from the controller (control thread)
+    bool connected;                  // read and written with client_connected/set_connected
+    pthread_t thread;                // forwarding (data plane)
+    pthread_t ctl_thread;            // controller packets, keepalives, TUN/route setup
     bool running;
     keypair_t keys;
     char virtual_ip[16];            // Assigned virtual IP (e.g., "10.0.0.1")
+    int overlay_prefix_len;          // IPv4 overlay prefix from the controller
+    uint8_t virtual_ip6[IPV6_ADDR_SIZE]; // Assigned virtual IPv6 (network /64 + member suffix)
+    bool has_ip6;
     client_peer_t peers[CLIENT_MAX_PEERS];
     int peer_count;
+    hmap_t peer_index;               // peer ID -> peers[] index
+    bool peers_full;                 // table full was reported
+    uint64_t relay_ids[CLIENT_MAX_PEERS]; // peers offering to relay (PEER_FLAG_RELAY)
+    int relay_count;
+    uint64_t relay_eval_us;          // next relay choice for every peer, 0 = now
+    fib_t fib;                       // vIP/vIP6 -> peers[] index
+    pc_table_t pcomp;                // per-flow payload compression policy
+    egress_t egress;                 // priority queues in front of the socket
+    bool relay_enabled;              // forward traffic between other members (ZTNET_RELAY=1)
+    stats_t *stats;                  // shared-memory counters (NULL if unavailable)
+    affinity_t affinity;             // CPU/NUMA placement of the client threads
+    cstate_t *state;                 // restart cache (ZTNET_STATE), NULL if disabled
+    bool overlay_configured;         // TUN carries virtual_ip / virtual_ip6
+    uint64_t created_us;             // monotonic time of client_create
+    uint64_t first_fwd_from_us;      // creation time until the first packet is forwarded, then 0
+    ring_t *ctl_ring;                // forwarding -> control: client_ctl_msg_t
+    ring_t *cmd_ring;                // control -> forwarding: client_peer_cmd_t
+    ring_notify_t ctl_notify;
+    ring_notify_t cmd_notify;
+    int forced_path;                 // path_kind_t pinned by ZTNET_PATH, -1 = automatic
     uint8_t target_network_id[NETWORK_ID_SIZE];
+    uint64_t member_version;         // membership version applied (control thread)
+    uint64_t snap_version;           // snapshot being collected
+    uint64_t snap_seen[CLIENT_SNAP_PARTS / 64]; // its parts received, one bit each
+    uint32_t snap_count;
 } client_t;
 
+// JOIN sent and not abandoned; the main thread reads it at shutdown
+static inline bool client_connected(const client_t *client) {
+    return __atomic_load_n(&client->connected, __ATOMIC_ACQUIRE);
+}
+
 // Function declarations
 client_t* client_create(const char *controller_ip, uint16_t controller_port, const uint8_t *network_id);
 void client_destroy(client_t *client);
@@ -42,5 +138,7 @@ int client_disconnect(client_t *client);
 int client_start(client_t *client);
 void client_stop(client_t *client);
 void* client_run(void *arg);
+void client_print_flow_stats(client_t *client);
+void client_print_peers(client_t *client);
 
 #endif // CLIENT_H
\ No newline at end of file
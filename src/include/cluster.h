@@ -0,0 +1,69 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "core.h"
+
+// Controller cluster membership and shard placement.
+//
+// ZTNET_CLUSTER lists every controller of the cluster ("ip:port,...",
+// the same string on every node) and ZTNET_NODE_ID says which entry this
+// process is. Members are sharded by peer ID over a consistent-hash ring
+// with CLUSTER_VNODES points per live node: a member belongs to the node
+// owning the first point at or after the hash of its ID. When a node dies
+// only its members move, each to the next live node clockwise, which is
+// the backup that already holds a replica of them.
+//
+// Nodes exchange heartbeats; one silent for CLUSTER_DEAD_MS leaves the
+// ring until it is heard from again.
+//
+// ZTNET_CLUSTER_KEY is a secret shared by all nodes. Every PKT_CLUSTER
+// carries an HMAC-SHA256 of its payload under it; datagrams that fail
+// the check are dropped, so a spoofed source address is not enough to
+// inject members or keep a dead node on the ring.
+
+#define CLUSTER_MAX_NODES 64
+#define CLUSTER_VNODES 64
+#define CLUSTER_HEARTBEAT_MS 500
+#define CLUSTER_DEAD_MS 3000
+#define CLUSTER_RESYNC_INTERVAL 30      // seconds between full pushes of a node's members
+#define CLUSTER_NO_NODE UINT32_MAX
+#define CLUSTER_KEY_MAX 256
+#define CLUSTER_MAC_LEN 32
+
+typedef struct {
+    struct sockaddr_in addr;
+    uint64_t last_heard_us;
+    bool alive;
+    bool synced;                        // has had our full member set since it came up
+} cluster_node_t;
+
+typedef struct {
+    uint64_t point;
+    uint32_t node;
+} cluster_vnode_t;
+
+typedef struct {
+    cluster_node_t nodes[CLUSTER_MAX_NODES];
+    uint32_t node_count;
+    uint32_t self;
+    cluster_vnode_t ring[CLUSTER_MAX_NODES * CLUSTER_VNODES];
+    uint32_t ring_len;
+    char spec[512];                     // ZTNET_CLUSTER as given
+    uint8_t key[CLUSTER_KEY_MAX];       // ZTNET_CLUSTER_KEY
+    size_t key_len;
+} cluster_t;
+
+int cluster_init(cluster_t *c, const char *spec, const char *node_id, const char *key,
+                 uint16_t port, uint64_t now_us);
+uint32_t cluster_owner(const cluster_t *c, uint64_t peer_id);
+uint32_t cluster_node_of(const cluster_t *c, const struct sockaddr_in *addr);
+bool cluster_heard(cluster_t *c, uint32_t node, uint64_t now_us);
+int cluster_expire(cluster_t *c, uint64_t now_us);
+size_t cluster_seal(const cluster_t *c, uint8_t *buf, size_t len);
+bool cluster_verify(const cluster_t *c, const uint8_t *buf, size_t len);
+int cluster_network_id(const cluster_t *c, const char *name, uint8_t out[NETWORK_ID_SIZE]);
+
+#endif // CLUSTER_H
\ No newline at end of file
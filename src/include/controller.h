@@ -5,35 +5,104 @@
 #include <pthread.h>
 #include "core.h"
 #include "transport.h"
+#include "stats.h"
+#include "affinity.h"
+#include "evloop.h"
+#include "relay.h"
+#include "ipam.h"
+#include "memberlog.h"
+#include "twheel.h"
+#include "replay.h"
+#include "store.h"
+#include "cluster.h"
+#include "authpool.h"
 
 #define KEEPALIVE_INTERVAL 30
 #define PEER_TIMEOUT 90
-#define JOIN_REPLAY_CACHE 64
+#define LEASE_SWEEP_INTERVAL 10     // seconds between returns of expired vIP leases
+#define CONTROLLER_TICK_MS 100       // timer wheel resolution for keepalives and expiry
+#define MEMBER_SYNC_INTERVAL_MS 20   // membership changes are coalesced and flushed this often
+#define CONTROLLER_RX_BUDGET 256     // datagrams handled per wakeup before timers get a turn
+#define CONTROLLER_SOCK_BUF (4 * 1024 * 1024)
+#define CONTROLLER_MAX_NETWORKS (1 << 20)
+#define LIST_SCAN_BUDGET 65536       // members looked at per LIST page
 
+// JOIN_RESPONSE held back until the member it admits is durable
 typedef struct {
-    uint64_t client_id;
-    uint64_t nonce;
-} join_nonce_entry_t;
+    struct sockaddr_in addr;
+    uint64_t peer_id;
+    uint8_t resp[JOIN_RESPONSE_CIDR_LEN];
+} join_reply_t;
 
-// Controller structure
+// One network hosted by the controller. An idle network is this struct,
+// its network_t and a small address pool; the member registry and the
+// membership log ring are allocated with the first member.
 typedef struct {
     network_t *network;
+    char password[128];         // optional
+    ipam_t ipam;                // overlay IPv4 pool and leases
+    member_log_t members;       // versioned membership changes
+    uint64_t synced_version;    // log version at the last sync flush
+    bool sync_pending;          // some member asked for a resend
+    bool dirty;                 // on the controller's list of networks to commit and sync
+    bool persist;               // has a state directory
+    store_t store;              // snapshot + WAL of the network and its members
+    uint32_t index;             // in controller_t.nets
+    uint8_t *repl;              // our members' changes not yet sent to the cluster
+    size_t repl_len, repl_cap;
+} ctrl_net_t;
+
+// Controller structure
+//
+// One socket, event loop, timer wheel and relay path serve every hosted
+// network. JOINs name their network by ID; every other packet is
+// attributed through its sender, since a peer ID belongs to one network.
+//
+// With ZTNET_CLUSTER the controller is one node of a cluster: it admits
+// and serves the members of its shard, redirects other JOINs to their
+// shard's node, and keeps the members placed elsewhere in its registry
+// (without timers) so its own members see the whole network. The nodes
+// share ZTNET_CLUSTER_KEY, which authenticates their PKT_CLUSTER traffic.
+typedef struct {
     transport_t *transport;
     pthread_t thread;
     bool running;
     uint64_t controller_id;
-    char network_password[128]; // optional
-    join_nonce_entry_t nonce_cache[JOIN_REPLAY_CACHE];
-    int nonce_cache_count;
+    ctrl_net_t **nets;          // hosted networks; nets[0] is the one named on the command line
+    uint32_t net_count, net_cap;
+    hmap_t net_by_id;           // folded network ID -> index
+    hmap_t net_by_name;         // name hash -> index
+    hmap_t member_net;          // peer ID -> index of its network
+    uint32_t *dirty;            // networks with changes to commit and sync
+    uint32_t dirty_count, dirty_cap;
+    char state_dir[200];        // ZTNET_STATE_DIR; empty = nothing persisted
+    replay_t replay;            // (client ID, nonce) of recent authenticated JOINs
+    int join_window;            // seconds a JOIN timestamp may be off
+    stats_t *stats;             // shared-memory counters (NULL if unavailable)
+    affinity_t affinity;        // CPU/NUMA placement of the controller threads
+    evloop_t loop;              // socket readiness + wheel/sweep/sync timers
+    twheel_t wheel;             // per-member keepalive and expiry deadlines, keyed by peer ID
+    relay_batch_t *relay;       // batched receive / relay fast path
+    uint8_t *sync_frames;       // shared delta of the current flush: [len(2) payload]...
+    size_t sync_frames_len, sync_frames_cap;
+    join_reply_t *replies;      // waiting for the next group commit
+    size_t reply_count, reply_cap;
+    cluster_t *cluster;         // NULL unless clustered
+    hmap_t remote;              // peer ID -> node serving it, for members placed elsewhere
+    time_t last_resync;         // last full push of our members to the cluster
+    auth_pool_t *auth;          // JOIN verification workers; NULL = inline
 } controller_t;
 
 // Function declarations
 controller_t* controller_create(const char *network_name, uint16_t port, const char *password);
 void controller_destroy(controller_t *ctrl);
+int controller_add_network(controller_t *ctrl, const char *name, const char *password,
+                           const char *cidr, const char *reserve);
+int controller_load_networks(controller_t *ctrl, const char *path);
 int controller_start(controller_t *ctrl);
 void controller_stop(controller_t *ctrl);
-int controller_approve_peer(controller_t *ctrl, uint64_t peer_id, 
-                            struct sockaddr_in addr);
+int controller_approve_peer(controller_t *ctrl, ctrl_net_t *net, uint64_t peer_id,
+                            struct sockaddr_in addr, uint32_t requested_vip, const keypair_t *keys);
 void controller_list_peers(controller_t *ctrl);
 void* controller_run(void *arg);
 
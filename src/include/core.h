@@ -4,16 +4,25 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <netinet/in.h>
+#include "hmap.h"
 
-#define MAX_PEERS 256
+#define MAX_PEERS (1 << 20)    // registry limit; storage grows on demand
 #define MAX_NETWORK_NAME 64
 #define KEYPAIR_SIZE 32
 #define SIGNATURE_SIZE 64
 #define NETWORK_ID_SIZE 16
 
-// Default overlay subnet (IPv4 /24)
-#define OVERLAY_BASE_IP "10.0.0.0"
-#define OVERLAY_NETMASK "255.255.255.0"
+// Default overlay subnet; the controller takes ZTNET_OVERLAY_CIDR and
+// tells members the prefix length in JOIN_RESPONSE
+#define OVERLAY_DEFAULT_CIDR "10.0.0.0/24"
+#define OVERLAY_DEFAULT_PREFIX_LEN 24
+
+// Peer flags advertised in PEER_INFO
+#define PEER_FLAG_RELAY 0x01   // member volunteers to relay for others
+
+// IPv6 overlay: ULA /64 derived from the network ID, member suffix = peer ID
+#define OVERLAY_V6_PREFIX_LEN 64
+#define IPV6_ADDR_SIZE 16
 
 // Key pair structure for Ed25519
 typedef struct {
@@ -21,22 +30,54 @@ typedef struct {
     uint8_t private_key[KEYPAIR_SIZE];
 } keypair_t;
 
+// Stable reference to a registry entry: generation << 32 | slot. Unlike a
+// peer_t pointer it survives other members joining and leaving, and a
+// handle to a removed member resolves to NULL. 0 is never a valid handle.
+typedef uint64_t peer_handle_t;
+#define PEER_HANDLE_NONE 0
+
 // Peer information
 typedef struct {
     uint64_t id;
+    peer_handle_t handle; // set by network_add_peer
     struct sockaddr_in addr;
     keypair_t keys;
     time_t last_seen;
     bool is_active;
     uint32_t virtual_ip; // network byte order
+    uint8_t virtual_ip6[IPV6_ADDR_SIZE];
+    uint8_t flags;       // PEER_FLAG_*
+    int stats_slot;      // per-peer counters in the stats segment (-1 = none)
+    uint64_t log_version;  // membership log entry that last described this peer
+    uint64_t sync_version; // membership version this member was last sent
+    uint32_t timer;        // controller: keepalive/expiry timer in the wheel
+    uint64_t next_keepalive_us;
 } peer_t;
 
+typedef struct {
+    uint32_t dense;      // index into peers[]; next free slot while unused
+    uint32_t gen;        // bumped on removal so stale handles miss
+} peer_slot_t;
+
 // Network structure
+//
+// Members live densely in peers[0..peer_count) (sweeps and broadcasts
+// walk contiguous memory); removal moves the last member into the hole.
+// peer_t pointers are therefore only valid until the next add or remove;
+// keep a peer_handle_t across those. Lookups by ID and by public
+// endpoint go through hash indexes, all O(1) expected.
 typedef struct {
     uint8_t network_id[NETWORK_ID_SIZE];
     char name[MAX_NETWORK_NAME];
-    peer_t peers[MAX_PEERS];
+    peer_t *peers;
     int peer_count;
+    int peer_cap;
+    peer_slot_t *slots;  // handle slot -> peers[] index
+    uint32_t slot_count;
+    uint32_t slot_cap;
+    uint32_t free_slot;  // head of the free slot list, UINT32_MAX = none
+    hmap_t by_id;        // peer ID -> slot
+    hmap_t by_endpoint;  // public ip:port -> slot
     keypair_t network_keys;
     bool is_controller;
 } network_t;
@@ -50,13 +91,25 @@ void keypair_print(const keypair_t *kp);
 
 // network.c
 network_t* network_create(const char *name, bool is_controller);
+network_t* network_create_with_id(const char *name, bool is_controller,
+                                  const uint8_t network_id[NETWORK_ID_SIZE],
+                                  const keypair_t *keys);
 void network_destroy(network_t *net);
 int network_add_peer(network_t *net, peer_t *peer);
+int network_load_peer(network_t *net, peer_t *peer);
 int network_remove_peer(network_t *net, uint64_t peer_id);
 peer_t* network_find_peer(network_t *net, uint64_t peer_id);
+peer_t* network_find_endpoint(network_t *net, const struct sockaddr_in *addr);
+peer_t* network_get_peer(network_t *net, peer_handle_t handle);
+peer_t* network_slot_peer(network_t *net, uint32_t slot);
+void network_set_endpoint(network_t *net, peer_t *peer, const struct sockaddr_in *addr);
+void network_overlay_prefix6(const uint8_t network_id[NETWORK_ID_SIZE], uint8_t out[IPV6_ADDR_SIZE]);
+void network_overlay_ip6(const uint8_t network_id[NETWORK_ID_SIZE], uint64_t member_id,
+                         uint8_t out[IPV6_ADDR_SIZE]);
 
 // peer.c
 peer_t* peer_create(uint64_t id, struct sockaddr_in addr);
+peer_t* peer_create_with_keys(uint64_t id, struct sockaddr_in addr, const keypair_t *keys);
 void peer_destroy(peer_t *peer);
 void peer_update_last_seen(peer_t *peer);
 bool peer_is_alive(peer_t *peer, int timeout_sec);
@@ -0,0 +1,75 @@
+#ifndef EGRESS_H
+#define EGRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "transport.h"
+#include "stats.h"
+#include "affinity.h"
+
+// Priority egress queues in front of the client's UDP socket.
+//
+// Packets read from the TUN are classified on their inner DSCP, protocol
+// and ports. EGRESS_HIGH goes first, but at most EGRESS_HIGH_WEIGHT
+// packets in a row while the other classes wait, so a host marking or
+// generating a lot of "interactive" traffic cannot starve them; NORMAL
+// and BULK share the rest by weighted round robin so bulk is never fully
+// starved either. Each class tail-drops independently, so a full bulk
+// queue never delays interactive traffic.
+
+typedef enum {
+    EGRESS_HIGH = 0,                 // voice, control (EF, CS5-7, DNS; small ICMP and SSH)
+    EGRESS_NORMAL,                   // best effort, video (CS4, AF4x)
+    EGRESS_BULK,                     // scavenger / high-throughput (CS1, AF1x)
+    EGRESS_CLASSES
+} egress_class_t;
+
+#define EGRESS_HIGH_LEN 64
+#define EGRESS_NORMAL_LEN 256
+#define EGRESS_BULK_LEN 128
+#define EGRESS_HIGH_WEIGHT 8         // HIGH packets per NORMAL/BULK packet when both are backlogged
+#define EGRESS_NORMAL_WEIGHT 4       // NORMAL packets per BULK packet
+#define EGRESS_SMALL_PKT 256         // ICMP and SSH above this are bulk transfers, not keystrokes
+#define EGRESS_READ_BATCH 32         // TUN packets classified per wakeup
+
+#define ECN_MASK 0x03
+#define ECN_NOT_ECT 0x00
+#define ECN_CE 0x03
+
+typedef struct {
+    struct sockaddr_in dest;
+    uint16_t len;
+    uint8_t tos;                     // outer TOS: inner DSCP|ECN
+    uint8_t data[MAX_PACKET_SIZE];
+} egress_pkt_t;
+
+typedef struct {
+    egress_pkt_t *slots;
+    uint32_t cap;
+    uint32_t head;
+    uint32_t count;
+    uint64_t enqueued;
+    uint64_t sent;
+    uint64_t dropped;
+} egress_queue_t;
+
+typedef struct {
+    egress_queue_t q[EGRESS_CLASSES];
+    uint32_t high_credit;
+    uint32_t normal_credit;
+    stats_t *stats;                  // optional: counts send errors
+} egress_t;
+
+int egress_init(egress_t *eg, const affinity_t *aff);
+void egress_free(egress_t *eg);
+egress_class_t egress_classify(const uint8_t *pkt, size_t len);
+uint8_t egress_inner_tos(const uint8_t *pkt, size_t len);
+egress_pkt_t* egress_reserve(egress_t *eg, egress_class_t cls);
+void egress_commit(egress_t *eg, egress_class_t cls);
+int egress_flush(egress_t *eg, transport_t *trans);
+bool egress_pending(const egress_t *eg);
+int egress_ecn_decap(uint8_t *pkt, size_t len, uint8_t outer_tos);
+
+#endif // EGRESS_H
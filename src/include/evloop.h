@@ -0,0 +1,53 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring.h"
+
+// Single-threaded event loop: sleeps in epoll_wait (poll elsewhere) until
+// a registered fd is readable, the next timer is due, or evloop_stop()
+// is called from another thread. Timers are kept in a binary min-heap
+// ordered by due time, so the wait timeout is always exact and a sweep
+// runs on time no matter how busy the sockets are.
+//
+// Fd handlers are level-triggered: a handler may stop after a budget and
+// is called again on the next iteration if data is still pending.
+
+#define EV_MAX_FDS 8
+#define EV_MAX_TIMERS 16
+
+typedef void (*ev_fd_cb)(void *ctx);
+typedef void (*ev_timer_cb)(void *ctx, uint64_t now_us);
+
+typedef struct {
+    int fd;
+    ev_fd_cb cb;
+    void *ctx;
+} ev_fd_t;
+
+typedef struct {
+    uint64_t due_us;                 // monotonic time of the next run
+    uint64_t period_us;              // 0 = one-shot
+    ev_timer_cb cb;
+    void *ctx;
+} ev_timer_t;
+
+typedef struct {
+    int epfd;                        // -1 when poll() is used
+    ev_fd_t fds[EV_MAX_FDS];
+    int fd_count;
+    ev_timer_t heap[EV_MAX_TIMERS];  // heap[0] is due first
+    int timer_count;
+    ring_notify_t wake;              // evloop_stop() from other threads
+    volatile bool stopped;           // set by evloop_stop()
+} evloop_t;
+
+int evloop_init(evloop_t *ev);
+void evloop_close(evloop_t *ev);
+int evloop_add_fd(evloop_t *ev, int fd, ev_fd_cb cb, void *ctx);
+int evloop_add_timer(evloop_t *ev, uint64_t delay_us, uint64_t period_us, ev_timer_cb cb, void *ctx);
+int evloop_run(evloop_t *ev);
+void evloop_stop(evloop_t *ev);
+
+#endif // EVLOOP_H
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef FIB_H
+#define FIB_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Overlay forwarding table: destination address -> client peer index.
+// IPv4 destinations are stored v4-mapped (::ffff:a.b.c.d) so both address
+// families share one fixed-size key and one lookup path.
+#define FIB_ADDR_SIZE 16
+#define FIB_SLOTS 1024   // power of two; two addresses per peer at <= 1/2 load
+
+typedef struct {
+    uint8_t addr[FIB_ADDR_SIZE];
+    int32_t peer_idx;                // -1 when the slot is empty
+} fib_entry_t;
+
+typedef struct {
+    fib_entry_t entries[FIB_SLOTS];
+    uint32_t count;
+} fib_t;
+
+void fib_init(fib_t *fib);
+int fib_insert(fib_t *fib, const uint8_t addr[FIB_ADDR_SIZE], int peer_idx);
+int fib_remove(fib_t *fib, const uint8_t addr[FIB_ADDR_SIZE]);
+int fib_lookup(const fib_t *fib, const uint8_t addr[FIB_ADDR_SIZE]);
+
+static inline void fib_key_from_ipv4(uint32_t ip_net, uint8_t key[FIB_ADDR_SIZE]) {
+    memset(key, 0, 10);
+    key[10] = 0xFF;
+    key[11] = 0xFF;
+    memcpy(key + 12, &ip_net, sizeof(uint32_t));
+}
+
+#endif // FIB_H
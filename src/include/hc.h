@@ -0,0 +1,75 @@
+#ifndef HC_H
+#define HC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Inner IPv4/TCP/UDP header compression (ROHC-lite).
+//
+// Frames are carried inside the AEAD payload of PKT_DATA. Plain IP packets
+// always start with 0x4X/0x6X, so any first byte below 0x40 is an HC frame:
+//   HC_IR:     [type][cid][gen] + full IPv4 packet (creates/refreshes context)
+//   HC_CO_UDP: [type][cid][gen][ip id:2][udp csum:2] + payload
+//   HC_CO_TCP: [type][cid][gen][ip id:2][seq:4][ack:4][off+flags:2][win:2]
+//              [csum:2][urg:2][options] + payload
+// Every other field is static per flow (or derived from the length) and
+// lives in the context. A decompressor that misses an IR sees an unknown
+// cid or stale generation, drops the frame and asks for a refresh with
+// PKT_HC_NACK; compressors also re-send IRs periodically.
+
+#define HC_MAX_CONTEXTS 16
+#define HC_IR_COUNT 2            // IRs sent when a context (re)starts
+#define HC_REFRESH_PACKETS 256   // periodic IR refresh
+#define HC_NACK_INTERVAL_MS 50   // per-context NACK rate limit
+
+#define HC_IR 0x01
+#define HC_CO_UDP 0x02
+#define HC_CO_TCP 0x03
+
+#define HC_MAX_EXPANSION 3       // bytes an IR adds to the packet
+
+#define HC_ERR_MALFORMED -1
+#define HC_ERR_RESYNC -2
+#define HC_ERR_RESYNC_PENDING -3   // context lost, refresh already requested
+
+typedef struct {
+    uint32_t src, dst;           // network byte order
+    uint16_t sport, dport;       // network byte order
+    uint8_t proto;
+    uint8_t tos;
+    uint8_t ttl;
+    uint16_t frag;               // flags/fragment field (DF only)
+} hc_flow_t;
+
+typedef struct {
+    bool valid;
+    hc_flow_t flow;
+    uint8_t gen;
+    uint8_t ir_remaining;
+    uint16_t since_refresh;
+} hc_comp_ctx_t;
+
+typedef struct {
+    bool valid;
+    hc_flow_t flow;
+    uint8_t gen;
+    uint64_t last_nack_ms;
+} hc_decomp_ctx_t;
+
+// Per-peer compressor + decompressor state
+typedef struct {
+    hc_comp_ctx_t comp[HC_MAX_CONTEXTS];
+    hc_decomp_ctx_t decomp[HC_MAX_CONTEXTS];
+    uint64_t bytes_saved;
+    uint64_t resyncs;
+} hc_state_t;
+
+void hc_init(hc_state_t *hc);
+int hc_compress(hc_state_t *hc, const uint8_t *pkt, size_t len, uint8_t *out, size_t out_cap);
+int hc_decompress(hc_state_t *hc, const uint8_t *in, size_t len,
+                  uint8_t *out, size_t out_cap, uint8_t *nack_cid);
+void hc_handle_nack(hc_state_t *hc, uint8_t cid);
+bool hc_is_frame(const uint8_t *buf, size_t len);
+
+#endif // HC_H
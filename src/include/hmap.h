@@ -0,0 +1,32 @@
+#ifndef HMAP_H
+#define HMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Open-addressed hash map from 64-bit keys to 32-bit values.
+//
+// Linear probing over a power-of-two table kept at most half full, with
+// backward-shift deletion (no tombstones), so lookups, inserts and deletes
+// stay O(1) expected however much the membership churns. Entries are 16
+// bytes; a probe sequence usually stays within one cache line.
+
+typedef struct {
+    uint64_t key;
+    uint32_t val;
+    uint32_t used;
+} hmap_entry_t;
+
+typedef struct {
+    hmap_entry_t *e;
+    uint32_t mask;                   // capacity - 1
+    uint32_t count;
+} hmap_t;
+
+int hmap_init(hmap_t *m, uint32_t capacity);
+void hmap_free(hmap_t *m);
+int hmap_put(hmap_t *m, uint64_t key, uint32_t val);
+bool hmap_get(const hmap_t *m, uint64_t key, uint32_t *val);
+bool hmap_del(hmap_t *m, uint64_t key);
+
+#endif // HMAP_H
\ No newline at end of file
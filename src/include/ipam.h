@@ -0,0 +1,85 @@
+#ifndef IPAM_H
+#define IPAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "hmap.h"
+
+// Overlay IPv4 address management for the controller.
+//
+// The pool is one CIDR (ZTNET_OVERLAY_CIDR, /8 to /30). Address state is a
+// hierarchical bitmap: level 0 has one bit per address (1 = taken), and
+// each bit of level k+1 says the matching 64-bit word of level k is full.
+// Finding the lowest free address walks one word per level (at most four
+// for a /8) and allocate/free touch the same path, so join cost does not
+// grow as the pool fills.
+//
+// Every address handed out belongs to a lease keyed by peer ID. A member
+// leaving does not return its address straight away: the lease is held
+// for ZTNET_IPAM_LEASE seconds so the same peer comes back on the same
+// address, and held leases are reclaimed oldest first once they expire or
+// when the pool runs dry. Reservations (ZTNET_IPAM_RESERVE) either keep
+// addresses out of the pool or pin an address to a peer ID for good.
+//
+// In a cluster every controller keeps the whole pool's leases (its own
+// members' and those it hears about from the others) but allocates new
+// addresses only from its own stride of the pool.
+
+#define IPAM_MIN_PREFIX 8
+#define IPAM_MAX_PREFIX 30
+#define IPAM_LEVELS 5
+#define IPAM_DEFAULT_LEASE 3600          // seconds a departed member's address is held
+
+typedef enum {
+    IPAM_LEASE_FREE = 0,
+    IPAM_LEASE_ACTIVE,               // member present
+    IPAM_LEASE_HELD,                 // member left; address kept for it until expiry
+    IPAM_LEASE_STATIC                // reserved for this peer ID, never expires
+} ipam_lease_state_t;
+
+typedef struct {
+    uint64_t peer_id;
+    uint32_t host;                   // offset from the network address
+    uint32_t gen;                    // bumped on every release (stale queue entries)
+    uint8_t state;                   // ipam_lease_state_t
+    uint8_t active;                  // STATIC leases: member present
+    time_t released;
+} ipam_lease_t;
+
+typedef struct {
+    uint32_t lease;
+    uint32_t gen;
+} ipam_held_t;
+
+typedef struct {
+    uint32_t network;                // host byte order
+    int prefix_len;
+    uint32_t size;                   // addresses in the prefix
+    uint32_t free_count;
+    uint64_t *level[IPAM_LEVELS];
+    uint32_t words[IPAM_LEVELS];
+    int levels;
+    ipam_lease_t *leases;
+    uint32_t lease_count, lease_cap;
+    uint32_t free_lease;             // head of the recycled lease list, UINT32_MAX = none
+    hmap_t by_peer;                  // peer ID -> lease index
+    ipam_held_t *held;               // released leases, oldest first (ring)
+    uint32_t held_head, held_count, held_cap;
+    int lease_sec;
+    uint32_t parts, part;            // stride partition; parts <= 1 = whole pool
+    hmap_t foreign;                  // adopted hosts outside our part -> unused
+} ipam_t;
+
+int ipam_init(ipam_t *ip, const char *cidr, int lease_sec);
+void ipam_free(ipam_t *ip);
+int ipam_load_reservations(ipam_t *ip, const char *spec);
+int ipam_partition(ipam_t *ip, uint32_t parts, uint32_t part);
+uint32_t ipam_assign(ipam_t *ip, uint64_t peer_id, uint32_t hint, time_t now);
+uint32_t ipam_adopt(ipam_t *ip, uint64_t peer_id, uint32_t addr, time_t now);
+void ipam_release(ipam_t *ip, uint64_t peer_id, time_t now);
+void ipam_expire(ipam_t *ip, time_t now);
+uint32_t ipam_netmask(const ipam_t *ip);
+void ipam_cidr_str(const ipam_t *ip, char *out, size_t len);
+
+#endif // IPAM_H
\ No newline at end of file
@@ -0,0 +1,16 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// LZ4 block-format codec (greedy, single pass) for packet-sized inputs.
+// Inputs must be shorter than 64 KiB.
+
+// Worst-case compressed size for src_len bytes of input
+#define LZ_BOUND(src_len) ((src_len) + (src_len) / 255 + 16)
+
+int lz_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_cap);
+int lz_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len);
+
+#endif // LZ_H
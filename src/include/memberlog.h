@@ -0,0 +1,48 @@
+#ifndef MEMBERLOG_H
+#define MEMBERLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "core.h"
+#include "transport.h"
+
+// Versioned membership log for the controller.
+//
+// Every change to the member set (join, new endpoint, new flags, leave)
+// takes the next version number and one entry in a fixed ring. Members
+// are brought up to date with PKT_MEMBER_SYNC datagrams packing many
+// records each: a member whose version is still covered by the ring gets
+// only the entries after it, anyone else (newcomers, members that fell
+// too far behind) a snapshot of the current membership. Upserts are
+// encoded from the live peer state when sent, so a member that changed
+// several times within a range goes out once.
+
+#define MEMBER_LOG_SIZE 4096
+
+typedef struct {
+    uint64_t version;
+    uint64_t peer_id;
+    uint8_t op;                      // MEMBER_UPSERT / MEMBER_REMOVE
+} member_log_entry_t;
+
+typedef struct {
+    member_log_entry_t *e;           // MEMBER_LOG_SIZE entries, allocated on first change
+    uint64_t version;                // latest entry; 0 = empty
+    uint64_t base;                   // oldest version a delta may start from
+} member_log_t;
+
+// Receives each encoded PKT_MEMBER_SYNC payload
+typedef void (*member_sync_emit_fn)(void *ctx, const uint8_t *buf, uint16_t len);
+
+void member_log_init(member_log_t *log);
+void member_log_free(member_log_t *log);
+void member_log_restore(member_log_t *log, uint64_t version);
+uint64_t member_log_append(member_log_t *log, uint8_t op, peer_t *peer);
+bool member_log_covers(const member_log_t *log, uint64_t since);
+int member_sync_delta(const member_log_t *log, network_t *net, uint64_t since,
+                      member_sync_emit_fn emit, void *ctx);
+int member_sync_snapshot(const member_log_t *log, const network_t *net, uint64_t skip_id,
+                         member_sync_emit_fn emit, void *ctx);
+void member_pack_info(const peer_t *p, uint8_t out[PEER_INFO_LEN]);
+
+#endif // MEMBERLOG_H
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef NETLINK_H
+#define NETLINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Native rtnetlink configuration of addresses, link state, MTU and routes
+// (Linux). Requests are queued into a batch and sent with one sendmsg;
+// nl_commit() then collects one ACK per request, so a whole interface
+// setup costs a single round trip to the kernel and no fork/exec.
+// Address and route requests use NLM_F_REPLACE and are idempotent.
+// Elsewhere every call fails with ENOSYS.
+
+#define NL_BATCH_BYTES 8192
+#define NL_BATCH_MSGS 32
+
+typedef struct {
+    int fd;
+    uint32_t seq;                    // sequence of the last queued request
+    int count;                       // requests in the batch
+    size_t len;                      // bytes in the batch
+    const char *what[NL_BATCH_MSGS]; // request labels for error reports
+    uint8_t buf[NL_BATCH_BYTES] __attribute__((aligned(8)));
+} nl_batch_t;
+
+int nl_open(nl_batch_t *nl);
+void nl_close(nl_batch_t *nl);
+int nl_addr(nl_batch_t *nl, int ifindex, int family, const void *addr, int prefix_len, bool add);
+int nl_link(nl_batch_t *nl, int ifindex, int up, int mtu);
+int nl_route(nl_batch_t *nl, int ifindex, int family, const void *dst, int prefix_len, bool add);
+int nl_commit(nl_batch_t *nl);
+
+#endif // NETLINK_H
\ No newline at end of file
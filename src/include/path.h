@@ -0,0 +1,86 @@
+#ifndef PATH_H
+#define PATH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Per-peer path measurement and selection.
+//
+// Each candidate path to a peer (direct, via a volunteer relay peer, via
+// the controller) is probed with a timestamped PKT_PROBE that the peer
+// echoes back over the same path as PKT_PROBE_REPLY. Replies feed a smoothed RTT (RFC 6298) and an EWMA loss
+// estimate; a probe still unanswered when the next one is due counts as
+// lost. The active path only changes when another path is clearly better
+// for several evaluations in a row, or immediately when the active path
+// goes dead.
+
+typedef enum {
+    PATH_DIRECT = 0,
+    PATH_RELAY,                      // via controller
+    PATH_PEER_RELAY,                 // via a member that volunteers as relay
+    PATH_KINDS
+} path_kind_t;
+
+typedef enum {
+    PATH_REASON_NONE = 0,            // no path has answered yet: relay fallback
+    PATH_REASON_INITIAL,             // first path to answer
+    PATH_REASON_FAILOVER,            // active path stopped answering
+    PATH_REASON_BETTER,              // sustained lower RTT/loss
+    PATH_REASON_FORCED,              // pinned by configuration (ZTNET_PATH)
+    PATH_REASON_RESUMED              // restored from the state cache, not yet re-measured
+} path_reason_t;
+
+// PKT_PROBE / PKT_PROBE_REPLY payload: kind(1) seq(4) sent_us(8)
+#define PATH_PROBE_LEN 13
+
+#define PATH_PROBE_INTERVAL_US 1000000ULL
+#define PATH_DEAD_US (3 * PATH_PROBE_INTERVAL_US + 500000ULL)
+#define PATH_SWITCH_MARGIN_PCT 20    // candidate must be 20% better ...
+#define PATH_SWITCH_MIN_US 1000      // ... and at least 1 ms better ...
+#define PATH_SWITCH_STREAK 3         // ... for 3 evaluations in a row
+#define PATH_LOSS_PENALTY 4          // score = srtt * (1 + 4 * loss)
+#define PATH_RELAY_TRIES 3           // unanswered probes before a relay is skipped
+#define PATH_RELAY_BACKOFF_US 60000000ULL
+
+typedef struct {
+    uint32_t next_seq;
+    uint32_t outstanding_seq;        // 0 when no probe is in flight
+    uint64_t last_probe_us;
+    uint64_t last_reply_us;
+    uint32_t srtt_us;                // 0 until the first sample
+    uint32_t rttvar_us;
+    float loss;                      // EWMA of probe loss, 0..1
+    uint64_t probes_sent;
+    uint64_t replies;
+} path_stats_t;
+
+typedef struct {
+    path_stats_t path[PATH_KINDS];
+    path_kind_t active;
+    path_reason_t reason;
+    uint8_t better_streak;
+    uint64_t switches;
+    bool forced;                     // active path pinned, selection disabled
+    uint64_t relay_id;               // relay peer for PATH_PEER_RELAY (0 = none)
+    uint64_t relay_failed_id;        // relay that could not reach this peer ...
+    uint64_t relay_failed_until_us;  // ... skipped until this time
+} peer_paths_t;
+
+void path_init(peer_paths_t *pp);
+bool path_probe_due(const peer_paths_t *pp, path_kind_t kind, uint64_t now_us);
+size_t path_make_probe(peer_paths_t *pp, path_kind_t kind, uint64_t now_us, uint8_t out[PATH_PROBE_LEN]);
+int path_on_reply(peer_paths_t *pp, const uint8_t *payload, size_t len, uint64_t now_us);
+bool path_is_up(const peer_paths_t *pp, path_kind_t kind, uint64_t now_us);
+bool path_select(peer_paths_t *pp, uint64_t now_us);
+void path_force(peer_paths_t *pp, path_kind_t kind);
+void path_resume(peer_paths_t *pp, path_kind_t kind, uint32_t srtt_us, uint64_t now_us);
+int path_kind_parse(const char *name);
+void path_set_relay(peer_paths_t *pp, uint64_t relay_id);
+bool path_relay_failing(const peer_paths_t *pp);
+const char* path_kind_name(path_kind_t kind);
+const char* path_reason_name(path_reason_t reason);
+void path_print(const peer_paths_t *pp, FILE *fp, uint64_t now_us);
+
+#endif // PATH_H
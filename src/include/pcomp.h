@@ -0,0 +1,64 @@
+#ifndef PCOMP_H
+#define PCOMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Adaptive per-flow payload compression (LZ4 block format) applied to the
+// inner frame before AEAD. Compressed frames are flagged on the wire as
+//   [PC_FRAME][original length:2][lz block]
+// which cannot be mistaken for an IP packet (0x4X/0x6X) or an HC frame.
+//
+// Each flow is probed by compressing a few packets; it stays on while the
+// sampled ratio is good and is switched off for incompressible streams
+// (e.g. TLS), then re-probed after PC_RESAMPLE_PACKETS skipped packets.
+
+#define PC_FRAME 0x10
+#define PC_FRAME_HDR 3
+#define PC_FLOWS 256              // direct-mapped flow table
+#define PC_MIN_LEN 96             // smaller frames are never compressed
+#define PC_SAMPLE_PACKETS 8       // packets per ratio sample
+#define PC_RESAMPLE_PACKETS 512   // packets skipped before re-probing
+#define PC_ON_RATIO_PCT 90        // keep compressing while out <= 90% of in
+
+typedef enum {
+    PC_PROBING = 0,
+    PC_ON,
+    PC_OFF
+} pc_mode_t;
+
+typedef struct {
+    uint8_t src[16], dst[16];     // IPv4 stored v4-mapped
+    uint16_t sport, dport;
+    uint8_t proto;
+} pc_key_t;
+
+typedef struct {
+    bool valid;
+    pc_key_t key;
+    pc_mode_t mode;
+    uint32_t sample_packets;
+    uint32_t sample_in, sample_out;
+    uint32_t skipped;
+    // Counters
+    uint64_t packets;
+    uint64_t packets_compressed;
+    uint64_t bytes_in;            // frame bytes before compression
+    uint64_t bytes_out;           // frame bytes handed to AEAD
+} pc_flow_t;
+
+typedef struct {
+    bool enabled;
+    pc_flow_t flows[PC_FLOWS];
+} pc_table_t;
+
+void pc_init(pc_table_t *pc, bool enabled);
+int pc_flow_key(const uint8_t *pkt, size_t len, pc_key_t *key);
+int pc_compress(pc_table_t *pc, const pc_key_t *key,
+                const uint8_t *frame, size_t len, uint8_t *out, size_t out_cap);
+int pc_decompress(const uint8_t *in, size_t len, uint8_t *out, size_t out_cap);
+void pc_print_flows(const pc_table_t *pc, FILE *fp);
+
+#endif // PCOMP_H
@@ -0,0 +1,52 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "transport.h"
+#include "affinity.h"
+
+// Batched datagram I/O for the controller's relay fast path.
+//
+// relay_batch_recv() pulls up to RELAY_BATCH datagrams with one recvmmsg
+// into a fixed pool (NUMA-local to the I/O thread). Packets to relay are
+// not parsed into a copy: relay_batch_forward() only records the new
+// destination and the datagram goes back out byte for byte from the
+// buffer it was received into. relay_batch_flush() sends everything
+// queued with one sendmmsg; consecutive same-size packets to the same
+// member leave as a single UDP GSO train (UDP_SEGMENT) when the kernel
+// supports it. Elsewhere the same calls fall back to recvmsg/sendmsg.
+// relay_batch_add() stages datagrams the controller generates itself
+// (keepalives) so they leave in the same kind of batch.
+
+#define RELAY_BATCH 64
+#define RELAY_GSO_SEGS 64                // UDP_MAX_SEGMENTS
+#define RELAY_GSO_BYTES 65000            // stays under the 64 KiB UDP limit
+
+typedef struct {
+    uint8_t *data;                   // whole datagram, header included
+    uint16_t len;
+    uint8_t tos;                     // outer DSCP|ECN as received
+    struct sockaddr_in from;
+    struct sockaddr_in to;           // set by relay_batch_forward()
+} relay_msg_t;
+
+typedef struct {
+    relay_msg_t msg[RELAY_BATCH];
+    int count;                       // datagrams from the last relay_batch_recv()
+    uint16_t fwd[RELAY_BATCH];       // msg[] indices queued for sending, in order
+    int fwd_count;
+    bool gso;                        // build GSO trains (cleared if the kernel refuses)
+    uint8_t *pool;                   // RELAY_BATCH * MAX_PACKET_SIZE
+    void *io;                        // platform syscall state
+} relay_batch_t;
+
+relay_batch_t* relay_batch_create(const affinity_t *aff, bool gso);
+void relay_batch_destroy(relay_batch_t *b);
+int relay_batch_recv(relay_batch_t *b, transport_t *trans);
+void relay_batch_forward(relay_batch_t *b, int idx, const struct sockaddr_in *to);
+uint8_t* relay_batch_add(relay_batch_t *b, const struct sockaddr_in *to, uint16_t len);
+int relay_batch_flush(relay_batch_t *b, transport_t *trans);
+
+#endif // RELAY_H
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "hmap.h"
+
+// JOIN replay cache for the controller.
+//
+// Authenticated JOINs carry a timestamp and are only accepted within
+// ZTNET_JOIN_WINDOW seconds of the controller's clock, so a (client ID,
+// nonce) pair only has to be remembered for as long as its timestamp
+// could still pass: twice the window. Pairs live in a hash set for O(1)
+// lookup and in a FIFO ring in arrival order, which is also expiry order,
+// so dropping what aged out is O(1) per entry. The ring holds
+// ZTNET_REPLAY_CACHE pairs; when it is full of live entries new JOINs are
+// refused rather than admitted unrecorded.
+
+#define REPLAY_DEFAULT_CAPACITY 65536
+#define JOIN_DEFAULT_WINDOW 30           // seconds of allowed clock difference
+
+typedef struct {
+    uint64_t key;
+    time_t seen;
+} replay_entry_t;
+
+typedef struct {
+    hmap_t set;                      // key -> unused
+    replay_entry_t *ring;
+    uint32_t cap;
+    uint32_t head, count;
+    int retain_sec;
+} replay_t;
+
+int replay_init(replay_t *r, uint32_t capacity, int window_sec);
+void replay_free(replay_t *r);
+int replay_check(replay_t *r, uint64_t client_id, uint64_t nonce, time_t now);
+
+#endif // REPLAY_H
\ No newline at end of file
@@ -0,0 +1,151 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+// Lock-free single-producer / single-consumer ring of fixed-size slots.
+//
+// The producer owns head, the consumer owns tail; each publishes its index
+// with a release store and reads the other's with an acquire load, so a
+// slot's contents are visible before the index that hands it over. The
+// indices sit on separate cache lines. Slots are used in place:
+// ring_reserve/ring_commit on the producer side, ring_front/ring_release
+// on the consumer side, so nothing is copied twice.
+//
+// ring_notify_t wakes a consumer sleeping in poll/select: an eventfd on
+// Linux, a non-blocking pipe elsewhere.
+
+typedef struct {
+    uint32_t mask;                   // capacity - 1 (capacity is a power of two)
+    uint32_t slot_size;
+    uint8_t *slots;
+    uint32_t head __attribute__((aligned(64)));  // next slot to fill (producer)
+    uint32_t tail __attribute__((aligned(64)));  // next slot to drain (consumer)
+} ring_t;
+
+// capacity is rounded up to a power of two
+static inline ring_t* ring_create(uint32_t capacity, size_t slot_size) {
+    uint32_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+    ring_t *r = NULL;
+    if (posix_memalign((void**)&r, 64, sizeof(ring_t)) != 0) return NULL;
+    memset(r, 0, sizeof(*r));
+    r->mask = cap - 1;
+    r->slot_size = (uint32_t)slot_size;
+    r->slots = (uint8_t*)calloc(cap, slot_size);
+    if (!r->slots) {
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static inline void ring_destroy(ring_t *r) {
+    if (!r) return;
+    free(r->slots);
+    free(r);
+}
+
+// Producer: slot to fill, NULL when the ring is full
+static inline void* ring_reserve(ring_t *r) {
+    uint32_t head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > r->mask) return NULL;
+    return r->slots + (size_t)(head & r->mask) * r->slot_size;
+}
+
+// Producer: publish the slot returned by ring_reserve
+static inline void ring_commit(ring_t *r) {
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+// Consumer: oldest filled slot, NULL when the ring is empty
+static inline void* ring_front(ring_t *r) {
+    uint32_t tail = r->tail;
+    if (tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) return NULL;
+    return r->slots + (size_t)(tail & r->mask) * r->slot_size;
+}
+
+// Consumer: hand the slot returned by ring_front back to the producer
+static inline void ring_release(ring_t *r) {
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+// Copying variants; return -1 when full / empty
+static inline int ring_push(ring_t *r, const void *elem) {
+    void *slot = ring_reserve(r);
+    if (!slot) return -1;
+    memcpy(slot, elem, r->slot_size);
+    ring_commit(r);
+    return 0;
+}
+
+static inline int ring_pop(ring_t *r, void *elem) {
+    void *slot = ring_front(r);
+    if (!slot) return -1;
+    memcpy(elem, slot, r->slot_size);
+    ring_release(r);
+    return 0;
+}
+
+typedef struct {
+    int rfd;                         // poll for POLLIN
+    int wfd;                         // same as rfd for an eventfd
+} ring_notify_t;
+
+static inline int ring_notify_init(ring_notify_t *n) {
+#ifdef __linux__
+    n->rfd = n->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return n->rfd >= 0 ? 0 : -1;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    n->rfd = fds[0];
+    n->wfd = fds[1];
+    return 0;
+#endif
+}
+
+// Wake the consumer; a full pipe already means a wakeup is pending
+static inline void ring_notify_signal(ring_notify_t *n) {
+    uint64_t one = 1;
+#ifdef __linux__
+    ssize_t w = write(n->wfd, &one, sizeof(one));
+#else
+    ssize_t w = write(n->wfd, &one, 1);
+#endif
+    (void)w;
+}
+
+// Consume pending wakeups before draining the ring
+static inline void ring_notify_drain(ring_notify_t *n) {
+    uint64_t buf[8];
+#ifdef __linux__
+    // One read resets the eventfd counter
+    ssize_t r = read(n->rfd, buf, sizeof(uint64_t));
+    (void)r;
+#else
+    while (read(n->rfd, buf, sizeof(buf)) > 0) {
+    }
+#endif
+}
+
+static inline void ring_notify_close(ring_notify_t *n) {
+    if (n->rfd >= 0) close(n->rfd);
+    if (n->wfd >= 0 && n->wfd != n->rfd) close(n->wfd);
+    n->rfd = n->wfd = -1;
+}
+
+#endif // RING_H
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "core.h"
+
+// Client state cache (ZTNET_STATE=<file>) for fast restarts.
+//
+// A small file mapped MAP_SHARED holds the identity, the assigned overlay
+// addresses and every known peer with its last endpoint and path. Updates
+// are plain stores into the mapping, so they survive a crash of the
+// process without any write syscalls. Each update is bracketed by a
+// sequence counter that is odd while a write is in progress; a file left
+// with an odd sequence (crash mid-update) is not resumed from.
+
+#define CSTATE_MAGIC 0x5343545AU     // "ZTCS"
+#define CSTATE_VERSION 1
+#define CSTATE_MAX_PEERS 256
+
+typedef struct {
+    uint64_t id;                     // 0 = free
+    uint32_t ip;                     // last public endpoint (network byte order)
+    uint16_t port;
+    uint8_t flags;                   // PEER_FLAG_*
+    uint8_t path;                    // active path_kind_t
+    uint32_t vip;                    // network byte order
+    uint8_t vip6[IPV6_ADDR_SIZE];
+    uint8_t has_vip6;
+    uint32_t srtt_us;                // of the active path
+    uint64_t relay_id;               // relay peer when path is PATH_PEER_RELAY
+} cstate_peer_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t seq;                    // odd while an update is in progress
+    uint64_t client_id;
+    keypair_t keys;
+    uint8_t network_id[NETWORK_ID_SIZE];
+    uint32_t controller_ip;          // network byte order
+    uint16_t controller_port;        // network byte order
+    uint16_t local_port;             // host byte order; rebound on restart
+    uint32_t vip;                    // 0 until joined
+    uint8_t vip6[IPV6_ADDR_SIZE];
+    uint8_t has_ip6;
+    uint8_t prefix_len;              // IPv4 overlay prefix; 0 = OVERLAY_DEFAULT_PREFIX_LEN
+    uint64_t saved_unix;
+    uint32_t peer_count;             // high-water mark of used slots
+    cstate_peer_t peer[CSTATE_MAX_PEERS];
+} cstate_file_t;
+
+typedef struct {
+    cstate_file_t *f;
+    char path[256];
+} cstate_t;
+
+cstate_t* cstate_open(const char *path);
+void cstate_close(cstate_t *st);
+bool cstate_valid(const cstate_t *st);
+void cstate_reset(cstate_t *st);
+void cstate_begin(cstate_t *st);
+void cstate_end(cstate_t *st);
+cstate_peer_t* cstate_peer(cstate_t *st, uint64_t peer_id, bool create);
+void cstate_flush(cstate_t *st);
+
+#endif // STATE_H
\ No newline at end of file
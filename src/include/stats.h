@@ -0,0 +1,134 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Live counters in a POSIX shared-memory segment (/zerrytee-<role>-<pid>).
+//
+// Writers never make syscalls: global counters live in per-thread shards
+// (one writer each, relaxed load+store; the last shard is shared by any
+// further threads and uses atomic adds), per-peer counters in slots
+// updated with relaxed atomic adds. Readers (`zerrytee top`, `zerrytee metrics`)
+// map the segment read-only and sum the shards; counters only grow, so a
+// reader never needs a lock to compute rates.
+
+#define STATS_MAGIC 0x5453545AU      // "ZTST"
+#define STATS_VERSION 1
+#define STATS_SHARDS 8
+#define STATS_SHARED_SHARD (STATS_SHARDS - 1) // threads beyond the first 7 share it
+#define STATS_PEER_SLOTS 256
+#define STATS_NAME_MAX 64
+
+typedef enum {
+    STAT_RX_PACKETS = 0,             // datagrams received
+    STAT_RX_BYTES,
+    STAT_TX_PACKETS,                 // datagrams sent / queued
+    STAT_TX_BYTES,
+    STAT_TUN_RX_PACKETS,             // packets read from the TUN
+    STAT_TUN_TX_PACKETS,             // packets written to the TUN
+    STAT_RELAY_PACKETS,              // forwarded between two other members
+    STAT_RELAY_BYTES,
+    STAT_DECRYPT_FAIL,
+    STAT_JOIN_OK,
+    STAT_JOIN_DENIED,
+    STAT_DROP_NO_ROUTE,              // no peer owns the destination
+    STAT_DROP_QUEUE_FULL,            // egress class queue full
+    STAT_DROP_SEND,                  // socket send error
+    STAT_DROP_MALFORMED,             // bad frame / header decompression
+    STAT_DROP_HC_RESYNC,             // lost header-compression context
+    STAT_DROP_ECN,                   // CE on a Not-ECT inner packet
+    STAT_DROP_UNKNOWN_PEER,          // relay/transit to an unknown member
+    STAT_COUNT
+} stat_id_t;
+
+typedef enum {
+    PSTAT_RX_PACKETS = 0,
+    PSTAT_RX_BYTES,
+    PSTAT_TX_PACKETS,
+    PSTAT_TX_BYTES,
+    PSTAT_RELAY_PACKETS,             // relayed on behalf of this peer
+    PSTAT_RELAY_BYTES,
+    PSTAT_DECRYPT_FAIL,
+    PSTAT_COUNT
+} peer_stat_id_t;
+
+typedef struct {
+    uint64_t c[STAT_COUNT];
+} __attribute__((aligned(64))) stats_shard_t;
+
+typedef struct {
+    uint64_t id;                     // 0 = free; published last
+    uint64_t c[PSTAT_COUNT];
+} __attribute__((aligned(64))) stats_peer_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                   // whole segment, bytes
+    uint32_t pid;
+    char role[16];                   // "client" / "controller"
+    uint64_t start_unix;
+    uint32_t shard_count;
+    uint32_t counter_count;
+    uint32_t peer_slots;
+    uint32_t peer_counter_count;
+} stats_header_t;
+
+typedef struct {
+    stats_header_t hdr;
+    stats_shard_t shard[STATS_SHARDS];
+    stats_peer_t peer[STATS_PEER_SLOTS];
+} stats_segment_t;
+
+typedef struct {
+    stats_segment_t *seg;
+    char name[STATS_NAME_MAX];
+    bool owner;                      // unlink on close
+    int refs;                        // in-process instances sharing it
+    int peers_used;                  // attached peer slots; a full table is not scanned
+} stats_t;
+
+// Writer side
+stats_t* stats_create(const char *role);
+void stats_destroy(stats_t *st);
+int stats_peer_attach(stats_t *st, uint64_t peer_id);
+void stats_peer_detach(stats_t *st, int slot);
+int stats_shard_claim(void);
+
+extern __thread int stats_tls_shard;  // this thread's shard, -1 until first use
+
+static inline int stats_shard_index(void) {
+    return stats_tls_shard >= 0 ? stats_tls_shard : stats_shard_claim();
+}
+
+static inline void stats_add(stats_t *st, stat_id_t id, uint64_t n) {
+    if (!st) return;
+    int s = stats_shard_index();
+    uint64_t *c = &st->seg->shard[s].c[id];
+    if (s == STATS_SHARED_SHARD) {
+        __atomic_fetch_add(c, n, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void stats_inc(stats_t *st, stat_id_t id) {
+    stats_add(st, id, 1);
+}
+
+static inline void stats_peer_add(stats_t *st, int slot, peer_stat_id_t id, uint64_t n) {
+    if (!st || slot < 0 || slot >= STATS_PEER_SLOTS) return;
+    __atomic_fetch_add(&st->seg->peer[slot].c[id], n, __ATOMIC_RELAXED);
+}
+
+// Reader side
+stats_t* stats_open(const char *role, int pid);
+int stats_find_pid(const char *role);
+uint64_t stats_read(const stats_t *st, stat_id_t id);
+uint64_t stats_peer_read(const stats_t *st, int slot, peer_stat_id_t id, uint64_t *peer_id);
+const char* stats_name(stat_id_t id);
+const char* stats_peer_name(peer_stat_id_t id);
+
+#endif // STATS_H
\ No newline at end of file
@@ -0,0 +1,92 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "core.h"
+#include "ipam.h"
+
+// Persistent controller state (ZTNET_STATE_DIR=<dir>).
+//
+// Two files: `snapshot`, the network identity plus every member and held
+// vIP lease as fixed-size records, and `wal`, an append-only log of the
+// membership changes made since. Each change carries its membership log
+// version, so the two line up: a restart maps the snapshot, loads its
+// records and replays the WAL entries with later versions, stopping at
+// the first torn or out-of-sequence one. Changes are buffered and
+// written with one write() + fdatasync() per group commit; JOIN replies
+// wait for the commit that makes their member durable. Once the WAL
+// outgrows the membership it is folded into a new snapshot (written to a
+// temporary file and renamed over the old one) and truncated. The WAL is
+// only open while a commit is written, so idle networks hold no files.
+
+#define STORE_MAGIC 0x5453435AU      // "ZCST"
+#define STORE_VERSION 1
+#define STORE_COMPACT_MIN 65536      // WAL records before compaction is considered
+
+typedef enum {
+    STORE_MEMBER = 1,                // present member
+    STORE_HELD                       // departed member whose vIP is still held
+} store_kind_t;
+
+typedef struct {
+    uint64_t id;
+    uint64_t released;               // STORE_HELD: unix time the member left
+    uint32_t vip;                    // network byte order
+    uint32_t ip;                     // last public endpoint (network byte order)
+    uint16_t port;                   // network byte order
+    uint8_t flags;                   // PEER_FLAG_*
+    uint8_t kind;                    // store_kind_t
+    uint32_t reserved;
+} store_member_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                   // of this header
+    uint32_t record_size;
+    uint64_t controller_id;
+    uint8_t network_id[NETWORK_ID_SIZE];
+    keypair_t network_keys;
+    char name[MAX_NETWORK_NAME];
+    uint32_t overlay_network;        // host byte order
+    uint32_t prefix_len;
+    uint64_t member_version;         // membership log version the records are at
+    uint64_t count;                  // records that follow
+} store_header_t;
+
+typedef struct {
+    uint64_t version;                // membership log version of the change
+    uint64_t check;                  // FNV-1a of the record with check = 0
+    uint8_t op;                      // MEMBER_UPSERT / MEMBER_REMOVE
+    uint8_t pad[7];
+    store_member_t m;
+} store_wal_rec_t;
+
+typedef struct {
+    char dir[320];
+    uint64_t wal_records;            // since the last snapshot
+    uint64_t wal_bytes;              // durable length; a failed commit is cut back to it
+    store_wal_rec_t *pending;        // group being collected
+    size_t pending_count, pending_cap;
+    const store_header_t *snap;      // mapped snapshot during restore
+    size_t snap_len;
+} store_t;
+
+// Receives each restored record in order; op is MEMBER_UPSERT or MEMBER_REMOVE
+typedef void (*store_load_fn)(void *ctx, uint8_t op, const store_member_t *m);
+
+int store_open(store_t *st, const char *dir);
+void store_close(store_t *st);
+const store_header_t* store_header(const store_t *st);
+uint64_t store_replay(store_t *st, store_load_fn fn, void *ctx);
+int store_append(store_t *st, uint64_t version, uint8_t op, const peer_t *peer, time_t now);
+bool store_pending(const store_t *st);
+int store_commit(store_t *st);
+int store_snapshot(store_t *st, const store_header_t *hdr, const network_t *net, const ipam_t *ip,
+                   const hmap_t *skip);
+bool store_wants_compaction(const store_t *st, int members);
+
+#endif // STORE_H
\ No newline at end of file
@@ -8,6 +8,61 @@
 #define MAX_PACKET_SIZE 1400
 #define DEFAULT_PORT 9993
 
+// PKT_PEER_INFO: id(8) vip4(4) ip(4) port(2) [vip6(16) [flags(1)]]
+#define PEER_INFO_V4_LEN 18
+#define PEER_INFO_V6_LEN (PEER_INFO_V4_LEN + 16)
+#define PEER_INFO_LEN (PEER_INFO_V6_LEN + 1)
+// PKT_JOIN_REQUEST: netid(16) [client_id(8) nonce(8) unix_time(8) hmac(32)] [vip_hint(4)]
+// The HMAC covers everything before it
+#define JOIN_AUTH_MSG_LEN (NETWORK_ID_SIZE + 8 + 8 + 8)
+#define JOIN_REQUEST_AUTH_LEN (JOIN_AUTH_MSG_LEN + 32)
+#define JOIN_VIP_HINT_LEN 4
+// PKT_JOIN_RESPONSE: vip4(4) [vip6(16) [v4 prefix length(1)]]
+#define JOIN_RESPONSE_V4_LEN 4
+#define JOIN_RESPONSE_LEN (JOIN_RESPONSE_V4_LEN + 16)
+#define JOIN_RESPONSE_CIDR_LEN (JOIN_RESPONSE_LEN + 1)
+// PKT_MEMBER_SYNC: from(8) to(8) flags(1) part(2) parts(2) records...
+//   record: MEMBER_UPSERT + PEER_INFO_LEN bytes, or MEMBER_REMOVE + id(8)
+// A delta takes a member from version `from` to `to`; a snapshot
+// (MEMBER_SYNC_SNAPSHOT) reaches `to` once all of its parts are in.
+#define MEMBER_SYNC_HDR_LEN 21
+#define MEMBER_SYNC_SNAPSHOT 0x01
+#define MEMBER_UPSERT 0x01
+#define MEMBER_REMOVE 0x02
+// PKT_KEEPALIVE (client -> controller): [membership version(8)]
+#define KEEPALIVE_VERSION_LEN 8
+// PKT_LIST_REQUEST (cli -> controller):
+//   tag(4) cursor(8) window(1) filter(1) [prefix(4) prefix_len(1)]
+// PKT_LIST_PAGE (controller -> cli):
+//   tag(4) part(1) flags(1) next_cursor(8) netid(16) count(1) records...
+//   record: id(8) vip4(4) ip(4) port(2) flags(1) idle seconds(2)
+// One page is up to `window` datagrams starting at `cursor` (0 = from the
+// start), each holding members of one network; the last carries
+// LIST_PAGE_LAST and the cursor of the next page, LIST_CURSOR_END when
+// the listing is complete. Asking for the same cursor again repeats a
+// page. The cursor is a network index and a member handle slot, so
+// members present for the whole listing appear exactly once however many
+// join or leave meanwhile. The vIP6 follows from netid and the member ID.
+#define LIST_REQUEST_LEN 14
+#define LIST_REQUEST_PREFIX_LEN (LIST_REQUEST_LEN + 5)
+#define LIST_FILTER_ACTIVE 0x01          // members heard from recently
+#define LIST_FILTER_PREFIX 0x02          // vIP inside prefix/prefix_len
+#define LIST_PAGE_HDR_LEN (4 + 1 + 1 + 8 + NETWORK_ID_SIZE + 1)
+#define LIST_RECORD_LEN 21
+#define LIST_PAGE_LAST 0x01
+#define LIST_CURSOR_END UINT64_MAX
+#define LIST_MAX_WINDOW 128
+// PKT_REDIRECT (controller -> client): ip(4) port(2), both network order;
+// the controller owning the client's shard, to send the JOIN to instead
+#define REDIRECT_LEN 6
+// PKT_CLUSTER (controller <-> controller): kind(1) ... mac(32)
+//   CLUSTER_HEARTBEAT: node index(1)
+//   CLUSTER_MEMBERS: node index(1) netid(16) records (as in PKT_MEMBER_SYNC)
+//   mac: HMAC-SHA256 of everything before it under ZTNET_CLUSTER_KEY
+#define CLUSTER_HEARTBEAT 0x01
+#define CLUSTER_MEMBERS 0x02
+#define CLUSTER_MEMBERS_HDR_LEN (2 + NETWORK_ID_SIZE)
+
 // Packet types
 typedef enum {
     PKT_HELLO = 0x01,
@@ -20,7 +75,15 @@ typedef enum {
     PKT_PEER_INFO = 0x08,     // controller -> clients (peer details)
     PKT_PEER_HELLO = 0x09,    // client -> client (direct hello)
     PKT_LIST_REQUEST = 0x0A,  // cli -> controller (ask for peers)
-    PKT_LIST_DONE = 0x0B      // controller -> cli (end of list)
+    PKT_LIST_DONE = 0x0B,     // controller -> cli (end of list)
+    PKT_HC_NACK = 0x0C,       // client -> client (header context lost, resend IR)
+    PKT_PROBE = 0x0D,         // client -> client (timestamped path probe)
+    PKT_PROBE_REPLY = 0x0E,   // client -> client (echoed probe, same path)
+    PKT_RELAY_ANNOUNCE = 0x0F, // client -> controller (volunteer as relay)
+    PKT_MEMBER_SYNC = 0x10,   // controller -> clients (membership delta/snapshot)
+    PKT_CLUSTER = 0x11,       // controller -> controller (heartbeat, member replication)
+    PKT_REDIRECT = 0x12,      // controller -> client (JOIN the shard's controller)
+    PKT_LIST_PAGE = 0x13      // controller -> cli (one datagram of a member listing)
 } packet_type_t;
 
 // Packet header
@@ -33,12 +96,17 @@ typedef struct {
     uint32_t sequence;
 } __attribute__((packed)) packet_header_t;
 
+#define MEMBER_SYNC_MAX (MAX_PACKET_SIZE - (int)sizeof(packet_header_t))
+
 // Transport context
 typedef struct {
     int socket_fd;
     uint16_t port;
     struct sockaddr_in bind_addr;
     uint32_t sequence_num;
+    uint8_t last_rx_tos;            // outer TOS (DSCP|ECN) of the last received packet
+    uint8_t tx_tos;                 // TOS currently set on the socket (non-Linux)
+    bool trace;                     // log every packet sent and received (ZTNET_TRACE=1)
 } transport_t;
 
 // Function declarations
@@ -47,8 +115,17 @@ void transport_destroy(transport_t *trans);
 int transport_send(transport_t *trans, struct sockaddr_in *dest, 
                    packet_type_t type, uint64_t sender_id, 
                    uint64_t dest_id, const uint8_t *data, uint16_t data_len);
+int transport_send_tos(transport_t *trans, struct sockaddr_in *dest,
+                       packet_type_t type, uint64_t sender_id,
+                       uint64_t dest_id, const uint8_t *data, uint16_t data_len,
+                       uint8_t tos);
+int transport_write_header(transport_t *trans, uint8_t *buf, packet_type_t type,
+                           uint64_t sender_id, uint64_t dest_id, uint16_t data_len);
+int transport_send_raw(transport_t *trans, const struct sockaddr_in *dest,
+                       const uint8_t *buf, size_t len, uint8_t tos);
 int transport_receive(transport_t *trans, packet_header_t *header, 
                       uint8_t *data, struct sockaddr_in *sender);
+int transport_decode(const uint8_t *buf, size_t len, packet_header_t *header);
 int transport_send_hello(transport_t *trans, struct sockaddr_in *dest, 
                          uint64_t sender_id);
 int transport_send_keepalive(transport_t *trans, struct sockaddr_in *dest,
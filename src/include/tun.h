@@ -8,25 +8,67 @@
 #define TUN_MTU 1500
 #define TUN_NAME_MAX 16
 
-// TUN interface structure
+typedef struct tun tun_t;
+
+// Backend operations. The kernel backend owns a real interface; the others
+// let the data plane run without /dev/net/tun, root or `ip` (tests and
+// benchmarks). configure/configure6/up/down/set_mtu/route/commit may be NULL
+// for backends with nothing to set up.
+//
+// Between tun_begin() and tun_commit() a backend may queue configuration
+// instead of applying it (the kernel backend batches rtnetlink requests
+// into one round trip); errors then surface from tun_commit().
 typedef struct {
-    int fd;                          // File descriptor for TUN device
+    const char *name;
+    bool system;                     // real OS interface: routes may be installed
+    int (*read)(tun_t *tun, uint8_t *buffer, size_t len);
+    int (*write)(tun_t *tun, const uint8_t *buffer, size_t len);
+    int (*configure)(tun_t *tun, const char *ip_str, const char *netmask_str);
+    int (*configure6)(tun_t *tun, const char *ip6_str, int prefix_len);
+    int (*up)(tun_t *tun);
+    int (*down)(tun_t *tun);
+    int (*set_mtu)(tun_t *tun, int mtu);
+    int (*route)(tun_t *tun, int family, const void *dst, int prefix_len);
+    int (*commit)(tun_t *tun);
+    void (*destroy)(tun_t *tun);
+} tun_ops_t;
+
+// TUN interface structure
+struct tun {
+    const tun_ops_t *ops;
+    int fd;                          // File descriptor polled for readability
     char name[TUN_NAME_MAX];         // Interface name (e.g., "utun0", "tun0")
     bool is_up;                      // Interface up/down status
     uint32_t ip_addr;                // Virtual IP address (network byte order)
     uint32_t netmask;                // Netmask (network byte order)
-} tun_t;
+    uint8_t ip6_addr[16];            // Virtual IPv6 address
+    int ip6_prefix_len;              // 0 when no IPv6 address is configured
+    int mtu;                         // 0 = backend default
+    int ifindex;                     // kernel backend: OS interface index
+    bool batching;                   // inside tun_begin()/tun_commit()
+    int peer_fd;                     // mem backend: the "wire" end, -1 otherwise
+    void *priv;                      // backend private state
+};
 
 // Function declarations
+tun_t* tun_open(const char *spec, const char *preferred_name);
 tun_t* tun_create(const char *preferred_name);
+tun_t* tun_mem_create(void);
+tun_t* tun_pcap_create(const char *in_path, const char *out_path);
 void tun_destroy(tun_t *tun);
 int tun_read(tun_t *tun, uint8_t *buffer, size_t len);
 int tun_write(tun_t *tun, const uint8_t *buffer, size_t len);
 int tun_configure(tun_t *tun, const char *ip_str, const char *netmask_str);
+int tun_configure6(tun_t *tun, const uint8_t addr[16], int prefix_len);
 int tun_up(tun_t *tun);
 int tun_down(tun_t *tun);
+int tun_set_mtu(tun_t *tun, int mtu);
+int tun_add_route(tun_t *tun, int family, const void *dst, int prefix_len);
+void tun_begin(tun_t *tun);
+int tun_commit(tun_t *tun);
 const char* tun_get_name(tun_t *tun);
 int tun_get_fd(tun_t *tun);
+int tun_mem_peer_fd(tun_t *tun);
+bool tun_is_system(tun_t *tun);
 
-#endif // TUN_H
-
+#endif // TUN_H
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef TWHEEL_H
+#define TWHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Hierarchical timer wheel for large numbers of per-object deadlines.
+//
+// Four levels of 64 slots: level 0 holds timers due within 64 ticks, one
+// slot per tick; each level above covers 64 times the span of the one
+// below and is cascaded down a slot at a time as the wheel turns. Arming,
+// re-arming and deleting a timer are O(1) list operations, and advancing
+// the wheel only touches the slots that come due, so per-tick cost tracks
+// the number of timers firing, not the number armed. Deadlines past the
+// top level's span (64^4 ticks) fire early at its far end.
+//
+// Timers are identified by a 32-bit id and carry a 64-bit key for the
+// owner (e.g. a peer handle). A fired timer stays allocated but idle until
+// it is armed again or deleted.
+
+#define TWHEEL_BITS 6
+#define TWHEEL_SLOTS (1 << TWHEEL_BITS)
+#define TWHEEL_LEVELS 4
+#define TWHEEL_NONE UINT32_MAX
+#define TWHEEL_FIRING (TWHEEL_LEVELS * TWHEEL_SLOTS)   // list of the tick being fired
+
+typedef struct {
+    uint64_t key;
+    uint64_t expires;                // tick
+    uint32_t next, prev;             // slot list links; next chains the free list
+    uint32_t slot;                   // level * TWHEEL_SLOTS + slot, TWHEEL_FIRING, or TWHEEL_NONE when idle
+} tw_node_t;
+
+typedef struct {
+    tw_node_t *nodes;
+    uint32_t count, cap;
+    uint32_t free_head;
+    uint32_t head[TWHEEL_LEVELS * TWHEEL_SLOTS + 1];
+    uint64_t tick;                   // last tick processed
+    uint64_t tick_us;
+    uint64_t origin_us;
+    uint32_t armed;
+} twheel_t;
+
+typedef void (*twheel_fire_fn)(void *ctx, uint64_t key, uint32_t id);
+
+int twheel_init(twheel_t *tw, uint64_t tick_us, uint64_t now_us);
+void twheel_free(twheel_t *tw);
+uint32_t twheel_add(twheel_t *tw, uint64_t key);
+void twheel_del(twheel_t *tw, uint32_t id);
+void twheel_arm(twheel_t *tw, uint32_t id, uint64_t due_us);
+int twheel_advance(twheel_t *tw, uint64_t now_us, twheel_fire_fn fire, void *ctx);
+
+#endif // TWHEEL_H
\ No newline at end of file
@@ -0,0 +1,469 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "../include/controller.h"
+#include "../include/client.h"
+#include "../include/ipam.h"
+#include "../include/hmap.h"
+#include "../include/hc.h"
+#include "../include/pcomp.h"
+#include "../include/lz.h"
+#include "../include/egress.h"
+
+// Data plane regression tests.
+//
+// Round trip: one controller and two clients in this process on
+// 127.0.0.1, each client on an in-memory TUN, as in bench-e2e. Packets
+// written to client A's TUN must come out of client B's TUN unchanged, on
+// the direct path and through the controller relay.
+//
+// Decoders: HC and payload (LZ) decompression must reject truncated and
+// corrupt frames without reading or writing out of bounds.
+//
+// Tables: hmap growth and backward-shift deletion, IPAM pool exhaustion
+// and lease hold/reuse.
+//
+// Egress: classification of inner packets into priority classes.
+//
+// Paths: initial choice, failover and the switch hysteresis of path_select.
+
+#define TEST_SETUP_TIMEOUT_SEC 10
+#define TEST_RTT_PACKETS 20
+#define TEST_PACKET_SIZE 1000
+
+static FILE *report;                 // real stdout; the daemons' chatter goes to /dev/null
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(report, "  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static uint16_t ip_checksum(const uint8_t *hdr, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2) sum += (uint32_t)((hdr[i] << 8) | hdr[i + 1]);
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+// IPv4/UDP packet 40000 -> 40001; payload = seq(4) then a repeating
+// pattern, so payload compression has something to do
+static void build_packet(uint8_t *pkt, int size, uint32_t src, uint32_t dst, uint32_t seq) {
+    memset(pkt, 0, (size_t)size);
+    pkt[0] = 0x45;
+    pkt[2] = (uint8_t)(size >> 8); pkt[3] = (uint8_t)size;
+    pkt[4] = (uint8_t)(seq >> 8); pkt[5] = (uint8_t)seq;
+    pkt[8] = 64;
+    pkt[9] = 17;
+    memcpy(pkt + 12, &src, 4);
+    memcpy(pkt + 16, &dst, 4);
+    uint16_t csum = ip_checksum(pkt, 20);
+    pkt[10] = (uint8_t)(csum >> 8); pkt[11] = (uint8_t)csum;
+    uint16_t udp_len = (uint16_t)(size - 20);
+    pkt[20] = 0x9C; pkt[21] = 0x40;
+    pkt[22] = 0x9C; pkt[23] = 0x41;
+    pkt[24] = (uint8_t)(udp_len >> 8); pkt[25] = (uint8_t)udp_len;
+    memcpy(pkt + 28, &seq, 4);
+    for (int i = 32; i < size; i++) pkt[i] = (uint8_t)("zerrytee"[i % 8]);
+}
+
+// --- Round trip over mem TUNs ---
+
+static int wait_ready(client_t **clients, int n) {
+    uint64_t deadline = now_ms() + TEST_SETUP_TIMEOUT_SEC * 1000ULL;
+    while (now_ms() < deadline) {
+        int ready = 0;
+        for (int i = 0; i < n; i++) {
+            if (clients[i]->virtual_ip[0] && clients[i]->tun->is_up &&
+                clients[i]->peer_count == n - 1) ready++;
+        }
+        if (ready == n) return 0;
+        usleep(10000);
+    }
+    return -1;
+}
+
+// Next packet of ours on fd within timeout_ms; 0 on timeout
+static int recv_packet(int fd, uint8_t *buf, size_t cap, int timeout_ms) {
+    uint64_t deadline = now_ms() + (uint64_t)timeout_ms;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (now_ms() < deadline) {
+        if (poll(&pfd, 1, 50) <= 0) continue;
+        ssize_t n = recv(fd, buf, cap, MSG_DONTWAIT);
+        // The kernel-less TUN still sees whatever else the client emits
+        if (n >= 32 && buf[9] == 17 && buf[22] == 0x9C && buf[23] == 0x41) return (int)n;
+    }
+    return 0;
+}
+
+static void test_round_trip(const char *path) {
+    fprintf(report, "round trip (%s)\n", path);
+    setenv("ZTNET_TUN", "mem", 1);
+    setenv("ZTNET_PATH", path, 1);
+
+    controller_t *ctrl = controller_create("test", 0, NULL);
+    if (!ctrl || controller_start(ctrl) != 0) {
+        CHECK(!"controller started");
+        controller_destroy(ctrl);
+        return;
+    }
+    struct sockaddr_in caddr;
+    socklen_t clen = sizeof(caddr);
+    getsockname(ctrl->transport->socket_fd, (struct sockaddr*)&caddr, &clen);
+
+    client_t *clients[2] = {0};
+    int created = 0;
+    for (; created < 2; created++) {
+        clients[created] = client_create("127.0.0.1", ntohs(caddr.sin_port),
+                                         ctrl->nets[0]->network->network_id);
+        if (!clients[created] || client_start(clients[created]) != 0 ||
+            client_connect(clients[created]) != 0) {
+            CHECK(!"client started");
+            if (clients[created]) created++;
+            goto out;
+        }
+    }
+    if (wait_ready(clients, 2) != 0) {
+        CHECK(!"clients joined and found each other");
+        goto out;
+    }
+
+    int tx = tun_mem_peer_fd(clients[0]->tun);
+    int rx = tun_mem_peer_fd(clients[1]->tun);
+    uint32_t src = clients[0]->tun->ip_addr, dst = clients[1]->tun->ip_addr;
+    uint8_t pkt[TUN_MTU], got[TUN_MTU];
+    int delivered = 0, intact = 0;
+    for (uint32_t seq = 0; seq < TEST_RTT_PACKETS; seq++) {
+        build_packet(pkt, TEST_PACKET_SIZE, src, dst, seq);
+        // The first packets may race the path coming up: retry a few times
+        for (int attempt = 0; attempt < 5; attempt++) {
+            if (send(tx, pkt, TEST_PACKET_SIZE, 0) != TEST_PACKET_SIZE) break;
+            int n = recv_packet(rx, got, sizeof(got), 500);
+            if (n == 0) continue;
+            uint32_t got_seq;
+            memcpy(&got_seq, got + 28, 4);
+            if (got_seq != seq) continue;
+            delivered++;
+            if (n == TEST_PACKET_SIZE && memcmp(got, pkt, TEST_PACKET_SIZE) == 0) intact++;
+            break;
+        }
+    }
+    CHECK(delivered == TEST_RTT_PACKETS);
+    CHECK(intact == delivered);
+
+out:
+    for (int i = 0; i < created; i++) {
+        if (clients[i]) client_destroy(clients[i]);
+    }
+    controller_destroy(ctrl);
+}
+
+// --- Decoders ---
+
+static void test_hc_malformed(void) {
+    fprintf(report, "hc decode of malformed input\n");
+    hc_state_t comp, decomp;
+    hc_init(&comp);
+    hc_init(&decomp);
+    uint8_t pkt[TEST_PACKET_SIZE], frame[TEST_PACKET_SIZE + HC_MAX_EXPANSION], out[TUN_MTU];
+    uint8_t nack = 0xFF;
+    build_packet(pkt, 200, htonl(0x0A000002), htonl(0x0A000003), 1);
+
+    // A compressed frame before any IR: unknown context, ask for a refresh
+    uint8_t co[16] = { HC_CO_UDP, 3, 0 };
+    CHECK(hc_decompress(&decomp, co, sizeof(co), out, sizeof(out), &nack) == HC_ERR_RESYNC);
+    CHECK(nack == 3);
+    // Until the refresh is due again the drops need no further NACK
+    CHECK(hc_decompress(&decomp, co, sizeof(co), out, sizeof(out), &nack) == HC_ERR_RESYNC_PENDING);
+    co[1] = HC_MAX_CONTEXTS;
+    CHECK(hc_decompress(&decomp, co, sizeof(co), out, sizeof(out), &nack) == HC_ERR_MALFORMED);
+    CHECK(hc_decompress(&decomp, co, 0, out, sizeof(out), &nack) == HC_ERR_MALFORMED);
+
+    // Every truncation of a valid IR is rejected or yields no more than it holds
+    int len = hc_compress(&comp, pkt, 200, frame, sizeof(frame));
+    CHECK(len > 0 && frame[0] == HC_IR);
+    for (int cut = 1; len > 0 && cut < len; cut++) {
+        hc_state_t d;
+        hc_init(&d);
+        int n = hc_decompress(&d, frame, (size_t)cut, out, sizeof(out), &nack);
+        CHECK(n < 0 || n <= cut);
+    }
+    CHECK(hc_decompress(&decomp, frame, (size_t)len, out, sizeof(out), &nack) == 200);
+    CHECK(memcmp(out, pkt, 200) == 0);
+    // Too small an output buffer
+    CHECK(hc_decompress(&decomp, frame, (size_t)len, out, 100, &nack) < 0);
+
+    // Compressed frames after the IR: truncated ones never decode to a packet
+    // longer than the frame could describe
+    len = hc_compress(&comp, pkt, 200, frame, sizeof(frame));
+    if (len > 0 && frame[0] != HC_IR) {
+        for (int cut = 1; cut < 6; cut++) {
+            CHECK(hc_decompress(&decomp, frame, (size_t)cut, out, sizeof(out), &nack) < 0);
+        }
+    }
+
+    // Random garbage behind every frame type
+    srand(1);
+    for (int i = 0; i < 20000; i++) {
+        uint8_t junk[64];
+        size_t n = 1 + (size_t)(rand() % (int)sizeof(junk));
+        for (size_t k = 0; k < n; k++) junk[k] = (uint8_t)rand();
+        junk[0] = (uint8_t)(HC_IR + rand() % 3);
+        junk[1] = (uint8_t)(rand() % HC_MAX_CONTEXTS);
+        int r = hc_decompress(&decomp, junk, n, out, sizeof(out), &nack);
+        CHECK(r < (int)sizeof(out));
+    }
+}
+
+static void test_pc_malformed(void) {
+    fprintf(report, "payload (LZ) decode of malformed input\n");
+    uint8_t src[TEST_PACKET_SIZE], block[LZ_BOUND(TEST_PACKET_SIZE)], out[TEST_PACKET_SIZE];
+    build_packet(src, TEST_PACKET_SIZE, htonl(0x0A000002), htonl(0x0A000003), 7);
+    int clen = lz_compress(src, sizeof(src), block, sizeof(block));
+    CHECK(clen > 0 && clen < TEST_PACKET_SIZE);
+    if (clen <= 0) return;
+    CHECK(lz_decompress(block, (size_t)clen, out, sizeof(out)) == TEST_PACKET_SIZE);
+    CHECK(memcmp(out, src, sizeof(src)) == 0);
+
+    // Truncated blocks and the wrong claimed length are errors
+    for (int cut = 1; cut < clen; cut++) {
+        CHECK(lz_decompress(block, (size_t)cut, out, sizeof(out)) < 0);
+    }
+    CHECK(lz_decompress(block, (size_t)clen, out, sizeof(out) - 1) < 0);
+
+    // A match reaching back before the start of the output
+    uint8_t back[] = { 0x14, 'a', 0x05, 0x00 };
+    CHECK(lz_decompress(back, sizeof(back), out, 9) < 0);
+    uint8_t zero_off[] = { 0x14, 'a', 0x00, 0x00 };
+    CHECK(lz_decompress(zero_off, sizeof(zero_off), out, 9) < 0);
+    // A length run that never ends
+    uint8_t run[] = { 0xF0, 0xFF, 0xFF, 0xFF };
+    CHECK(lz_decompress(run, sizeof(run), out, sizeof(out)) < 0);
+
+    // PC frames: bad lengths, then the same garbage behind a header
+    uint8_t frame[PC_FRAME_HDR + sizeof(block)];
+    frame[0] = PC_FRAME;
+    frame[1] = 0; frame[2] = 0;
+    CHECK(pc_decompress(frame, PC_FRAME_HDR, out, sizeof(out)) < 0);
+    frame[1] = 0xFF; frame[2] = 0xFF;
+    memcpy(frame + PC_FRAME_HDR, block, (size_t)clen);
+    CHECK(pc_decompress(frame, PC_FRAME_HDR + (size_t)clen, out, sizeof(out)) < 0);
+    CHECK(pc_decompress(frame, 2, out, sizeof(out)) < 0);
+    frame[1] = (uint8_t)(TEST_PACKET_SIZE >> 8); frame[2] = (uint8_t)TEST_PACKET_SIZE;
+    CHECK(pc_decompress(frame, PC_FRAME_HDR + (size_t)clen, out, sizeof(out)) == TEST_PACKET_SIZE);
+
+    srand(2);
+    for (int i = 0; i < 20000; i++) {
+        size_t n = PC_FRAME_HDR + (size_t)(rand() % 64);
+        for (size_t k = PC_FRAME_HDR; k < n; k++) frame[k] = (uint8_t)rand();
+        uint16_t orig = (uint16_t)(1 + rand() % TEST_PACKET_SIZE);
+        frame[1] = (uint8_t)(orig >> 8); frame[2] = (uint8_t)orig;
+        int r = pc_decompress(frame, n, out, sizeof(out));
+        CHECK(r < 0 || r == orig);
+    }
+}
+
+// --- Tables ---
+
+static void test_hmap(void) {
+    fprintf(report, "hmap growth and deletion\n");
+    hmap_t m;
+    CHECK(hmap_init(&m, 2) == 0);
+    const uint32_t n = 20000;
+    // Sequential keys collide in runs; key 0 is an ordinary key
+    for (uint32_t i = 0; i < n; i++) CHECK(hmap_put(&m, (uint64_t)i << 20, i) == 0);
+    CHECK(m.count == n);
+    uint32_t v = 0;
+    bool all = true;
+    for (uint32_t i = 0; i < n; i++) all &= hmap_get(&m, (uint64_t)i << 20, &v) && v == i;
+    CHECK(all);
+    CHECK(hmap_put(&m, 0, 42) == 0 && m.count == n);
+    CHECK(hmap_get(&m, 0, &v) && v == 42);
+
+    // Deleting must keep every other key reachable (backward shift)
+    for (uint32_t i = 0; i < n; i += 2) CHECK(hmap_del(&m, (uint64_t)i << 20));
+    CHECK(!hmap_del(&m, 0));
+    CHECK(m.count == n / 2);
+    all = true;
+    for (uint32_t i = 0; i < n; i++) {
+        bool found = hmap_get(&m, (uint64_t)i << 20, &v);
+        all &= (i % 2) ? (found && v == i) : !found;
+    }
+    CHECK(all);
+    for (uint32_t i = 1; i < n; i += 2) hmap_del(&m, (uint64_t)i << 20);
+    CHECK(m.count == 0);
+    CHECK(!hmap_get(&m, 1ULL << 20, &v));
+    hmap_free(&m);
+}
+
+static void test_ipam(void) {
+    fprintf(report, "ipam exhaustion and leases\n");
+    ipam_t ip;
+    CHECK(ipam_init(&ip, "10.9.0.0/31", 60) != 0);
+    CHECK(ipam_init(&ip, "10.0.0.0/7", 60) != 0);
+    CHECK(ipam_init(&ip, "10.9.0.0", 60) != 0);
+
+    // A /30 has one address left once network, broadcast and .1 are out
+    CHECK(ipam_init(&ip, "10.9.0.0/30", 60) == 0);
+    uint32_t a = ipam_assign(&ip, 1, 0, 100);
+    CHECK(a == inet_addr("10.9.0.2"));
+    CHECK(ipam_assign(&ip, 2, 0, 100) == 0);
+    CHECK(ipam_assign(&ip, 1, 0, 100) == a);
+    // Dry pool: a held lease gives way before it expires
+    ipam_release(&ip, 1, 100);
+    CHECK(ipam_assign(&ip, 2, 0, 101) == a);
+    CHECK(ipam_assign(&ip, 1, 0, 102) == 0);
+    ipam_free(&ip);
+
+    // Held leases bring a member back to its address; expired ones are reused
+    CHECK(ipam_init(&ip, "10.9.0.0/29", 60) == 0);
+    uint32_t pa = ipam_assign(&ip, 1, 0, 100);
+    uint32_t pb = ipam_assign(&ip, 2, 0, 100);
+    CHECK(pa && pb && pa != pb);
+    ipam_release(&ip, 1, 100);
+    uint32_t pc = ipam_assign(&ip, 3, pa, 110);
+    CHECK(pc && pc != pa);
+    CHECK(ipam_assign(&ip, 1, 0, 120) == pa);
+    ipam_release(&ip, 2, 130);
+    CHECK(ipam_assign(&ip, 4, 0, 150) != pb);
+    CHECK(ipam_assign(&ip, 5, pb, 200) == pb);
+    ipam_free(&ip);
+}
+
+// --- Egress classification ---
+
+static void set_ports(uint8_t *pkt, uint8_t proto, uint16_t sport, uint16_t dport) {
+    pkt[9] = proto;
+    pkt[20] = (uint8_t)(sport >> 8); pkt[21] = (uint8_t)sport;
+    pkt[22] = (uint8_t)(dport >> 8); pkt[23] = (uint8_t)dport;
+}
+
+static void test_egress_classify(void) {
+    fprintf(report, "egress classification\n");
+    uint8_t pkt[TEST_PACKET_SIZE];
+    build_packet(pkt, 100, htonl(0x0A000002), htonl(0x0A000003), 1);
+    CHECK(egress_classify(pkt, 100) == EGRESS_NORMAL);
+
+    // Voice is high, video shares the weighted classes
+    pkt[1] = 46 << 2;
+    CHECK(egress_classify(pkt, 100) == EGRESS_HIGH);
+    pkt[1] = 32 << 2;
+    CHECK(egress_classify(pkt, 100) == EGRESS_NORMAL);
+    pkt[1] = 34 << 2;
+    CHECK(egress_classify(pkt, 100) == EGRESS_NORMAL);
+    pkt[1] = 8 << 2;
+    CHECK(egress_classify(pkt, 100) == EGRESS_BULK);
+    pkt[1] = 0;
+
+    // SSH and ICMP only while small
+    set_ports(pkt, IPPROTO_TCP, 40000, 22);
+    CHECK(egress_classify(pkt, 100) == EGRESS_HIGH);
+    CHECK(egress_classify(pkt, TEST_PACKET_SIZE) == EGRESS_NORMAL);
+    pkt[9] = IPPROTO_ICMP;
+    CHECK(egress_classify(pkt, 100) == EGRESS_HIGH);
+    CHECK(egress_classify(pkt, TEST_PACKET_SIZE) == EGRESS_NORMAL);
+    set_ports(pkt, IPPROTO_UDP, 40000, 53);
+    CHECK(egress_classify(pkt, 100) == EGRESS_HIGH);
+
+    // A later fragment has no ports; a bad header length is not parsed
+    pkt[7] = 1;
+    CHECK(egress_classify(pkt, 100) == EGRESS_NORMAL);
+    pkt[7] = 0;
+    pkt[0] = 0x44;
+    CHECK(egress_classify(pkt, 100) == EGRESS_NORMAL);
+}
+
+// --- Path selection ---
+
+// One probe on a path, sent at sent_us and answered at now_us
+static void path_answer(peer_paths_t *pp, path_kind_t kind, uint64_t sent_us, uint64_t now_us) {
+    uint8_t probe[PATH_PROBE_LEN];
+    path_make_probe(pp, kind, sent_us, probe);
+    CHECK(path_on_reply(pp, probe, sizeof(probe), now_us) == (int)kind);
+}
+
+static void test_path_select(void) {
+    fprintf(report, "path selection\n");
+    peer_paths_t pp;
+    path_init(&pp);
+    uint64_t t = 10 * PATH_PROBE_INTERVAL_US;
+
+    // Relay and direct replies in one batch: direct wins the initial choice
+    path_answer(&pp, PATH_RELAY, t, t + 20000);
+    path_answer(&pp, PATH_DIRECT, t, t + 20000);
+    t += 20000;
+    CHECK(path_select(&pp, t));
+    CHECK(pp.active == PATH_DIRECT);
+    CHECK(pp.reason == PATH_REASON_INITIAL);
+
+    // Direct goes silent while the relay keeps answering: fail over once
+    // it has been quiet for PATH_DEAD_US
+    uint64_t direct_last = t;
+    for (int i = 0; i < 4; i++) {
+        t += PATH_PROBE_INTERVAL_US;
+        path_answer(&pp, PATH_RELAY, t, t + 20000);
+        t += 20000;
+        CHECK(!path_select(&pp, t) || t - direct_last > PATH_DEAD_US);
+    }
+    CHECK(pp.active == PATH_RELAY);
+    CHECK(pp.reason == PATH_REASON_FAILOVER);
+
+    // Direct comes back much faster (enough samples to pull its smoothed
+    // RTT well under the relay's): it takes PATH_SWITCH_STREAK evaluations
+    // in a row before the switch
+    for (int i = 0; i < 4; i++) {
+        path_answer(&pp, PATH_DIRECT, t + 1000 * (uint64_t)i, t + 1000 * (uint64_t)i + 2000);
+    }
+    for (int i = 1; i <= PATH_SWITCH_STREAK; i++) {
+        t += PATH_PROBE_INTERVAL_US;
+        path_answer(&pp, PATH_RELAY, t, t + 20000);
+        path_answer(&pp, PATH_DIRECT, t + 18000, t + 20000);
+        t += 20000;
+        bool changed = path_select(&pp, t);
+        CHECK(changed == (i == PATH_SWITCH_STREAK));
+        CHECK(pp.active == (changed ? PATH_DIRECT : PATH_RELAY));
+    }
+    CHECK(pp.reason == PATH_REASON_BETTER);
+    CHECK(pp.switches == 3);
+}
+
+int main(void) {
+    // Keep the report on the real stdout; silence the daemons
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    int devnull = open("/dev/null", O_WRONLY);
+    if (!report || devnull < 0) {
+        perror("Failed to set up output");
+        return 1;
+    }
+    setvbuf(report, NULL, _IOLBF, 0);
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    test_hmap();
+    test_ipam();
+    test_egress_classify();
+    test_path_select();
+    test_hc_malformed();
+    test_pc_malformed();
+    test_round_trip("direct");
+    test_round_trip("relay");
+
+    fprintf(report, failures ? "%d check(s) failed\n" : "all tests passed\n", failures);
+    fclose(report);
+    return failures ? 1 : 0;
+}
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <netinet/ip.h>
 #include "../include/transport.h"
 
 // Create transport layer
@@ -30,6 +31,15 @@ transport_t* transport_create(uint16_t port) {
         perror("Failed to set SO_REUSEADDR");
     }
     
+#ifdef IP_RECVTOS
+    // Deliver the outer TOS byte so ECN marks can be propagated inward
+    int recv_tos = 1;
+    if (setsockopt(trans->socket_fd, IPPROTO_IP, IP_RECVTOS,
+                   &recv_tos, sizeof(recv_tos)) < 0) {
+        perror("Failed to set IP_RECVTOS");
+    }
+#endif
+    
     // Bind socket
     trans->port = port;
     memset(&trans->bind_addr, 0, sizeof(trans->bind_addr));
@@ -45,9 +55,21 @@ transport_t* transport_create(uint16_t port) {
         return NULL;
     }
     
+    // Record the port the kernel picked for port 0
+    if (port == 0) {
+        struct sockaddr_in bound;
+        socklen_t blen = sizeof(bound);
+        if (getsockname(trans->socket_fd, (struct sockaddr*)&bound, &blen) == 0) {
+            trans->port = ntohs(bound.sin_port);
+        }
+    }
+    
     trans->sequence_num = 0;
+    // Per-packet logging is for debugging only (ZTNET_TRACE=1)
+    const char *trace = getenv("ZTNET_TRACE");
+    trans->trace = trace && strcmp(trace, "1") == 0;
     
-    printf("Transport layer initialized on port %d\n", port);
+    printf("Transport layer initialized on port %d\n", trans->port);
     return trans;
 }
 
@@ -63,10 +85,75 @@ void transport_destroy(transport_t *trans) {
     free(trans);
 }
 
-// Send packet
-int transport_send(transport_t *trans, struct sockaddr_in *dest, 
-                   packet_type_t type, uint64_t sender_id, 
-                   uint64_t dest_id, const uint8_t *data, uint16_t data_len) {
+// Fill the packet header at the start of buf; returns the header size
+int transport_write_header(transport_t *trans, uint8_t *buf, packet_type_t type,
+                           uint64_t sender_id, uint64_t dest_id, uint16_t data_len) {
+    if (!trans || !buf) return -1;
+    
+    packet_header_t *header = (packet_header_t*)buf;
+    header->version = 1;
+    header->type = type;
+    header->length = htons(data_len);
+    header->sender_id = sender_id;
+    header->dest_id = dest_id;
+    // The socket is shared by the client's forwarding and control threads
+    header->sequence = htonl(__atomic_fetch_add(&trans->sequence_num, 1, __ATOMIC_RELAXED));
+    
+    return (int)sizeof(packet_header_t);
+}
+
+// Send an already built datagram with the given outer TOS (DSCP|ECN).
+// Returns -1 with errno set on failure (EAGAIN when the socket is full).
+int transport_send_raw(transport_t *trans, const struct sockaddr_in *dest,
+                       const uint8_t *buf, size_t len, uint8_t tos) {
+    if (!trans || !dest || !buf) return -1;
+    
+    struct iovec iov = { .iov_base = (void*)buf, .iov_len = len };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void*)dest;
+    msg.msg_namelen = sizeof(*dest);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    
+#ifdef __linux__
+    // Per-packet TOS via ancillary data, no extra syscall
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    if (tos != 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type = IP_TOS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        int tos_val = tos;
+        memcpy(CMSG_DATA(cmsg), &tos_val, sizeof(tos_val));
+    }
+#else
+    if (tos != trans->tx_tos) {
+        int tos_val = tos;
+        if (setsockopt(trans->socket_fd, IPPROTO_IP, IP_TOS, &tos_val, sizeof(tos_val)) == 0) {
+            trans->tx_tos = tos;
+        }
+    }
+#endif
+    
+    ssize_t sent = sendmsg(trans->socket_fd, &msg, 0);
+    if (sent < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Send packet with an outer TOS byte
+int transport_send_tos(transport_t *trans, struct sockaddr_in *dest,
+                       packet_type_t type, uint64_t sender_id,
+                       uint64_t dest_id, const uint8_t *data, uint16_t data_len,
+                       uint8_t tos) {
     if (!trans || !dest) return -1;
     
     if (data_len > MAX_PACKET_SIZE - sizeof(packet_header_t)) {
@@ -75,15 +162,7 @@ int transport_send(transport_t *trans, struct sockaddr_in *dest,
     }
     
     uint8_t buffer[MAX_PACKET_SIZE];
-    packet_header_t *header = (packet_header_t*)buffer;
-    
-    // Fill header
-    header->version = 1;
-    header->type = type;
-    header->length = htons(data_len);
-    header->sender_id = sender_id;
-    header->dest_id = dest_id;
-    header->sequence = htonl(trans->sequence_num++);
+    transport_write_header(trans, buffer, type, sender_id, dest_id, data_len);
     
     // Copy data if present
     if (data && data_len > 0) {
@@ -91,32 +170,59 @@ int transport_send(transport_t *trans, struct sockaddr_in *dest,
     }
     
     int total_len = sizeof(packet_header_t) + data_len;
-    ssize_t sent = sendto(trans->socket_fd, buffer, total_len, 0,
-                          (struct sockaddr*)dest, sizeof(*dest));
-    
-    if (sent < 0) {
+    if (transport_send_raw(trans, dest, buffer, (size_t)total_len, tos) != 0) {
         perror("Failed to send packet");
         return -1;
     }
     
-    char ip_str[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(dest->sin_addr), ip_str, INET_ADDRSTRLEN);
-    printf("Sent packet type %d to %s:%d (%zd bytes)\n", 
-           type, ip_str, ntohs(dest->sin_port), sent);
+    if (trans->trace) {
+        char ip_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(dest->sin_addr), ip_str, INET_ADDRSTRLEN);
+        printf("Sent packet type %d to %s:%d (%d bytes)\n", 
+               type, ip_str, ntohs(dest->sin_port), total_len);
+    }
     
     return 0;
 }
 
+// Send packet
+int transport_send(transport_t *trans, struct sockaddr_in *dest, 
+                   packet_type_t type, uint64_t sender_id, 
+                   uint64_t dest_id, const uint8_t *data, uint16_t data_len) {
+    return transport_send_tos(trans, dest, type, sender_id, dest_id, data, data_len, 0);
+}
+
+// Parse the header of a received datagram (host byte order); returns
+// the payload length, -1 for a runt
+int transport_decode(const uint8_t *buf, size_t len, packet_header_t *header) {
+    if (!buf || !header || len < sizeof(packet_header_t)) return -1;
+    memcpy(header, buf, sizeof(packet_header_t));
+    header->length = ntohs(header->length);
+    header->sequence = ntohl(header->sequence);
+    return (int)(len - sizeof(packet_header_t));
+}
+
 // Receive packet
 int transport_receive(transport_t *trans, packet_header_t *header, 
                       uint8_t *data, struct sockaddr_in *sender) {
     if (!trans || !header) return -1;
     
     uint8_t buffer[MAX_PACKET_SIZE];
-    socklen_t sender_len = sizeof(*sender);
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = buffer, .iov_len = MAX_PACKET_SIZE };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = sender;
+    msg.msg_namelen = sizeof(*sender);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
     
-    ssize_t received = recvfrom(trans->socket_fd, buffer, MAX_PACKET_SIZE, 0,
-                                (struct sockaddr*)sender, &sender_len);
+    ssize_t received = recvmsg(trans->socket_fd, &msg, 0);
     
     if (received < 0) {
         if (errno != EAGAIN && errno != EWOULDBLOCK) {
@@ -125,26 +231,43 @@ int transport_receive(transport_t *trans, packet_header_t *header,
         return -1;
     }
     
-    if (received < (ssize_t)sizeof(packet_header_t)) {
+    // Outer TOS (if delivered) for ECN propagation
+    trans->last_rx_tos = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP &&
+            (cmsg->cmsg_type == IP_TOS
+#ifdef IP_RECVTOS
+             || cmsg->cmsg_type == IP_RECVTOS
+#endif
+            )) {
+            // Linux delivers a single byte, BSDs an int
+            if (cmsg->cmsg_len >= CMSG_LEN(sizeof(int))) {
+                int tos_val;
+                memcpy(&tos_val, CMSG_DATA(cmsg), sizeof(tos_val));
+                trans->last_rx_tos = (uint8_t)tos_val;
+            } else {
+                trans->last_rx_tos = *(uint8_t*)CMSG_DATA(cmsg);
+            }
+        }
+    }
+    
+    int data_len = transport_decode(buffer, (size_t)received, header);
+    if (data_len < 0) {
         fprintf(stderr, "Packet too small: %zd bytes\n", received);
         return -1;
     }
     
-    // Copy header
-    memcpy(header, buffer, sizeof(packet_header_t));
-    header->length = ntohs(header->length);
-    header->sequence = ntohl(header->sequence);
-    
     // Copy data if present
-    int data_len = received - sizeof(packet_header_t);
     if (data && data_len > 0) {
         memcpy(data, buffer + sizeof(packet_header_t), data_len);
     }
     
-    char ip_str[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(sender->sin_addr), ip_str, INET_ADDRSTRLEN);
-    printf("Received packet type %d from %s:%d (%zd bytes)\n", 
-           header->type, ip_str, ntohs(sender->sin_port), received);
+    if (trans->trace) {
+        char ip_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &(sender->sin_addr), ip_str, INET_ADDRSTRLEN);
+        printf("Received packet type %d from %s:%d (%zd bytes)\n", 
+               header->type, ip_str, ntohs(sender->sin_port), received);
+    }
     
     return data_len;
 }
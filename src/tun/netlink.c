@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "../include/netlink.h"
+
+#ifdef __linux__
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+
+int nl_open(nl_batch_t *nl) {
+    if (!nl) return -1;
+    memset(nl, 0, sizeof(*nl));
+    nl->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (nl->fd < 0) {
+        perror("Failed to open rtnetlink socket");
+        return -1;
+    }
+    struct sockaddr_nl local;
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    if (bind(nl->fd, (struct sockaddr*)&local, sizeof(local)) < 0) {
+        perror("Failed to bind rtnetlink socket");
+        close(nl->fd);
+        nl->fd = -1;
+        return -1;
+    }
+    // The kernel answers synchronously; the timeout only guards against a
+    // lost ACK
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(nl->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    nl->seq = (uint32_t)time(NULL);
+    return 0;
+}
+
+void nl_close(nl_batch_t *nl) {
+    if (!nl || nl->fd < 0) return;
+    close(nl->fd);
+    nl->fd = -1;
+}
+
+// Start a request of the given type with a fixed header of hdr_len bytes
+static struct nlmsghdr* nl_begin(nl_batch_t *nl, uint16_t type, uint16_t flags,
+                                 size_t hdr_len, const char *what) {
+    size_t need = NLMSG_SPACE(hdr_len) + 64; // room for the attributes we add
+    if (nl->fd < 0 || nl->count >= NL_BATCH_MSGS || nl->len + need > sizeof(nl->buf)) {
+        errno = ENOBUFS;
+        return NULL;
+    }
+    struct nlmsghdr *h = (struct nlmsghdr*)(nl->buf + nl->len);
+    memset(h, 0, NLMSG_SPACE(hdr_len));
+    h->nlmsg_len = NLMSG_LENGTH(hdr_len);
+    h->nlmsg_type = type;
+    h->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    h->nlmsg_seq = ++nl->seq;
+    nl->what[nl->count] = what;
+    return h;
+}
+
+static void nl_attr(struct nlmsghdr *h, uint16_t type, const void *data, size_t len) {
+    struct rtattr *rta = (struct rtattr*)((uint8_t*)h + NLMSG_ALIGN(h->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = (unsigned short)RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    h->nlmsg_len = NLMSG_ALIGN(h->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static void nl_end(nl_batch_t *nl, struct nlmsghdr *h) {
+    nl->len += NLMSG_ALIGN(h->nlmsg_len);
+    nl->count++;
+}
+
+static size_t family_addr_len(int family) {
+    return family == AF_INET6 ? 16 : 4;
+}
+
+// Queue an address add (replace) or delete
+int nl_addr(nl_batch_t *nl, int ifindex, int family, const void *addr, int prefix_len, bool add) {
+    if (!nl || !addr || (family != AF_INET && family != AF_INET6)) return -1;
+    struct nlmsghdr *h = nl_begin(nl, add ? RTM_NEWADDR : RTM_DELADDR,
+                                  add ? NLM_F_CREATE | NLM_F_REPLACE : 0,
+                                  sizeof(struct ifaddrmsg), family == AF_INET6 ? "address6" : "address");
+    if (!h) return -1;
+    struct ifaddrmsg *ifa = (struct ifaddrmsg*)NLMSG_DATA(h);
+    ifa->ifa_family = (uint8_t)family;
+    ifa->ifa_prefixlen = (uint8_t)prefix_len;
+    ifa->ifa_index = (uint32_t)ifindex;
+    ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+    // Overlay addresses are unique by construction: skip duplicate address
+    // detection so the v6 address is usable at once
+    if (family == AF_INET6) ifa->ifa_flags = IFA_F_NODAD;
+    size_t alen = family_addr_len(family);
+    nl_attr(h, IFA_LOCAL, addr, alen);
+    nl_attr(h, IFA_ADDRESS, addr, alen);
+    nl_end(nl, h);
+    return 0;
+}
+
+// Queue a link change: up = 1/0 (-1 keeps the state), mtu > 0 sets the MTU
+int nl_link(nl_batch_t *nl, int ifindex, int up, int mtu) {
+    if (!nl) return -1;
+    struct nlmsghdr *h = nl_begin(nl, RTM_NEWLINK, 0, sizeof(struct ifinfomsg),
+                                  up < 0 ? "mtu" : (up ? "link up" : "link down"));
+    if (!h) return -1;
+    struct ifinfomsg *ifi = (struct ifinfomsg*)NLMSG_DATA(h);
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = ifindex;
+    if (up >= 0) {
+        ifi->ifi_flags = up ? IFF_UP : 0;
+        ifi->ifi_change = IFF_UP;
+    }
+    if (mtu > 0) {
+        uint32_t m = (uint32_t)mtu;
+        nl_attr(h, IFLA_MTU, &m, sizeof(m));
+    }
+    nl_end(nl, h);
+    return 0;
+}
+
+// Queue a route add (replace) or delete for dst/prefix_len via the interface
+int nl_route(nl_batch_t *nl, int ifindex, int family, const void *dst, int prefix_len, bool add) {
+    if (!nl || !dst || (family != AF_INET && family != AF_INET6)) return -1;
+    struct nlmsghdr *h = nl_begin(nl, add ? RTM_NEWROUTE : RTM_DELROUTE,
+                                  add ? NLM_F_CREATE | NLM_F_REPLACE : 0,
+                                  sizeof(struct rtmsg), family == AF_INET6 ? "route6" : "route");
+    if (!h) return -1;
+    struct rtmsg *rtm = (struct rtmsg*)NLMSG_DATA(h);
+    rtm->rtm_family = (uint8_t)family;
+    rtm->rtm_dst_len = (uint8_t)prefix_len;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    rtm->rtm_protocol = RTPROT_STATIC;
+    rtm->rtm_scope = RT_SCOPE_LINK;
+    rtm->rtm_type = RTN_UNICAST;
+    uint32_t oif = (uint32_t)ifindex;
+    nl_attr(h, RTA_DST, dst, family_addr_len(family));
+    nl_attr(h, RTA_OIF, &oif, sizeof(oif));
+    nl_end(nl, h);
+    return 0;
+}
+
+// Send the batch and wait for every ACK. Returns -1 with errno set from
+// the first request the kernel rejected (reported on stderr).
+int nl_commit(nl_batch_t *nl) {
+    if (!nl || nl->fd < 0) return -1;
+    if (nl->count == 0) return 0;
+
+    struct sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    uint32_t first_seq = nl->seq - (uint32_t)nl->count + 1;
+    int pending = nl->count;
+    int sent_count = nl->count;
+    int err = 0;
+    const char *failed = NULL;
+
+    ssize_t sent = sendto(nl->fd, nl->buf, nl->len, 0, (struct sockaddr*)&kernel, sizeof(kernel));
+    nl->len = 0;
+    nl->count = 0;
+    if (sent < 0) {
+        perror("rtnetlink send failed");
+        return -1;
+    }
+
+    uint8_t rbuf[8192] __attribute__((aligned(8)));
+    while (pending > 0) {
+        ssize_t n = recv(nl->fd, rbuf, sizeof(rbuf), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("rtnetlink receive failed");
+            return -1;
+        }
+        for (struct nlmsghdr *h = (struct nlmsghdr*)rbuf; NLMSG_OK(h, (unsigned)n);
+             h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_type != NLMSG_ERROR) continue;
+            uint32_t idx = h->nlmsg_seq - first_seq;
+            if (idx >= (uint32_t)sent_count) continue;  // stale answer
+            pending--;
+            struct nlmsgerr *e = (struct nlmsgerr*)NLMSG_DATA(h);
+            if (e->error != 0 && err == 0) {
+                err = -e->error;
+                failed = nl->what[idx];
+            }
+        }
+    }
+    if (err != 0) {
+        fprintf(stderr, "rtnetlink %s failed: %s\n", failed ? failed : "request", strerror(err));
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+#else
+
+int nl_open(nl_batch_t *nl) {
+    if (nl) nl->fd = -1;
+    errno = ENOSYS;
+    return -1;
+}
+
+void nl_close(nl_batch_t *nl) {
+    (void)nl;
+}
+
+int nl_addr(nl_batch_t *nl, int ifindex, int family, const void *addr, int prefix_len, bool add) {
+    (void)nl; (void)ifindex; (void)family; (void)addr; (void)prefix_len; (void)add;
+    errno = ENOSYS;
+    return -1;
+}
+
+int nl_link(nl_batch_t *nl, int ifindex, int up, int mtu) {
+    (void)nl; (void)ifindex; (void)up; (void)mtu;
+    errno = ENOSYS;
+    return -1;
+}
+
+int nl_route(nl_batch_t *nl, int ifindex, int family, const void *dst, int prefix_len, bool add) {
+    (void)nl; (void)ifindex; (void)family; (void)dst; (void)prefix_len; (void)add;
+    errno = ENOSYS;
+    return -1;
+}
+
+int nl_commit(nl_batch_t *nl) {
+    (void)nl;
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <net/if.h>
 #include <arpa/inet.h>
 #include "../include/tun.h"
+#include "../include/netlink.h"
 
 #ifdef __APPLE__
 #include <sys/kern_control.h>
@@ -21,7 +22,281 @@
 #include <linux/if_tun.h>
 #endif
 
-// Create TUN interface
+// Kernel backend: read IP packet from the TUN device
+static int kernel_read(tun_t *tun, uint8_t *buffer, size_t len) {
+#ifdef __APPLE__
+    // macOS utun prepends 4-byte address family
+    uint8_t temp_buffer[TUN_MTU + 4];
+    ssize_t n = read(tun->fd, temp_buffer, sizeof(temp_buffer));
+    
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0; // No data available (non-blocking)
+        }
+        perror("Failed to read from TUN");
+        return -1;
+    }
+    
+    if (n < 4) {
+        fprintf(stderr, "Received packet too short\n");
+        return -1;
+    }
+    
+    // Skip 4-byte address family header
+    size_t packet_len = n - 4;
+    if (packet_len > len) {
+        fprintf(stderr, "Packet too large for buffer\n");
+        return -1;
+    }
+    
+    memcpy(buffer, temp_buffer + 4, packet_len);
+    return packet_len;
+    
+#elif __linux__
+    ssize_t n = read(tun->fd, buffer, len);
+    
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0; // No data available (non-blocking)
+        }
+        perror("Failed to read from TUN");
+        return -1;
+    }
+    
+    return n;
+#else
+    return -1;
+#endif
+}
+
+// Kernel backend: write IP packet to the TUN device
+static int kernel_write(tun_t *tun, const uint8_t *buffer, size_t len) {
+#ifdef __APPLE__
+    // macOS utun requires 4-byte address family prefix
+    uint8_t temp_buffer[TUN_MTU + 4];
+    
+    if (len > TUN_MTU) {
+        fprintf(stderr, "Packet too large for TUN interface\n");
+        return -1;
+    }
+    
+    // Determine address family from IP header
+    uint8_t version = (buffer[0] >> 4) & 0x0F;
+    
+    // Prepend address family (AF_INET for IPv4, AF_INET6 for IPv6)
+    temp_buffer[0] = 0;
+    temp_buffer[1] = 0;
+    temp_buffer[2] = 0;
+    temp_buffer[3] = (version == 4) ? AF_INET : AF_INET6;
+    
+    memcpy(temp_buffer + 4, buffer, len);
+    
+    ssize_t n = write(tun->fd, temp_buffer, len + 4);
+    if (n < 0) {
+        perror("Failed to write to TUN");
+        return -1;
+    }
+    
+    return n - 4; // Return actual packet length (excluding header)
+    
+#elif __linux__
+    ssize_t n = write(tun->fd, buffer, len);
+    if (n < 0) {
+        perror("Failed to write to TUN");
+        return -1;
+    }
+    
+    return n;
+#else
+    return -1;
+#endif
+}
+
+#ifdef __linux__
+// Kernel backend (Linux): configuration goes through rtnetlink. Requests
+// are applied immediately, or queued until tun_commit() while batching.
+static int kernel_nl_apply(tun_t *tun, int queued) {
+    if (queued != 0) {
+        perror("Failed to queue rtnetlink request");
+        return -1;
+    }
+    if (tun->batching) return 0;
+    return nl_commit((nl_batch_t*)tun->priv);
+}
+
+static int kernel_configure(tun_t *tun, const char *ip_str, const char *netmask_str) {
+    (void)ip_str; (void)netmask_str;
+    return kernel_nl_apply(tun, nl_addr((nl_batch_t*)tun->priv, tun->ifindex, AF_INET, &tun->ip_addr,
+                                        __builtin_popcount(ntohl(tun->netmask)), true));
+}
+
+static int kernel_configure6(tun_t *tun, const char *ip6_str, int prefix_len) {
+    (void)ip6_str;
+    return kernel_nl_apply(tun, nl_addr((nl_batch_t*)tun->priv, tun->ifindex, AF_INET6, tun->ip6_addr,
+                                        prefix_len, true));
+}
+
+// Link up carries the MTU too, so both land in one request
+static int kernel_up(tun_t *tun) {
+    return kernel_nl_apply(tun, nl_link((nl_batch_t*)tun->priv, tun->ifindex, 1, tun->mtu));
+}
+
+static int kernel_down(tun_t *tun) {
+    return kernel_nl_apply(tun, nl_link((nl_batch_t*)tun->priv, tun->ifindex, 0, 0));
+}
+
+// While down, the MTU rides along with the next link up
+static int kernel_set_mtu(tun_t *tun, int mtu) {
+    if (!tun->is_up) return 0;
+    return kernel_nl_apply(tun, nl_link((nl_batch_t*)tun->priv, tun->ifindex, -1, mtu));
+}
+
+static int kernel_route(tun_t *tun, int family, const void *dst, int prefix_len) {
+    return kernel_nl_apply(tun, nl_route((nl_batch_t*)tun->priv, tun->ifindex, family, dst,
+                                         prefix_len, true));
+}
+
+static int kernel_commit(tun_t *tun) {
+    return nl_commit((nl_batch_t*)tun->priv);
+}
+
+#else
+
+// Kernel backend: assign the IPv4 address with the system tools
+static int kernel_configure(tun_t *tun, const char *ip_str, const char *netmask_str) {
+    char cmd[256];
+    
+#ifdef __APPLE__
+    // macOS requires source and destination IP for utun (point-to-point)
+    snprintf(cmd, sizeof(cmd),
+             "ifconfig %s inet %s %s netmask %s up",
+             tun->name, ip_str, ip_str, netmask_str);
+#else
+    (void)tun; (void)ip_str; (void)netmask_str;
+    fprintf(stderr, "IP configuration not supported on this platform\n");
+    return -1;
+#endif
+    
+    printf("Configuring %s: %s\n", tun->name, cmd);
+    
+    int result = system(cmd);
+    if (result != 0) {
+        fprintf(stderr, "Warning: Failed to configure IP address (may need sudo)\n");
+        fprintf(stderr, "You can manually configure with: %s\n", cmd);
+        return -1;
+    }
+    return 0;
+}
+
+// Kernel backend: assign the IPv6 address with the system tools
+static int kernel_configure6(tun_t *tun, const char *ip6_str, int prefix_len) {
+    char cmd[256];
+    
+#ifdef __APPLE__
+    snprintf(cmd, sizeof(cmd),
+             "ifconfig %s inet6 %s prefixlen %d alias",
+             tun->name, ip6_str, prefix_len);
+#else
+    (void)tun; (void)ip6_str; (void)prefix_len;
+    fprintf(stderr, "IPv6 configuration not supported on this platform\n");
+    return -1;
+#endif
+    
+    printf("Configuring %s: %s\n", tun->name, cmd);
+    
+    int result = system(cmd);
+    if (result != 0) {
+        fprintf(stderr, "Warning: Failed to configure IPv6 address (may need sudo)\n");
+        fprintf(stderr, "You can manually configure with: %s\n", cmd);
+        return -1;
+    }
+    return 0;
+}
+
+static int kernel_set_state(tun_t *tun, const char *state) {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "ifconfig %s %s", tun->name, state);
+    return system(cmd) == 0 ? 0 : -1;
+}
+
+static int kernel_up(tun_t *tun) {
+    if (tun->mtu > 0) {
+        char mtu[32];
+        snprintf(mtu, sizeof(mtu), "mtu %d", tun->mtu);
+        kernel_set_state(tun, mtu);
+    }
+    if (kernel_set_state(tun, "up") != 0) {
+        fprintf(stderr, "Failed to bring interface up (may need sudo)\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int kernel_down(tun_t *tun) {
+    if (kernel_set_state(tun, "down") != 0) {
+        fprintf(stderr, "Failed to bring interface down\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int kernel_set_mtu(tun_t *tun, int mtu) {
+    if (!tun->is_up) return 0;
+    char arg[32];
+    snprintf(arg, sizeof(arg), "mtu %d", mtu);
+    return kernel_set_state(tun, arg);
+}
+
+// macOS: route add -net <dst>/<len> via the interface
+static int kernel_route(tun_t *tun, int family, const void *dst, int prefix_len) {
+    char dst_str[INET6_ADDRSTRLEN];
+    if (!inet_ntop(family, dst, dst_str, sizeof(dst_str))) return -1;
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "route -n add %s-net %s/%d -interface %s",
+             family == AF_INET6 ? "-inet6 " : "", dst_str, prefix_len, tun->name);
+    int rc = system(cmd);
+    if (rc != 0) {
+        fprintf(stderr, "Warning: failed to add route via %s; you may need sudo: %s\n", tun->name, cmd);
+        return -1;
+    }
+    return 0;
+}
+
+static int kernel_commit(tun_t *tun) {
+    (void)tun;
+    return 0;
+}
+
+#endif
+
+static void kernel_destroy(tun_t *tun) {
+    if (tun->fd >= 0) {
+        close(tun->fd);
+        tun->fd = -1;
+    }
+    if (tun->priv) {
+        nl_close((nl_batch_t*)tun->priv);
+        free(tun->priv);
+        tun->priv = NULL;
+    }
+}
+
+static const tun_ops_t kernel_ops = {
+    .name = "kernel",
+    .system = true,
+    .read = kernel_read,
+    .write = kernel_write,
+    .configure = kernel_configure,
+    .configure6 = kernel_configure6,
+    .up = kernel_up,
+    .down = kernel_down,
+    .set_mtu = kernel_set_mtu,
+    .route = kernel_route,
+    .commit = kernel_commit,
+    .destroy = kernel_destroy,
+};
+
+// Create a kernel TUN interface
 tun_t* tun_create(const char *preferred_name) {
     tun_t *tun = (tun_t*)calloc(1, sizeof(tun_t));
     if (!tun) {
@@ -29,7 +304,9 @@ tun_t* tun_create(const char *preferred_name) {
         return NULL;
     }
     
+    tun->ops = &kernel_ops;
     tun->fd = -1;
+    tun->peer_fd = -1;
     tun->is_up = false;
     
 #ifdef __APPLE__
@@ -120,6 +397,17 @@ tun_t* tun_create(const char *preferred_name) {
     
     printf("Created TUN interface: %s\n", tun->name);
     
+    // Native configuration channel (no `ip` needed)
+    tun->ifindex = (int)if_nametoindex(tun->name);
+    tun->priv = calloc(1, sizeof(nl_batch_t));
+    if (!tun->priv || nl_open((nl_batch_t*)tun->priv) != 0) {
+        fprintf(stderr, "Failed to open rtnetlink for %s\n", tun->name);
+        free(tun->priv);
+        close(tun->fd);
+        free(tun);
+        return NULL;
+    }
+    
 #else
     (void)preferred_name; // Suppress unused parameter warning
     fprintf(stderr, "TUN interface not supported on this platform\n");
@@ -137,6 +425,27 @@ tun_t* tun_create(const char *preferred_name) {
     return tun;
 }
 
+// Open a TUN backend from a spec (ZTNET_TUN): NULL/"kernel", "mem", or
+// "pcap:<in.pcap>[,<out.pcap>]"
+tun_t* tun_open(const char *spec, const char *preferred_name) {
+    if (!spec || !spec[0] || strcmp(spec, "kernel") == 0) {
+        return tun_create(preferred_name);
+    }
+    if (strcmp(spec, "mem") == 0) {
+        return tun_mem_create();
+    }
+    if (strncmp(spec, "pcap:", 5) == 0) {
+        char paths[512];
+        strncpy(paths, spec + 5, sizeof(paths) - 1);
+        paths[sizeof(paths) - 1] = '\0';
+        char *out_path = strchr(paths, ',');
+        if (out_path) *out_path++ = '\0';
+        return tun_pcap_create(paths[0] ? paths : NULL, out_path && out_path[0] ? out_path : NULL);
+    }
+    fprintf(stderr, "Unknown TUN backend: %s (expect kernel, mem or pcap:in[,out])\n", spec);
+    return NULL;
+}
+
 // Destroy TUN interface
 void tun_destroy(tun_t *tun) {
     if (!tun) return;
@@ -145,109 +454,25 @@ void tun_destroy(tun_t *tun) {
         tun_down(tun);
     }
     
-    if (tun->fd >= 0) {
-        close(tun->fd);
-        tun->fd = -1;
-    }
+    tun->ops->destroy(tun);
     
     printf("Destroyed TUN interface: %s\n", tun->name);
     free(tun);
 }
 
 // Read IP packet from TUN interface
+// Returns packet length, 0 when nothing is pending, -1 on error
 int tun_read(tun_t *tun, uint8_t *buffer, size_t len) {
     if (!tun || tun->fd < 0) return -1;
     if (!buffer || len == 0) return -1;
-    
-#ifdef __APPLE__
-    // macOS utun prepends 4-byte address family
-    uint8_t temp_buffer[TUN_MTU + 4];
-    ssize_t n = read(tun->fd, temp_buffer, sizeof(temp_buffer));
-    
-    if (n < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return 0; // No data available (non-blocking)
-        }
-        perror("Failed to read from TUN");
-        return -1;
-    }
-    
-    if (n < 4) {
-        fprintf(stderr, "Received packet too short\n");
-        return -1;
-    }
-    
-    // Skip 4-byte address family header
-    size_t packet_len = n - 4;
-    if (packet_len > len) {
-        fprintf(stderr, "Packet too large for buffer\n");
-        return -1;
-    }
-    
-    memcpy(buffer, temp_buffer + 4, packet_len);
-    return packet_len;
-    
-#elif __linux__
-    ssize_t n = read(tun->fd, buffer, len);
-    
-    if (n < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return 0; // No data available (non-blocking)
-        }
-        perror("Failed to read from TUN");
-        return -1;
-    }
-    
-    return n;
-#else
-    return -1;
-#endif
+    return tun->ops->read(tun, buffer, len);
 }
 
 // Write IP packet to TUN interface
 int tun_write(tun_t *tun, const uint8_t *buffer, size_t len) {
-    if (!tun || tun->fd < 0) return -1;
+    if (!tun) return -1;
     if (!buffer || len == 0) return -1;
-    
-#ifdef __APPLE__
-    // macOS utun requires 4-byte address family prefix
-    uint8_t temp_buffer[TUN_MTU + 4];
-    
-    if (len > TUN_MTU) {
-        fprintf(stderr, "Packet too large for TUN interface\n");
-        return -1;
-    }
-    
-    // Determine address family from IP header
-    uint8_t version = (buffer[0] >> 4) & 0x0F;
-    
-    // Prepend address family (AF_INET for IPv4, AF_INET6 for IPv6)
-    temp_buffer[0] = 0;
-    temp_buffer[1] = 0;
-    temp_buffer[2] = 0;
-    temp_buffer[3] = (version == 4) ? AF_INET : AF_INET6;
-    
-    memcpy(temp_buffer + 4, buffer, len);
-    
-    ssize_t n = write(tun->fd, temp_buffer, len + 4);
-    if (n < 0) {
-        perror("Failed to write to TUN");
-        return -1;
-    }
-    
-    return n - 4; // Return actual packet length (excluding header)
-    
-#elif __linux__
-    ssize_t n = write(tun->fd, buffer, len);
-    if (n < 0) {
-        perror("Failed to write to TUN");
-        return -1;
-    }
-    
-    return n;
-#else
-    return -1;
-#endif
+    return tun->ops->write(tun, buffer, len);
 }
 
 // Configure TUN interface with IP address and netmask
@@ -262,49 +487,45 @@ int tun_configure(tun_t *tun, const char *ip_str, const char *netmask_str) {
     }
     
     // Parse netmask (default to /24 if not provided)
+    if (!netmask_str) {
+        netmask_str = "255.255.255.0";
+    }
     struct in_addr netmask;
-    if (netmask_str) {
-        if (inet_aton(netmask_str, &netmask) == 0) {
-            fprintf(stderr, "Invalid netmask: %s\n", netmask_str);
-            return -1;
-        }
-    } else {
-        // Default to /24 (255.255.255.0)
-        inet_aton("255.255.255.0", &netmask);
+    if (inet_aton(netmask_str, &netmask) == 0) {
+        fprintf(stderr, "Invalid netmask: %s\n", netmask_str);
+        return -1;
     }
     
     tun->ip_addr = ip_addr.s_addr;
     tun->netmask = netmask.s_addr;
     
-    // Configure interface using system call
-    char cmd[256];
+    if (tun->ops->configure && tun->ops->configure(tun, ip_str, netmask_str) != 0) {
+        return -1;
+    }
     
-#ifdef __APPLE__
-    // macOS requires source and destination IP for utun (point-to-point)
-    snprintf(cmd, sizeof(cmd),
-             "ifconfig %s inet %s %s netmask %s up",
-             tun->name, ip_str, ip_str, netmask_str ? netmask_str : "255.255.255.0");
-#elif __linux__
-    // Linux uses ip command
-    snprintf(cmd, sizeof(cmd),
-             "ip addr add %s/%d dev %s",
-             ip_str, __builtin_popcount(ntohl(netmask.s_addr)), tun->name);
-#else
-    fprintf(stderr, "IP configuration not supported on this platform\n");
-    return -1;
-#endif
+    printf("Configured %s with IP: %s/%s\n", tun->name, ip_str, netmask_str);
     
-    printf("Configuring %s: %s\n", tun->name, cmd);
+    return 0;
+}
+
+// Configure TUN interface with an IPv6 address and prefix length
+int tun_configure6(tun_t *tun, const uint8_t addr[16], int prefix_len) {
+    if (!tun || !addr || prefix_len <= 0 || prefix_len > 128) return -1;
     
-    int result = system(cmd);
-    if (result != 0) {
-        fprintf(stderr, "Warning: Failed to configure IP address (may need sudo)\n");
-        fprintf(stderr, "You can manually configure with: %s\n", cmd);
+    char ip6_str[INET6_ADDRSTRLEN];
+    if (!inet_ntop(AF_INET6, addr, ip6_str, sizeof(ip6_str))) {
+        fprintf(stderr, "Invalid IPv6 address\n");
         return -1;
     }
     
-    printf("Configured %s with IP: %s/%s\n", 
-           tun->name, ip_str, netmask_str ? netmask_str : "255.255.255.0");
+    memcpy(tun->ip6_addr, addr, sizeof(tun->ip6_addr));
+    tun->ip6_prefix_len = prefix_len;
+    
+    if (tun->ops->configure6 && tun->ops->configure6(tun, ip6_str, prefix_len) != 0) {
+        return -1;
+    }
+    
+    printf("Configured %s with IPv6: %s/%d\n", tun->name, ip6_str, prefix_len);
     
     return 0;
 }
@@ -317,18 +538,12 @@ int tun_up(tun_t *tun) {
         return 0; // Already up
     }
     
-    char cmd[128];
-    snprintf(cmd, sizeof(cmd), "ifconfig %s up", tun->name);
-    
-    int result = system(cmd);
-    if (result == 0) {
-        tun->is_up = true;
-        printf("Brought interface %s up\n", tun->name);
-        return 0;
+    if (tun->ops->up && tun->ops->up(tun) != 0) {
+        return -1;
     }
-    
-    fprintf(stderr, "Failed to bring interface up (may need sudo)\n");
-    return -1;
+    tun->is_up = true;
+    printf("Brought interface %s up\n", tun->name);
+    return 0;
 }
 
 // Bring TUN interface down
@@ -339,18 +554,48 @@ int tun_down(tun_t *tun) {
         return 0; // Already down
     }
     
-    char cmd[128];
-    snprintf(cmd, sizeof(cmd), "ifconfig %s down", tun->name);
-    
-    int result = system(cmd);
-    if (result == 0) {
-        tun->is_up = false;
-        printf("Brought interface %s down\n", tun->name);
-        return 0;
+    if (tun->ops->down && tun->ops->down(tun) != 0) {
+        return -1;
     }
-    
-    fprintf(stderr, "Failed to bring interface down\n");
-    return -1;
+    tun->is_up = false;
+    printf("Brought interface %s down\n", tun->name);
+    return 0;
+}
+
+// Set the interface MTU; applied with the next tun_up() if still down
+int tun_set_mtu(tun_t *tun, int mtu) {
+    if (!tun || mtu <= 0) return -1;
+    tun->mtu = mtu;
+    if (tun->ops->set_mtu && tun->ops->set_mtu(tun, mtu) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Route dst/prefix_len through the interface (backends without a kernel
+// interface ignore it)
+int tun_add_route(tun_t *tun, int family, const void *dst, int prefix_len) {
+    if (!tun || !dst) return -1;
+    if (!tun->ops->route) return 0;
+    if (tun->ops->route(tun, family, dst, prefix_len) != 0) {
+        return -1;
+    }
+    char dst_str[INET6_ADDRSTRLEN];
+    inet_ntop(family, dst, dst_str, sizeof(dst_str));
+    printf("Route %s/%d via %s%s\n", dst_str, prefix_len, tun->name, tun->batching ? " (queued)" : "");
+    return 0;
+}
+
+// Queue configuration until tun_commit() (one round trip for the batch)
+void tun_begin(tun_t *tun) {
+    if (tun) tun->batching = true;
+}
+
+// Apply everything queued since tun_begin()
+int tun_commit(tun_t *tun) {
+    if (!tun) return -1;
+    tun->batching = false;
+    return tun->ops->commit ? tun->ops->commit(tun) : 0;
 }
 
 // Get interface name
@@ -365,3 +610,7 @@ int tun_get_fd(tun_t *tun) {
     return tun->fd;
 }
 
+// Whether the backend is a real OS interface (routes/addresses apply)
+bool tun_is_system(tun_t *tun) {
+    return tun && tun->ops->system;
+}
\ No newline at end of file
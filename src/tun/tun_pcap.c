@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "../include/tun.h"
+
+// pcap TUN backend: replays the IP packets of a capture file as if they had
+// been read from the device, as fast as the client consumes them, and
+// optionally records everything the client writes to the device into a
+// second capture. The file is mapped once so replay does no I/O.
+//
+// A self-pipe provides the pollable fd: it holds one byte while packets
+// remain, so select() sees the device readable until the capture is done.
+// Replay starts when the interface is brought up, i.e. once the client has
+// joined and has an address.
+
+#define PCAP_MAGIC_US 0xa1b2c3d4U
+#define PCAP_MAGIC_NS 0xa1b23c4dU
+#define PCAP_HDR_LEN 24
+#define PCAP_REC_LEN 16
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_IPV6 229
+
+typedef struct {
+    const uint8_t *map;              // mapped input capture (NULL: sink only)
+    size_t map_len;
+    size_t off;                      // next record
+    bool swapped;                    // capture written with the other byte order
+    uint32_t linktype;
+    int wake[2];                     // self-pipe: [0] is tun->fd
+    bool wake_armed;
+    FILE *out;                       // output capture, LINKTYPE_RAW
+    uint64_t replayed;
+    uint64_t recorded;
+} pcap_state_t;
+
+static uint32_t rd32(const pcap_state_t *ps, const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return ps->swapped ? __builtin_bswap32(v) : v;
+}
+
+// Offset of the IP header inside a captured frame, -1 if not IP
+static int ip_offset(uint32_t linktype, const uint8_t *frame, uint32_t len) {
+    switch (linktype) {
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_IPV6:
+            return 0;
+        case LINKTYPE_NULL:
+            return len >= 4 ? 4 : -1;
+        case LINKTYPE_ETHERNET: {
+            if (len < 14) return -1;
+            int off = 12;
+            uint16_t type = (uint16_t)((frame[off] << 8) | frame[off + 1]);
+            if (type == 0x8100 && len >= 18) {          // one VLAN tag
+                off += 4;
+                type = (uint16_t)((frame[off] << 8) | frame[off + 1]);
+            }
+            return (type == 0x0800 || type == 0x86DD) ? off + 2 : -1;
+        }
+        case LINKTYPE_LINUX_SLL: {
+            if (len < 16) return -1;
+            uint16_t type = (uint16_t)((frame[14] << 8) | frame[15]);
+            return (type == 0x0800 || type == 0x86DD) ? 16 : -1;
+        }
+        default:
+            return -1;
+    }
+}
+
+static bool supported_linktype(uint32_t linktype) {
+    switch (linktype) {
+        case LINKTYPE_RAW: case LINKTYPE_IPV4: case LINKTYPE_IPV6:
+        case LINKTYPE_NULL: case LINKTYPE_ETHERNET: case LINKTYPE_LINUX_SLL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void pcap_disarm(pcap_state_t *ps) {
+    if (!ps->wake_armed) return;
+    uint8_t b;
+    if (read(ps->wake[0], &b, 1) == 1) ps->wake_armed = false;
+}
+
+static int pcap_read(tun_t *tun, uint8_t *buffer, size_t len) {
+    pcap_state_t *ps = (pcap_state_t*)tun->priv;
+    while (ps->map && ps->off + PCAP_REC_LEN <= ps->map_len) {
+        const uint8_t *rec = ps->map + ps->off;
+        uint32_t caplen = rd32(ps, rec + 8);
+        if (ps->off + PCAP_REC_LEN + caplen > ps->map_len) break;   // truncated capture
+        ps->off += PCAP_REC_LEN + caplen;
+
+        const uint8_t *frame = rec + PCAP_REC_LEN;
+        int ip = ip_offset(ps->linktype, frame, caplen);
+        if (ip < 0 || caplen - (uint32_t)ip < 20) continue;
+        const uint8_t *pkt = frame + ip;
+        uint32_t pkt_len = caplen - (uint32_t)ip;
+        uint8_t version = pkt[0] >> 4;
+        if (version != 4 && version != 6) continue;
+        if (pkt_len > len || pkt_len > TUN_MTU) continue;           // larger than the MTU
+        memcpy(buffer, pkt, pkt_len);
+        ps->replayed++;
+        return (int)pkt_len;
+    }
+    if (ps->wake_armed) {
+        pcap_disarm(ps);
+        printf("pcap replay on %s finished: %llu packets\n", tun->name,
+               (unsigned long long)ps->replayed);
+    }
+    return 0;
+}
+
+static int pcap_write(tun_t *tun, const uint8_t *buffer, size_t len) {
+    pcap_state_t *ps = (pcap_state_t*)tun->priv;
+    if (!ps->out) return (int)len;   // no sink: behave like a device that accepts all
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    uint32_t rec[4] = { (uint32_t)tv.tv_sec, (uint32_t)tv.tv_usec, (uint32_t)len, (uint32_t)len };
+    if (fwrite(rec, sizeof(rec), 1, ps->out) != 1 || fwrite(buffer, len, 1, ps->out) != 1) {
+        perror("Failed to write pcap record");
+        return -1;
+    }
+    ps->recorded++;
+    return (int)len;
+}
+
+static void pcap_destroy(tun_t *tun) {
+    pcap_state_t *ps = (pcap_state_t*)tun->priv;
+    if (!ps) return;
+    if (ps->map) munmap((void*)ps->map, ps->map_len);
+    if (ps->out) fclose(ps->out);
+    close(ps->wake[0]);
+    close(ps->wake[1]);
+    free(ps);
+    tun->priv = NULL;
+    tun->fd = -1;
+}
+
+static int pcap_up(tun_t *tun) {
+    pcap_state_t *ps = (pcap_state_t*)tun->priv;
+    if (ps->map && !ps->wake_armed && ps->off + PCAP_REC_LEN <= ps->map_len) {
+        uint8_t b = 1;
+        ps->wake_armed = write(ps->wake[1], &b, 1) == 1;
+    }
+    return 0;
+}
+
+static const tun_ops_t pcap_ops = {
+    .name = "pcap",
+    .system = false,
+    .read = pcap_read,
+    .write = pcap_write,
+    .up = pcap_up,
+    .destroy = pcap_destroy,
+};
+
+static int pcap_map_input(pcap_state_t *ps, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open pcap input");
+        return -1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size < PCAP_HDR_LEN) {
+        fprintf(stderr, "pcap input %s is too short\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map pcap input");
+        return -1;
+    }
+    ps->map = (const uint8_t*)map;
+    ps->map_len = (size_t)sb.st_size;
+
+    uint32_t magic;
+    memcpy(&magic, ps->map, sizeof(magic));
+    if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS) {
+        ps->swapped = false;
+    } else if (magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS)) {
+        ps->swapped = true;
+    } else {
+        fprintf(stderr, "%s is not a pcap file (pcapng is not supported)\n", path);
+        return -1;
+    }
+    ps->linktype = rd32(ps, ps->map + 20) & 0xFFFF;
+    if (!supported_linktype(ps->linktype)) {
+        fprintf(stderr, "Unsupported pcap link type %u\n", ps->linktype);
+        return -1;
+    }
+    ps->off = PCAP_HDR_LEN;
+    return 0;
+}
+
+static int pcap_open_output(pcap_state_t *ps, const char *path) {
+    ps->out = fopen(path, "wb");
+    if (!ps->out) {
+        perror("Failed to open pcap output");
+        return -1;
+    }
+    uint32_t hdr[6] = { PCAP_MAGIC_US, 0x00040002 /* v2.4 */, 0, 0, 65535, LINKTYPE_RAW };
+    if (fwrite(hdr, sizeof(hdr), 1, ps->out) != 1) {
+        perror("Failed to write pcap header");
+        return -1;
+    }
+    return 0;
+}
+
+// Create a pcap TUN: replay in_path (optional) and record to out_path (optional)
+tun_t* tun_pcap_create(const char *in_path, const char *out_path) {
+    static int next_unit = 0;
+    
+    tun_t *tun = (tun_t*)calloc(1, sizeof(tun_t));
+    pcap_state_t *ps = (pcap_state_t*)calloc(1, sizeof(pcap_state_t));
+    if (!tun || !ps) {
+        perror("Failed to allocate TUN structure");
+        free(tun); free(ps);
+        return NULL;
+    }
+    tun->ops = &pcap_ops;
+    tun->priv = ps;
+    tun->peer_fd = -1;
+    
+    if (pipe(ps->wake) != 0) {
+        perror("Failed to create pcap wake pipe");
+        free(ps); free(tun);
+        return NULL;
+    }
+    tun->fd = ps->wake[0];
+    fcntl(ps->wake[0], F_SETFL, fcntl(ps->wake[0], F_GETFL, 0) | O_NONBLOCK);
+    
+    if ((in_path && pcap_map_input(ps, in_path) != 0) ||
+        (out_path && pcap_open_output(ps, out_path) != 0)) {
+        pcap_destroy(tun);
+        free(tun);
+        return NULL;
+    }
+    snprintf(tun->name, sizeof(tun->name), "pcap%d", __atomic_fetch_add(&next_unit, 1, __ATOMIC_RELAXED));
+    
+    printf("Created pcap TUN interface: %s (replay: %s, record: %s)\n", tun->name,
+           in_path ? in_path : "-", out_path ? out_path : "-");
+    return tun;
+}
\ No newline at end of file